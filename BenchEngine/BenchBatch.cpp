@@ -0,0 +1,63 @@
+// BenchBatch.cpp: Batch versus single-call operations
+
+#include "core.h"
+#include <benchmark/benchmark.h>
+#include <thread>
+#include <vector>
+
+using namespace arrakis;
+
+namespace
+{
+    const int max_threads = (int)std::thread::hardware_concurrency();
+    const Ledger rich = { INT64_MAX / 2, INT64_MAX / 2, 0 };
+
+    // All threads share one object, as COM clients of one Arrakeener do
+    Arrakeener* shared = nullptr;
+
+    void setup(const benchmark::State&)
+    {
+        shared = new Arrakeener(rich, 1);
+    }
+
+    void teardown(const benchmark::State&)
+    {
+        delete shared;
+        shared = nullptr;
+    }
+
+
+    void BM_MineSpiceSingle(benchmark::State& state)
+    {
+        const size_t n = (size_t)state.range(0);
+        int64_t delta;
+        for (auto _ : state)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                shared->mine_spice(1, delta);
+                benchmark::DoNotOptimize(delta);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+    BENCHMARK(BM_MineSpiceSingle)->Arg(1000)->ThreadRange(1, max_threads)
+        ->Setup(setup)->Teardown(teardown)->UseRealTime();
+
+
+    void BM_MineSpiceBatch(benchmark::State& state)
+    {
+        const size_t n = (size_t)state.range(0);
+        std::vector<int64_t> harvesters(n, 1);
+        std::vector<int64_t> deltas(n);
+        std::vector<Status> results(n);
+        for (auto _ : state)
+        {
+            shared->mine_spice_batch(harvesters.data(), n, deltas.data(), results.data());
+            benchmark::DoNotOptimize(deltas.data());
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+    BENCHMARK(BM_MineSpiceBatch)->Arg(1000)->ThreadRange(1, max_threads)
+        ->Setup(setup)->Teardown(teardown)->UseRealTime();
+}
@@ -0,0 +1,88 @@
+// BenchClone.cpp: Deep copies versus shared, batched clones
+
+#include "core.h"
+#include "pool.h"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+using namespace arrakis;
+
+namespace
+{
+    // Names long enough to need heap storage, as real names do
+    void name(Arrakeener& obj)
+    {
+        obj.set_first_name(L"Duncan of the Ginaz Swordmasters");
+        obj.set_last_name(L"Idaho, Ghola of the Bene Tleilax");
+        obj.set_affiliation(L"House Atreides of Caladan and Arrakis");
+        obj.set_occupation(L"Swordmaster, Mentat and Consort");
+    }
+
+    // Bytes per clone: the object, plus a private identity if it has one
+    const int64_t identity_bytes = (int64_t)(sizeof(Names) + 4 * 36 * sizeof(wchar_t));
+
+
+    // Every clone with its own copy of the names, as each clone had before
+    // names were shared
+
+    void BM_CloneDeep(benchmark::State& state)
+    {
+        const size_t n = (size_t)state.range(0);
+        Arrakeener source(1);
+        name(source);
+        std::vector<Arrakeener*> clones(n);
+        for (auto _ : state)
+        {
+            for (Arrakeener*& clone : clones)
+            {
+                clone = new Arrakeener(source.ledger(), 1);
+                name(*clone);
+            }
+            for (Arrakeener* clone : clones) delete clone;
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+        state.counters["bytes_per_clone"] = (double)(sizeof(Arrakeener) + identity_bytes);
+    }
+    BENCHMARK(BM_CloneDeep)->Arg(1000);
+
+
+    void BM_CloneSingle(benchmark::State& state)
+    {
+        const size_t n = (size_t)state.range(0);
+        Arrakeener source(1);
+        name(source);
+        std::vector<Arrakeener*> clones(n);
+        for (auto _ : state)
+        {
+            for (Arrakeener*& clone : clones) clone = new Arrakeener(source);
+            for (Arrakeener* clone : clones) delete clone;
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+        state.counters["bytes_per_clone"] = (double)sizeof(Arrakeener);
+    }
+    BENCHMARK(BM_CloneSingle)->Arg(1000);
+
+
+    void BM_CloneMany(benchmark::State& state)
+    {
+        const size_t n = (size_t)state.range(0);
+        Arrakeener source(1);
+        name(source);
+        Pool pool(sizeof(Arrakeener));
+        std::vector<void*> slots(n);
+        for (auto _ : state)
+        {
+            pool.allocate_many(slots.data(), n);
+            Arrakeener::Clones clones = source.clones(n);
+            for (void* slot : slots) new (slot) Arrakeener(clones);
+            for (void* slot : slots)
+            {
+                static_cast<Arrakeener*>(slot)->~Arrakeener();
+                pool.deallocate(slot);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+        state.counters["bytes_per_clone"] = (double)pool.slot_size();
+    }
+    BENCHMARK(BM_CloneMany)->Arg(1000);
+}
@@ -0,0 +1,74 @@
+// BenchCreate.cpp: Object creation from the heap and from a pool
+
+#include "core.h"
+#include "pool.h"
+#include <benchmark/benchmark.h>
+#include <thread>
+
+using namespace arrakis;
+
+namespace
+{
+    const int max_threads = (int)std::thread::hardware_concurrency();
+    Pool* pool = nullptr;
+
+    void setup(const benchmark::State&)
+    {
+        pool = new Pool(sizeof(Arrakeener));
+    }
+
+    void teardown(const benchmark::State&)
+    {
+        delete pool;
+        pool = nullptr;
+    }
+
+
+    void BM_CreateHeap(benchmark::State& state)
+    {
+        uint64_t seed = 0;
+        for (auto _ : state)
+        {
+            Arrakeener* p = new Arrakeener(++seed);
+            benchmark::DoNotOptimize(p);
+            delete p;
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_CreateHeap)->ThreadRange(1, max_threads)->UseRealTime();
+
+
+    void BM_CreatePooled(benchmark::State& state)
+    {
+        uint64_t seed = 0;
+        for (auto _ : state)
+        {
+            Arrakeener* p = new (pool->allocate()) Arrakeener(++seed);
+            benchmark::DoNotOptimize(p);
+            p->~Arrakeener();
+            pool->deallocate(p);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_CreatePooled)->ThreadRange(1, max_threads)
+        ->Setup(setup)->Teardown(teardown)->UseRealTime();
+
+
+    // Clone is the other way objects are created
+
+    void BM_ClonePooled(benchmark::State& state)
+    {
+        Arrakeener source(1);
+        source.set_first_name(L"Duncan");
+        for (auto _ : state)
+        {
+            Arrakeener* p = new (pool->allocate()) Arrakeener(source);
+            benchmark::DoNotOptimize(p);
+            p->~Arrakeener();
+            pool->deallocate(p);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_ClonePooled)->ThreadRange(1, max_threads)
+        ->Setup(setup)->Teardown(teardown)->UseRealTime();
+}
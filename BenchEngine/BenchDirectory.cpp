@@ -0,0 +1,108 @@
+// BenchDirectory.cpp: Directory lookups and updates against a locked map
+
+#include "directory.h"
+#include <benchmark/benchmark.h>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace arrakis;
+
+namespace
+{
+    const int max_threads = (int)std::thread::hardware_concurrency();
+    const int population = 1000000;
+    std::vector<std::wstring> first_names;
+    Directory<int>* directory = nullptr;
+
+    // The obvious alternative: one map behind a reader-writer lock
+    std::shared_mutex locked_mutex;
+    std::unordered_map<std::wstring, int>* locked = nullptr;
+
+    void setup(const benchmark::State&)
+    {
+        directory = new Directory<int>;
+        locked = new std::unordered_map<std::wstring, int>;
+        for (int i = 0; i < population; ++i)
+        {
+            first_names.push_back(L"Fedaykin" + std::to_wstring(i));
+            directory->insert(first_names.back(), L"Tabr", i);
+            locked->emplace(first_names.back() + L"\tTabr", i);
+        }
+    }
+
+    void teardown(const benchmark::State&)
+    {
+        delete directory;
+        delete locked;
+        directory = nullptr;
+        locked = nullptr;
+        first_names.clear();
+    }
+
+
+    // Lookups spread over a million registered names
+
+    void BM_Find(benchmark::State& state)
+    {
+        size_t i = (size_t)state.thread_index() * 7919;
+        int value = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(directory->find(first_names[i], L"Tabr", value));
+            i = (i + 104729) % population;
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_Find)->ThreadRange(1, max_threads)->Setup(setup)->Teardown(teardown)->UseRealTime();
+
+    void BM_FindLocked(benchmark::State& state)
+    {
+        size_t i = (size_t)state.thread_index() * 7919;
+        for (auto _ : state)
+        {
+            std::shared_lock<std::shared_mutex> lock(locked_mutex);
+            benchmark::DoNotOptimize(locked->find(first_names[i] + L"\tTabr"));
+            i = (i + 104729) % population;
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_FindLocked)->ThreadRange(1, max_threads)->Setup(setup)->Teardown(teardown)->UseRealTime();
+
+
+    // Register and unregister a name; each thread has its own
+
+    void BM_InsertRemove(benchmark::State& state)
+    {
+        const std::wstring first_name = L"Stilgar" + std::to_wstring(state.thread_index());
+        for (auto _ : state)
+        {
+            directory->insert(first_name, L"Tabr", 0);
+            directory->remove(first_name, L"Tabr");
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_InsertRemove)->ThreadRange(1, max_threads)->Setup(setup)->Teardown(teardown)->UseRealTime();
+
+
+    // Enumerate the whole directory in batches of range(0)
+
+    void BM_Enumerate(benchmark::State& state)
+    {
+        std::vector<int> batch;
+        for (auto _ : state)
+        {
+            Directory<int>::Cursor cursor;
+            while (!cursor.done())
+            {
+                batch.clear();
+                directory->next(cursor, (size_t)state.range(0), batch);
+                benchmark::DoNotOptimize(batch.data());
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * population);
+    }
+    BENCHMARK(BM_Enumerate)->Arg(1)->Arg(64)->Arg(4096)->Setup(setup)->Teardown(teardown)->Unit(benchmark::kMillisecond);
+}
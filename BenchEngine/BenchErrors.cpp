@@ -0,0 +1,58 @@
+// BenchErrors.cpp: Throughput of failing calls
+
+#include "core.h"
+#include <benchmark/benchmark.h>
+#include <string>
+#include <thread>
+
+using namespace arrakis;
+
+namespace
+{
+    const int max_threads = (int)std::thread::hardware_concurrency();
+
+    // No spice, so every eat fails with Status::no_spice
+    Arrakeener* shared = nullptr;
+
+    void setup(const benchmark::State&)
+    {
+        shared = new Arrakeener(Ledger{ 100, 400000, 0 }, 1);
+    }
+
+    void teardown(const benchmark::State&)
+    {
+        delete shared;
+        shared = nullptr;
+    }
+
+
+    // A description built for every failure, as SetError used to do
+    void BM_FailedCallBuildMessage(benchmark::State& state)
+    {
+        int64_t delta;
+        for (auto _ : state)
+        {
+            Status status = shared->eat_spice(1, delta);
+            std::wstring description(status_info(status).message);
+            benchmark::DoNotOptimize(description.data());
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_FailedCallBuildMessage)->ThreadRange(1, max_threads)
+        ->Setup(setup)->Teardown(teardown)->UseRealTime();
+
+
+    // The static table: no allocation on the failure path
+    void BM_FailedCallCached(benchmark::State& state)
+    {
+        int64_t delta;
+        for (auto _ : state)
+        {
+            Status status = shared->eat_spice(1, delta);
+            benchmark::DoNotOptimize(&status_info(status));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_FailedCallCached)->ThreadRange(1, max_threads)
+        ->Setup(setup)->Teardown(teardown)->UseRealTime();
+}
@@ -0,0 +1,86 @@
+// BenchExecutor.cpp: Asynchronous against blocking operations from one client thread
+
+#include "executor.h"
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+using namespace arrakis;
+
+namespace
+{
+    const size_t people = 4096;
+
+    std::vector<std::unique_ptr<Arrakeener>> population()
+    {
+        std::vector<std::unique_ptr<Arrakeener>> result;
+        for (size_t i = 0; i < people; ++i) result.emplace_back(new Arrakeener(i));
+        return result;
+    }
+
+
+    // One client thread mining each object in turn, waiting for every call
+
+    void BM_BlockingMine(benchmark::State& state)
+    {
+        auto objects = population();
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            int64_t delta = 0;
+            benchmark::DoNotOptimize(objects[i++ % people]->mine_spice(1, delta));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_BlockingMine)->UseRealTime();
+
+
+    // The same client keeping up to range(0) operations in flight, collecting
+    // the oldest result once the window is full
+
+    void BM_AsyncMine(benchmark::State& state)
+    {
+        auto objects = population();
+        const size_t window = (size_t)state.range(0);
+        std::vector<Future<OperationResult>> futures(window);
+        Executor executor;
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            Future<OperationResult>& slot = futures[i % window];
+            if (slot.valid()) benchmark::DoNotOptimize(slot.get());
+            slot = executor.mine_spice(*objects[i % people], 1);
+            ++i;
+        }
+        for (auto& future : futures)
+        {
+            if (future.valid()) future.get();
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_AsyncMine)->RangeMultiplier(8)->Range(1, 4096)->UseRealTime();
+
+
+    // Fire and forget with continuations instead of waiting on each result
+
+    void BM_AsyncMineThen(benchmark::State& state)
+    {
+        auto objects = population();
+        Executor executor;
+        std::atomic<int64_t> total(0);
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            executor.mine_spice(*objects[i++ % people], 1).then([&](OperationResult result)
+            {
+                total.fetch_add(result.delta, std::memory_order_relaxed);
+                return true;
+            });
+        }
+        executor.wait();
+        benchmark::DoNotOptimize(total.load());
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_AsyncMineThen)->UseRealTime();
+}
@@ -0,0 +1,108 @@
+// BenchJournal.cpp: Journaled operations per second and replay speed
+
+#include "journal.h"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+using namespace arrakis;
+
+namespace
+{
+    const std::string path = (std::filesystem::temp_directory_path() / "arrakis_bench.journal").string();
+    Journal* journal = nullptr;
+    std::vector<std::unique_ptr<Arrakeener>> people;
+
+    void open(Durability durability)
+    {
+        journal = new Journal(path, durability);
+        for (int i = 0; i < 64; ++i)
+        {
+            people.emplace_back(new Arrakeener(Ledger{ INT64_MAX / 2, INT64_MAX / 2, 0 }, (uint64_t)i));
+            journal->attach(*people.back());
+        }
+    }
+
+    void close()
+    {
+        for (auto& obj : people) obj->observe(nullptr);
+        people.clear();
+        delete journal;
+        journal = nullptr;
+        std::remove(path.c_str());
+    }
+
+
+    // Each thread mines with its own object; every call waits for its sync,
+    // so throughput comes from threads sharing syncs
+
+    void BM_SynchronousMine(benchmark::State& state)
+    {
+        if (state.thread_index() == 0) open(Durability::synchronous);
+        Arrakeener* obj = nullptr;
+        for (auto _ : state)
+        {
+            if (!obj) obj = people[(size_t)state.thread_index()].get();
+            int64_t delta;
+            benchmark::DoNotOptimize(obj->mine_spice(1, delta));
+        }
+        state.SetItemsProcessed(state.iterations());
+        if (state.thread_index() == 0)
+        {
+            state.counters["syncs"] = (double)journal->syncs();
+            close();
+        }
+    }
+    BENCHMARK(BM_SynchronousMine)->Threads(1)->Threads(8)->Threads(64)->UseRealTime();
+
+
+    void BM_DeferredMine(benchmark::State& state)
+    {
+        if (state.thread_index() == 0) open(Durability::deferred);
+        Arrakeener* obj = nullptr;
+        for (auto _ : state)
+        {
+            if (!obj) obj = people[(size_t)state.thread_index()].get();
+            int64_t delta;
+            benchmark::DoNotOptimize(obj->mine_spice(1, delta));
+        }
+        state.SetItemsProcessed(state.iterations());
+        if (state.thread_index() == 0) close();
+    }
+    BENCHMARK(BM_DeferredMine)->Threads(1)->Threads(8)->UseRealTime();
+
+
+    // Replay a journal of range(0) objects with 100 changes each
+
+    void BM_Replay(benchmark::State& state)
+    {
+        const size_t objects = (size_t)state.range(0);
+        {
+            Journal writer(path, Durability::deferred);
+            std::vector<std::unique_ptr<Arrakeener>> population;
+            for (size_t i = 0; i < objects; ++i)
+            {
+                population.emplace_back(new Arrakeener(Ledger{ INT64_MAX / 2, INT64_MAX / 2, 0 }, i));
+                writer.attach(*population.back());
+                population.back()->set_first_name(L"Fedaykin");
+                int64_t delta;
+                for (int j = 0; j < 100; ++j) population.back()->mine_spice(1, delta);
+            }
+            for (auto& obj : population) obj->observe(nullptr);
+        }
+
+        size_t records = 0;
+        for (auto _ : state)
+        {
+            Replay replay = Journal::replay(path);
+            records = replay.records;
+            benchmark::DoNotOptimize(replay.objects.size());
+        }
+        state.SetItemsProcessed(state.iterations() * records);
+        state.SetBytesProcessed(state.iterations() * std::filesystem::file_size(path));
+        std::remove(path.c_str());
+    }
+    BENCHMARK(BM_Replay)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+}
@@ -0,0 +1,89 @@
+// BenchLeaderboard.cpp: Cost of keeping leaderboards on the mining path, and of reading them
+
+#include "leaderboard.h"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using namespace arrakis;
+
+namespace
+{
+    // Boards for the three counters, already ranking a population
+    struct Boards
+    {
+        Leaderboard energy{ Field::energy };
+        Leaderboard solaris{ Field::solaris };
+        Leaderboard spice{ Field::spice };
+        Observers all{ { &energy, &solaris, &spice } };
+        std::vector<std::unique_ptr<Arrakeener>> people;
+
+        explicit Boards(size_t n)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                people.emplace_back(new Arrakeener(Ledger{ (int64_t)i, (int64_t)i * 7 % 1000, (int64_t)i * 13 % 100000 }, i));
+                people.back()->observe(&all);
+            }
+        }
+
+        ~Boards()
+        {
+            for (auto& obj : people) obj->observe(nullptr);
+        }
+    };
+
+
+    // Each thread mines on its own object with range(0) boards of 100K
+    // objects attached
+
+    void BM_LeaderboardMineSpice(benchmark::State& state)
+    {
+        static Boards boards(100000);
+        Arrakeener obj(Ledger{ 0, 0, 0 }, (uint64_t)state.thread_index());
+        if (state.range(0) == 1) obj.observe(&boards.spice);
+        if (state.range(0) == 3) obj.observe(&boards.all);
+        int64_t delta;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(obj.mine_spice(1, delta));
+        }
+        obj.observe(nullptr);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_LeaderboardMineSpice)->ArgName("boards")->Arg(0)->Arg(1)->Arg(3)->ThreadRange(1, 8)->UseRealTime();
+
+
+    // The top range(0) of a million, against sorting them
+
+    void BM_LeaderboardTop(benchmark::State& state)
+    {
+        Boards boards(1000000);
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(boards.spice.top((size_t)state.range(0)));
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(BM_LeaderboardTop)->Arg(10)->Arg(100)->Arg(1000)->Unit(benchmark::kMicrosecond);
+
+    void BM_SortTop(benchmark::State& state)
+    {
+        Boards boards(1000000);
+        for (auto _ : state)
+        {
+            std::vector<std::pair<int64_t, const Arrakeener*>> all;
+            all.reserve(boards.people.size());
+            for (const auto& obj : boards.people) all.emplace_back(obj->spice(), obj.get());
+            std::partial_sort(all.begin(), all.begin() + state.range(0), all.end(), std::greater<>());
+            std::vector<Standing> top;
+            for (int64_t i = 0; i < state.range(0); ++i) top.push_back(Standing{ all[i].first, all[i].second->names() });
+            benchmark::DoNotOptimize(top.data());
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(BM_SortTop)->Arg(100)->Unit(benchmark::kMicrosecond);
+}
@@ -0,0 +1,244 @@
+// BenchOperations.cpp: Every operation of an Arrakeener, uncontended and contended
+//
+// Each benchmark runs on 1 to max_threads threads, every thread on its own
+// object (shared:0) or all of them on one (shared:1). Operations have one
+// benchmark per outcome, with a ledger that keeps every call on that path.
+// To compare a run with the stored baseline, run BenchEngine with the
+// options
+//
+//   --benchmark_filter='^BM_Op[A-Z]' --benchmark_repetitions=3
+//   --benchmark_report_aggregates_only=true
+//   --benchmark_out=run.json --benchmark_out_format=json
+//
+// then python3 BenchEngine/compare.py BenchEngine/baseline.json run.json,
+// or build the bench_operations target, which does both.
+
+#include "core.h"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace arrakis;
+
+namespace
+{
+    // At least two, so that there is contention to measure
+    const int max_threads = std::max(2, (int)std::thread::hardware_concurrency());
+
+    // Enough of everything for billions of successful calls
+    const int64_t plenty = (int64_t)1 << 50;
+
+    const Ledger rich = { plenty, plenty, plenty };
+    const Ledger no_spice = { plenty, plenty, 0 };
+    const Ledger no_energy = { 0, plenty, plenty };
+    const Ledger no_solaris = { plenty, 0, plenty };
+    const Ledger full_energy = { INT64_MAX, plenty, plenty };
+    const Ledger full_solaris = { plenty, INT64_MAX, plenty };
+    const Ledger full_spice = { plenty, plenty, INT64_MAX };
+
+
+    // The object shared by the threads of the running benchmark. Every
+    // thread takes it before the timing barrier, so the first creates it
+    // and the last to finish lets it go.
+
+    std::mutex shared_mutex;
+    std::shared_ptr<Arrakeener> shared_object;
+    int shared_users = 0;
+
+    std::shared_ptr<Arrakeener> acquire(const benchmark::State& state, const Ledger& ledger)
+    {
+        if (state.range(0) == 0) return std::make_shared<Arrakeener>(ledger, (uint64_t)state.thread_index());
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        if (shared_users++ == 0) shared_object = std::make_shared<Arrakeener>(ledger, 0);
+        return shared_object;
+    }
+
+    void release(const benchmark::State& state)
+    {
+        if (state.range(0) == 0) return;
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        if (--shared_users == 0) shared_object.reset();
+    }
+
+
+    template <typename F>
+    void run(benchmark::State& state, const Ledger& ledger, F f)
+    {
+        std::shared_ptr<Arrakeener> obj = acquire(state, ledger);
+        for (auto _ : state)
+        {
+            f(*obj);
+        }
+        state.SetItemsProcessed(state.iterations());
+        obj.reset();
+        release(state);
+    }
+
+
+    void contention(benchmark::internal::Benchmark* b)
+    {
+        b->ArgName("shared")->Arg(0)->Arg(1)->ThreadRange(1, max_threads)->UseRealTime();
+    }
+
+
+    // Names long enough to need heap storage, as real names do
+    const wchar_t* const long_name = L"Duncan of the Ginaz Swordmasters";
+
+
+    // Properties
+
+    void BM_OpGetFirstName(benchmark::State& state)
+    {
+        run(state, rich, [](Arrakeener& obj) { benchmark::DoNotOptimize(obj.first_name()); });
+    }
+    BENCHMARK(BM_OpGetFirstName)->Apply(contention);
+
+    void BM_OpGetLastName(benchmark::State& state)
+    {
+        run(state, rich, [](Arrakeener& obj) { benchmark::DoNotOptimize(obj.last_name()); });
+    }
+    BENCHMARK(BM_OpGetLastName)->Apply(contention);
+
+    void BM_OpGetAffiliation(benchmark::State& state)
+    {
+        run(state, rich, [](Arrakeener& obj) { benchmark::DoNotOptimize(obj.affiliation()); });
+    }
+    BENCHMARK(BM_OpGetAffiliation)->Apply(contention);
+
+    void BM_OpGetOccupation(benchmark::State& state)
+    {
+        run(state, rich, [](Arrakeener& obj) { benchmark::DoNotOptimize(obj.occupation()); });
+    }
+    BENCHMARK(BM_OpGetOccupation)->Apply(contention);
+
+    void BM_OpGetEnergy(benchmark::State& state)
+    {
+        run(state, rich, [](Arrakeener& obj) { benchmark::DoNotOptimize(obj.energy()); });
+    }
+    BENCHMARK(BM_OpGetEnergy)->Apply(contention);
+
+    void BM_OpGetSolaris(benchmark::State& state)
+    {
+        run(state, rich, [](Arrakeener& obj) { benchmark::DoNotOptimize(obj.solaris()); });
+    }
+    BENCHMARK(BM_OpGetSolaris)->Apply(contention);
+
+    void BM_OpGetSpice(benchmark::State& state)
+    {
+        run(state, rich, [](Arrakeener& obj) { benchmark::DoNotOptimize(obj.spice()); });
+    }
+    BENCHMARK(BM_OpGetSpice)->Apply(contention);
+
+    void BM_OpGetLedger(benchmark::State& state)
+    {
+        run(state, rich, [](Arrakeener& obj) { benchmark::DoNotOptimize(obj.ledger()); });
+    }
+    BENCHMARK(BM_OpGetLedger)->Apply(contention);
+
+    void BM_OpGetNames(benchmark::State& state)
+    {
+        run(state, rich, [](Arrakeener& obj) { benchmark::DoNotOptimize(obj.names()); });
+    }
+    BENCHMARK(BM_OpGetNames)->Apply(contention);
+
+    void BM_OpGetState(benchmark::State& state)
+    {
+        run(state, rich, [](Arrakeener& obj) { benchmark::DoNotOptimize(obj.state()); });
+    }
+    BENCHMARK(BM_OpGetState)->Apply(contention);
+
+    void BM_OpPutFirstName(benchmark::State& state)
+    {
+        run(state, rich, [](Arrakeener& obj) { obj.set_first_name(long_name); });
+    }
+    BENCHMARK(BM_OpPutFirstName)->Apply(contention);
+
+    void BM_OpPutLastName(benchmark::State& state)
+    {
+        run(state, rich, [](Arrakeener& obj) { obj.set_last_name(long_name); });
+    }
+    BENCHMARK(BM_OpPutLastName)->Apply(contention);
+
+    void BM_OpPutAffiliation(benchmark::State& state)
+    {
+        run(state, rich, [](Arrakeener& obj) { obj.set_affiliation(long_name); });
+    }
+    BENCHMARK(BM_OpPutAffiliation)->Apply(contention);
+
+    void BM_OpPutOccupation(benchmark::State& state)
+    {
+        run(state, rich, [](Arrakeener& obj) { obj.set_occupation(long_name); });
+    }
+    BENCHMARK(BM_OpPutOccupation)->Apply(contention);
+
+
+    // Operations, by outcome
+
+    void BM_OpEatSpice(benchmark::State& state, const Ledger& ledger, int64_t units)
+    {
+        run(state, ledger, [units](Arrakeener& obj)
+        {
+            int64_t delta;
+            benchmark::DoNotOptimize(obj.eat_spice(units, delta));
+        });
+    }
+    BENCHMARK_CAPTURE(BM_OpEatSpice, ok, rich, 1)->Apply(contention);
+    BENCHMARK_CAPTURE(BM_OpEatSpice, nonpos_spice, rich, 0)->Apply(contention);
+    BENCHMARK_CAPTURE(BM_OpEatSpice, no_spice, no_spice, 1)->Apply(contention);
+    BENCHMARK_CAPTURE(BM_OpEatSpice, overflow, full_energy, 1)->Apply(contention);
+
+    void BM_OpSellSpice(benchmark::State& state, const Ledger& ledger, int64_t units)
+    {
+        run(state, ledger, [units](Arrakeener& obj)
+        {
+            int64_t delta;
+            benchmark::DoNotOptimize(obj.sell_spice(units, delta));
+        });
+    }
+    BENCHMARK_CAPTURE(BM_OpSellSpice, ok, rich, 1)->Apply(contention);
+    BENCHMARK_CAPTURE(BM_OpSellSpice, nonpos_spice, rich, 0)->Apply(contention);
+    BENCHMARK_CAPTURE(BM_OpSellSpice, no_spice, no_spice, 1)->Apply(contention);
+    BENCHMARK_CAPTURE(BM_OpSellSpice, overflow, full_solaris, 1)->Apply(contention);
+
+    void BM_OpMineSpice(benchmark::State& state, const Ledger& ledger, int64_t harvesters)
+    {
+        run(state, ledger, [harvesters](Arrakeener& obj)
+        {
+            int64_t delta;
+            benchmark::DoNotOptimize(obj.mine_spice(harvesters, delta));
+        });
+    }
+    BENCHMARK_CAPTURE(BM_OpMineSpice, ok, rich, 1)->Apply(contention);
+    BENCHMARK_CAPTURE(BM_OpMineSpice, no_harvester, rich, 0)->Apply(contention);
+    BENCHMARK_CAPTURE(BM_OpMineSpice, no_energy, no_energy, 1)->Apply(contention);
+    BENCHMARK_CAPTURE(BM_OpMineSpice, no_solaris, no_solaris, 1)->Apply(contention);
+    BENCHMARK_CAPTURE(BM_OpMineSpice, overflow, full_spice, 1)->Apply(contention);
+
+
+    // Lifetime: a clone of the thread's or the shared object, and a new
+    // object, which has nothing to share
+
+    void BM_OpClone(benchmark::State& state)
+    {
+        run(state, rich, [](Arrakeener& obj)
+        {
+            Arrakeener clone(obj);
+            benchmark::DoNotOptimize(&clone);
+        });
+    }
+    BENCHMARK(BM_OpClone)->Apply(contention);
+
+    void BM_OpCreate(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            Arrakeener obj;
+            benchmark::DoNotOptimize(&obj);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_OpCreate)->ThreadRange(1, max_threads)->UseRealTime();
+}
@@ -0,0 +1,79 @@
+// BenchPopulation.cpp: Column kernels versus one object per Arrakeener
+
+#include "population.h"
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <vector>
+
+using namespace arrakis;
+
+namespace
+{
+    const Ledger rich = { INT64_MAX / 2, INT64_MAX / 2, 0 };
+
+    void BM_PopulationMineSpice(benchmark::State& state)
+    {
+        const size_t rows = (size_t)state.range(0);
+        Population population(1);
+        population.set_kernel((Kernel)state.range(1));
+        population.reserve(rows);
+        for (size_t i = 0; i < rows; ++i) population.add(rich);
+
+        std::vector<int64_t> deltas(rows);
+        std::vector<Status> results(rows);
+        for (auto _ : state)
+        {
+            population.mine_spice(int64_t(1), deltas.data(), results.data());
+            benchmark::DoNotOptimize(deltas.data());
+        }
+        state.SetItemsProcessed(state.iterations() * rows);
+        state.SetLabel(population.kernel() == Kernel::avx2 ? "avx2" :
+            population.kernel() == Kernel::sse42 ? "sse42" : "scalar");
+    }
+    BENCHMARK(BM_PopulationMineSpice)
+        ->ArgsProduct({ { 100000 }, { (int)Kernel::scalar, (int)Kernel::sse42, (int)Kernel::avx2 } });
+
+
+    void BM_PopulationSellSpice(benchmark::State& state)
+    {
+        const size_t rows = (size_t)state.range(0);
+        Population population(1);
+        population.set_kernel((Kernel)state.range(1));
+        population.reserve(rows);
+        for (size_t i = 0; i < rows; ++i) population.add(Ledger{ rich.energy, 0, INT64_MAX / 2 });
+
+        std::vector<int64_t> deltas(rows);
+        std::vector<Status> results(rows);
+        for (auto _ : state)
+        {
+            population.sell_spice(int64_t(1), deltas.data(), results.data());
+            benchmark::DoNotOptimize(deltas.data());
+        }
+        state.SetItemsProcessed(state.iterations() * rows);
+    }
+    BENCHMARK(BM_PopulationSellSpice)
+        ->ArgsProduct({ { 100000 }, { (int)Kernel::scalar, (int)Kernel::sse42, (int)Kernel::avx2 } });
+
+
+    // The per-object path: one heap object with its own lock and stream each
+
+    void BM_ObjectsMineSpice(benchmark::State& state)
+    {
+        const size_t rows = (size_t)state.range(0);
+        std::vector<std::unique_ptr<Arrakeener>> objects;
+        objects.reserve(rows);
+        for (size_t i = 0; i < rows; ++i) objects.emplace_back(new Arrakeener(rich, i));
+
+        int64_t delta;
+        for (auto _ : state)
+        {
+            for (auto& object : objects)
+            {
+                object->mine_spice(1, delta);
+                benchmark::DoNotOptimize(delta);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * rows);
+    }
+    BENCHMARK(BM_ObjectsMineSpice)->Arg(100000);
+}
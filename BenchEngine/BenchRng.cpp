@@ -0,0 +1,75 @@
+// BenchRng.cpp: Random number generation and MineSpice scaling across threads
+
+#include "core.h"
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <thread>
+
+using namespace arrakis;
+
+namespace
+{
+    const int max_threads = (int)std::thread::hardware_concurrency();
+
+    // The C runtime generator the engine used to share between all objects
+
+    void BM_SharedRand(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize((rand() % 10) + 1);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_SharedRand)->ThreadRange(1, max_threads)->UseRealTime();
+
+
+    // One stream per thread
+
+    void BM_RngRange(benchmark::State& state)
+    {
+        Rng rng;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(rng.range(1, 10));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_RngRange)->ThreadRange(1, max_threads)->UseRealTime();
+
+
+    // One Arrakeener per thread, with enough energy and solaris to keep mining
+
+    void BM_MineSpice(benchmark::State& state)
+    {
+        Rng rng;
+        Ledger ledger = { INT64_MAX / 2, INT64_MAX / 2, 0 };
+        int64_t delta;
+        for (auto _ : state)
+        {
+            if (mine_spice(ledger, rng, 1, delta) != Status::ok)
+            {
+                ledger = { INT64_MAX / 2, INT64_MAX / 2, 0 };
+            }
+            benchmark::DoNotOptimize(delta);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_MineSpice)->ThreadRange(1, max_threads)->UseRealTime();
+
+
+    // Through the thread-safe object, including its lock
+
+    void BM_ArrakeenerMineSpice(benchmark::State& state)
+    {
+        Arrakeener arrakeener;
+        int64_t delta;
+        for (auto _ : state)
+        {
+            arrakeener.mine_spice(1, delta);
+            benchmark::DoNotOptimize(delta);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_ArrakeenerMineSpice)->ThreadRange(1, max_threads)->UseRealTime();
+}
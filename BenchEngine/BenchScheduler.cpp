@@ -0,0 +1,78 @@
+// BenchScheduler.cpp: Parallel MineSpice over a population by worker count
+
+#include "core.h"
+#include "scheduler.h"
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace arrakis;
+
+namespace
+{
+    const int max_threads = (int)std::thread::hardware_concurrency();
+    const size_t people = 1 << 16;
+
+    // Every Arrakeener mines once per iteration. The range is the number of
+    // threads: the calling thread plus range - 1 workers, or one worker for
+    // a single thread so that the scheduling overhead is still measured.
+
+    void BM_ParallelMine(benchmark::State& state)
+    {
+        const unsigned threads = (unsigned)state.range(0);
+        Scheduler scheduler(threads > 1 ? threads - 1 : 1);
+        std::vector<std::unique_ptr<Arrakeener>> population;
+        for (size_t i = 0; i < people; ++i) population.emplace_back(new Arrakeener(i));
+
+        for (auto _ : state)
+        {
+            parallel_for(scheduler, 0, people, 256, [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    int64_t delta = 0;
+                    population[i]->mine_spice(1, delta);
+                    benchmark::DoNotOptimize(delta);
+                }
+            });
+        }
+        state.SetItemsProcessed(state.iterations() * people);
+    }
+    BENCHMARK(BM_ParallelMine)->RangeMultiplier(2)->Range(1, max_threads)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+
+    // Baseline: the same work on the calling thread alone
+
+    void BM_SerialMine(benchmark::State& state)
+    {
+        std::vector<std::unique_ptr<Arrakeener>> population;
+        for (size_t i = 0; i < people; ++i) population.emplace_back(new Arrakeener(i));
+
+        for (auto _ : state)
+        {
+            for (size_t i = 0; i < people; ++i)
+            {
+                int64_t delta = 0;
+                population[i]->mine_spice(1, delta);
+                benchmark::DoNotOptimize(delta);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * people);
+    }
+    BENCHMARK(BM_SerialMine)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+
+    // Cost of scheduling alone: empty tasks spawned into one group
+
+    void BM_SpawnEmpty(benchmark::State& state)
+    {
+        Scheduler scheduler((unsigned)state.range(0));
+        for (auto _ : state)
+        {
+            parallel_for(scheduler, 0, 4096, 1, [](size_t begin, size_t end) { benchmark::DoNotOptimize(end - begin); });
+        }
+        state.SetItemsProcessed(state.iterations() * 4096);
+    }
+    BENCHMARK(BM_SpawnEmpty)->RangeMultiplier(2)->Range(1, max_threads)->UseRealTime();
+}
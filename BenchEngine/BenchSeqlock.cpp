@@ -0,0 +1,78 @@
+// BenchSeqlock.cpp: Reader throughput while operations run
+
+#include "core.h"
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <thread>
+
+using namespace arrakis;
+
+namespace
+{
+    const int max_threads = (int)std::thread::hardware_concurrency();
+    const Ledger rich = { INT64_MAX / 2, INT64_MAX / 2, 0 };
+
+    // One object, continuously mined by a background writer
+    Arrakeener* shared = nullptr;
+    std::atomic<bool> stop(false);
+    std::thread writer;
+
+    void setup(const benchmark::State&)
+    {
+        shared = new Arrakeener(rich, 1);
+        stop = false;
+        writer = std::thread([]
+        {
+            int64_t delta;
+            while (!stop.load(std::memory_order_relaxed)) shared->mine_spice(1, delta);
+        });
+    }
+
+    void teardown(const benchmark::State&)
+    {
+        stop = true;
+        writer.join();
+        delete shared;
+        shared = nullptr;
+    }
+
+
+    // Lock-free path: energy, solaris and spice from the published ledger
+
+    void BM_ReadLedger(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(shared->ledger());
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_ReadLedger)->ThreadRange(1, max_threads)
+        ->Setup(setup)->Teardown(teardown)->UseRealTime();
+
+
+    void BM_ReadEnergy(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(shared->energy());
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_ReadEnergy)->ThreadRange(1, max_threads)
+        ->Setup(setup)->Teardown(teardown)->UseRealTime();
+
+
+    // Locked path for comparison: state takes the mutex the writer holds
+
+    void BM_ReadStateLocked(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(shared->state().ledger);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_ReadStateLocked)->ThreadRange(1, max_threads)
+        ->Setup(setup)->Teardown(teardown)->UseRealTime();
+}
@@ -0,0 +1,40 @@
+// BenchSimulation.cpp: Monte Carlo trajectories per second by thread count
+
+#include "simulation.h"
+#include <benchmark/benchmark.h>
+#include <thread>
+
+using namespace arrakis;
+
+namespace
+{
+    const int max_threads = (int)std::thread::hardware_concurrency();
+
+    // Mine each cycle, eating when energy runs low and selling when solaris
+    // runs low
+    void BM_Simulate(benchmark::State& state)
+    {
+        Simulation simulation;
+        simulation.start = { 100, 400000, 0 };
+        simulation.policy =
+        {
+            { Op::mine, 1, { Field::spice, Compare::always, 0 }, 1 },
+            { Op::eat, 1, { Field::energy, Compare::less, 20 }, 1 },
+            { Op::sell, all_spice, { Field::solaris, Compare::less, 300000 }, 1 }
+        };
+        simulation.cycles = 100;
+        simulation.trajectories = 10000;
+        simulation.threads = (unsigned)state.range(0);
+
+        for (auto _ : state)
+        {
+            simulation.seed++;
+            Outcome outcome = simulate(simulation);
+            benchmark::DoNotOptimize(outcome.solaris.mean);
+        }
+        state.SetItemsProcessed(state.iterations() * simulation.trajectories);
+        state.counters["cycles_per_second"] = benchmark::Counter(
+            (double)state.iterations() * simulation.trajectories * simulation.cycles, benchmark::Counter::kIsRate);
+    }
+    BENCHMARK(BM_Simulate)->RangeMultiplier(2)->Range(1, max_threads)->UseRealTime()->Unit(benchmark::kMillisecond);
+}
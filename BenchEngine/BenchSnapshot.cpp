@@ -0,0 +1,135 @@
+// BenchSnapshot.cpp: Startup from a mapped snapshot against creating every object
+
+#include "snapshot.h"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+using namespace arrakis;
+
+namespace
+{
+    const std::string path = (std::filesystem::temp_directory_path() / "arrakis_bench.snapshot").string();
+
+    // Save range(0) named objects
+    void save(size_t n)
+    {
+        static const wchar_t* const houses[] = { L"Atreides", L"Harkonnen", L"Corrino", L"Fremen" };
+        Snapshot::write(path, n, [](size_t i)
+        {
+            State state;
+            state.names.first_name = L"Fedaykin" + std::to_wstring(i);
+            state.names.last_name = L"of Sietch Tabr";
+            state.names.affiliation = houses[i % 4];
+            state.names.occupation = L"Warrior";
+            state.ledger = Ledger{ 1000, 1000000, (int64_t)i };
+            return state;
+        });
+    }
+
+
+    // Opening maps the file and reads the header, whatever the population
+
+    void BM_Open(benchmark::State& state)
+    {
+        save((size_t)state.range(0));
+        for (auto _ : state)
+        {
+            Snapshot snapshot(path);
+            benchmark::DoNotOptimize(snapshot.ledger(snapshot.size() / 2));
+        }
+        state.counters["bytes"] = (double)std::filesystem::file_size(path);
+        std::remove(path.c_str());
+    }
+    BENCHMARK(BM_Open)->Arg(10000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMicrosecond);
+
+
+    // The alternative: create every object at startup
+
+    void BM_Eager(benchmark::State& state)
+    {
+        save((size_t)state.range(0));
+        for (auto _ : state)
+        {
+            Snapshot snapshot(path);
+            std::vector<std::unique_ptr<Arrakeener>> people;
+            people.reserve(snapshot.size());
+            for (size_t i = 0; i < snapshot.size(); ++i)
+            {
+                const State saved = snapshot.state(i);
+                people.emplace_back(new Arrakeener(saved.ledger, i));
+                people.back()->set_first_name(saved.names.first_name.c_str());
+                people.back()->set_last_name(saved.names.last_name.c_str());
+                people.back()->set_affiliation(saved.names.affiliation.str().c_str());
+                people.back()->set_occupation(saved.names.occupation.str().c_str());
+            }
+            benchmark::DoNotOptimize(people.data());
+        }
+        std::remove(path.c_str());
+    }
+    BENCHMARK(BM_Eager)->Arg(10000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+
+    // Reads served from the mapping
+
+    void BM_MappedLedger(benchmark::State& state)
+    {
+        const size_t n = 1000000;
+        save(n);
+        Snapshot snapshot(path);
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(snapshot.ledger(i));
+            i = (i + 7919) % n;
+        }
+        state.SetItemsProcessed(state.iterations());
+        std::remove(path.c_str());
+    }
+    BENCHMARK(BM_MappedLedger);
+
+    void BM_MappedNames(benchmark::State& state)
+    {
+        const size_t n = 1000000;
+        save(n);
+        Snapshot snapshot(path);
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(snapshot.names(i));
+            i = (i + 7919) % n;
+        }
+        state.SetItemsProcessed(state.iterations());
+        std::remove(path.c_str());
+    }
+    BENCHMARK(BM_MappedNames);
+
+
+    // First change to an object: materialize it, then mine
+
+    void BM_FirstMine(benchmark::State& state)
+    {
+        const size_t n = 1000000;
+        save(n);
+        auto snapshot = std::make_unique<Snapshot>(path);
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            if (i == n)
+            {
+                state.PauseTiming();
+                snapshot = std::make_unique<Snapshot>(path);
+                i = 0;
+                state.ResumeTiming();
+            }
+            int64_t delta;
+            benchmark::DoNotOptimize(snapshot->materialize(i++).mine_spice(1, delta));
+        }
+        state.SetItemsProcessed(state.iterations());
+        snapshot.reset();
+        std::remove(path.c_str());
+    }
+    BENCHMARK(BM_FirstMine);
+}
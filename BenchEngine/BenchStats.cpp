@@ -0,0 +1,52 @@
+// BenchStats.cpp: Cost of per-method statistics, off and on, and of collecting them
+
+#include "core.h"
+#include "stats.h"
+#include <benchmark/benchmark.h>
+
+using namespace arrakis;
+
+namespace
+{
+    // Each thread on its own object, with recording off or on. The setting
+    // is process-wide, so thread 0 switches it inside the timing barriers.
+
+    void BM_StatsEatSpice(benchmark::State& state)
+    {
+        if (state.thread_index() == 0) stats::enable(state.range(0) != 0);
+        Arrakeener obj(Ledger{ 0, 0, (int64_t)1 << 50 }, (uint64_t)state.thread_index());
+        int64_t delta;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(obj.eat_spice(1, delta));
+        }
+        state.SetItemsProcessed(state.iterations());
+        if (state.thread_index() == 0) stats::enable(false);
+    }
+    BENCHMARK(BM_StatsEatSpice)->ArgName("recording")->Arg(0)->Arg(1)->ThreadRange(1, 8)->UseRealTime();
+
+    void BM_StatsGetSpice(benchmark::State& state)
+    {
+        if (state.thread_index() == 0) stats::enable(state.range(0) != 0);
+        Arrakeener obj(Ledger{ 0, 0, 0 }, (uint64_t)state.thread_index());
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(obj.spice());
+        }
+        state.SetItemsProcessed(state.iterations());
+        if (state.thread_index() == 0) stats::enable(false);
+    }
+    BENCHMARK(BM_StatsGetSpice)->ArgName("recording")->Arg(0)->Arg(1)->ThreadRange(1, 8)->UseRealTime();
+
+
+    // Adding up every thread's counters, as for a scrape
+
+    void BM_StatsCollect(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(stats::prometheus(stats::collect()));
+        }
+    }
+    BENCHMARK(BM_StatsCollect);
+}
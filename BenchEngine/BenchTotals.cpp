@@ -0,0 +1,53 @@
+// BenchTotals.cpp: Cost of keeping affiliation totals, and of reading them
+
+#include "totals.h"
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <vector>
+
+using namespace arrakis;
+
+namespace
+{
+    const wchar_t* const houses[] = { L"Atreides", L"Harkonnen", L"Corrino", L"Fremen" };
+
+    // Each thread mines on its own object, with or without totals attached
+
+    void BM_TotalsMineSpice(benchmark::State& state)
+    {
+        static Totals totals;
+        Arrakeener obj(Ledger{ 0, 0, 0 }, (uint64_t)state.thread_index());
+        obj.set_affiliation(houses[state.thread_index() % 4]);
+        if (state.range(0)) totals.attach(obj);
+        int64_t delta;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(obj.mine_spice(1, delta));
+        }
+        obj.observe(nullptr);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_TotalsMineSpice)->ArgName("totals")->Arg(0)->Arg(1)->ThreadRange(1, 8)->UseRealTime();
+
+
+    // A query over range(0) houses, whatever the population
+
+    void BM_ByAffiliation(benchmark::State& state)
+    {
+        Totals totals;
+        std::vector<std::unique_ptr<Arrakeener>> people;
+        for (int64_t i = 0; i < 100000; ++i)
+        {
+            people.emplace_back(new Arrakeener(Ledger{ 1000, 1000000, i }, (uint64_t)i));
+            people.back()->set_affiliation((std::wstring(houses[i % 4]) + std::to_wstring(i % state.range(0))).c_str());
+            totals.attach(*people.back());
+        }
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(totals.by_affiliation());
+        }
+        for (auto& obj : people) obj->observe(nullptr);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_ByAffiliation)->Arg(1)->Arg(16)->Arg(256);
+}
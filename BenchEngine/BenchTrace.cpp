@@ -0,0 +1,60 @@
+// BenchTrace.cpp: Cost of trace spans, off and on, and of flushing them
+
+#include "core.h"
+#include "trace.h"
+#include <benchmark/benchmark.h>
+
+using namespace arrakis;
+
+namespace
+{
+    // A span around nothing. Tracing is process-wide, so thread 0 switches
+    // it inside the timing barriers; full rings overwrite their oldest.
+
+    void BM_TraceSpan(benchmark::State& state)
+    {
+        if (state.thread_index() == 0) trace::enable(state.range(0) != 0);
+        for (auto _ : state)
+        {
+            trace::Span span("bench", "span");
+        }
+        state.SetItemsProcessed(state.iterations());
+        if (state.thread_index() == 0) trace::enable(false);
+    }
+    BENCHMARK(BM_TraceSpan)->ArgName("tracing")->Arg(0)->Arg(1)->ThreadRange(1, 8)->UseRealTime();
+
+    // Each thread on its own object: spans for the lock and the rules
+
+    void BM_TraceEatSpice(benchmark::State& state)
+    {
+        if (state.thread_index() == 0) trace::enable(state.range(0) != 0);
+        Arrakeener obj(Ledger{ 0, 0, (int64_t)1 << 50 }, (uint64_t)state.thread_index());
+        int64_t delta;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(obj.eat_spice(1, delta));
+        }
+        state.SetItemsProcessed(state.iterations());
+        if (state.thread_index() == 0) trace::enable(false);
+    }
+    BENCHMARK(BM_TraceEatSpice)->ArgName("tracing")->Arg(0)->Arg(1)->ThreadRange(1, 8)->UseRealTime();
+
+
+    // Writing out a full ring
+
+    void BM_TraceFlush(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            trace::flush();
+            trace::enable(true);
+            for (size_t i = 0; i < trace::ring_size; ++i) trace::Span span("bench", "span");
+            trace::enable(false);
+            state.ResumeTiming();
+            benchmark::DoNotOptimize(trace::flush());
+        }
+        state.SetItemsProcessed(state.iterations() * trace::ring_size);
+    }
+    BENCHMARK(BM_TraceFlush)->Unit(benchmark::kMillisecond);
+}
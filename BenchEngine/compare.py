@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# compare.py: Compare a benchmark run with a baseline
+#
+# Both files are Google Benchmark JSON output (--benchmark_out_format=json).
+# Benchmarks are matched by name; with repetitions, the median is used.
+# Prints the real time per iteration of each in nanoseconds and its change,
+# and exits with 1 if any is slower than the baseline by more than the
+# threshold.
+
+import argparse
+import json
+import sys
+
+
+# Nanoseconds per time unit
+units = {"ns": 1, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load(path):
+    with open(path) as f:
+        benchmarks = json.load(f)["benchmarks"]
+    times = {}
+    medians = {}
+    for b in benchmarks:
+        if b.get("error_occurred"):
+            continue
+        time = b["real_time"] * units[b.get("time_unit", "ns")]
+        if b.get("run_type") == "aggregate":
+            if b.get("aggregate_name") == "median":
+                medians[b["run_name"]] = time
+        else:
+            times.setdefault(b.get("run_name", b["name"]), time)
+    times.update(medians)
+    return times
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare a benchmark run with a baseline")
+    parser.add_argument("baseline", help="JSON output of the baseline run")
+    parser.add_argument("current", help="JSON output of the run to check")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="largest slowdown allowed, in percent (default 10)")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    width = max((len(name) for name in current), default=10)
+    print(f"{'Benchmark':<{width}}  {'Baseline':>12}  {'Current':>12}  {'Change':>8}")
+    regressions = 0
+    for name, time in current.items():
+        if name not in baseline:
+            print(f"{name:<{width}}  {'-':>12}  {time:>12.1f}  {'new':>8}")
+            continue
+        change = (time - baseline[name]) / baseline[name] * 100
+        mark = ""
+        if change > args.threshold:
+            mark = "  slower"
+            regressions += 1
+        print(f"{name:<{width}}  {baseline[name]:>12.1f}  {time:>12.1f}  {change:>+7.1f}%{mark}")
+
+    missing = [name for name in baseline if name not in current]
+    for name in missing:
+        print(f"{name:<{width}}  {baseline[name]:>12.1f}  {'-':>12}  {'missing':>8}")
+
+    if regressions:
+        print(f"{regressions} of {len(current)} benchmarks slower by more than {args.threshold:g}%")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,83 @@
+// BenchServer.cpp: Round trips through the socket server at several connection counts
+
+#include "client.h"
+#include "server.h"
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using namespace arrakis;
+using namespace arrakis::protocol;
+
+namespace
+{
+    const std::string path = (std::filesystem::temp_directory_path() / ("arrakis_bench_" + std::to_string(getpid()) + ".sock")).string();
+
+    Request mine(uint64_t handle)
+    {
+        Request request;
+        request.method = Method::mine;
+        request.handle = handle;
+        request.arg = 1;
+        return request;
+    }
+
+
+    // Each iteration sends range(1) MineSpice requests on each of range(0)
+    // connections, each to its own object, then waits for every response.
+    // The time per iteration is the latency of a request when range(0) x
+    // range(1) are in flight; range(2) reactors serve them.
+
+    void BM_ServerMineSpice(benchmark::State& state)
+    {
+        const size_t connections = (size_t)state.range(0);
+        const int depth = (int)state.range(1);
+        Server server(path, (unsigned)state.range(2));
+        std::vector<std::unique_ptr<Client>> clients;
+        std::vector<uint64_t> handles;
+        for (size_t i = 0; i < connections; ++i)
+        {
+            clients.emplace_back(new Client(path));
+            Request create;
+            create.method = Method::create;
+            handles.push_back((uint64_t)clients.back()->call(create).value);
+        }
+
+        for (auto _ : state)
+        {
+            for (size_t i = 0; i < connections; ++i)
+            {
+                for (int d = 0; d < depth; ++d) clients[i]->send(mine(handles[i]));
+                clients[i]->flush();
+            }
+            for (size_t i = 0; i < connections; ++i)
+            {
+                for (int d = 0; d < depth; ++d) benchmark::DoNotOptimize(clients[i]->receive());
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * (int64_t)connections * depth);
+    }
+    BENCHMARK(BM_ServerMineSpice)
+        ->ArgNames({ "connections", "depth", "reactors" })
+        ->ArgsProduct({ { 1, 64, 1024 }, { 1, 16 }, { 1, 4 } })
+        ->UseRealTime()
+        ->Unit(benchmark::kMicrosecond);
+
+
+    // The same request in process, for the cost of the transport
+
+    void BM_InProcessMineSpice(benchmark::State& state)
+    {
+        Arrakeener obj;
+        int64_t delta;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(obj.mine_spice(1, delta));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_InProcessMineSpice);
+}
@@ -0,0 +1,512 @@
+// LoadArrakis.cpp: Open-loop load generator for the engine and the socket server
+//
+// Usage: LoadArrakis [options]
+//   --server PATH       Drive the server listening at PATH instead of objects
+//                       in this process
+//   --population N      Objects to create before starting (10000)
+//   --rate R            Operations per second, over all workers (100000)
+//   --duration S        Seconds to run (10)
+//   --workers W         Threads issuing operations (4)
+//   --connections C     Connections to the server, shared by the workers (W)
+//   --mix LIST          Relative weights of the operations
+//                       (get=40,put=5,mine=20,eat=15,sell=15,clone=5)
+//   --interval S        Seconds between throughput lines (1)
+//   --seed N            Seed for the choice of operations and objects (1)
+//   --trace FILE        Trace the run, in process or on the server, and write
+//                       the spans to FILE for chrome://tracing or Perfetto
+//
+// Operations are issued on a fixed schedule whether or not earlier ones
+// have finished, and each latency is measured from the time the operation
+// was due, not the time it was sent, so a stall shows up in the latencies
+// of everything scheduled behind it rather than being hidden by sending
+// less (coordinated omission). In process, a worker that falls behind
+// issues its overdue operations back to back; against a server, each
+// connection pipelines them.
+
+#include "client.h"
+#include "core.h"
+#include "histogram.h"
+#include "rng.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <poll.h>
+
+using namespace arrakis;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+    enum Kind
+    {
+        get,
+        put,
+        mine,
+        eat,
+        sell,
+        clone,
+        kind_count
+    };
+
+    const char* const kind_names[kind_count] = { "get", "put", "mine", "eat", "sell", "clone" };
+    const wchar_t* const occupations[] = { L"Smuggler", L"Mentat", L"Trooper", L"Planetologist" };
+
+    struct Config
+    {
+        std::string server;                 // Empty for in process
+        size_t population = 10000;
+        double rate = 100000;
+        double duration = 10;
+        unsigned workers = 4;
+        unsigned connections = 0;           // 0 for one per worker
+        unsigned weights[kind_count] = { 40, 5, 20, 15, 15, 5 };
+        double interval = 1;
+        uint64_t seed = 1;
+        std::string trace;                  // Empty for no trace
+    };
+
+
+    // What one worker saw, merged at the end
+
+    struct Results
+    {
+        Histogram latency[kind_count];      // Nanoseconds from due to done
+        uint64_t failed[kind_count] = {};
+        Clock::time_point finished;         // When the last operation completed
+    };
+
+
+    // Chooses the operations and objects of one worker
+
+    class Chooser
+    {
+        Rng m_rng;
+        unsigned m_cumulative[kind_count];
+        size_t m_population;
+
+    public:
+        Chooser(const Config& config, unsigned worker) :
+            m_rng(config.seed * 0x9E3779B97F4A7C15ull + worker),
+            m_population(config.population)
+        {
+            unsigned total = 0;
+            for (int k = 0; k < kind_count; ++k) m_cumulative[k] = total += config.weights[k];
+        }
+
+        Kind kind() noexcept
+        {
+            const unsigned draw = (unsigned)m_rng.range(0, (int)m_cumulative[kind_count - 1] - 1);
+            int k = 0;
+            while (draw >= m_cumulative[k]) ++k;
+            return (Kind)k;
+        }
+
+        size_t object() noexcept { return (size_t)(m_rng.next() % m_population); }
+        const wchar_t* occupation() noexcept { return occupations[m_rng.next() % 4]; }
+    };
+
+
+    // Operation i of the whole run is due at start + i / rate; worker w
+    // issues operations w, w + W, w + 2W, ...
+
+    class Schedule
+    {
+        Clock::time_point m_start;
+        double m_period;                    // Nanoseconds between a worker's operations
+        double m_offset;
+        uint64_t m_issued;
+        uint64_t m_total;
+
+    public:
+        Schedule(const Config& config, Clock::time_point start, unsigned worker) :
+            m_start(start),
+            m_period(1e9 * config.workers / config.rate),
+            m_offset(1e9 * worker / config.rate),
+            m_issued(0)
+        {
+            const uint64_t all = (uint64_t)(config.rate * config.duration);
+            m_total = all / config.workers + (worker < all % config.workers ? 1 : 0);
+        }
+
+        bool done() const noexcept { return m_issued == m_total; }
+        Clock::time_point due() const noexcept
+        {
+            return m_start + std::chrono::nanoseconds((int64_t)(m_offset + m_period * (double)m_issued));
+        }
+        void advance() noexcept { ++m_issued; }
+    };
+
+
+    // Sleep until shortly before t, then yield until it
+
+    void wait_until(Clock::time_point t)
+    {
+        const auto early = std::chrono::microseconds(100);
+        if (Clock::now() + early < t) std::this_thread::sleep_until(t - early);
+        while (Clock::now() < t) std::this_thread::yield();
+    }
+
+
+    int64_t since(Clock::time_point due, Clock::time_point now) noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(now - due).count();
+    }
+
+
+    // In process: each operation is a call on a shared object
+
+    void run_local(const Config& config, std::vector<std::unique_ptr<Arrakeener>>& people, unsigned worker,
+        Clock::time_point start, Results& results, std::atomic<uint64_t>& completed)
+    {
+        Chooser chooser(config, worker);
+        for (Schedule schedule(config, start, worker); !schedule.done(); schedule.advance())
+        {
+            const Clock::time_point due = schedule.due();
+            wait_until(due);
+            const Kind kind = chooser.kind();
+            Arrakeener& obj = *people[chooser.object()];
+            Status status = Status::ok;
+            int64_t delta;
+            switch (kind)
+            {
+            case get: obj.occupation(); break;
+            case put: obj.set_occupation(chooser.occupation()); break;
+            case mine: status = obj.mine_spice(1, delta); break;
+            case eat: status = obj.eat_spice(1, delta); break;
+            case sell: status = obj.sell_spice(1, delta); break;
+            default: Arrakeener copy(obj); break;
+            }
+            results.latency[kind].record(since(due, Clock::now()));
+            if (status != Status::ok) ++results.failed[kind];
+            completed.fetch_add(1, std::memory_order_relaxed);
+        }
+        results.finished = Clock::now();
+    }
+
+
+    // Against a server: requests are sent when due on the worker's
+    // connections in turn, and responses are matched to them in order
+
+    struct Pending
+    {
+        Clock::time_point due;
+        int kind;                           // kind_count for an unmeasured release
+    };
+
+    struct Connection
+    {
+        std::unique_ptr<Client> client;
+        std::deque<Pending> pending;
+    };
+
+    protocol::Request request(Kind kind, uint64_t handle, const wchar_t* occupation)
+    {
+        protocol::Request request;
+        request.handle = handle;
+        request.arg = 1;
+        switch (kind)
+        {
+        case get: request.method = protocol::Method::get; request.property = protocol::Property::occupation; break;
+        case put: request.method = protocol::Method::put; request.property = protocol::Property::occupation; request.text = occupation; break;
+        case mine: request.method = protocol::Method::mine; break;
+        case eat: request.method = protocol::Method::eat; break;
+        case sell: request.method = protocol::Method::sell; break;
+        default: request.method = protocol::Method::clone; break;
+        }
+        return request;
+    }
+
+    void run_remote(const Config& config, const std::vector<uint64_t>& handles, std::vector<Connection>& connections,
+        unsigned worker, Clock::time_point start, Results& results, std::atomic<uint64_t>& completed)
+    {
+        Chooser chooser(config, worker);
+        Schedule schedule(config, start, worker);
+        std::vector<pollfd> fds;
+        for (Connection& connection : connections) fds.push_back(pollfd{ connection.client->fd(), POLLIN, 0 });
+        size_t next = 0, outstanding = 0;
+
+        while (!schedule.done() || outstanding)
+        {
+            // Send everything due, pipelined behind what is in flight
+            Clock::time_point now = Clock::now();
+            while (!schedule.done() && schedule.due() <= now)
+            {
+                Connection& connection = connections[next];
+                next = (next + 1) % connections.size();
+                const Kind kind = chooser.kind();
+                connection.client->send(request(kind, handles[chooser.object()], chooser.occupation()));
+                connection.pending.push_back(Pending{ schedule.due(), kind });
+                ++outstanding;
+                schedule.advance();
+            }
+            for (Connection& connection : connections) connection.client->flush();
+
+            // Wait for responses until the next send is due
+            int64_t timeout = -1;
+            if (!schedule.done()) timeout = std::max<int64_t>(0, since(Clock::now(), schedule.due()));
+            timespec wait = { (time_t)(timeout / 1000000000), (long)(timeout % 1000000000) };
+            if (ppoll(fds.data(), fds.size(), timeout < 0 ? nullptr : &wait, nullptr) < 0 && errno != EINTR)
+            {
+                throw std::system_error(errno, std::generic_category(), "ppoll");
+            }
+
+            now = Clock::now();
+            for (Connection& connection : connections)
+            {
+                protocol::Response response;
+                while (connection.client->try_receive(response))
+                {
+                    const Pending pending = connection.pending.front();
+                    connection.pending.pop_front();
+                    --outstanding;
+                    if (pending.kind == kind_count) continue;
+                    results.latency[pending.kind].record(since(pending.due, now));
+                    if (response.status != 0) ++results.failed[pending.kind];
+                    completed.fetch_add(1, std::memory_order_relaxed);
+
+                    // Keep the population steady; the release is not measured
+                    if (pending.kind == clone && response.status == 0)
+                    {
+                        protocol::Request release;
+                        release.method = protocol::Method::release;
+                        release.handle = (uint64_t)response.value;
+                        connection.client->send(release);
+                        connection.pending.push_back(Pending{ now, kind_count });
+                        ++outstanding;
+                    }
+                }
+                connection.client->flush();
+            }
+        }
+        results.finished = Clock::now();
+    }
+
+
+    [[noreturn]] void usage(const char* message)
+    {
+        std::fprintf(stderr, "LoadArrakis: %s\n", message);
+        std::fprintf(stderr, "usage: LoadArrakis [--server PATH] [--population N] [--rate R] [--duration S]\n"
+            "                   [--workers W] [--connections C] [--mix get=40,put=5,...]\n"
+            "                   [--interval S] [--seed N] [--trace FILE]\n");
+        std::exit(2);
+    }
+
+
+    void parse_mix(const std::string& text, Config& config)
+    {
+        std::fill(std::begin(config.weights), std::end(config.weights), 0u);
+        size_t start = 0;
+        while (start < text.size())
+        {
+            size_t end = text.find(',', start);
+            if (end == std::string::npos) end = text.size();
+            const std::string item = text.substr(start, end - start);
+            const size_t equals = item.find('=');
+            if (equals == std::string::npos) usage("--mix takes name=weight pairs");
+            const std::string name = item.substr(0, equals);
+            int k = 0;
+            while (k < kind_count && name != kind_names[k]) ++k;
+            if (k == kind_count) usage(("unknown operation in --mix: " + name).c_str());
+            config.weights[k] = (unsigned)std::strtoul(item.c_str() + equals + 1, nullptr, 10);
+            start = end + 1;
+        }
+        unsigned total = 0;
+        for (unsigned weight : config.weights) total += weight;
+        if (total == 0) usage("--mix has no weight");
+    }
+
+
+    Config parse(int argc, char* argv[])
+    {
+        Config config;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string option = argv[i];
+            if (i + 1 == argc) usage(("missing value for " + option).c_str());
+            const char* value = argv[++i];
+            if (option == "--server") config.server = value;
+            else if (option == "--population") config.population = (size_t)std::strtoull(value, nullptr, 10);
+            else if (option == "--rate") config.rate = std::strtod(value, nullptr);
+            else if (option == "--duration") config.duration = std::strtod(value, nullptr);
+            else if (option == "--workers") config.workers = (unsigned)std::strtoul(value, nullptr, 10);
+            else if (option == "--connections") config.connections = (unsigned)std::strtoul(value, nullptr, 10);
+            else if (option == "--mix") parse_mix(value, config);
+            else if (option == "--interval") config.interval = std::strtod(value, nullptr);
+            else if (option == "--seed") config.seed = std::strtoull(value, nullptr, 10);
+            else if (option == "--trace") config.trace = value;
+            else usage(("unknown option " + option).c_str());
+        }
+        if (config.population == 0 || config.rate <= 0 || config.duration <= 0 || config.workers == 0 || config.interval <= 0)
+        {
+            usage("population, rate, duration, workers and interval must be positive");
+        }
+        if (config.connections == 0) config.connections = config.workers;
+        if (config.connections < config.workers) usage("each worker needs a connection");
+        return config;
+    }
+
+
+    // Start or stop tracing where the operations run. Stopping writes the
+    // trace to the file; the server returns its trace in the response.
+
+    void set_tracing(const Config& config, Client* client, bool on)
+    {
+        if (config.trace.empty()) return;
+        if (!client)
+        {
+            if (on) trace::flush();
+            trace::enable(on);
+            if (!on) trace::flush(config.trace);
+            return;
+        }
+        protocol::Request request;
+        request.method = protocol::Method::trace;
+        request.on = on;
+        const protocol::Response response = client->call(request);
+        if (response.status != 0) throw std::runtime_error("the server could not trace");
+        if (on) return;
+
+        const std::string text(response.text.begin(), response.text.end());
+        std::FILE* file = std::fopen(config.trace.c_str(), "wb");
+        if (!file) throw std::system_error(errno, std::generic_category(), config.trace);
+        const bool ok = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+        if (std::fclose(file) != 0 || !ok) throw std::system_error(EIO, std::generic_category(), config.trace);
+    }
+
+
+    void report(const Config& config, const Results& results, double elapsed)
+    {
+        auto us = [](int64_t ns) { return (double)ns / 1000; };
+        std::printf("\n%-6s %10s %10s %10s %10s %10s %10s\n", "op", "count", "failed", "p50 us", "p99 us", "p99.9 us", "max us");
+        Histogram all;
+        uint64_t failed = 0;
+        for (int k = 0; k < kind_count; ++k)
+        {
+            const Histogram& h = results.latency[k];
+            all.merge(h);
+            failed += results.failed[k];
+            if (h.count() == 0) continue;
+            std::printf("%-6s %10llu %10llu %10.1f %10.1f %10.1f %10.1f\n", kind_names[k], (unsigned long long)h.count(),
+                (unsigned long long)results.failed[k], us(h.percentile(50)), us(h.percentile(99)), us(h.percentile(99.9)), us(h.max()));
+        }
+        std::printf("%-6s %10llu %10llu %10.1f %10.1f %10.1f %10.1f\n", "all", (unsigned long long)all.count(),
+            (unsigned long long)failed, us(all.percentile(50)), us(all.percentile(99)), us(all.percentile(99.9)), us(all.max()));
+        std::printf("\n%.0f ops/s achieved of %.0f ops/s scheduled\n", (double)all.count() / elapsed, config.rate);
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    const Config config = parse(argc, argv);
+    try
+    {
+        // The population, in process or on the server
+        std::vector<std::unique_ptr<Arrakeener>> people;
+        std::vector<uint64_t> handles;
+        std::vector<std::vector<Connection>> connections(config.workers);
+        if (config.server.empty())
+        {
+            for (size_t i = 0; i < config.population; ++i) people.emplace_back(new Arrakeener);
+        }
+        else
+        {
+            for (unsigned c = 0; c < config.connections; ++c)
+            {
+                connections[c % config.workers].push_back(Connection{ std::unique_ptr<Client>(new Client(config.server)), {} });
+            }
+            Client& client = *connections[0][0].client;
+            protocol::Request create;
+            create.method = protocol::Method::create;
+            for (size_t i = 0; i < config.population; ++i) client.send(create);
+            for (size_t i = 0; i < config.population; ++i)
+            {
+                const protocol::Response response = client.receive();
+                if (response.status != 0) throw std::runtime_error("the server could not create the population");
+                handles.push_back((uint64_t)response.value);
+            }
+        }
+        std::printf("%zu objects %s, %.0f ops/s for %.0f s on %u workers\n", config.population,
+            config.server.empty() ? "in process" : ("on " + config.server).c_str(), config.rate, config.duration, config.workers);
+
+        Client* control = config.server.empty() ? nullptr : connections[0][0].client.get();
+        set_tracing(config, control, true);
+
+        // Workers start together, a little in the future
+        const Clock::time_point start = Clock::now() + std::chrono::milliseconds(50);
+        std::vector<Results> results(config.workers);
+        std::atomic<uint64_t> completed(0);
+        std::mutex error_mutex;
+        std::exception_ptr error;
+        std::atomic<bool> failed(false);
+        std::vector<std::thread> threads;
+        for (unsigned w = 0; w < config.workers; ++w)
+        {
+            threads.emplace_back([&, w]
+            {
+                try
+                {
+                    if (config.server.empty()) run_local(config, people, w, start, results[w], completed);
+                    else run_remote(config, handles, connections[w], w, start, results[w], completed);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) error = std::current_exception();
+                    failed = true;
+                }
+            });
+        }
+
+        // Throughput over time, until every worker has finished
+        const auto interval = std::chrono::nanoseconds((int64_t)(config.interval * 1e9));
+        const uint64_t scheduled = (uint64_t)(config.rate * config.duration);
+        uint64_t last = 0;
+        Clock::time_point tick = start;
+        std::printf("\n%8s %12s\n", "time s", "ops/s");
+        while (completed.load() < scheduled && !failed)
+        {
+            tick += interval;
+            std::this_thread::sleep_until(tick);
+            const uint64_t now = completed.load();
+            std::printf("%8.1f %12.0f\n", std::chrono::duration<double>(tick - start).count(), (double)(now - last) / config.interval);
+            std::fflush(stdout);
+            last = now;
+        }
+        for (auto& thread : threads) thread.join();
+        if (error) std::rethrow_exception(error);
+        set_tracing(config, control, false);
+        Results total;
+        total.finished = start;
+        for (const Results& r : results)
+        {
+            total.finished = std::max(total.finished, r.finished);
+            for (int k = 0; k < kind_count; ++k)
+            {
+                total.latency[k].merge(r.latency[k]);
+                total.failed[k] += r.failed[k];
+            }
+        }
+        report(config, total, std::chrono::duration<double>(total.finished - start).count());
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "LoadArrakis: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -6,6 +6,7 @@
 #include "arrakis_h.h"
 #include "arrakis_i.c"
 #include <iptr.h>
+#include <string>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -76,8 +77,19 @@ namespace TestArrakis
 
     TEST_CLASS(TestArrakeener)
     {
-        IPtr<IArrakeener> arrakeener;
-        IPtr<IArrakeener> ghola;
+        IPtr<IArrakeener2> arrakeener;
+        IPtr<IArrakeener2> ghola;
+
+        // Clone returns the first interface; the tests use the second
+        HRESULT clone(IPtr<IArrakeener2>& p) const
+        {
+            IArrakeener* copy = nullptr;
+            HRESULT hr = arrakeener->Clone(&copy);
+            if (FAILED(hr)) return hr;
+            hr = copy->QueryInterface(IID_IArrakeener2, (void**)set(p));
+            copy->Release();
+            return hr;
+        }
 
         void check_error_message(wchar_t const* expected) const
         {
@@ -140,11 +152,32 @@ namespace TestArrakis
 
         TEST_METHOD_INITIALIZE(CreateArrakeener)
         {
-            HRESULT hr = CoCreateInstance(CLSID_Arrakeener, nullptr, CLSCTX_ALL, IID_IArrakeener, (void**)set(arrakeener));
+            HRESULT hr = CoCreateInstance(CLSID_Arrakeener, nullptr, CLSCTX_ALL, IID_IArrakeener2, (void**)set(arrakeener));
             Assert::IsTrue(SUCCEEDED(hr));
             Assert::IsTrue((bool)arrakeener);
         }
 
+        // Clients built against the first interface still find it
+        TEST_METHOD(Interfaces)
+        {
+            IArrakeener* first = nullptr;
+            HRESULT hr = arrakeener->QueryInterface(IID_IArrakeener, (void**)&first);
+            Assert::AreEqual(S_OK, hr);
+            IArrakeener2* second = nullptr;
+            hr = first->QueryInterface(IID_IArrakeener2, (void**)&second);
+            Assert::AreEqual(S_OK, hr);
+            Assert::IsTrue(second == arrakeener);
+            second->Release();
+            first->Release();
+
+            ISupportErrorInfo* psei = nullptr;
+            hr = arrakeener->QueryInterface(IID_ISupportErrorInfo, (void**)&psei);
+            Assert::AreEqual(S_OK, hr);
+            Assert::AreEqual(S_OK, psei->InterfaceSupportsErrorInfo(IID_IArrakeener));
+            Assert::AreEqual(S_OK, psei->InterfaceSupportsErrorInfo(IID_IArrakeener2));
+            psei->Release();
+        }
+
         TEST_METHOD(FirstName)
         {
             _UBSTR bstr;
@@ -386,6 +419,147 @@ namespace TestArrakis
             check_spice(spice);
         }
 
+        TEST_METHOD(Batch)
+        {
+            HRESULT hr;
+            const LONGLONG harvesters[] = { 1LL, 1LL, 0LL };
+            const ULONG n = sizeof(harvesters) / sizeof(harvesters[0]);
+
+            SAFEARRAY* psa = SafeArrayCreateVector(VT_I8, 0, n);
+            Assert::IsNotNull(psa);
+            for (LONG i = 0; i < (LONG)n; ++i)
+            {
+                hr = SafeArrayPutElement(psa, &i, (void*)&harvesters[i]);
+                Assert::IsTrue(SUCCEEDED(hr));
+            }
+
+            SAFEARRAY* psaDeltas = nullptr;
+            SAFEARRAY* psaResults = nullptr;
+            hr = arrakeener->MineSpiceBatch(psa, &psaDeltas, &psaResults);
+            SafeArrayDestroy(psa);
+            Assert::AreEqual(S_FALSE, hr);  // The last element has no harvester
+            Assert::IsNotNull(psaDeltas);
+            Assert::IsNotNull(psaResults);
+
+            LONGLONG spice = 0LL;
+            for (LONG i = 0; i < (LONG)n; ++i)
+            {
+                LONGLONG delta;
+                LONG result;
+                SafeArrayGetElement(psaDeltas, &i, &delta);
+                SafeArrayGetElement(psaResults, &i, &result);
+                if (result == ArrakeenerOK) spice += delta;
+                else Assert::AreEqual(0LL, delta);
+            }
+
+            LONG i = 2;
+            LONG result;
+            SafeArrayGetElement(psaResults, &i, &result);
+            SafeArrayDestroy(psaDeltas);
+            SafeArrayDestroy(psaResults);
+            Assert::AreEqual((LONG)ArrakeenerNoHarvester, result);
+            check_spice(spice);
+        }
+
+        TEST_METHOD(Transact)
+        {
+            // Mine until there are 20 units, then sell them all
+            const LONGLONG program[] =
+            {
+                ArrakeenerMine, 1LL, ArrakeenerSpice, ArrakeenerLess, 20LL, 1024LL,
+                ArrakeenerSell, 0LL, ArrakeenerSpice, ArrakeenerGreater, 0LL, 1LL
+            };
+            const ULONG n = sizeof(program) / sizeof(program[0]);
+
+            SAFEARRAY* psa = SafeArrayCreateVector(VT_I8, 0, n);
+            Assert::IsNotNull(psa);
+            LONGLONG* values = nullptr;
+            SafeArrayAccessData(psa, (void**)&values);
+            for (ULONG i = 0; i < n; ++i) values[i] = program[i];
+            SafeArrayUnaccessData(psa);
+
+            SAFEARRAY* psaDeltas = nullptr;
+            LONG failed = 0;
+            ArrakeenerStatus status = ArrakeenerOverflow;
+            HRESULT hr = arrakeener->Transact(psa, &psaDeltas, &failed, &status);
+            SafeArrayDestroy(psa);
+
+            // A poor Arrakeener may run out of energy or solaris first
+            if (hr == S_OK)
+            {
+                Assert::AreEqual((int)ArrakeenerOK, (int)status);
+                Assert::AreEqual(-1L, failed);
+                check_spice(0LL);
+            }
+            else
+            {
+                Assert::AreEqual(S_FALSE, hr);
+                Assert::AreEqual(0L, failed);
+                check_spice(0LL);       // Rolled back
+            }
+            Assert::IsNotNull(psaDeltas);
+            SafeArrayDestroy(psaDeltas);
+        }
+
+        TEST_METHOD(Simulate)
+        {
+            // Mine once a cycle
+            const LONGLONG policy[] = { ArrakeenerMine, 1LL, ArrakeenerSpice, ArrakeenerAlways, 0LL, 1LL };
+            const ULONG n = sizeof(policy) / sizeof(policy[0]);
+
+            SAFEARRAY* psa = SafeArrayCreateVector(VT_I8, 0, n);
+            Assert::IsNotNull(psa);
+            LONGLONG* values = nullptr;
+            SafeArrayAccessData(psa, (void**)&values);
+            for (ULONG i = 0; i < n; ++i) values[i] = policy[i];
+            SafeArrayUnaccessData(psa);
+
+            SAFEARRAY* psaStats = nullptr;
+            HRESULT hr = arrakeener->Simulate(psa, 3, 1000, 42, &psaStats);
+            SafeArrayDestroy(psa);
+            Assert::AreEqual(S_OK, hr);
+            Assert::IsNotNull(psaStats);
+
+            LONG upper = 0;
+            SafeArrayGetUBound(psaStats, 1, &upper);
+            Assert::AreEqual(13L, upper);
+            double* stats = nullptr;
+            SafeArrayAccessData(psaStats, (void**)&stats);
+            const double ruin = stats[12], cycles = stats[13];
+            SafeArrayUnaccessData(psaStats);
+            SafeArrayDestroy(psaStats);
+            Assert::IsTrue(ruin >= 0 && ruin <= 1);
+            Assert::IsTrue(cycles >= 0 && cycles <= 3);
+            check_spice(0LL);           // Simulation leaves the object alone
+        }
+
+        TEST_METHOD(GetState)
+        {
+            HRESULT hr = arrakeener->put_FirstName(_UBSTR(L"Gurney"));
+            Assert::IsTrue(SUCCEEDED(hr));
+            hr = arrakeener->put_Occupation(_UBSTR(L"Warmaster"));
+            Assert::IsTrue(SUCCEEDED(hr));
+
+            ArrakeenerState state;
+            hr = arrakeener->GetState(&state);
+            Assert::IsTrue(SUCCEEDED(hr));
+            Assert::AreEqual(L"Gurney", state.FirstName);
+            Assert::AreEqual(L"", state.LastName);
+            Assert::AreEqual(L"Warmaster", state.Occupation);
+            Assert::AreEqual(0LL, state.Spice);
+
+            LONGLONG energy, solaris;
+            arrakeener->get_Energy(&energy);
+            arrakeener->get_Solaris(&solaris);
+            Assert::AreEqual(energy, state.Energy);
+            Assert::AreEqual(solaris, state.Solaris);
+
+            SysFreeString(state.FirstName);
+            SysFreeString(state.LastName);
+            SysFreeString(state.Affiliation);
+            SysFreeString(state.Occupation);
+        }
+
         TEST_METHOD(Clone)
         {
             _UBSTR bstr1;
@@ -404,10 +578,10 @@ namespace TestArrakis
             // Create an alias of Duncan
             // This just copies the pointer, not the data
             // It is the same Duncan
-            IPtr<IArrakeener> p = arrakeener;
+            IPtr<IArrakeener2> p = arrakeener;
 
             // Create a copy of Duncan
-            hr = arrakeener->Clone(set(ghola));
+            hr = clone(ghola);
             Assert::IsTrue(SUCCEEDED(hr));
 
             hr = ghola->put_Occupation(_UBSTR(L"Ghola"));
@@ -463,5 +637,227 @@ namespace TestArrakis
             Assert::IsTrue(SUCCEEDED(hr));
             Assert::AreNotEqual(std::wstring(bstr1), std::wstring(bstr2));
         }
+
+        TEST_METHOD(CloneMany)
+        {
+            HRESULT hr = arrakeener->put_FirstName(_UBSTR(L"Duncan"));
+            Assert::IsTrue(SUCCEEDED(hr));
+
+            SAFEARRAY* psa = nullptr;
+            hr = arrakeener->CloneMany(0, &psa);
+            Assert::AreEqual(E_INVALIDARG, hr);
+
+            const LONG n = 100;
+            hr = arrakeener->CloneMany(n, &psa);
+            Assert::IsTrue(SUCCEEDED(hr));
+            Assert::IsNotNull(psa);
+
+            IArrakeener** clones = nullptr;
+            hr = SafeArrayAccessData(psa, (void**)&clones);
+            Assert::IsTrue(SUCCEEDED(hr));
+            for (LONG i = 0; i < n; ++i)
+            {
+                _UBSTR bstr;
+                hr = clones[i]->get_FirstName(set(bstr));
+                Assert::IsTrue(SUCCEEDED(hr));
+                Assert::AreEqual(L"Duncan", bstr);
+            }
+
+            // Renaming one clone leaves the others alone
+            hr = clones[0]->put_FirstName(_UBSTR(L"Hayt"));
+            Assert::IsTrue(SUCCEEDED(hr));
+            _UBSTR bstr;
+            hr = clones[1]->get_FirstName(set(bstr));
+            Assert::AreEqual(L"Duncan", bstr);
+
+            SafeArrayUnaccessData(psa);
+            SafeArrayDestroy(psa);
+        }
+
+        TEST_METHOD(Directory)
+        {
+            HRESULT hr = arrakeener->put_FirstName(_UBSTR(L"Thufir"));
+            Assert::IsTrue(SUCCEEDED(hr));
+            hr = arrakeener->put_LastName(_UBSTR(L"Hawat"));
+            Assert::IsTrue(SUCCEEDED(hr));
+
+            IArrakeener* found = nullptr;
+            hr = arrakeener->Find(_UBSTR(L"Thufir"), _UBSTR(L"Hawat"), &found);
+            Assert::AreEqual(S_FALSE, hr);
+            Assert::IsNull(found);
+
+            hr = arrakeener->Register();
+            Assert::AreEqual(S_OK, hr);
+            hr = clone(ghola);
+            Assert::IsTrue(SUCCEEDED(hr));
+            hr = ghola->Register();             // Same names
+            Assert::AreEqual(HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS), hr);
+            hr = ghola->put_Occupation(_UBSTR(L"Ghola"));
+            Assert::IsTrue(SUCCEEDED(hr));
+
+            // Any person can look up any other
+            hr = ghola->Find(_UBSTR(L"Thufir"), _UBSTR(L"Hawat"), &found);
+            Assert::AreEqual(S_OK, hr);
+            _UBSTR occupation;
+            hr = found->get_Occupation(set(occupation));
+            Assert::IsTrue(SUCCEEDED(hr));
+            Assert::AreNotEqual(L"Ghola", occupation);
+            found->Release();
+
+            // The whole directory in batches of one
+            LONGLONG cursor = 0;
+            bool seen = false;
+            do
+            {
+                SAFEARRAY* psa = nullptr;
+                hr = ghola->Enumerate(&cursor, 1, &psa);
+                Assert::AreEqual(S_OK, hr);
+                IArrakeener** batch = nullptr;
+                SafeArrayAccessData(psa, (void**)&batch);
+                LONG upper = -1;
+                SafeArrayGetUBound(psa, 1, &upper);
+                for (LONG i = 0; i <= upper; ++i)
+                {
+                    _UBSTR bstr;
+                    hr = batch[i]->get_LastName(set(bstr));
+                    Assert::IsTrue(SUCCEEDED(hr));
+                    seen = seen || std::wstring(bstr) == L"Hawat";
+                }
+                SafeArrayUnaccessData(psa);
+                SafeArrayDestroy(psa);
+            } while (cursor != 0);
+            Assert::IsTrue(seen);
+
+            hr = ghola->Unregister();
+            Assert::AreEqual(S_FALSE, hr);      // Not listed
+            hr = arrakeener->Unregister();
+            Assert::AreEqual(S_OK, hr);
+            hr = ghola->Find(_UBSTR(L"Thufir"), _UBSTR(L"Hawat"), &found);
+            Assert::AreEqual(S_FALSE, hr);
+        }
+
+        TEST_METHOD(AffiliationTotals)
+        {
+            HRESULT hr = arrakeener->put_Affiliation(_UBSTR(L"Bene Tleilax"));
+            Assert::IsTrue(SUCCEEDED(hr));
+            LONGLONG delta = 0;
+            hr = arrakeener->MineSpice(1, &delta);
+            Assert::IsTrue(SUCCEEDED(hr));
+            hr = clone(ghola);
+            Assert::IsTrue(SUCCEEDED(hr));
+            ArrakeenerState state = {};
+            hr = arrakeener->GetState(&state);
+            Assert::IsTrue(SUCCEEDED(hr));
+
+            SAFEARRAY* psaAffiliations = nullptr;
+            SAFEARRAY* psaTotals = nullptr;
+            hr = arrakeener->AffiliationTotals(&psaAffiliations, &psaTotals);
+            Assert::AreEqual(S_OK, hr);
+            LONG upper = -1;
+            SafeArrayGetUBound(psaAffiliations, 1, &upper);
+            BSTR* names = nullptr;
+            LONGLONG* totals = nullptr;
+            SafeArrayAccessData(psaAffiliations, (void**)&names);
+            SafeArrayAccessData(psaTotals, (void**)&totals);
+            bool seen = false;
+            for (LONG i = 0; i <= upper; ++i)
+            {
+                if (std::wstring(names[i]) != L"Bene Tleilax") continue;
+                seen = true;
+                Assert::AreEqual(2LL, totals[4 * i]);   // The person and its clone
+                Assert::AreEqual(2 * state.Energy, totals[4 * i + 1]);
+                Assert::AreEqual(2 * state.Solaris, totals[4 * i + 2]);
+                Assert::AreEqual(2 * state.Spice, totals[4 * i + 3]);
+            }
+            SafeArrayUnaccessData(psaTotals);
+            SafeArrayUnaccessData(psaAffiliations);
+            SafeArrayDestroy(psaTotals);
+            SafeArrayDestroy(psaAffiliations);
+            SysFreeString(state.FirstName);
+            SysFreeString(state.LastName);
+            SysFreeString(state.Affiliation);
+            SysFreeString(state.Occupation);
+            Assert::IsTrue(seen);
+        }
+
+        TEST_METHOD(Leaders)
+        {
+            HRESULT hr = arrakeener->put_FirstName(_UBSTR(L"Baron"));
+            Assert::IsTrue(SUCCEEDED(hr));
+            hr = arrakeener->put_LastName(_UBSTR(L"Harkonnen"));
+            Assert::IsTrue(SUCCEEDED(hr));
+            LONGLONG solaris = 0;
+            hr = arrakeener->get_Solaris(&solaris);
+            Assert::IsTrue(SUCCEEDED(hr));
+
+            SAFEARRAY* psaNames = nullptr;
+            SAFEARRAY* psaValues = nullptr;
+            hr = arrakeener->Leaders(ArrakeenerSolaris, 1000, &psaNames, &psaValues);
+            Assert::AreEqual(S_OK, hr);
+            LONG upper = -1;
+            SafeArrayGetUBound(psaValues, 1, &upper);
+            BSTR* names = nullptr;
+            LONGLONG* values = nullptr;
+            SafeArrayAccessData(psaNames, (void**)&names);
+            SafeArrayAccessData(psaValues, (void**)&values);
+            bool seen = false;
+            for (LONG i = 0; i <= upper; ++i)
+            {
+                if (i > 0) Assert::IsTrue(values[i - 1] >= values[i]);
+                seen = seen || (std::wstring(names[2 * i]) == L"Baron" && std::wstring(names[2 * i + 1]) == L"Harkonnen" && values[i] == solaris);
+            }
+            SafeArrayUnaccessData(psaValues);
+            SafeArrayUnaccessData(psaNames);
+            SafeArrayDestroy(psaValues);
+            SafeArrayDestroy(psaNames);
+            Assert::IsTrue(seen || upper == 999);
+
+            hr = arrakeener->Leaders((ArrakeenerField)3, 10, &psaNames, &psaValues);
+            Assert::AreEqual(E_INVALIDARG, hr);
+            hr = arrakeener->Leaders(ArrakeenerSolaris, 1001, &psaNames, &psaValues);
+            Assert::AreEqual(E_INVALIDARG, hr);
+        }
+
+        TEST_METHOD(Stats)
+        {
+            LONGLONG delta = 0;
+            HRESULT hr = arrakeener->EatSpice(0, &delta);
+            Assert::AreEqual(E_INVALIDARG, hr);
+
+            BSTR text = nullptr;
+            hr = arrakeener->Stats(ArrakeenerSummary, &text);
+            Assert::AreEqual(S_OK, hr);
+            Assert::IsTrue(std::wstring(text).find(L"eat_spice calls=") != std::wstring::npos);
+            Assert::IsTrue(std::wstring(text).find(L" nonpos_spice=") != std::wstring::npos);
+            SysFreeString(text);
+
+            hr = arrakeener->Stats(ArrakeenerPrometheus, &text);
+            Assert::AreEqual(S_OK, hr);
+            Assert::IsTrue(std::wstring(text).find(L"# TYPE arrakis_latency_seconds histogram") != std::wstring::npos);
+            SysFreeString(text);
+
+            hr = arrakeener->Stats((ArrakeenerStatsFormat)2, &text);
+            Assert::AreEqual(E_INVALIDARG, hr);
+        }
+
+        TEST_METHOD(Trace)
+        {
+            BSTR text = nullptr;
+            HRESULT hr = arrakeener->Trace(VARIANT_TRUE, &text);
+            Assert::AreEqual(S_OK, hr);
+            Assert::AreEqual(0u, SysStringLen(text));
+            SysFreeString(text);
+            LONGLONG delta = 0;
+            arrakeener->MineSpice(0, &delta);
+            hr = arrakeener->Trace(VARIANT_FALSE, &text);
+            Assert::AreEqual(S_OK, hr);
+
+            // The server's spans, around the engine's
+            const std::wstring trace(text);
+            SysFreeString(text);
+            Assert::IsTrue(trace.find(L"{\"name\":\"MineSpice\",\"cat\":\"com\"") != std::wstring::npos);
+            Assert::IsTrue(trace.find(L"{\"name\":\"SetError\",\"cat\":\"com\"") != std::wstring::npos);
+            Assert::IsTrue(trace.find(L"{\"name\":\"lock\",\"cat\":\"engine\"") != std::wstring::npos);
+        }
     };
 }
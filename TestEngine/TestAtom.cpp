@@ -0,0 +1,115 @@
+// TestAtom.cpp: Unit tests for interned strings
+
+#include "core.h"
+#include "population.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    TEST(Atom, Intern)
+    {
+        Atom a(L"House Atreides");
+        Atom b(std::wstring(L"House ") + L"Atreides");
+        Atom c(L"House Harkonnen");
+
+        EXPECT_EQ(a, b);
+        EXPECT_EQ(&a.str(), &b.str());      // One shared entry
+        EXPECT_EQ(a.id(), b.id());
+        EXPECT_NE(a, c);
+        EXPECT_NE(a.id(), c.id());
+        EXPECT_LT(c.id(), Atom::count());
+
+        EXPECT_EQ(L"House Atreides", a);
+        EXPECT_EQ(std::wstring(L"House Atreides"), a);
+        EXPECT_NE(L"House Atreides", c);
+    }
+
+    TEST(Atom, Empty)
+    {
+        Atom empty;
+        EXPECT_TRUE(empty.empty());
+        EXPECT_EQ(0u, empty.id());
+        EXPECT_EQ(empty, Atom(L""));
+        EXPECT_EQ(L"", empty);
+    }
+
+    TEST(Atom, Hash)
+    {
+        std::unordered_map<Atom, int> houses;
+        ++houses[Atom(L"House Corrino")];
+        ++houses[Atom(L"House Corrino")];
+        ++houses[Atom(L"House Ordos")];
+        EXPECT_EQ(2u, houses.size());
+        EXPECT_EQ(2, houses[Atom(L"House Corrino")]);
+    }
+
+    TEST(Atom, Threads)
+    {
+        const int threads = std::max(4, (int)std::thread::hardware_concurrency());
+        const int names = 200;
+        std::vector<std::vector<Atom>> atoms(threads);
+
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]
+            {
+                for (int i = 0; i < names; ++i)
+                {
+                    atoms[t].push_back(Atom(L"Sietch " + std::to_wstring((i * 7 + t) % names)));
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+
+        for (int t = 0; t < threads; ++t)
+        {
+            for (int i = 0; i < names; ++i)
+            {
+                const int n = (i * 7 + t) % names;
+                EXPECT_EQ(atoms[0][(n * 143) % names], atoms[t][i]);   // 143 * 7 = 1 (mod 200)
+                EXPECT_EQ(L"Sietch " + std::to_wstring(n), atoms[t][i].str());
+            }
+        }
+    }
+
+    TEST(Atom, Arrakeener)
+    {
+        Arrakeener paul(1), jessica(2);
+        paul.set_affiliation(L"House Atreides");
+        jessica.set_affiliation(L"House Atreides");
+        jessica.set_occupation(L"Reverend Mother");
+
+        EXPECT_EQ(paul.affiliation_atom(), jessica.affiliation_atom());
+        EXPECT_EQ(L"House Atreides", paul.affiliation());
+        EXPECT_NE(paul.occupation_atom(), jessica.occupation_atom());
+        EXPECT_EQ(L"Reverend Mother", jessica.names().occupation);
+
+        jessica.set_occupation(nullptr);
+        EXPECT_EQ(Atom(), jessica.occupation_atom());
+    }
+
+    TEST(Atom, Census)
+    {
+        Population population(1);
+        const Ledger ledger = { 1, 1, 1 };
+        population.add(ledger, Names{ L"Paul", L"Atreides", L"House Atreides", L"Duke" });
+        population.add(ledger, Names{ L"Leto", L"Atreides", L"House Atreides", L"Duke" });
+        population.add(ledger, Names{ L"Feyd", L"Rautha", L"House Harkonnen", L"na-Baron" });
+        population.add(ledger);
+
+        const std::vector<size_t> houses = population.census(&Names::affiliation);
+        EXPECT_EQ(2u, houses[Atom(L"House Atreides").id()]);
+        EXPECT_EQ(1u, houses[Atom(L"House Harkonnen").id()]);
+        EXPECT_EQ(1u, houses[Atom().id()]);
+
+        const std::vector<size_t> occupations = population.census(&Names::occupation);
+        EXPECT_EQ(2u, occupations[Atom(L"Duke").id()]);
+    }
+}
@@ -0,0 +1,358 @@
+// TestCore.cpp: Unit tests for the portable Arrakeener
+
+#include "core.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    TEST(Rules, SafeAdd)
+    {
+        int64_t sum = -1;
+        EXPECT_TRUE(safe_add(1, 2, sum));
+        EXPECT_EQ(3, sum);
+        EXPECT_TRUE(safe_add(INT64_MAX, 0, sum));
+        EXPECT_EQ(INT64_MAX, sum);
+        EXPECT_FALSE(safe_add(INT64_MAX, 1, sum));
+        EXPECT_EQ(INT64_MAX, sum);
+    }
+
+    TEST(Rules, SafeMultiply)
+    {
+        int64_t prod = -1;
+        EXPECT_TRUE(safe_multiply(6, 7, prod));
+        EXPECT_EQ(42, prod);
+        EXPECT_TRUE(safe_multiply(INT64_MAX, 1, prod));
+        EXPECT_EQ(INT64_MAX, prod);
+        EXPECT_FALSE(safe_multiply(2, INT64_MAX / 2 + 1, prod));
+        EXPECT_EQ(INT64_MAX, prod);
+    }
+
+    TEST(Rules, StatusInfo)
+    {
+        EXPECT_STREQ("ok", status_info(Status::ok).name);
+        EXPECT_STREQ(L"Insufficient spice", status_info(Status::no_spice).message);
+        for (int i = 1; i < status_count; ++i)
+        {
+            const StatusInfo& info = status_info((Status)i);
+            EXPECT_NE(L'\0', info.message[0]);
+            EXPECT_EQ(i == (int)Status::nonpos_spice || i == (int)Status::no_harvester, info.invalid_argument);
+            for (int j = 0; j < i; ++j) EXPECT_STRNE(status_info((Status)j).name, info.name);
+        }
+    }
+
+    TEST(Rules, LedgerUnchangedOnFailure)
+    {
+        Ledger ledger = { 10, 1000, 3 };
+        Rng rng(1);
+        int64_t delta = -1;
+
+        EXPECT_EQ(Status::nonpos_spice, eat_spice(ledger, rng, 0, delta));
+        EXPECT_EQ(0, delta);
+        EXPECT_EQ(Status::no_spice, sell_spice(ledger, rng, 4, delta));
+        EXPECT_EQ(0, delta);
+        EXPECT_EQ(Status::no_harvester, mine_spice(ledger, rng, -1, delta));
+        EXPECT_EQ(0, delta);
+        EXPECT_EQ(Status::no_solaris, mine_spice(ledger, rng, 1, delta));
+        EXPECT_EQ(0, delta);
+
+        EXPECT_EQ(10, ledger.energy);
+        EXPECT_EQ(1000, ledger.solaris);
+        EXPECT_EQ(3, ledger.spice);
+    }
+
+    TEST(Rules, NoEnergy)
+    {
+        Ledger ledger = { 0, 1000000, 0 };
+        Rng rng(1);
+        int64_t delta;
+        EXPECT_EQ(Status::no_energy, mine_spice(ledger, rng, 1, delta));
+        EXPECT_EQ(0, delta);
+    }
+
+    TEST(Arrakeener, Names)
+    {
+        Arrakeener paul;
+        EXPECT_EQ(L"", paul.first_name());
+        EXPECT_EQ(L"", paul.last_name());
+        EXPECT_EQ(L"", paul.affiliation());
+        EXPECT_EQ(L"", paul.occupation());
+
+        paul.set_first_name(L"Paul");
+        paul.set_last_name(L"Atreides");
+        paul.set_affiliation(L"House Atreides");
+        paul.set_occupation(L"Kwisatz Haderach");
+        EXPECT_EQ(L"Paul", paul.first_name());
+        EXPECT_EQ(L"Atreides", paul.last_name());
+        EXPECT_EQ(L"House Atreides", paul.affiliation());
+        EXPECT_EQ(L"Kwisatz Haderach", paul.occupation());
+
+        paul.set_first_name(nullptr);
+        EXPECT_EQ(L"", paul.first_name());
+    }
+
+    TEST(Arrakeener, InitialValues)
+    {
+        Arrakeener arrakeener;
+        EXPECT_GE(arrakeener.energy(), 1);
+        EXPECT_LE(arrakeener.energy(), 100);
+        EXPECT_GE(arrakeener.solaris(), 200000);
+        EXPECT_LE(arrakeener.solaris(), 400000);
+        EXPECT_EQ(0, arrakeener.spice());
+    }
+
+    TEST(Arrakeener, Operations)
+    {
+        Arrakeener arrakeener(Ledger{ 100, 400000, 0 }, 1);
+        int64_t energy = arrakeener.energy();
+        int64_t solaris = arrakeener.solaris();
+        int64_t spice = 0;
+        int64_t delta_energy, delta_solaris, delta_spice;
+
+        // Try to sell and eat without spice
+        EXPECT_EQ(Status::no_spice, arrakeener.sell_spice(1, delta_solaris));
+        EXPECT_EQ(0, delta_solaris);
+        EXPECT_EQ(Status::no_spice, arrakeener.eat_spice(1, delta_energy));
+        EXPECT_EQ(0, delta_energy);
+
+        // Mine some spice
+        ASSERT_EQ(Status::ok, arrakeener.mine_spice(1, delta_spice));
+        spice += delta_spice;
+        EXPECT_EQ(spice, arrakeener.spice());
+        EXPECT_LT(arrakeener.energy(), energy);
+        EXPECT_LT(arrakeener.solaris(), solaris);
+        energy = arrakeener.energy();
+        solaris = arrakeener.solaris();
+
+        // Eat some spice
+        ASSERT_EQ(Status::ok, arrakeener.eat_spice(1, delta_energy));
+        energy += delta_energy;
+        spice -= 1;
+        EXPECT_EQ(energy, arrakeener.energy());
+        EXPECT_EQ(spice, arrakeener.spice());
+
+        // Sell the rest
+        if (spice > 0)
+        {
+            ASSERT_EQ(Status::ok, arrakeener.sell_spice(spice, delta_solaris));
+            solaris += delta_solaris;
+            spice = 0;
+        }
+        EXPECT_EQ(solaris, arrakeener.solaris());
+        EXPECT_EQ(spice, arrakeener.spice());
+
+        // Check integer overflow
+        EXPECT_EQ(Status::overflow, arrakeener.mine_spice(INT64_MAX - 1, delta_spice));
+        EXPECT_EQ(0, delta_spice);
+        EXPECT_EQ(energy, arrakeener.energy());
+        EXPECT_EQ(solaris, arrakeener.solaris());
+        EXPECT_EQ(spice, arrakeener.spice());
+    }
+
+    TEST(Arrakeener, Clone)
+    {
+        Arrakeener duncan;
+        duncan.set_first_name(L"Duncan");
+        duncan.set_last_name(L"Idaho");
+        duncan.set_affiliation(L"House Atreides");
+        duncan.set_occupation(L"Swordmaster");
+
+        Arrakeener ghola(duncan);
+        ghola.set_occupation(L"Ghola");
+
+        EXPECT_EQ(duncan.first_name(), ghola.first_name());
+        EXPECT_EQ(duncan.last_name(), ghola.last_name());
+        EXPECT_EQ(duncan.affiliation(), ghola.affiliation());
+        EXPECT_NE(duncan.occupation(), ghola.occupation());
+        EXPECT_EQ(duncan.energy(), ghola.energy());
+        EXPECT_EQ(duncan.solaris(), ghola.solaris());
+        EXPECT_EQ(duncan.spice(), ghola.spice());
+    }
+
+    TEST(Arrakeener, Seeded)
+    {
+        Arrakeener a(42), b(42);
+        EXPECT_EQ(a.energy(), b.energy());
+        EXPECT_EQ(a.solaris(), b.solaris());
+
+        int64_t delta_a, delta_b;
+        EXPECT_EQ(a.mine_spice(1, delta_a), b.mine_spice(1, delta_b));
+        EXPECT_EQ(delta_a, delta_b);
+    }
+
+    TEST(Arrakeener, CloneStream)
+    {
+        // A clone must not replay the random numbers of its source
+        Arrakeener source(42);
+        Arrakeener ghola(source);
+        int same = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            Arrakeener a(source), b(ghola);
+            int64_t delta_a, delta_b;
+            a.mine_spice(1, delta_a);
+            b.mine_spice(1, delta_b);
+            if (delta_a == delta_b) ++same;
+        }
+        EXPECT_LT(same, 8);
+    }
+
+    TEST(Arrakeener, CloneMany)
+    {
+        Arrakeener duncan(42);
+        duncan.set_first_name(L"Duncan");
+        duncan.set_affiliation(L"House Atreides");
+
+        std::vector<Arrakeener*> gholas;
+        {
+            Arrakeener::Clones clones = duncan.clones(3);
+            EXPECT_EQ(3u, clones.remaining());
+            while (clones.remaining()) gholas.push_back(new Arrakeener(clones));
+        }
+        gholas[0]->set_first_name(L"Hayt");
+
+        EXPECT_EQ(L"Duncan", duncan.first_name());
+        EXPECT_EQ(L"Hayt", gholas[0]->first_name());
+        int same = 0;
+        int64_t delta_a, delta_b;
+        for (Arrakeener* ghola : gholas)
+        {
+            EXPECT_EQ(L"House Atreides", ghola->affiliation());
+            EXPECT_EQ(duncan.energy(), ghola->energy());
+            EXPECT_EQ(duncan.solaris(), ghola->solaris());
+        }
+        for (int i = 0; i < 8; ++i)
+        {
+            gholas[1]->mine_spice(1, delta_a);
+            gholas[2]->mine_spice(1, delta_b);
+            if (delta_a == delta_b) ++same;
+        }
+        EXPECT_LT(same, 8);
+        for (Arrakeener* ghola : gholas) delete ghola;
+    }
+
+    TEST(Arrakeener, CloneManyUnused)
+    {
+        // References held for clones that are never made are given back
+        Arrakeener duncan(42);
+        duncan.set_first_name(L"Duncan");
+        {
+            Arrakeener::Clones clones = duncan.clones(5);
+            Arrakeener one(clones);
+            Arrakeener::Clones moved(std::move(clones));
+            EXPECT_EQ(0u, clones.remaining());
+            EXPECT_EQ(4u, moved.remaining());
+        }
+        duncan.set_first_name(L"Hayt");
+        EXPECT_EQ(L"Hayt", duncan.first_name());
+        EXPECT_EQ(0u, duncan.clones(0).remaining());
+    }
+
+    TEST(Arrakeener, Batch)
+    {
+        // A batch must behave exactly like the same sequence of single calls
+        Arrakeener a(42), b(42);
+        const int64_t harvesters[] = { 1, 0, 1, INT64_MAX - 1, 1 };
+        const size_t n = sizeof(harvesters) / sizeof(harvesters[0]);
+        int64_t deltas[n];
+        Status results[n];
+
+        size_t succeeded = a.mine_spice_batch(harvesters, n, deltas, results);
+
+        size_t expected = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            int64_t delta;
+            Status status = b.mine_spice(harvesters[i], delta);
+            EXPECT_EQ(status, results[i]);
+            EXPECT_EQ(delta, deltas[i]);
+            if (status == Status::ok) ++expected;
+        }
+        EXPECT_EQ(expected, succeeded);
+        EXPECT_EQ(Status::no_harvester, results[1]);
+        EXPECT_EQ(b.energy(), a.energy());
+        EXPECT_EQ(b.solaris(), a.solaris());
+        EXPECT_EQ(b.spice(), a.spice());
+
+        // Eat and sell what was mined, one unit at a time, plus one too many
+        const int64_t spice = a.spice();
+        std::vector<int64_t> units((size_t)spice + 1, 1);
+        std::vector<int64_t> delta_energy(units.size());
+        std::vector<Status> eat_results(units.size());
+        EXPECT_EQ((size_t)spice, a.eat_spice_batch(units.data(), units.size(), delta_energy.data(), eat_results.data()));
+        EXPECT_EQ(Status::no_spice, eat_results.back());
+        EXPECT_EQ(0, delta_energy.back());
+        EXPECT_EQ(0, a.spice());
+
+        int64_t delta_solaris;
+        Status sell_result;
+        EXPECT_EQ(0u, a.sell_spice_batch(units.data(), 1, &delta_solaris, &sell_result));
+        EXPECT_EQ(Status::no_spice, sell_result);
+    }
+
+    // Records what an observer is told
+
+    struct Recorder : Observer
+    {
+        std::vector<std::string> events;
+        Ledger ledger = {};
+
+        void attached(const Arrakeener&, const State& state) noexcept override
+        {
+            events.push_back("attached");
+            ledger = state.ledger;
+        }
+
+        void renamed(const Arrakeener&, const Names& before, const Names& after) noexcept override
+        {
+            events.push_back(before.first_name == after.first_name ? "renamed" : "renamed first");
+        }
+
+        void changed(const Arrakeener&, Change change, int64_t arg, const Ledger& before, const Ledger& after) noexcept override
+        {
+            events.push_back("changed " + std::to_string((int)change) + " " + std::to_string(arg));
+            EXPECT_EQ(ledger.energy, before.energy);
+            EXPECT_EQ(ledger.spice, before.spice);
+            ledger = after;
+        }
+
+        void detached(const Arrakeener&) noexcept override
+        {
+            events.push_back("detached");
+        }
+    };
+
+    TEST(Arrakeener, Observer)
+    {
+        Recorder recorder;
+        {
+            Arrakeener a(Ledger{ 100, 1000000, 0 }, 1);
+            a.observe(&recorder);
+            a.set_first_name(L"Leto");
+            a.set_occupation(L"Duke");
+
+            int64_t delta;
+            EXPECT_EQ(Status::ok, a.mine_spice(2, delta));
+            EXPECT_EQ(Status::nonpos_spice, a.eat_spice(0, delta));     // Failures are not reported
+            const int64_t units[] = { 1, 1 };
+            int64_t deltas[2];
+            Status results[2];
+            a.sell_spice_batch(units, 2, deltas, results);
+            EXPECT_EQ(a.energy(), recorder.ledger.energy);
+            EXPECT_EQ(a.solaris(), recorder.ledger.solaris);
+            EXPECT_EQ(a.spice(), recorder.ledger.spice);
+
+            Arrakeener b(a);                // Clones are observed
+            a.observe(nullptr);
+        }
+        const std::vector<std::string> expected =
+        {
+            "attached", "renamed first", "renamed", "changed 2 2", "changed 4 2",
+            "attached", "detached", "detached"
+        };
+        EXPECT_EQ(expected, recorder.events);
+    }
+}
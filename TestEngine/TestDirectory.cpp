@@ -0,0 +1,157 @@
+// TestDirectory.cpp: Unit tests for the concurrent directory
+
+#include "directory.h"
+#include "core.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    TEST(Directory, FindInsertRemove)
+    {
+        Directory<int> directory;
+        int value = 0;
+        EXPECT_FALSE(directory.find(L"Paul", L"Atreides", value));
+        EXPECT_TRUE(directory.insert(L"Paul", L"Atreides", 1));
+        EXPECT_TRUE(directory.insert(L"Leto", L"Atreides", 2));
+        EXPECT_TRUE(directory.insert(L"Paul", L"", 3));
+        EXPECT_FALSE(directory.insert(L"Paul", L"Atreides", 4));    // Taken
+        EXPECT_EQ(3u, directory.size());
+
+        EXPECT_TRUE(directory.find(L"Paul", L"Atreides", value));
+        EXPECT_EQ(1, value);
+        EXPECT_TRUE(directory.find(L"Paul", L"", value));
+        EXPECT_EQ(3, value);
+        EXPECT_FALSE(directory.find(L"PaulAtreides", L"", value));
+
+        EXPECT_FALSE(directory.remove(L"Leto", L"Atreides", 5));     // Another value
+        EXPECT_TRUE(directory.remove(L"Leto", L"Atreides", 2));
+        EXPECT_FALSE(directory.remove(L"Leto", L"Atreides"));
+        EXPECT_FALSE(directory.find(L"Leto", L"Atreides", value));
+        EXPECT_TRUE(directory.insert(L"Leto", L"Atreides", 6));
+        EXPECT_TRUE(directory.find(L"Leto", L"Atreides", value));
+        EXPECT_EQ(6, value);
+        EXPECT_EQ(3u, directory.size());
+    }
+
+    TEST(Directory, Grow)
+    {
+        const int n = 100000;
+        Directory<int> directory;
+        for (int i = 0; i < n; ++i) ASSERT_TRUE(directory.insert(std::to_wstring(i), L"Fremen", i));
+        EXPECT_EQ((size_t)n, directory.size());
+        for (int i = 0; i < n; ++i)
+        {
+            int value = -1;
+            ASSERT_TRUE(directory.find(std::to_wstring(i), L"Fremen", value));
+            EXPECT_EQ(i, value);
+        }
+        for (int i = 0; i < n; i += 2) ASSERT_TRUE(directory.remove(std::to_wstring(i), L"Fremen"));
+        EXPECT_EQ((size_t)n / 2, directory.size());
+    }
+
+    // Entries present for a whole enumeration come back exactly once, even
+    // as the tables grow under the cursor
+
+    TEST(Directory, Enumerate)
+    {
+        const int n = 5000;
+        Directory<int> directory;
+        for (int i = 0; i < n; ++i) directory.insert(std::to_wstring(i), L"Harkonnen", i);
+
+        std::vector<int> seen;
+        Directory<int>::Cursor cursor;
+        int added = 0;
+        while (!cursor.done())
+        {
+            const size_t before = seen.size();
+            const size_t count = directory.next(cursor, 100, seen);
+            EXPECT_EQ(before + count, seen.size());
+            EXPECT_LE(count, 110u);
+            for (int i = 0; i < 200; ++i)
+            {
+                directory.insert(std::to_wstring(added), L"Corrino", n + added);
+                ++added;
+            }
+        }
+
+        std::multiset<int> original;
+        for (int value : seen)
+        {
+            if (value < n) original.insert(value);
+        }
+        EXPECT_EQ((size_t)n, original.size());
+        for (int i = 0; i < n; ++i) EXPECT_EQ(1u, original.count(i)) << i;
+
+        // An empty directory is done in one call
+        Directory<int> empty;
+        Directory<int>::Cursor start;
+        std::vector<int> none;
+        EXPECT_EQ(0u, empty.next(start, 10, none));
+        EXPECT_TRUE(start.done());
+    }
+
+    // Readers look up objects while writers register, unregister and grow
+    // the tables; handles keep found objects alive after they are removed
+
+    TEST(Directory, Concurrent)
+    {
+        using Handle = std::shared_ptr<Arrakeener>;
+        const int writers = 2, readers = 4, names = 2000;
+        Directory<Handle> directory;
+        std::atomic<bool> stop{ false };
+        std::atomic<long> found{ 0 };
+
+        std::vector<std::thread> threads;
+        for (int w = 0; w < writers; ++w)
+        {
+            threads.emplace_back([&, w]
+            {
+                for (int round = 0; round < 5; ++round)
+                {
+                    for (int i = w; i < names; i += writers)
+                    {
+                        auto obj = std::make_shared<Arrakeener>((uint64_t)i);
+                        directory.insert(std::to_wstring(i), L"Atreides", obj);
+                    }
+                    for (int i = w; i < names; i += writers) directory.remove(std::to_wstring(i), L"Atreides");
+                }
+                for (int i = w; i < names; i += writers) directory.insert(std::to_wstring(i), L"Atreides", std::make_shared<Arrakeener>((uint64_t)i));
+            });
+        }
+        for (int r = 0; r < readers; ++r)
+        {
+            threads.emplace_back([&, r]
+            {
+                int i = r;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    Handle obj;
+                    if (directory.find(std::to_wstring(i), L"Atreides", obj))
+                    {
+                        int64_t delta;
+                        obj->mine_spice(1, delta);
+                        ++found;
+                    }
+                    i = (i + 7) % names;
+                }
+            });
+        }
+        for (int w = 0; w < writers; ++w) threads[w].join();
+        stop = true;
+        for (size_t t = writers; t < threads.size(); ++t) threads[t].join();
+
+        EXPECT_EQ((size_t)names, directory.size());
+        std::vector<Handle> all;
+        Directory<Handle>::Cursor cursor;
+        while (!cursor.done()) directory.next(cursor, 64, all);
+        EXPECT_EQ((size_t)names, all.size());
+    }
+}
@@ -0,0 +1,126 @@
+// TestEncoding.cpp: Unit tests for the state snapshot and its encoding
+
+#include "encoding.h"
+#include <gtest/gtest.h>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    State make_state()
+    {
+        State state;
+        state.names.first_name = L"Paul";
+        state.names.last_name = L"Atreides";
+        state.names.affiliation = L"House Atreides";
+        state.names.occupation = L"Kwisatz Haderach \u00E9\u4E2D";
+        state.ledger = { 42, INT64_MAX, -1 };
+        return state;
+    }
+
+    void expect_equal(const State& expected, const State& actual)
+    {
+        EXPECT_EQ(expected.names.first_name, actual.names.first_name);
+        EXPECT_EQ(expected.names.last_name, actual.names.last_name);
+        EXPECT_EQ(expected.names.affiliation, actual.names.affiliation);
+        EXPECT_EQ(expected.names.occupation, actual.names.occupation);
+        EXPECT_EQ(expected.ledger.energy, actual.ledger.energy);
+        EXPECT_EQ(expected.ledger.solaris, actual.ledger.solaris);
+        EXPECT_EQ(expected.ledger.spice, actual.ledger.spice);
+    }
+
+    TEST(Encoding, RoundTrip)
+    {
+        const State state = make_state();
+        std::vector<uint8_t> bytes;
+        encode(state, bytes);
+
+        State decoded;
+        EXPECT_EQ(bytes.size(), decode(bytes.data(), bytes.size(), decoded));
+        expect_equal(state, decoded);
+    }
+
+    TEST(Encoding, Layout)
+    {
+        // The layout is fixed, independent of the platform
+        State state;
+        state.names.first_name = L"A";
+        state.ledger = { 1, 256, -1 };
+        std::vector<uint8_t> bytes;
+        encode(state, bytes);
+
+        const std::vector<uint8_t> expected =
+        {
+            state_version,
+            1, 0, 0, 0, 0, 0, 0, 0,
+            0, 1, 0, 0, 0, 0, 0, 0,
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+            1, 0, 0, 0, 'A', 0,
+            0, 0, 0, 0,
+            0, 0, 0, 0,
+            0, 0, 0, 0
+        };
+        EXPECT_EQ(expected, bytes);
+    }
+
+    TEST(Encoding, Supplementary)
+    {
+        // Characters outside the BMP are a surrogate pair on every platform
+        State state;
+        state.names.first_name = sizeof(wchar_t) > 2 ? std::wstring(1, (wchar_t)0x1F3DC) : std::wstring(L"\xD83C\xDFDC");
+        std::vector<uint8_t> bytes;
+        encode(state, bytes);
+        EXPECT_EQ(2u, bytes[25]);
+        EXPECT_EQ(0xD83Cu, bytes[29] | (bytes[30] << 8));
+        EXPECT_EQ(0xDFDCu, bytes[31] | (bytes[32] << 8));
+
+        State decoded;
+        ASSERT_NE(0u, decode(bytes.data(), bytes.size(), decoded));
+        EXPECT_EQ(state.names.first_name, decoded.names.first_name);
+    }
+
+    TEST(Encoding, Truncated)
+    {
+        std::vector<uint8_t> bytes;
+        encode(make_state(), bytes);
+
+        State decoded;
+        for (size_t n = 0; n < bytes.size(); ++n)
+        {
+            EXPECT_EQ(0u, decode(bytes.data(), n, decoded));
+        }
+
+        bytes[0] = state_version + 1;
+        EXPECT_EQ(0u, decode(bytes.data(), bytes.size(), decoded));
+    }
+
+    TEST(Encoding, Sequence)
+    {
+        // Records can be concatenated
+        std::vector<uint8_t> bytes;
+        encode(make_state(), bytes);
+        encode(State(), bytes);
+
+        State first, second;
+        size_t n = decode(bytes.data(), bytes.size(), first);
+        ASSERT_NE(0u, n);
+        EXPECT_EQ(bytes.size() - n, decode(bytes.data() + n, bytes.size() - n, second));
+        expect_equal(make_state(), first);
+        EXPECT_EQ(L"", second.names.first_name);
+    }
+
+    TEST(Encoding, Snapshot)
+    {
+        Arrakeener paul(1);
+        paul.set_first_name(L"Paul");
+        paul.set_occupation(L"Duke");
+
+        const State state = paul.state();
+        EXPECT_EQ(L"Paul", state.names.first_name);
+        EXPECT_EQ(L"", state.names.last_name);
+        EXPECT_EQ(L"Duke", state.names.occupation);
+        EXPECT_EQ(paul.energy(), state.ledger.energy);
+        EXPECT_EQ(paul.solaris(), state.ledger.solaris);
+        EXPECT_EQ(paul.spice(), state.ledger.spice);
+    }
+}
@@ -0,0 +1,147 @@
+// TestExecutor.cpp: Unit tests for futures and asynchronous operations
+
+#include "executor.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    TEST(Future, Ready)
+    {
+        Future<int> future = Future<int>::ready(7);
+        EXPECT_TRUE(future.is_ready());
+        EXPECT_EQ(7, future.get());
+        EXPECT_FALSE(future.valid());
+    }
+
+    TEST(Future, Then)
+    {
+        Promise<int> promise;
+        Future<std::string> future = promise.future()
+            .then([](int x) { return x * 2; })
+            .then([](int x) { return std::to_string(x); });
+        EXPECT_FALSE(future.is_ready());
+
+        std::thread([&] { promise.set_value(21); }).join();
+        EXPECT_EQ("42", future.get());
+
+        // Continuations of a completed future run right away
+        int seen = 0;
+        Future<int>::ready(3).then([&](int x) { return seen = x; });
+        EXPECT_EQ(3, seen);
+    }
+
+    TEST(Future, Exceptions)
+    {
+        Promise<int> promise;
+        Future<int> future = promise.future().then([](int x) -> int { throw std::runtime_error("then"); return x; });
+        promise.set_value(1);
+        EXPECT_THROW(future.get(), std::runtime_error);
+
+        Future<int> broken;
+        {
+            Promise<int> unsatisfied;
+            broken = unsatisfied.future().then([](int x) { return x + 1; });
+        }
+        EXPECT_THROW(broken.get(), std::future_error);
+    }
+
+
+    // Asynchronous operations give the same results, in the same order, as
+    // the blocking calls on an identical object
+
+    TEST(Executor, MatchesBlocking)
+    {
+        Scheduler scheduler(3);
+        Executor executor(scheduler, 4);
+        Arrakeener sync(42), async(42);
+
+        std::vector<Future<OperationResult>> futures;
+        std::vector<OperationResult> expected;
+        for (int i = 0; i < 300; ++i)
+        {
+            OperationResult result = { Status::ok, 0 };
+            switch (i % 3)
+            {
+            case 0:
+                result.status = sync.mine_spice(2, result.delta);
+                futures.push_back(executor.mine_spice(async, 2));
+                break;
+            case 1:
+                result.status = sync.sell_spice(1, result.delta);
+                futures.push_back(executor.sell_spice(async, 1));
+                break;
+            case 2:
+                result.status = sync.eat_spice(1, result.delta);
+                futures.push_back(executor.eat_spice(async, 1));
+                break;
+            }
+            expected.push_back(result);
+        }
+
+        for (size_t i = 0; i < futures.size(); ++i)
+        {
+            OperationResult result = futures[i].get();
+            EXPECT_EQ(expected[i].status, result.status) << i;
+            EXPECT_EQ(expected[i].delta, result.delta) << i;
+        }
+        EXPECT_EQ(sync.energy(), async.energy());
+        EXPECT_EQ(sync.solaris(), async.solaris());
+        EXPECT_EQ(sync.spice(), async.spice());
+    }
+
+    TEST(Executor, Clone)
+    {
+        Executor executor;
+        Arrakeener obj(1);
+        obj.set_first_name(L"Paul");
+        executor.mine_spice(obj, 1);
+        std::unique_ptr<Arrakeener> clone = executor.clone(obj).get();
+        EXPECT_EQ(L"Paul", clone->first_name());
+        EXPECT_EQ(obj.spice(), clone->spice());     // Cloned after mining
+    }
+
+    TEST(Executor, Post)
+    {
+        Executor executor;
+        Arrakeener obj(1);
+        Future<int64_t> future = executor.mine_spice(obj, 1)
+            .then([](OperationResult result) { return result.delta; });
+        EXPECT_THROW(executor.post(obj, []() -> int { throw std::logic_error("post"); }).get(), std::logic_error);
+        EXPECT_GE(future.get(), 0);
+    }
+
+    // One thread keeps thousands of operations in flight over many objects
+
+    TEST(Executor, ManyInFlight)
+    {
+        Scheduler scheduler(4);
+        const size_t people = 1000;
+        const int rounds = 10;
+        std::vector<std::unique_ptr<Arrakeener>> population;
+        for (size_t i = 0; i < people; ++i) population.emplace_back(new Arrakeener(i));
+
+        std::vector<int64_t> mined(people);
+        std::vector<Future<OperationResult>> futures;
+        {
+            Executor executor(scheduler);
+            for (int round = 0; round < rounds; ++round)
+            {
+                for (size_t i = 0; i < people; ++i) futures.push_back(executor.mine_spice(*population[i], 1));
+            }
+        }   // Destruction finishes them all
+
+        for (size_t i = 0; i < futures.size(); ++i)
+        {
+            ASSERT_TRUE(futures[i].is_ready());
+            OperationResult result = futures[i].get();
+            if (result.status == Status::ok) mined[i % people] += result.delta;
+        }
+        for (size_t i = 0; i < people; ++i) EXPECT_EQ(mined[i], population[i]->spice()) << i;
+    }
+}
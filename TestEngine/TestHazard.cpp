@@ -0,0 +1,189 @@
+// TestHazard.cpp: Unit and stress tests for hazard pointers and names
+
+#include "core.h"
+#include "hazard.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    struct Counted
+    {
+        static std::atomic<int> live;
+        int value;
+        explicit Counted(int value) : value(value) { ++live; }
+        ~Counted() { value = -1; --live; }
+    };
+    std::atomic<int> Counted::live(0);
+
+
+    TEST(Hazard, ReclaimUnprotected)
+    {
+        std::atomic<Counted*> shared(new Counted(1));
+        Counted* old = shared.exchange(new Counted(2));
+        hazard::retire(old);
+        hazard::scan();
+        EXPECT_EQ(1, Counted::live.load());
+        delete shared.load();
+    }
+
+    TEST(Hazard, KeepProtected)
+    {
+        std::atomic<Counted*> shared(new Counted(1));
+        {
+            hazard::Guard guard;
+            Counted* p = guard.protect(shared);
+            hazard::retire(shared.exchange(new Counted(2)));
+            hazard::scan();
+            EXPECT_EQ(2, Counted::live.load());
+            EXPECT_EQ(1, p->value);     // Still readable
+        }
+        hazard::scan();
+        EXPECT_EQ(1, Counted::live.load());
+        delete shared.load();
+    }
+
+    TEST(Hazard, NestedTooDeep)
+    {
+        std::atomic<Counted*> shared(new Counted(1));
+        {
+            hazard::Guard guards[hazard::slots_per_thread];
+            for (hazard::Guard& guard : guards) guard.protect(shared);
+            EXPECT_THROW(hazard::Guard extra, std::logic_error);
+        }
+        hazard::Guard guard;                // The failure took no slot
+        EXPECT_EQ(1, guard.protect(shared)->value);
+        guard.reset();
+        delete shared.load();
+    }
+
+    // A record retired by one thread while another protects it survives
+    // the retiring thread's exit and is reclaimed later
+
+    TEST(Hazard, Orphans)
+    {
+        std::atomic<Counted*> shared(new Counted(1));
+        hazard::Guard guard;
+        Counted* p = guard.protect(shared);
+        std::thread([&]
+        {
+            hazard::retire(shared.exchange(new Counted(2)));
+        }).join();
+        EXPECT_EQ(1, p->value);
+        guard.reset();
+        hazard::scan();
+        EXPECT_EQ(1, Counted::live.load());
+        delete shared.load();
+    }
+
+    // Readers never see a partly written or reclaimed name while a writer
+    // renames concurrently; each name is one character repeated
+
+    bool uniform(const std::wstring& name)
+    {
+        return name.size() == 100 && std::all_of(name.begin(), name.end(), [&](wchar_t c) { return c == name[0]; });
+    }
+
+    TEST(Hazard, RenameWhileReading)
+    {
+        const int renames = 20000;
+        const int readers = std::max(4, (int)std::thread::hardware_concurrency());
+        const std::wstring names[] = { std::wstring(100, L'P'), std::wstring(100, L'U') };
+
+        Arrakeener paul(1);
+        paul.set_first_name(names[0].c_str());
+        paul.set_last_name(names[0].c_str());
+        std::atomic<bool> done(false);
+        std::atomic<int> bad(0);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < readers; ++t)
+        {
+            threads.emplace_back([&]
+            {
+                while (!done.load(std::memory_order_relaxed))
+                {
+                    if (!uniform(paul.first_name())) ++bad;
+
+                    const Names snapshot = paul.names();
+                    if (!uniform(snapshot.first_name) || !uniform(snapshot.last_name)) ++bad;
+
+                    Arrakeener clone(paul);
+                    if (!uniform(clone.last_name())) ++bad;
+                }
+            });
+        }
+
+        for (int i = 0; i < renames; ++i)
+        {
+            paul.set_first_name(names[(i + 1) % 2].c_str());
+            paul.set_last_name(names[i % 2].c_str());
+        }
+        done = true;
+        for (auto& thread : threads) thread.join();
+
+        EXPECT_EQ(0, bad.load());
+        EXPECT_EQ(names[0], paul.first_name());
+        EXPECT_EQ(names[1], paul.last_name());
+    }
+
+    // The writer renames to i, then eats one unit, so the state named i
+    // has either i - 1 or i units gone; anything else mixes two instants
+    TEST(Hazard, StateWhileRenamingAndEating)
+    {
+        const int steps = 20000;
+        const int readers = std::max(2, (int)std::thread::hardware_concurrency());
+        const int64_t spice = steps + 10;
+
+        Arrakeener paul(Ledger{ 100, 1000, spice }, 1);
+        paul.set_first_name(L"0");
+        std::atomic<bool> done(false);
+        std::atomic<int> bad(0);
+        std::atomic<int> seen(0);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < readers; ++t)
+        {
+            threads.emplace_back([&]
+            {
+                while (!done.load(std::memory_order_relaxed))
+                {
+                    const State state = paul.state();
+                    const int64_t i = std::stoll(state.names.first_name);
+                    const int64_t gone = spice - state.ledger.spice;
+                    if (gone != i && gone != i - 1) ++bad;
+                    ++seen;
+                }
+            });
+        }
+
+        int64_t delta;
+        for (int i = 1; i <= steps; ++i)
+        {
+            paul.set_first_name(std::to_wstring(i).c_str());
+            if (paul.eat_spice(1, delta) != Status::ok) ++bad;
+        }
+        done = true;
+        for (auto& thread : threads) thread.join();
+
+        EXPECT_EQ(0, bad.load());
+        EXPECT_GT(seen.load(), 0);
+    }
+
+    TEST(Hazard, CloneSharesUntilRenamed)
+    {
+        Arrakeener duncan(1);
+        duncan.set_first_name(L"Duncan");
+        Arrakeener ghola(duncan);
+        ghola.set_first_name(L"Hayt");
+        EXPECT_EQ(L"Duncan", duncan.first_name());
+        EXPECT_EQ(L"Hayt", ghola.first_name());
+    }
+}
@@ -0,0 +1,118 @@
+// TestHistogram.cpp: Unit tests for latency histograms
+
+#include "histogram.h"
+#include "rng.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    TEST(Histogram, Empty)
+    {
+        Histogram histogram;
+        EXPECT_EQ(0u, histogram.count());
+        EXPECT_EQ(0, histogram.percentile(50));
+        EXPECT_EQ(0, histogram.max());
+        EXPECT_EQ(0, histogram.mean());
+    }
+
+
+    TEST(Histogram, SmallValuesExact)
+    {
+        Histogram histogram(1000000, 7);
+        for (int64_t v = 1; v <= 100; ++v) histogram.record(v);
+        EXPECT_EQ(100u, histogram.count());
+        EXPECT_EQ(1, histogram.min());
+        EXPECT_EQ(100, histogram.max());
+        EXPECT_EQ(50, histogram.percentile(50));
+        EXPECT_EQ(99, histogram.percentile(99));
+        EXPECT_EQ(100, histogram.percentile(100));
+        EXPECT_EQ(1, histogram.percentile(0));
+        EXPECT_DOUBLE_EQ(50.5, histogram.mean());
+    }
+
+
+    // Against sorted samples spread over six orders of magnitude
+
+    TEST(Histogram, RelativeError)
+    {
+        Histogram histogram;
+        Rng rng(11);
+        std::vector<int64_t> samples;
+        for (int i = 0; i < 100000; ++i)
+        {
+            const int64_t value = (int64_t)std::exp(rng.range(0, 1400) / 100.0);
+            samples.push_back(value);
+            histogram.record(value);
+        }
+        std::sort(samples.begin(), samples.end());
+        for (double percent : { 10.0, 50.0, 90.0, 99.0, 99.9 })
+        {
+            const int64_t exact = samples[(size_t)std::ceil(percent / 100 * samples.size()) - 1];
+            const int64_t estimate = histogram.percentile(percent);
+            EXPECT_GE(estimate, exact);
+            EXPECT_LE(estimate, exact + exact / 128 + 1) << percent;
+        }
+        EXPECT_EQ(samples.back(), histogram.max());
+        EXPECT_EQ(samples.back(), histogram.percentile(100));
+    }
+
+
+    TEST(Histogram, BucketsCoverEveryValue)
+    {
+        Histogram histogram(1 << 20, 4);
+        int64_t expected = 0;
+        histogram.record(0);
+        for (int64_t v = 1; v < (1 << 20); v = v * 5 / 4 + 1) histogram.record(v);
+        histogram.for_each([&](int64_t lowest, int64_t highest, uint64_t)
+        {
+            EXPECT_GE(lowest, expected);
+            EXPECT_LE(lowest, highest);
+            EXPECT_LE(highest - lowest, std::max<int64_t>(lowest >> 4, 0));
+            expected = highest + 1;
+        });
+    }
+
+
+    TEST(Histogram, BucketIndexes)
+    {
+        // Counts kept by bucket add back into the same buckets
+        Histogram histogram(1 << 20, 3), copy(1 << 20, 3);
+        std::vector<uint64_t> counts(histogram.buckets());
+        for (int64_t v = 0; v < (1 << 20); v = v * 3 / 2 + 1)
+        {
+            histogram.record(v);
+            ++counts[histogram.bucket(v)];
+            EXPECT_LE(histogram.bucket_lowest(histogram.bucket(v)), v);
+            EXPECT_GE(histogram.bucket_highest(histogram.bucket(v)), v);
+        }
+        EXPECT_EQ(histogram.buckets() - 1, histogram.bucket((int64_t)1 << 30));  // Clamped to the range
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            if (counts[i]) copy.record(histogram.bucket_highest(i), counts[i]);
+        }
+        EXPECT_EQ(histogram.count(), copy.count());
+        for (double p : { 10.0, 50.0, 90.0, 99.0 }) EXPECT_EQ(histogram.bucket(histogram.percentile(p)), copy.bucket(copy.percentile(p)));
+    }
+
+
+    TEST(Histogram, MergeAndClamp)
+    {
+        Histogram a(1000), b(1000);
+        a.record(10, 3);
+        b.record(20000);                    // Beyond the range
+        b.record(-5);
+        a.merge(b);
+        EXPECT_EQ(5u, a.count());
+        EXPECT_EQ(0, a.min());
+        EXPECT_EQ(1000, a.max());
+        EXPECT_EQ(10, a.percentile(80));
+        a.reset();
+        EXPECT_EQ(0u, a.count());
+        EXPECT_EQ(0, a.percentile(99));
+    }
+}
@@ -0,0 +1,285 @@
+// TestJournal.cpp: Unit tests for the journal and its replay
+
+#include "journal.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    class Journaled : public ::testing::Test
+    {
+    protected:
+        std::string path;
+
+        void SetUp() override
+        {
+            const auto* info = ::testing::UnitTest::GetInstance()->current_test_info();
+            path = (std::filesystem::temp_directory_path() / (std::string("arrakis_") + info->name() + ".journal")).string();
+        }
+
+        void TearDown() override
+        {
+            std::remove(path.c_str());
+            std::remove((path + ".old").c_str());
+        }
+
+        static void expect_state(const Arrakeener& obj, const State& state)
+        {
+            const State expected = obj.state();
+            EXPECT_EQ(expected.names.first_name, state.names.first_name);
+            EXPECT_EQ(expected.names.last_name, state.names.last_name);
+            EXPECT_EQ(expected.names.affiliation, state.names.affiliation);
+            EXPECT_EQ(expected.names.occupation, state.names.occupation);
+            EXPECT_EQ(expected.ledger.energy, state.ledger.energy);
+            EXPECT_EQ(expected.ledger.solaris, state.ledger.solaris);
+            EXPECT_EQ(expected.ledger.spice, state.ledger.spice);
+        }
+
+        // Find the replayed state matching obj's first name
+        static const State* find(const Replay& replay, const std::wstring& first_name)
+        {
+            for (const auto& entry : replay.objects)
+            {
+                if (entry.second.names.first_name == first_name) return &entry.second;
+            }
+            return nullptr;
+        }
+    };
+
+
+    TEST_F(Journaled, RoundTrip)
+    {
+        std::vector<std::unique_ptr<Arrakeener>> live;
+        {
+            Journal journal(path);
+            auto paul = std::make_unique<Arrakeener>(Ledger{ 1000, 100000000, 0 }, 1);
+            journal.attach(*paul);
+            paul->set_first_name(L"Paul");
+            paul->set_last_name(L"Atreides");
+            paul->set_affiliation(L"Fremen");
+
+            int64_t delta;
+            for (int i = 0; i < 20; ++i) paul->mine_spice(3, delta);
+            paul->eat_spice(2, delta);
+            paul->sell_spice(5, delta);
+            const Step steps[] = { { Op::mine, 1, { Field::spice, Compare::always, 0 }, 4 } };
+            StepResult results[1];
+            size_t failed;
+            EXPECT_EQ(Status::ok, paul->transact(steps, 1, results, failed));
+
+            // A clone and a family of clones, each renamed to tell them apart
+            auto alia = std::make_unique<Arrakeener>(*paul);
+            alia->set_first_name(L"Alia");
+            alia->mine_spice(1, delta);
+            Arrakeener::Clones clones = paul->clones(2);
+            auto leto = std::make_unique<Arrakeener>(clones);
+            auto ghanima = std::make_unique<Arrakeener>(clones);
+            leto->set_first_name(L"Leto");
+            ghanima->set_first_name(L"Ghanima");
+
+            // Destroyed objects do not come back
+            auto jessica = std::make_unique<Arrakeener>(2);
+            journal.attach(*jessica);
+            jessica->set_first_name(L"Jessica");
+            jessica.reset();
+
+            journal.flush();
+            EXPECT_FALSE(journal.failed());
+            EXPECT_GE(journal.records(), 30u);
+
+            live.push_back(std::move(paul));
+            live.push_back(std::move(alia));
+            live.push_back(std::move(leto));
+            live.push_back(std::move(ghanima));
+
+            Replay replay = Journal::replay(path);
+            EXPECT_TRUE(replay.complete);
+            EXPECT_EQ(journal.records(), replay.records);
+            ASSERT_EQ(4u, replay.objects.size());
+            for (const auto& obj : live)
+            {
+                const State* state = find(replay, obj->first_name());
+                ASSERT_NE(nullptr, state);
+                expect_state(*obj, *state);
+            }
+            for (auto& obj : live) obj->observe(nullptr);
+        }
+    }
+
+    // Closing keeps the objects; a restart recreates them in a new journal,
+    // in the order created, and a restart cut short is replayed again
+
+    TEST_F(Journaled, Restart)
+    {
+        std::vector<std::unique_ptr<Arrakeener>> before;
+        {
+            Journal journal(path);
+            const wchar_t* names[] = { L"Duncan", L"Gurney", L"Thufir" };
+            int64_t delta;
+            for (int i = 0; i < 3; ++i)
+            {
+                before.emplace_back(new Arrakeener(Ledger{ 1000, 100000000, 0 }, (uint64_t)i));
+                journal.attach(*before.back());
+                before.back()->set_first_name(names[i]);
+                before.back()->mine_spice(i + 1, delta);
+            }
+            journal.close();
+            before[1]->set_last_name(L"Halleck");    // Not recorded
+            for (auto& obj : before) obj->observe(nullptr);
+        }
+
+        EXPECT_EQ(0u, Journal::recover(path + ".none").objects.size());
+        std::vector<std::unique_ptr<Arrakeener>> after;
+        for (int attempt = 0; attempt < 2; ++attempt)
+        {
+            Replay replay = Journal::recover(path);
+            EXPECT_TRUE(replay.complete);
+            EXPECT_TRUE(std::filesystem::exists(path + ".old"));
+            std::vector<State> states = replay.take();
+            ASSERT_EQ(3u, states.size());
+
+            // The first attempt stops before recovered, as a crash would
+            Journal journal(path);
+            after.clear();
+            journal.restore([&]
+            {
+                for (size_t i = 0; i < states.size(); ++i)
+                {
+                    after.emplace_back(new Arrakeener(states[i].names, states[i].ledger, i));
+                    journal.attach(*after.back());
+                }
+            });
+            EXPECT_FALSE(journal.failed());
+            if (attempt == 1) Journal::recovered(path);
+            journal.close();
+            for (auto& obj : after) obj->observe(nullptr);
+        }
+        EXPECT_FALSE(std::filesystem::exists(path + ".old"));
+
+        Replay replay = Journal::replay(path);
+        EXPECT_EQ(3u, replay.records);
+        std::vector<State> states = replay.take();
+        ASSERT_EQ(3u, states.size());
+        for (size_t i = 0; i < states.size(); ++i)
+        {
+            EXPECT_EQ(before[i]->first_name(), states[i].names.first_name);
+            EXPECT_EQ(L"", states[i].names.last_name);
+            EXPECT_EQ(before[i]->spice(), states[i].ledger.spice);
+            expect_state(*after[i], states[i]);
+        }
+    }
+
+    // Deferred changes are written when the journal closes
+
+    TEST_F(Journaled, Deferred)
+    {
+        Arrakeener obj(Ledger{ INT64_MAX / 2, INT64_MAX / 2, 0 }, 3);
+        {
+            Journal journal(path, Durability::deferred, std::chrono::seconds(10));
+            journal.attach(obj);
+            obj.set_first_name(L"Stilgar");
+            int64_t delta;
+            for (int i = 0; i < 100; ++i) obj.mine_spice(1, delta);
+            obj.observe(nullptr);
+        }
+
+        // The object was detached, so nothing is left
+        Replay replay = Journal::replay(path);
+        EXPECT_TRUE(replay.complete);
+        EXPECT_EQ(0u, replay.objects.size());
+        EXPECT_EQ(103u, replay.records);
+    }
+
+    // A crash in the middle of a write leaves a torn last record, which
+    // replay ignores along with anything after a corrupt one
+
+    TEST_F(Journaled, TornAndCorrupt)
+    {
+        Arrakeener obj(Ledger{ 1000, 10000000, 0 }, 4);
+        State before;
+        {
+            Journal journal(path);
+            journal.attach(obj);
+            obj.set_first_name(L"Gurney");
+            before = obj.state();
+            int64_t delta;
+            obj.mine_spice(1, delta);
+            obj.observe(nullptr);
+        }
+        const auto size = std::filesystem::file_size(path);
+
+        // Cut into the last record, the detach
+        std::filesystem::resize_file(path, size - 3);
+        Replay torn = Journal::replay(path);
+        EXPECT_FALSE(torn.complete);
+        EXPECT_EQ(3u, torn.records);
+        ASSERT_EQ(1u, torn.objects.size());
+        expect_state(obj, torn.objects.begin()->second);
+
+        // Flip a byte in the last delta of the mining record
+        std::FILE* file = std::fopen(path.c_str(), "r+b");
+        ASSERT_NE(nullptr, file);
+        std::fseek(file, (long)(torn.bytes - 1), SEEK_SET);
+        std::fputc(0x5A, file);
+        std::fclose(file);
+        Replay corrupt = Journal::replay(path);
+        EXPECT_FALSE(corrupt.complete);
+        EXPECT_EQ(2u, corrupt.records);
+        ASSERT_EQ(1u, corrupt.objects.size());
+        EXPECT_EQ(before.ledger.spice, corrupt.objects.begin()->second.ledger.spice);
+        EXPECT_EQ(L"Gurney", corrupt.objects.begin()->second.names.first_name);
+    }
+
+    TEST_F(Journaled, NotAJournal)
+    {
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        ASSERT_NE(nullptr, file);
+        std::fputs("not a journal", file);
+        std::fclose(file);
+        EXPECT_THROW(Journal::replay(path), std::runtime_error);
+        std::remove(path.c_str());
+        EXPECT_THROW(Journal::replay(path), std::system_error);
+    }
+
+    // Writers on different objects wait on shared syncs
+
+    TEST_F(Journaled, GroupCommit)
+    {
+        const int threads = 8;
+        const int operations = 100;
+        std::vector<std::unique_ptr<Arrakeener>> people;
+        for (int t = 0; t < threads; ++t) people.emplace_back(new Arrakeener(Ledger{ INT64_MAX / 2, INT64_MAX / 2, 0 }, t));
+
+        Journal journal(path);
+        for (auto& obj : people) journal.attach(*obj);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]
+            {
+                int64_t delta;
+                for (int i = 0; i < operations; ++i) people[t]->mine_spice(1, delta);
+            });
+        }
+        for (auto& worker : workers) worker.join();
+
+        // Every change was synced before its call returned
+        Replay replay = Journal::replay(path);
+        EXPECT_EQ((size_t)threads, replay.objects.size());
+        int64_t replayed = 0, spice = 0;
+        for (const auto& entry : replay.objects) replayed += entry.second.ledger.spice;
+        for (const auto& obj : people) spice += obj->spice();
+        EXPECT_EQ(spice, replayed);
+        EXPECT_LE(journal.syncs(), journal.records());
+
+        for (auto& obj : people) obj->observe(nullptr);
+    }
+}
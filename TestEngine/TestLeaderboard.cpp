@@ -0,0 +1,199 @@
+// TestLeaderboard.cpp: Unit tests for the top Arrakeeners by one counter
+
+#include "leaderboard.h"
+#include "totals.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    // The top k the slow way
+    static std::vector<int64_t> sorted_spice(const std::vector<std::unique_ptr<Arrakeener>>& people, size_t k)
+    {
+        std::vector<int64_t> values;
+        for (const auto& obj : people) values.push_back(obj->spice());
+        std::sort(values.begin(), values.end(), [](int64_t a, int64_t b) { return a > b; });
+        values.resize(std::min(k, values.size()));
+        return values;
+    }
+
+    static std::vector<int64_t> values(const std::vector<Standing>& standings)
+    {
+        std::vector<int64_t> result;
+        for (const Standing& standing : standings) result.push_back(standing.value);
+        return result;
+    }
+
+
+    TEST(Leaderboard, Ranking)
+    {
+        Leaderboard board(Field::spice);
+        std::vector<std::unique_ptr<Arrakeener>> people;
+        for (int i = 0; i < 100; ++i)
+        {
+            people.emplace_back(new Arrakeener(Ledger{ 1000000, 10000000, i }, (uint64_t)i));
+            people.back()->set_first_name((L"Fedaykin" + std::to_wstring(i)).c_str());
+            board.attach(*people.back());
+        }
+        EXPECT_EQ(100u, board.size());
+        EXPECT_EQ(Field::spice, board.field());
+
+        std::vector<Standing> top = board.top(3);
+        ASSERT_EQ(3u, top.size());
+        EXPECT_EQ(99, top[0].value);
+        EXPECT_EQ(L"Fedaykin99", top[0].names.first_name);
+        EXPECT_EQ(97, top[2].value);
+        EXPECT_EQ(100u, board.top(1000).size());
+        EXPECT_TRUE(board.top(0).empty());
+
+        // Ops, batches and transactions move objects
+        int64_t delta;
+        while (people[0]->spice() < 200) people[0]->mine_spice(100, delta);
+        people[99]->sell_spice(99, delta);
+        const int64_t harvesters[] = { 5, 5 };
+        int64_t deltas[2];
+        Status results[2];
+        people[50]->mine_spice_batch(harvesters, 2, deltas, results);
+        const Step steps[] = { { Op::eat, 10, { Field::spice, Compare::always, 0 }, 3 } };
+        StepResult step_results[1];
+        size_t failed;
+        people[98]->transact(steps, 1, step_results, failed);
+        EXPECT_EQ(sorted_spice(people, 10), values(board.top(10)));
+        EXPECT_EQ(L"Fedaykin0", board.top(1)[0].names.first_name);
+
+        // Renames show in later reads; clones and destruction change the field
+        people[0]->set_first_name(L"Stilgar");
+        EXPECT_EQ(L"Stilgar", board.top(1)[0].names.first_name);
+        people.emplace_back(new Arrakeener(*people[0]));
+        Arrakeener::Clones clones = people[1]->clones(2);
+        people.emplace_back(new Arrakeener(clones));
+        people.emplace_back(new Arrakeener(clones));
+        people.erase(people.begin() + 10, people.begin() + 20);
+        EXPECT_EQ(people.size(), board.size());
+        EXPECT_EQ(sorted_spice(people, 100), values(board.top(100)));
+
+        for (auto& obj : people) obj->observe(nullptr);
+        EXPECT_EQ(0u, board.size());
+        EXPECT_TRUE(board.complete());
+    }
+
+
+    // Several boards and totals share objects through Observers
+
+    TEST(Leaderboard, Observers)
+    {
+        Leaderboard energy(Field::energy), solaris(Field::solaris);
+        Totals totals;
+        Observers all({ &energy, &solaris, &totals });
+        Arrakeener rich(Ledger{ 10, 1000, 0 }, 1), strong(Ledger{ 1000, 10, 0 }, 2);
+        rich.observe(&all);
+        strong.observe(&all);
+        EXPECT_EQ(1000, energy.top(1)[0].value);
+        EXPECT_EQ(1000, solaris.top(1)[0].value);
+        EXPECT_EQ(2, totals.affiliation(rich.affiliation_atom()).count);
+        rich.observe(nullptr);
+        strong.observe(nullptr);
+        EXPECT_EQ(0u, energy.size());
+        EXPECT_EQ(0, totals.affiliation(rich.affiliation_atom()).count);
+    }
+
+
+    TEST(Leaderboard, Limit)
+    {
+        Leaderboard board(Field::spice);
+        std::vector<std::unique_ptr<Arrakeener>> people;
+        for (size_t i = 0; i <= Leaderboard::max_top; ++i)
+        {
+            people.emplace_back(new Arrakeener(Ledger{ 0, 0, (int64_t)i }, (uint64_t)i));
+            board.attach(*people.back());
+        }
+        EXPECT_EQ((size_t)Leaderboard::max_top, board.top(SIZE_MAX).size());
+        for (auto& obj : people) obj->observe(nullptr);
+    }
+
+
+    // Names are copied outside the board's locks; an object destroyed
+    // meanwhile waits until its names are copied
+
+    TEST(Leaderboard, DestroyWhileCopying)
+    {
+        Leaderboard board(Field::spice);
+        const std::wstring name(1000, L'N');
+        std::vector<std::unique_ptr<Arrakeener>> people;
+        for (int i = 0; i < 400; ++i)
+        {
+            people.emplace_back(new Arrakeener(Ledger{ 0, 0, i }, (uint64_t)i));
+            people.back()->set_first_name(name.c_str());
+            board.attach(*people.back());
+        }
+
+        std::atomic<bool> done(false);
+        size_t wrong = 0;
+        std::thread reader([&]
+        {
+            while (!done.load())
+            {
+                for (const Standing& standing : board.top(Leaderboard::max_top)) wrong += standing.names.first_name != name;
+            }
+        });
+        for (auto& obj : people) obj.reset();
+        done = true;
+        reader.join();
+        EXPECT_EQ(0u, wrong);
+        EXPECT_EQ(0u, board.size());
+    }
+
+
+    // Readers see a sorted board while threads mine and die
+
+    TEST(Leaderboard, Concurrent)
+    {
+        Leaderboard board(Field::spice);
+        const int threads = 4, per_thread = 100;
+        std::vector<std::unique_ptr<Arrakeener>> people;
+        for (int i = 0; i < threads * per_thread; ++i)
+        {
+            people.emplace_back(new Arrakeener(Ledger{ 0, 0, 0 }, (uint64_t)i));
+            board.attach(*people.back());
+        }
+
+        std::atomic<bool> done(false);
+        std::thread reader([&]
+        {
+            while (!done.load())
+            {
+                const std::vector<Standing> top = board.top(20);
+                for (size_t i = 1; i < top.size(); ++i) EXPECT_GE(top[i - 1].value, top[i].value);
+            }
+        });
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]
+            {
+                int64_t delta;
+                for (int round = 0; round < 50; ++round)
+                {
+                    for (int i = t * per_thread; i < (t + 1) * per_thread; ++i) people[i]->mine_spice(3, delta);
+                }
+                // Destroy a few while the reader copies names
+                for (int i = t * per_thread; i < t * per_thread + 10; ++i) people[i].reset();
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        done = true;
+        reader.join();
+
+        people.erase(std::remove(people.begin(), people.end(), nullptr), people.end());
+        EXPECT_EQ(sorted_spice(people, 50), values(board.top(50)));
+        for (auto& obj : people) obj->observe(nullptr);
+    }
+}
@@ -0,0 +1,136 @@
+// TestPool.cpp: Unit tests for the slab allocator
+
+#include "core.h"
+#include "pool.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    TEST(Pool, SlotSize)
+    {
+        Pool small(1, 4);
+        EXPECT_GE(small.slot_size(), sizeof(void*));
+        EXPECT_EQ(0u, small.slot_size() % alignof(std::max_align_t));
+
+        Pool exact(sizeof(Arrakeener), 4);
+        EXPECT_GE(exact.slot_size(), sizeof(Arrakeener));
+    }
+
+    TEST(Pool, GrowsBySlab)
+    {
+        Pool pool(24, 4);
+        EXPECT_EQ(0u, pool.capacity());
+
+        std::vector<void*> slots;
+        for (int i = 0; i < 5; ++i) slots.push_back(pool.allocate());
+        EXPECT_EQ(8u, pool.capacity());
+        EXPECT_EQ(5u, pool.in_use());
+
+        // Distinct and aligned
+        EXPECT_EQ(5u, std::set<void*>(slots.begin(), slots.end()).size());
+        for (void* p : slots) EXPECT_EQ(0u, (uintptr_t)p % alignof(std::max_align_t));
+
+        for (void* p : slots) pool.deallocate(p);
+        EXPECT_EQ(0u, pool.in_use());
+        EXPECT_EQ(8u, pool.capacity());
+    }
+
+    TEST(Pool, ReusesReleased)
+    {
+        Pool pool(24, 4);
+        void* a = pool.allocate();
+        void* b = pool.allocate();
+        pool.deallocate(a);
+        EXPECT_EQ(a, pool.allocate());      // Most recently released first
+        pool.deallocate(b);
+        pool.deallocate(a);
+        pool.deallocate(nullptr);
+        EXPECT_EQ(0u, pool.in_use());
+
+        // Churn never needs another slab
+        for (int i = 0; i < 1000; ++i) pool.deallocate(pool.allocate());
+        EXPECT_EQ(4u, pool.capacity());
+    }
+
+    TEST(Pool, AllocateMany)
+    {
+        Pool pool(24, 4);
+        void* one = pool.allocate();
+        std::vector<void*> slots(10);
+        pool.allocate_many(slots.data(), slots.size());
+        EXPECT_EQ(11u, pool.in_use());
+        EXPECT_EQ(12u, pool.capacity());   // One slab, then one allocation of two
+
+        std::set<void*> distinct(slots.begin(), slots.end());
+        distinct.insert(one);
+        EXPECT_EQ(11u, distinct.size());
+
+        for (void* p : slots) pool.deallocate(p);
+        pool.allocate_many(slots.data(), slots.size());
+        EXPECT_EQ(12u, pool.capacity());   // Reused
+        for (void* p : slots) pool.deallocate(p);
+        pool.deallocate(one);
+        EXPECT_EQ(0u, pool.in_use());
+    }
+
+    TEST(Pool, Objects)
+    {
+        Pool pool(sizeof(Arrakeener), 2);
+        std::vector<Arrakeener*> people;
+        for (uint64_t i = 0; i < 5; ++i)
+        {
+            people.push_back(new (pool.allocate()) Arrakeener(i));
+            people.back()->set_first_name(L"Fremen");
+        }
+        for (Arrakeener* p : people)
+        {
+            EXPECT_EQ(L"Fremen", p->first_name());
+            p->~Arrakeener();
+            pool.deallocate(p);
+        }
+        EXPECT_EQ(0u, pool.in_use());
+    }
+
+    TEST(Pool, Threads)
+    {
+        const int threads = std::max(4, (int)std::thread::hardware_concurrency());
+        const int rounds = 10000;
+        Pool pool(sizeof(int64_t), 16);
+        std::atomic<int> bad(0);
+
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]
+            {
+                int64_t* held[8];
+                for (int r = 0; r < rounds; ++r)
+                {
+                    for (int64_t*& p : held)
+                    {
+                        p = static_cast<int64_t*>(pool.allocate());
+                        *p = t;
+                    }
+                    for (int64_t* p : held)
+                    {
+                        if (*p != t) ++bad;         // Slot handed out twice
+                        pool.deallocate(p);
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+
+        EXPECT_EQ(0, bad.load());
+        EXPECT_EQ(0u, pool.in_use());
+        EXPECT_LE(pool.capacity(), (size_t)threads * 8 + 16);
+    }
+}
@@ -0,0 +1,158 @@
+// TestPopulation.cpp: Unit tests for the structure-of-arrays population
+
+#include "population.h"
+#include "stats.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    // Ledgers and arguments that reach every outcome, including overflow
+    // at the edges of the safe_add and safe_multiply checks
+
+    const int64_t edge_values[] =
+    {
+        0, 1, 2, 9, 10, 100, 99999, 200000, 700000,
+        INT64_MAX / 700000, INT64_MAX / 200000 + 1, (int64_t)1 << 31, ((int64_t)1 << 32) + 1,
+        INT64_MAX / 2, INT64_MAX - 1000, INT64_MAX - 1, INT64_MAX
+    };
+
+    const int64_t edge_args[] =
+    {
+        -5, 0, 1, 2, 50, 1000, (int64_t)1 << 31, ((int64_t)1 << 32) - 1, (int64_t)1 << 32,
+        INT64_MAX / 700000, INT64_MAX / 50, INT64_MAX / 2, INT64_MAX
+    };
+
+    Population make_population(Kernel kernel, size_t rows)
+    {
+        Population population(1234);
+        population.set_kernel(kernel);
+        Rng rng(99);
+        const size_t nvalues = sizeof(edge_values) / sizeof(edge_values[0]);
+        for (size_t i = 0; i < rows; ++i)
+        {
+            Ledger ledger;
+            ledger.energy = edge_values[rng.next() % nvalues];
+            ledger.solaris = edge_values[rng.next() % nvalues];
+            ledger.spice = edge_values[rng.next() % nvalues];
+            population.add(ledger);
+        }
+        return population;
+    }
+
+    std::vector<int64_t> make_args(size_t rows, uint64_t seed)
+    {
+        Rng rng(seed);
+        const size_t nargs = sizeof(edge_args) / sizeof(edge_args[0]);
+        std::vector<int64_t> args(rows);
+        for (int64_t& arg : args) arg = edge_args[rng.next() % nargs];
+        return args;
+    }
+
+    class PopulationKernels : public ::testing::TestWithParam<Kernel> { };
+
+    TEST_P(PopulationKernels, MatchScalar)
+    {
+        const size_t rows = 1003;   // Not a multiple of any vector width
+        Population scalar = make_population(Kernel::scalar, rows);
+        Population vector = make_population(GetParam(), rows);
+
+        std::vector<int64_t> deltas_scalar(rows), deltas_vector(rows);
+        std::vector<Status> results_scalar(rows), results_vector(rows);
+
+        for (int step = 0; step < 12; ++step)
+        {
+            const std::vector<int64_t> args = make_args(rows, step);
+            size_t succeeded_scalar = 0, succeeded_vector = 0;
+            switch (step % 3)
+            {
+            case 0:
+                succeeded_scalar = scalar.mine_spice(args.data(), deltas_scalar.data(), results_scalar.data());
+                succeeded_vector = vector.mine_spice(args.data(), deltas_vector.data(), results_vector.data());
+                break;
+            case 1:
+                succeeded_scalar = scalar.eat_spice(args.data(), deltas_scalar.data(), results_scalar.data());
+                succeeded_vector = vector.eat_spice(args.data(), deltas_vector.data(), results_vector.data());
+                break;
+            case 2:
+                succeeded_scalar = scalar.sell_spice(args.data(), deltas_scalar.data(), results_scalar.data());
+                succeeded_vector = vector.sell_spice(args.data(), deltas_vector.data(), results_vector.data());
+                break;
+            }
+
+            EXPECT_EQ(succeeded_scalar, succeeded_vector);
+            for (size_t i = 0; i < rows; ++i)
+            {
+                ASSERT_EQ(results_scalar[i], results_vector[i]) << "step " << step << " row " << i;
+                ASSERT_EQ(deltas_scalar[i], deltas_vector[i]) << "step " << step << " row " << i;
+                ASSERT_EQ(scalar.energy()[i], vector.energy()[i]);
+                ASSERT_EQ(scalar.solaris()[i], vector.solaris()[i]);
+                ASSERT_EQ(scalar.spice()[i], vector.spice()[i]);
+            }
+        }
+    }
+
+    INSTANTIATE_TEST_SUITE_P(Population, PopulationKernels,
+        ::testing::Values(Kernel::sse42, Kernel::avx2));
+
+    TEST(Population, Outcomes)
+    {
+        Population population(1);
+        population.set_kernel(Kernel::scalar);
+        population.add(Ledger{ 100, 1000000, 0 });          // Can mine
+        population.add(Ledger{ 0, 1000000, 0 });            // No energy
+        population.add(Ledger{ 100, 0, 0 });                // No solaris
+        population.add(Ledger{ 100, 1000000, INT64_MAX });  // Spice overflow
+
+        const int64_t harvesters[] = { 1, 1, 1, 1 };
+        int64_t deltas[4];
+        Status results[4];
+        EXPECT_EQ(1u, population.mine_spice(harvesters, deltas, results));
+        EXPECT_EQ(Status::ok, results[0]);
+        EXPECT_EQ(Status::no_energy, results[1]);
+        EXPECT_EQ(Status::no_solaris, results[2]);
+        EXPECT_EQ(Status::overflow, results[3]);
+        EXPECT_EQ(deltas[0], population.spice()[0]);
+        EXPECT_EQ(0, deltas[1]);
+
+        EXPECT_EQ(0u, population.mine_spice(int64_t(0), deltas, results));
+        for (Status result : results) EXPECT_EQ(Status::no_harvester, result);
+
+        EXPECT_EQ(0u, population.eat_spice(int64_t(0), deltas, results));
+        for (Status result : results) EXPECT_EQ(Status::nonpos_spice, result);
+    }
+
+    TEST(Population, Names)
+    {
+        Arrakeener paul(7);
+        paul.set_first_name(L"Paul");
+        paul.set_affiliation(L"House Atreides");
+
+        Population population(1);
+        const size_t row = population.add(paul);
+        EXPECT_EQ(L"Paul", population.names(row).first_name);
+        EXPECT_EQ(L"House Atreides", population.names(row).affiliation);
+        EXPECT_EQ(paul.energy(), population.ledger(row).energy);
+        EXPECT_EQ(paul.solaris(), population.ledger(row).solaris);
+    }
+
+#if !defined(ARRAKIS_NO_STATS)
+    // Copying an object in is not a call on it
+    TEST(Population, AddCountsNothing)
+    {
+        Arrakeener paul(7);
+        Population population(1);
+        stats::enable(true);
+        const auto before = stats::collect();
+        population.add(paul);
+        const auto after = stats::collect();
+        stats::enable(false);
+
+        uint64_t calls = 0;
+        for (size_t i = 0; i < after.size(); ++i) calls += after[i].calls - before[i].calls;
+        EXPECT_EQ(0u, calls);
+    }
+#endif
+}
@@ -0,0 +1,67 @@
+// TestRng.cpp: Unit tests for the random number streams
+
+#include "rng.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    TEST(Rng, Reproducible)
+    {
+        Rng a(7), b(7), c(8);
+        for (int i = 0; i < 100; ++i)
+        {
+            uint64_t x = a.next();
+            EXPECT_EQ(x, b.next());
+            EXPECT_NE(x, c.next());
+        }
+    }
+
+    TEST(Rng, Range)
+    {
+        Rng rng(1);
+        for (int i = 0; i < 100000; ++i)
+        {
+            int64_t x = rng.range(1, 10);
+            ASSERT_GE(x, 1);
+            ASSERT_LE(x, 10);
+        }
+        for (int i = 0; i < 100000; ++i)
+        {
+            int64_t x = rng.range(200000, 700000);
+            ASSERT_GE(x, 200000);
+            ASSERT_LE(x, 700000);
+        }
+    }
+
+    TEST(Rng, Uniform)
+    {
+        Rng rng(2);
+        std::vector<int> counts(10);
+        const int n = 100000;
+        for (int i = 0; i < n; ++i) ++counts[rng.range(0, 9)];
+        for (int count : counts)
+        {
+            EXPECT_GT(count, n / 10 * 9 / 10);
+            EXPECT_LT(count, n / 10 * 11 / 10);
+        }
+    }
+
+    TEST(Rng, Split)
+    {
+        Rng a(3);
+        Rng b(3);
+        Rng child = a.split();
+        b.next();
+        EXPECT_EQ(a.next(), b.next());     // Parent advanced by one draw
+        EXPECT_NE(child.next(), a.next());
+    }
+
+    TEST(Rng, Unseeded)
+    {
+        Rng a, b;
+        EXPECT_NE(a.next(), b.next());
+    }
+}
@@ -0,0 +1,236 @@
+// TestScheduler.cpp: Unit and stress tests for the work-stealing scheduler
+
+#include "core.h"
+#include "scheduler.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    struct Counter : Task
+    {
+        std::atomic<int>& count;
+        explicit Counter(std::atomic<int>& count) : count(count) {}
+        void execute() override { ++count; }
+    };
+
+
+    TEST(WorkDeque, OwnerIsLastInFirstOut)
+    {
+        std::atomic<int> count(0);
+        WorkDeque deque(2);
+        std::vector<Task*> tasks;
+        for (int i = 0; i < 5; ++i)
+        {
+            tasks.push_back(new Counter(count));
+            deque.push(tasks.back());       // Grows twice
+        }
+        EXPECT_EQ(tasks[0], deque.steal());
+        for (int i = 4; i >= 1; --i) EXPECT_EQ(tasks[i], deque.pop());
+        EXPECT_EQ(nullptr, deque.pop());
+        EXPECT_EQ(nullptr, deque.steal());
+        EXPECT_TRUE(deque.empty());
+        for (Task* task : tasks) delete task;
+    }
+
+    // Every task is taken exactly once while the owner pushes and pops and
+    // several thieves steal
+
+    TEST(WorkDeque, Stress)
+    {
+        const int n = 200000;
+        const int thieves = 3;
+        std::atomic<int> count(0);
+        std::vector<Counter> tasks(n, Counter(count));
+        std::vector<std::atomic<int>> taken(n);
+        WorkDeque deque(4);
+
+        std::atomic<bool> done(false);
+        auto take = [&](Task* task)
+        {
+            taken[static_cast<Counter*>(task) - tasks.data()]++;
+        };
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thieves; ++t)
+        {
+            threads.emplace_back([&]
+            {
+                while (!done.load() || !deque.empty())
+                {
+                    if (Task* task = deque.steal()) take(task);
+                }
+            });
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            deque.push(&tasks[i]);
+            if (i % 3 == 0)
+            {
+                if (Task* task = deque.pop()) take(task);
+            }
+        }
+        while (Task* task = deque.pop()) take(task);
+        done = true;
+        for (auto& thread : threads) thread.join();
+
+        for (int i = 0; i < n; ++i) ASSERT_EQ(1, taken[i].load()) << i;
+    }
+
+
+    TEST(Scheduler, Workers)
+    {
+        Scheduler scheduler(3);
+        EXPECT_EQ(3u, scheduler.workers());
+        Scheduler defaults;
+        EXPECT_GE(defaults.workers(), 1u);
+    }
+
+    TEST(Scheduler, RunAndWait)
+    {
+        Scheduler scheduler(4);
+        std::atomic<int> count(0);
+        TaskGroup group(scheduler);
+        for (int i = 0; i < 1000; ++i) group.run([&] { ++count; });
+        group.wait();
+        EXPECT_EQ(1000, count.load());
+
+        // Groups can be reused
+        group.spawn(new Counter(count));
+        group.wait();
+        EXPECT_EQ(1001, count.load());
+    }
+
+    TEST(Scheduler, ParallelFor)
+    {
+        Scheduler scheduler(4);
+        const size_t n = 100003;
+        std::vector<std::atomic<int>> visits(n);
+        parallel_for(scheduler, 0, n, 64, [&](size_t begin, size_t end)
+        {
+            EXPECT_LE(end - begin, 64u);
+            for (size_t i = begin; i < end; ++i) visits[i]++;
+        });
+        for (size_t i = 0; i < n; ++i) ASSERT_EQ(1, visits[i].load()) << i;
+
+        // Empty ranges do nothing
+        parallel_for(scheduler, 5, 5, 1, [](size_t, size_t) { FAIL(); });
+    }
+
+    // Tasks that wait on their own groups, recursively
+
+    static long fibonacci(TaskGroup& parent, int n)
+    {
+        if (n < 2) return n;
+        long a = 0;
+        TaskGroup group(parent.scheduler());
+        group.run([&] { a = fibonacci(group, n - 1); });
+        long b = fibonacci(group, n - 2);
+        group.wait();
+        return a + b;
+    }
+
+    TEST(Scheduler, Nested)
+    {
+        Scheduler scheduler(4);
+        TaskGroup group(scheduler);
+        long result = 0;
+        group.run([&] { result = fibonacci(group, 20); });
+        group.wait();
+        EXPECT_EQ(6765, result);
+    }
+
+    TEST(Scheduler, Exception)
+    {
+        Scheduler scheduler(2);
+        std::atomic<int> count(0);
+        TaskGroup group(scheduler);
+        group.run([] { throw std::runtime_error("first"); });
+        for (int i = 0; i < 100; ++i) group.run([&] { ++count; });
+        EXPECT_THROW(group.wait(), std::runtime_error);
+        EXPECT_EQ(100, count.load());       // The rest still ran
+
+        group.run([&] { ++count; });
+        EXPECT_NO_THROW(group.wait());      // Reported once
+    }
+
+    // Workers park when idle and wake for new work, repeatedly
+
+    TEST(Scheduler, ParkAndWake)
+    {
+        Scheduler scheduler(4, 1);
+        std::atomic<int> count(0);
+        for (int round = 0; round < 20; ++round)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            TaskGroup group(scheduler);
+            for (int i = 0; i < 10; ++i) group.run([&] { ++count; });
+            group.wait();
+        }
+        EXPECT_EQ(200, count.load());
+    }
+
+    // Several outside threads submit and wait at once while tasks spawn
+    // more tasks; every task runs exactly once
+
+    TEST(Scheduler, Stress)
+    {
+        Scheduler scheduler(4, 8);
+        const int submitters = 4;
+        const int rounds = 50;
+        std::atomic<long> count(0);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < submitters; ++t)
+        {
+            threads.emplace_back([&]
+            {
+                for (int round = 0; round < rounds; ++round)
+                {
+                    TaskGroup group(scheduler);
+                    for (int i = 0; i < 20; ++i)
+                    {
+                        group.run([&]
+                        {
+                            for (int j = 0; j < 10; ++j) group.run([&] { ++count; });
+                            ++count;
+                        });
+                    }
+                    parallel_for(scheduler, 0, 1000, 7, [&](size_t begin, size_t end) { count += (long)(end - begin); });
+                    group.wait();
+                }
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        EXPECT_EQ((long)submitters * rounds * (20 * 11 + 1000), count.load());
+    }
+
+    // The benchmark workload: every Arrakeener mines in parallel
+
+    TEST(Scheduler, MineSpice)
+    {
+        Scheduler scheduler(4);
+        std::vector<Arrakeener> people;
+        people.reserve(1000);
+        for (int i = 0; i < 1000; ++i) people.emplace_back((uint64_t)i);
+        std::vector<int64_t> before(people.size());
+        for (size_t i = 0; i < people.size(); ++i) before[i] = people[i].spice();
+
+        std::vector<int64_t> mined(people.size());
+        parallel_for(scheduler, 0, people.size(), 16, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                int64_t delta = 0;
+                if (people[i].mine_spice(1, delta) == Status::ok) mined[i] = delta;
+            }
+        });
+        for (size_t i = 0; i < people.size(); ++i) EXPECT_EQ(before[i] + mined[i], people[i].spice());
+    }
+}
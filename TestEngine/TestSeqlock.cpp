@@ -0,0 +1,138 @@
+// TestSeqlock.cpp: Stress tests for lock-free reads of the ledger
+
+#include "core.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    const int readers = std::max(4, (int)std::thread::hardware_concurrency());
+
+    using Triple = std::tuple<int64_t, int64_t, int64_t>;
+
+    Triple triple(const Ledger& ledger)
+    {
+        return Triple(ledger.energy, ledger.solaris, ledger.spice);
+    }
+
+
+    TEST(Seqlock, LoadStore)
+    {
+        Seqlock<Ledger> seqlock(Ledger{ 1, 2, 3 });
+        EXPECT_EQ(Triple(1, 2, 3), triple(seqlock.load()));
+        seqlock.store(Ledger{ 4, 5, 6 });
+        EXPECT_EQ(Triple(4, 5, 6), triple(seqlock.load()));
+    }
+
+    // Every value the writer stores satisfies an invariant across the three
+    // words; a torn read would break it
+
+    TEST(Seqlock, NoTornReads)
+    {
+        const int64_t writes = 200000;
+        Seqlock<Ledger> seqlock(Ledger{ 0, 0, 0 });
+        std::atomic<bool> done(false);
+        std::atomic<int64_t> torn(0);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < readers; ++t)
+        {
+            threads.emplace_back([&]
+            {
+                int64_t last = 0;
+                while (!done.load(std::memory_order_relaxed))
+                {
+                    Ledger ledger = seqlock.load();
+                    if (ledger.solaris != -ledger.energy || ledger.spice != 3 * ledger.energy || ledger.energy < last)
+                    {
+                        torn.fetch_add(1);
+                    }
+                    last = ledger.energy;
+                }
+            });
+        }
+
+        for (int64_t i = 1; i <= writes; ++i)
+        {
+            seqlock.store(Ledger{ i, -i, 3 * i });
+        }
+        done = true;
+        for (auto& thread : threads) thread.join();
+
+        EXPECT_EQ(0, torn.load());
+        EXPECT_EQ(Triple(writes, -writes, 3 * writes), triple(seqlock.load()));
+    }
+
+    // Readers of a live Arrakeener only ever see ledgers that the writer
+    // actually produced. Each operation changes two or three counters, so a
+    // torn read would be a ledger that never existed.
+
+    TEST(Seqlock, ArrakeenerNoTornReads)
+    {
+        const int rounds = 20000;
+        const Ledger start = { 1000, INT64_MAX / 2, 0 };
+        Arrakeener paul(start, 1);
+        std::atomic<bool> done(false);
+
+        std::vector<std::vector<Triple>> seen(readers);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < readers; ++t)
+        {
+            threads.emplace_back([&, t]
+            {
+                Triple last;
+                while (!done.load(std::memory_order_relaxed))
+                {
+                    Triple current = triple(paul.ledger());
+                    if (current != last) seen[t].push_back(last = current);
+                }
+            });
+        }
+
+        // The single writer reconstructs every ledger it publishes
+        std::set<Triple> history = { triple(start) };
+        Ledger ledger = start;
+        int64_t delta;
+        for (int i = 0; i < rounds; ++i)
+        {
+            if (paul.mine_spice(1, delta) == Status::ok)
+            {
+                const int64_t spice = ledger.spice + delta;
+                ledger = paul.ledger();     // Energy and solaris draws are not returned
+                EXPECT_EQ(spice, ledger.spice);
+                history.insert(triple(ledger));
+            }
+            if (paul.sell_spice(1, delta) == Status::ok)
+            {
+                ledger.spice -= 1;
+                ledger.solaris += delta;
+                history.insert(triple(ledger));
+            }
+            if (paul.eat_spice(1, delta) == Status::ok)
+            {
+                ledger.spice -= 1;
+                ledger.energy += delta;
+                history.insert(triple(ledger));
+            }
+        }
+        done = true;
+        for (auto& thread : threads) thread.join();
+
+        EXPECT_EQ(triple(ledger), triple(paul.ledger()));
+        for (const auto& observations : seen)
+        {
+            for (const Triple& observed : observations)
+            {
+                EXPECT_TRUE(history.count(observed)) << "Torn read: "
+                    << std::get<0>(observed) << ", " << std::get<1>(observed) << ", " << std::get<2>(observed);
+            }
+        }
+    }
+}
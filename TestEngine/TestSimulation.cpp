@@ -0,0 +1,91 @@
+// TestSimulation.cpp: Unit tests for Monte Carlo trajectories
+
+#include "simulation.h"
+#include <gtest/gtest.h>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    const Condition always = { Field::spice, Compare::always, 0 };
+
+    Simulation mining(size_t trajectories, uint32_t cycles)
+    {
+        Simulation simulation;
+        simulation.start = { 100, INT64_MAX / 2, 0 };
+        simulation.policy = { { Op::mine, 1, always, 1 } };
+        simulation.cycles = cycles;
+        simulation.trajectories = trajectories;
+        simulation.seed = 42;
+        return simulation;
+    }
+
+
+    TEST(Simulation, Deterministic)
+    {
+        // Same outcome for any number of threads
+        Simulation simulation = mining(5000, 15);
+        simulation.threads = 1;
+        const Outcome one = simulate(simulation);
+        simulation.threads = 4;
+        const Outcome four = simulate(simulation);
+
+        EXPECT_EQ(one.ruin_probability, four.ruin_probability);
+        EXPECT_EQ(one.mean_cycles, four.mean_cycles);
+        EXPECT_EQ(one.solaris.mean, four.solaris.mean);
+        EXPECT_EQ(one.spice.quantiles, four.spice.quantiles);
+        EXPECT_EQ(one.energy.min, four.energy.min);
+    }
+
+    TEST(Simulation, Ruin)
+    {
+        // Mining 15 times needs 15 to 150 energy, and there are 100
+        const Outcome outcome = simulate(mining(10000, 15));
+        EXPECT_GT(outcome.ruin_probability, 0.0);
+        EXPECT_LT(outcome.ruin_probability, 1.0);
+        EXPECT_LT(outcome.mean_cycles, 15.0);
+        EXPECT_GE(outcome.energy.min, 0);
+
+        // Always failing: every trajectory ruined at once and unchanged
+        Simulation broke = mining(100, 10);
+        broke.policy = { { Op::sell, INT64_MAX, always, 1 } };
+        const Outcome none = simulate(broke);
+        EXPECT_EQ(1.0, none.ruin_probability);
+        EXPECT_EQ(0.0, none.mean_cycles);
+        EXPECT_EQ(INT64_MAX / 2, none.solaris.min);
+        EXPECT_EQ(INT64_MAX / 2, none.solaris.max);
+    }
+
+    TEST(Simulation, Statistics)
+    {
+        // With ample energy and solaris, mining k harvesters for n cycles
+        // yields k * n * 25.5 spice on average
+        Simulation simulation = mining(20000, 10);
+        simulation.start = { 1000000, INT64_MAX / 2, 0 };
+        simulation.policy = { { Op::mine, 3, always, 1 } };
+        const Outcome outcome = simulate(simulation);
+
+        EXPECT_EQ(0.0, outcome.ruin_probability);
+        EXPECT_EQ(10.0, outcome.mean_cycles);
+        EXPECT_NEAR(3 * 10 * 25.5, outcome.spice.mean, 3 * 10 * 25.5 * 0.02);
+
+        ASSERT_EQ(3u, outcome.spice.quantiles.size());
+        EXPECT_LE(outcome.spice.min, outcome.spice.quantiles[0]);
+        EXPECT_LE(outcome.spice.quantiles[0], outcome.spice.quantiles[1]);
+        EXPECT_LE(outcome.spice.quantiles[1], outcome.spice.quantiles[2]);
+        EXPECT_LE(outcome.spice.quantiles[2], outcome.spice.max);
+        EXPECT_GE(outcome.spice.min, 3 * 10);
+        EXPECT_LE(outcome.spice.max, 3 * 10 * 50);
+    }
+
+    TEST(Simulation, EmptyPolicy)
+    {
+        Simulation simulation = mining(10, 5);
+        simulation.policy.clear();
+        simulation.quantiles = { 0.0, 1.0 };
+        const Outcome outcome = simulate(simulation);
+        EXPECT_EQ(0.0, outcome.ruin_probability);
+        EXPECT_EQ(100.0, outcome.energy.mean);
+        EXPECT_EQ(std::vector<int64_t>({ 100, 100 }), outcome.energy.quantiles);
+    }
+}
@@ -0,0 +1,224 @@
+// TestSnapshot.cpp: Unit tests for memory-mapped snapshots
+
+#include "snapshot.h"
+#include "stats.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    class Snapshotted : public ::testing::Test
+    {
+    protected:
+        std::string path;
+        std::vector<std::unique_ptr<Arrakeener>> people;
+
+        void SetUp() override
+        {
+            const auto* info = ::testing::UnitTest::GetInstance()->current_test_info();
+            path = (std::filesystem::temp_directory_path() / (std::string("arrakis_") + info->name() + ".snapshot")).string();
+        }
+
+        void TearDown() override
+        {
+            std::remove(path.c_str());
+        }
+
+        void populate(size_t n)
+        {
+            static const wchar_t* const houses[] = { L"Atreides", L"Harkonnen", L"Fremen" };
+            for (size_t i = 0; i < n; ++i)
+            {
+                people.emplace_back(new Arrakeener(Ledger{ 1000 + (int64_t)i, 1000000, 10 + (int64_t)i }, i));
+                people.back()->set_first_name(std::to_wstring(i).c_str());
+                people.back()->set_last_name(i % 2 ? L"Atreides" : L"");
+                people.back()->set_affiliation(houses[i % 3]);
+                people.back()->set_occupation(L"Mentat \U0001F3DC");
+            }
+            Snapshot::write(path, n, [&](size_t i) { return people[i]->state(); });
+        }
+
+        static void expect_state(const State& expected, const State& state)
+        {
+            EXPECT_EQ(expected.names.first_name, state.names.first_name);
+            EXPECT_EQ(expected.names.last_name, state.names.last_name);
+            EXPECT_EQ(expected.names.affiliation, state.names.affiliation);
+            EXPECT_EQ(expected.names.occupation, state.names.occupation);
+            EXPECT_EQ(expected.ledger.energy, state.ledger.energy);
+            EXPECT_EQ(expected.ledger.solaris, state.ledger.solaris);
+            EXPECT_EQ(expected.ledger.spice, state.ledger.spice);
+        }
+    };
+
+
+    TEST_F(Snapshotted, RoundTrip)
+    {
+        populate(10000);
+        Snapshot snapshot(path);
+        ASSERT_EQ(people.size(), snapshot.size());
+        for (size_t i = 0; i < people.size(); ++i)
+        {
+            expect_state(people[i]->state(), snapshot.state(i));
+            EXPECT_FALSE(snapshot.materialized(i));
+        }
+    }
+
+    // Changes go to the materialized object; the file keeps the saved state
+
+    TEST_F(Snapshotted, Materialize)
+    {
+        populate(5000);
+        State saved;
+        {
+            Snapshot snapshot(path);
+            saved = snapshot.state(4321);
+            Arrakeener& obj = snapshot.materialize(4321);
+            EXPECT_TRUE(snapshot.materialized(4321));
+            EXPECT_EQ(&obj, &snapshot.materialize(4321));
+            expect_state(saved, obj.state());
+
+            int64_t delta;
+            ASSERT_EQ(Status::ok, obj.mine_spice(2, delta));
+            obj.set_first_name(L"Duncan");
+            EXPECT_EQ(saved.ledger.spice + delta, snapshot.ledger(4321).spice);
+            EXPECT_EQ(L"Duncan", snapshot.names(4321).first_name);
+            EXPECT_FALSE(snapshot.materialized(4320));
+
+            // Saving the snapshot over its own file
+            Snapshot::write(path, snapshot.size(), [&](size_t i) { return snapshot.state(i); });
+            EXPECT_EQ(L"Duncan", snapshot.names(4321).first_name);
+        }
+        Snapshot reopened(path);
+        EXPECT_EQ(L"Duncan", reopened.names(4321).first_name);
+        EXPECT_EQ(L"Atreides", reopened.names(4321).last_name);
+        EXPECT_EQ(saved.names.first_name, L"4321");
+    }
+
+    // An object for another owner leaves the snapshot as it was
+
+    TEST_F(Snapshotted, Create)
+    {
+        populate(100);
+        Snapshot snapshot(path);
+        const std::unique_ptr<Arrakeener> obj = snapshot.create(42);
+        expect_state(people[42]->state(), obj->state());
+        obj->set_first_name(L"Gurney");
+        EXPECT_FALSE(snapshot.materialized(42));
+        EXPECT_EQ(L"42", snapshot.names(42).first_name);
+    }
+
+#if !defined(ARRAKIS_NO_STATS)
+    // Creating from the snapshot counts the creation and nothing else
+
+    TEST_F(Snapshotted, CreateCountsOneCall)
+    {
+        populate(10);
+        Snapshot snapshot(path);
+        stats::enable(true);
+        const auto before = stats::collect();
+        const std::unique_ptr<Arrakeener> obj = snapshot.create(3);
+        const auto after = stats::collect();
+        stats::enable(false);
+
+        uint64_t calls = 0;
+        for (size_t i = 0; i < after.size(); ++i) calls += after[i].calls - before[i].calls;
+        EXPECT_EQ(1u, after[(int)stats::Method::create].calls - before[(int)stats::Method::create].calls);
+        EXPECT_EQ(1u, calls);
+        EXPECT_EQ(L"3", obj->first_name());
+    }
+
+    // Reading and saving count nothing, materialized objects included
+
+    TEST_F(Snapshotted, ReadsCountNothing)
+    {
+        populate(10);
+        Snapshot snapshot(path);
+        snapshot.materialize(3);
+        stats::enable(true);
+        const auto before = stats::collect();
+        for (size_t i = 0; i < snapshot.size(); ++i)
+        {
+            snapshot.state(i);
+            snapshot.names(i);
+            snapshot.ledger(i);
+        }
+        const auto after = stats::collect();
+        stats::enable(false);
+
+        uint64_t calls = 0;
+        for (size_t i = 0; i < after.size(); ++i) calls += after[i].calls - before[i].calls;
+        EXPECT_EQ(0u, calls);
+    }
+#endif
+
+    class Tally : public Observer
+    {
+    public:
+        std::atomic<int> attached_count{ 0 }, changed_count{ 0 }, detached_count{ 0 };
+
+        void attached(const Arrakeener&, const State&) noexcept override { ++attached_count; }
+        void renamed(const Arrakeener&, const Names&, const Names&) noexcept override {}
+        void changed(const Arrakeener&, Change, int64_t, const Ledger&, const Ledger&) noexcept override { ++changed_count; }
+        void detached(const Arrakeener&) noexcept override { ++detached_count; }
+    };
+
+    // Threads racing to change the same objects create each one once
+
+    TEST_F(Snapshotted, ConcurrentMaterialize)
+    {
+        populate(9000);
+        Tally counter;
+        {
+            Snapshot snapshot(path, &counter);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < 4; ++t)
+            {
+                threads.emplace_back([&]
+                {
+                    int64_t delta;
+                    for (size_t i = 0; i < snapshot.size(); i += 7) snapshot.materialize(i).sell_spice(1, delta);
+                });
+            }
+            for (auto& thread : threads) thread.join();
+
+            const int objects = (int)((snapshot.size() + 6) / 7);
+            EXPECT_EQ(objects, counter.attached_count.load());
+            EXPECT_EQ(4 * objects, counter.changed_count.load());
+            for (size_t i = 0; i < snapshot.size(); i += 7) EXPECT_EQ((int64_t)i + 6, snapshot.ledger(i).spice);
+        }
+        EXPECT_EQ(counter.attached_count.load(), counter.detached_count.load());
+    }
+
+    TEST_F(Snapshotted, Empty)
+    {
+        Snapshot::write(path, 0, [](size_t) { return State(); });
+        Snapshot snapshot(path);
+        EXPECT_EQ(0u, snapshot.size());
+    }
+
+    TEST_F(Snapshotted, NotASnapshot)
+    {
+        populate(100);
+        const auto size = std::filesystem::file_size(path);
+        std::filesystem::resize_file(path, size - 1);
+        EXPECT_THROW(Snapshot{ path }, std::runtime_error);
+
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        ASSERT_NE(nullptr, file);
+        std::fputs("not a snapshot, though it is long enough to hold the header of one", file);
+        std::fclose(file);
+        EXPECT_THROW(Snapshot{ path }, std::runtime_error);
+
+        std::remove(path.c_str());
+        EXPECT_THROW(Snapshot{ path }, std::system_error);
+    }
+}
@@ -0,0 +1,203 @@
+// TestStats.cpp: Unit tests for per-method statistics
+
+#include "core.h"
+#include "leaderboard.h"
+#include "stats.h"
+#include "totals.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    // Record for the lifetime of the object
+    class Recording
+    {
+    public:
+        Recording() { stats::enable(true); }
+        ~Recording() { stats::enable(false); }
+    };
+
+    // What was recorded between two collections
+    static stats::MethodStats since(const std::vector<stats::MethodStats>& before, stats::Method method)
+    {
+        const stats::MethodStats& a = before[(int)method];
+        stats::MethodStats b = stats::collect()[(int)method];
+        b.calls -= a.calls;
+        for (int i = 0; i < status_count; ++i) b.statuses[i] -= a.statuses[i];
+        b.latency_sum -= a.latency_sum;
+        b.lock_wait_sum -= a.lock_wait_sum;
+        return b;
+    }
+
+
+    TEST(Stats, Names)
+    {
+        EXPECT_STREQ("create", stats::name(stats::Method::create));
+        EXPECT_STREQ("eat_spice", stats::name(stats::Method::eat_spice));
+        EXPECT_STREQ("transact", stats::name(stats::Method::transact));
+    }
+
+
+    TEST(Stats, OffRecordsNothing)
+    {
+        ASSERT_FALSE(stats::enabled());
+        const auto before = stats::collect();
+        Arrakeener obj(Ledger{ 100, 1000000, 10 }, 1);
+        int64_t delta;
+        obj.eat_spice(1, delta);
+        obj.set_first_name(L"Paul");
+        EXPECT_EQ(0u, since(before, stats::Method::create).calls);
+        EXPECT_EQ(0u, since(before, stats::Method::eat_spice).calls);
+        EXPECT_EQ(0u, since(before, stats::Method::set_first_name).calls);
+    }
+
+
+#if !defined(ARRAKIS_NO_STATS)
+    TEST(Stats, CallsAndStatuses)
+    {
+        const auto before = stats::collect();
+        {
+            Recording recording;
+            Arrakeener obj(Ledger{ 100, 1000000, 2 }, 1);
+            int64_t delta;
+            EXPECT_EQ(Status::ok, obj.eat_spice(1, delta));
+            EXPECT_EQ(Status::ok, obj.eat_spice(1, delta));
+            EXPECT_EQ(Status::no_spice, obj.eat_spice(1, delta));
+            EXPECT_EQ(Status::nonpos_spice, obj.eat_spice(0, delta));
+            EXPECT_EQ(Status::no_harvester, obj.mine_spice(0, delta));
+            obj.energy();
+            obj.state();
+            Arrakeener clone(obj);
+        }
+
+        const stats::MethodStats eat = since(before, stats::Method::eat_spice);
+        EXPECT_EQ(4u, eat.calls);
+        EXPECT_EQ(2u, eat.statuses[(int)Status::ok]);
+        EXPECT_EQ(1u, eat.statuses[(int)Status::no_spice]);
+        EXPECT_EQ(1u, eat.statuses[(int)Status::nonpos_spice]);
+        EXPECT_EQ(1u, since(before, stats::Method::mine_spice).statuses[(int)Status::no_harvester]);
+        EXPECT_EQ(1u, since(before, stats::Method::energy).calls);
+        EXPECT_EQ(1u, since(before, stats::Method::create).calls);     // The clone is not a creation
+        EXPECT_EQ(1u, since(before, stats::Method::clone).calls);
+
+        // state() reads the names without counting a call to names()
+        EXPECT_EQ(1u, since(before, stats::Method::state).calls);
+        EXPECT_EQ(0u, since(before, stats::Method::names).calls);
+    }
+
+
+    // Observers and the board's readers add no calls of their own
+
+    TEST(Stats, OneCallPerCall)
+    {
+        auto total = [](const std::vector<stats::MethodStats>& all)
+        {
+            uint64_t n = 0;
+            for (const stats::MethodStats& method : all) n += method.calls;
+            return n;
+        };
+        Totals totals;
+        Leaderboard board(Field::spice);
+        std::unique_ptr<Arrakeener> obj(new Arrakeener(Ledger{ 100, 1000000, 10 }, 1));
+        obj->observe(&totals);
+        board.attach(*obj);                 // Replaces the totals, which hold its ledger
+        int64_t delta;
+
+        Recording recording;
+        auto before = stats::collect();
+        obj->mine_spice(1, delta);
+        EXPECT_EQ(1u, since(before, stats::Method::mine_spice).calls);
+        EXPECT_EQ(total(before) + 1, total(stats::collect()));
+
+        before = stats::collect();
+        board.top(10);
+        obj->observe(&totals);
+        obj->set_affiliation(L"Fremen");
+        obj.reset();
+        EXPECT_EQ(1u, since(before, stats::Method::set_affiliation).calls);
+        EXPECT_EQ(total(before) + 1, total(stats::collect()));
+    }
+
+
+    TEST(Stats, LatencyAndLockWait)
+    {
+        const auto before = stats::collect();
+        {
+            Recording recording;
+            Arrakeener obj(Ledger{ 100, 1000000, 1000 }, 1);
+            int64_t delta;
+            for (int i = 0; i < 100; ++i)
+            {
+                obj.sell_spice(1, delta);
+                obj.spice();
+            }
+        }
+
+        // Every locked call has a wait, if only of zero; lock-free ones have none
+        const stats::MethodStats sell = since(before, stats::Method::sell_spice);
+        EXPECT_EQ(100u, sell.calls);
+        EXPECT_GE(sell.latency.count(), 100u);
+        EXPECT_GE(sell.lock_wait.count(), 100u);
+        EXPECT_GT(sell.latency_sum, 0u);
+        EXPECT_EQ(0u, since(before, stats::Method::spice).lock_wait.count());
+    }
+
+
+    TEST(Stats, ThreadsMerged)
+    {
+        const int threads = 8;
+        const int calls = 1000;
+        const auto before = stats::collect();
+        {
+            Recording recording;
+            Arrakeener shared(Ledger{ 100, 1000000, threads * calls }, 1);
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; ++t)
+            {
+                workers.emplace_back([&]
+                {
+                    int64_t delta;
+                    for (int i = 0; i < calls; ++i) shared.eat_spice(1, delta);
+                });
+            }
+            for (auto& worker : workers) worker.join();
+        }
+
+        // The threads have exited; their counts remain
+        const stats::MethodStats eat = since(before, stats::Method::eat_spice);
+        EXPECT_EQ((uint64_t)threads * calls, eat.calls);
+        EXPECT_EQ((uint64_t)threads * calls, eat.statuses[(int)Status::ok]);
+    }
+
+
+    TEST(Stats, Text)
+    {
+        {
+            Recording recording;
+            Arrakeener obj(Ledger{ 100, 1000000, 0 }, 1);
+            int64_t delta;
+            obj.sell_spice(1, delta);
+        }
+        const auto collected = stats::collect();
+
+        const std::string summary = stats::summary(collected);
+        EXPECT_NE(std::string::npos, summary.find("sell_spice calls="));
+        EXPECT_NE(std::string::npos, summary.find(" no_spice="));
+        EXPECT_EQ(std::string::npos, summary.find("mine_spice_batch"));    // Never called
+
+        const std::string text = stats::prometheus(collected);
+        EXPECT_NE(std::string::npos, text.find("# TYPE arrakis_calls_total counter\n"));
+        EXPECT_NE(std::string::npos, text.find("arrakis_calls_total{method=\"sell_spice\"} "));
+        EXPECT_NE(std::string::npos, text.find("arrakis_errors_total{method=\"sell_spice\",status=\"no_spice\"} "));
+        EXPECT_NE(std::string::npos, text.find("arrakis_latency_seconds_bucket{method=\"sell_spice\",le=\"1e-07\"} "));
+        EXPECT_NE(std::string::npos, text.find("arrakis_latency_seconds_bucket{method=\"sell_spice\",le=\"+Inf\"} "));
+        EXPECT_NE(std::string::npos, text.find("arrakis_lock_wait_seconds_count{method=\"sell_spice\"} "));
+    }
+#endif
+}
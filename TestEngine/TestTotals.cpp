@@ -0,0 +1,141 @@
+// TestTotals.cpp: Unit tests for running totals by affiliation
+
+#include "totals.h"
+#include <gtest/gtest.h>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    // Totals computed the slow way
+    static std::map<std::wstring, Aggregate> brute_force(const std::vector<std::unique_ptr<Arrakeener>>& people)
+    {
+        std::map<std::wstring, Aggregate> result;
+        for (const auto& obj : people)
+        {
+            const State state = obj->state();
+            auto it = result.emplace(state.names.affiliation.str(), Aggregate{ state.names.affiliation, 0, Ledger{ 0, 0, 0 } }).first;
+            ++it->second.count;
+            it->second.totals.energy += state.ledger.energy;
+            it->second.totals.solaris += state.ledger.solaris;
+            it->second.totals.spice += state.ledger.spice;
+        }
+        return result;
+    }
+
+    static void expect_totals(const Totals& totals, const std::vector<std::unique_ptr<Arrakeener>>& people)
+    {
+        const auto expected = brute_force(people);
+        const auto actual = totals.by_affiliation();
+        EXPECT_EQ(expected.size(), actual.size());
+        for (const Aggregate& aggregate : actual)
+        {
+            auto it = expected.find(aggregate.affiliation.str());
+            ASSERT_NE(expected.end(), it) << aggregate.affiliation.c_str();
+            EXPECT_EQ(it->second.count, aggregate.count);
+            EXPECT_EQ(it->second.totals.energy, aggregate.totals.energy);
+            EXPECT_EQ(it->second.totals.solaris, aggregate.totals.solaris);
+            EXPECT_EQ(it->second.totals.spice, aggregate.totals.spice);
+        }
+        EXPECT_TRUE(totals.complete());
+    }
+
+
+    TEST(Totals, Operations)
+    {
+        Totals totals;
+        std::vector<std::unique_ptr<Arrakeener>> people;
+        const wchar_t* houses[] = { L"Atreides", L"Harkonnen", L"Fremen" };
+        for (int i = 0; i < 30; ++i)
+        {
+            people.emplace_back(new Arrakeener(Ledger{ 100000, 10000000, 5 }, (uint64_t)i));
+            people.back()->set_affiliation(houses[i % 3]);
+            totals.attach(*people.back());
+        }
+        expect_totals(totals, people);
+        EXPECT_EQ(10, totals.affiliation(L"Fremen").count);
+        EXPECT_EQ(50, totals.affiliation(L"Fremen").totals.spice);
+        EXPECT_EQ(0, totals.affiliation(L"Corrino").count);
+
+        int64_t delta;
+        for (auto& obj : people)
+        {
+            obj->mine_spice(3, delta);
+            obj->sell_spice(2, delta);
+            obj->eat_spice(1, delta);
+        }
+        const int64_t harvesters[] = { 1, 2, 3 };
+        int64_t deltas[3];
+        Status results[3];
+        people[0]->mine_spice_batch(harvesters, 3, deltas, results);
+        const Step steps[] = { { Op::mine, 1, { Field::spice, Compare::always, 0 }, 4 } };
+        StepResult step_results[1];
+        size_t failed;
+        people[1]->transact(steps, 1, step_results, failed);
+        expect_totals(totals, people);
+
+        // Changing affiliation moves the whole ledger
+        people[0]->set_affiliation(L"Corrino");
+        people[3]->set_affiliation(L"Corrino");
+        people[4]->set_occupation(L"Smuggler");
+        expect_totals(totals, people);
+        EXPECT_EQ(2, totals.affiliation(L"Corrino").count);
+
+        // Clones join their source's affiliation; destruction leaves it
+        people.emplace_back(new Arrakeener(*people[0]));
+        Arrakeener::Clones clones = people[1]->clones(2);
+        people.emplace_back(new Arrakeener(clones));
+        people.emplace_back(new Arrakeener(clones));
+        people.erase(people.begin() + 5, people.begin() + 10);
+        expect_totals(totals, people);
+
+        // Detaching removes an object without destroying it
+        people[2]->observe(nullptr);
+        std::unique_ptr<Arrakeener> outside = std::move(people[2]);
+        people.erase(people.begin() + 2);
+        expect_totals(totals, people);
+
+        for (auto& obj : people) obj->observe(nullptr);
+        EXPECT_TRUE(totals.by_affiliation().empty());
+    }
+
+    // Threads change their own objects and move them between houses
+
+    TEST(Totals, Concurrent)
+    {
+        Totals totals;
+        const int threads = 8, per_thread = 50;
+        const wchar_t* houses[] = { L"Atreides", L"Harkonnen", L"Fremen", L"Ecaz" };
+        std::vector<std::unique_ptr<Arrakeener>> people;
+        for (int i = 0; i < threads * per_thread; ++i)
+        {
+            people.emplace_back(new Arrakeener(Ledger{ 1000000, 1000000000, 0 }, (uint64_t)i));
+            totals.attach(*people.back());
+        }
+
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]
+            {
+                int64_t delta;
+                for (int round = 0; round < 20; ++round)
+                {
+                    for (int i = t * per_thread; i < (t + 1) * per_thread; ++i)
+                    {
+                        people[i]->mine_spice(2, delta);
+                        people[i]->sell_spice(1, delta);
+                        if (round % 5 == 0) people[i]->set_affiliation(houses[(i + round) % 4]);
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        expect_totals(totals, people);
+        for (auto& obj : people) obj->observe(nullptr);
+    }
+}
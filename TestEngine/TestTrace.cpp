@@ -0,0 +1,197 @@
+// TestTrace.cpp: Unit tests for trace spans
+
+#include "core.h"
+#include "trace.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    // Trace for the lifetime of the object, from an empty trace
+    class Tracing
+    {
+    public:
+        Tracing() { trace::flush(); trace::enable(true); }
+        ~Tracing() { trace::enable(false); }
+    };
+
+    static size_t count(const std::string& text, const std::string& what)
+    {
+        size_t n = 0;
+        for (size_t at = text.find(what); at != std::string::npos; at = text.find(what, at + 1)) ++n;
+        return n;
+    }
+
+    static size_t spans(const std::string& text)
+    {
+        return count(text, "\"ph\":\"X\"");
+    }
+
+
+    TEST(Trace, OffRecordsNothing)
+    {
+        ASSERT_FALSE(trace::enabled());
+        trace::flush();
+        Arrakeener obj(Ledger{ 100, 1000000, 10 }, 1);
+        int64_t delta;
+        obj.eat_spice(1, delta);
+        {
+            trace::Span span("test", "off");
+        }
+        EXPECT_EQ(0u, spans(trace::flush()));
+    }
+
+
+#if !defined(ARRAKIS_NO_TRACE)
+    TEST(Trace, Operations)
+    {
+        std::string text;
+        {
+            Tracing tracing;
+            Arrakeener obj(Ledger{ 100, 1000000, 10 }, 1);
+            int64_t delta;
+            obj.eat_spice(1, delta);
+            obj.mine_spice(0, delta);
+        }
+        text = trace::flush();
+
+        // Each operation waits for the lock, then applies the rules
+        EXPECT_EQ(0u, text.find("{\"traceEvents\":["));
+        EXPECT_EQ(2u, count(text, "{\"name\":\"lock\",\"cat\":\"engine\",\"ph\":\"X\",\"pid\":1,\"tid\":"));
+        EXPECT_EQ(2u, count(text, "{\"name\":\"rules\",\"cat\":\"engine\""));
+        EXPECT_EQ(4u, spans(text));
+        EXPECT_NE(std::string::npos, text.find("\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":"));
+    }
+
+
+    TEST(Trace, Nested)
+    {
+        {
+            Tracing tracing;
+            trace::Span outer("test", "outer");
+            {
+                trace::Span inner("test", "inner");
+            }
+            trace::Span ended("test", "ended");
+            ended.end();
+            ended.end();                    // Once only
+        }
+        const std::string text = trace::flush();
+        EXPECT_EQ(3u, spans(text));
+        EXPECT_LT(text.find("\"inner\""), text.find("\"ended\""));
+        EXPECT_LT(text.find("\"ended\""), text.find("\"outer\""));  // In the order they ended
+    }
+
+
+    TEST(Trace, FlushTakesSpans)
+    {
+        {
+            Tracing tracing;
+            trace::Span span("test", "once");
+        }
+        EXPECT_EQ(1u, spans(trace::flush()));
+        EXPECT_EQ(0u, spans(trace::flush()));
+    }
+
+
+    TEST(Trace, Threads)
+    {
+        const int threads = 4;
+        const int each = 100;
+        {
+            Tracing tracing;
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; ++t)
+            {
+                workers.emplace_back([&]
+                {
+                    for (int i = 0; i < each; ++i) trace::Span span("test", "worker");
+                });
+            }
+            for (auto& worker : workers) worker.join();
+        }
+
+        // The threads have exited; their spans remain
+        const std::string text = trace::flush();
+        EXPECT_EQ((size_t)threads * each, spans(text));
+    }
+
+
+    TEST(Trace, FullRingDropsOldest)
+    {
+        const uint64_t before = trace::dropped();
+        {
+            Tracing tracing;
+            trace::Span first("test", "first");
+            first.end();
+            for (size_t i = 0; i < trace::ring_size + 99; ++i) trace::Span span("test", "filler");
+        }
+        const std::string text = trace::flush();
+        EXPECT_EQ(trace::ring_size, spans(text));
+        EXPECT_EQ(std::string::npos, text.find("\"first\""));
+        EXPECT_EQ(before + 100, trace::dropped());
+    }
+
+
+    TEST(Trace, MaxSize)
+    {
+        const uint64_t before = trace::dropped();
+        {
+            Tracing tracing;
+            for (int i = 0; i < 1000; ++i) trace::Span span("test", "sized");
+        }
+        const std::string text = trace::flush(10000);
+        EXPECT_GE(10000u, text.size());
+        EXPECT_LT(0u, spans(text));
+        EXPECT_EQ(1000u, spans(text) + (trace::dropped() - before));
+        EXPECT_EQ(text.size() - 3, text.rfind("}}\n"));
+    }
+
+
+    // Every span is either flushed or dropped, whatever the interleaving
+    TEST(Trace, FlushWhileWriting)
+    {
+        const size_t total = 4 * trace::ring_size;
+        const uint64_t before = trace::dropped();
+        size_t flushed = 0;
+        {
+            Tracing tracing;
+            std::thread writer([&]
+            {
+                for (size_t i = 0; i < total; ++i) trace::Span span("test", "busy");
+            });
+            for (int i = 0; i < 50; ++i) flushed += spans(trace::flush());
+            writer.join();
+        }
+        flushed += spans(trace::flush());
+        EXPECT_EQ(total, flushed + (trace::dropped() - before));
+    }
+
+
+    TEST(Trace, File)
+    {
+        const std::string path = (std::filesystem::temp_directory_path() / "arrakis_Trace_File.json").string();
+        {
+            Tracing tracing;
+            trace::Span span("test", "file");
+        }
+        trace::flush(path);
+        std::ifstream in(path);
+        std::stringstream text;
+        text << in.rdbuf();
+        EXPECT_EQ(1u, spans(text.str()));
+        std::remove(path.c_str());
+
+        EXPECT_THROW(trace::flush((std::filesystem::temp_directory_path() / "no such directory" / "trace.json").string()), std::system_error);
+    }
+#endif
+}
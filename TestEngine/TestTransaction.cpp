@@ -0,0 +1,161 @@
+// TestTransaction.cpp: Unit tests for compound operations
+
+#include "core.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace arrakis;
+
+namespace TestEngine
+{
+    const Condition always = { Field::spice, Compare::always, 0 };
+
+    // Mine until there are at least 100 units, eat 10, sell the rest
+    std::vector<Step> refill()
+    {
+        return
+        {
+            { Op::mine, 1, { Field::spice, Compare::less, 100 }, max_step_runs },
+            { Op::eat, 10, always, 1 },
+            { Op::sell, all_spice, { Field::spice, Compare::greater, 0 }, 1 }
+        };
+    }
+
+
+    TEST(Transaction, Valid)
+    {
+        EXPECT_TRUE(valid(Step{ Op::mine, 1, always, 1 }));
+        EXPECT_TRUE(valid(Step{ Op::sell, all_spice, always, max_step_runs }));
+        EXPECT_FALSE(valid(Step{ Op::mine, all_spice, always, 1 }));
+        EXPECT_FALSE(valid(Step{ Op::eat, 1, always, 0 }));
+        EXPECT_FALSE(valid(Step{ Op::eat, 1, always, max_step_runs + 1 }));
+        EXPECT_FALSE(valid(Step{ (Op)3, 1, always, 1 }));
+        EXPECT_FALSE(valid(Step{ Op::eat, 1, { (Field)3, Compare::less, 0 }, 1 }));
+        EXPECT_FALSE(valid(Step{ Op::eat, 1, { Field::spice, (Compare)5, 0 }, 1 }));
+    }
+
+    TEST(Transaction, Commit)
+    {
+        const Ledger start = { 1000, INT64_MAX / 2, 0 };
+        Ledger ledger = start;
+        Rng rng(1);
+        const std::vector<Step> steps = refill();
+        std::vector<StepResult> results(steps.size());
+        size_t failed = 99;
+
+        ASSERT_EQ(Status::ok, transact(ledger, rng, steps.data(), steps.size(), results.data(), failed));
+        EXPECT_EQ(99u, failed);
+        EXPECT_GE(results[0].runs, 2u);
+        EXPECT_EQ(1u, results[1].runs);
+        EXPECT_EQ(1u, results[2].runs);
+
+        // The deltas account for the whole change
+        EXPECT_EQ(0, ledger.spice);
+        EXPECT_GE(results[0].delta, 100);
+        EXPECT_GT(results[1].delta, 0);
+        EXPECT_GT(results[2].delta, 0);
+    }
+
+    // A transaction is the same sequence of single calls, without the
+    // interleaving
+
+    TEST(Transaction, MatchesSingleCalls)
+    {
+        const Ledger start = { 1000, INT64_MAX / 2, 0 };
+        Ledger ledger = start, expected = start;
+        Rng rng(7), expected_rng(7);
+        const std::vector<Step> steps = refill();
+        std::vector<StepResult> results(steps.size());
+        size_t failed;
+        ASSERT_EQ(Status::ok, transact(ledger, rng, steps.data(), steps.size(), results.data(), failed));
+
+        int64_t delta, mined = 0;
+        for (uint32_t i = 0; i < results[0].runs; ++i)
+        {
+            ASSERT_EQ(Status::ok, mine_spice(expected, expected_rng, 1, delta));
+            mined += delta;
+        }
+        EXPECT_EQ(mined, results[0].delta);
+        ASSERT_EQ(Status::ok, eat_spice(expected, expected_rng, 10, delta));
+        EXPECT_EQ(delta, results[1].delta);
+        ASSERT_EQ(Status::ok, sell_spice(expected, expected_rng, expected.spice, delta));
+        EXPECT_EQ(delta, results[2].delta);
+
+        EXPECT_EQ(expected.energy, ledger.energy);
+        EXPECT_EQ(expected.solaris, ledger.solaris);
+        EXPECT_EQ(expected.spice, ledger.spice);
+    }
+
+    TEST(Transaction, RollBack)
+    {
+        const Ledger start = { 1000, INT64_MAX / 2, 5 };
+        Ledger ledger = start;
+        Rng rng(1);
+        const std::vector<Step> steps =
+        {
+            { Op::mine, 1, always, 3 },
+            { Op::sell, INT64_MAX, always, 1 }     // More than is held
+        };
+        std::vector<StepResult> results(steps.size());
+        size_t failed = 99;
+
+        EXPECT_EQ(Status::no_spice, transact(ledger, rng, steps.data(), steps.size(), results.data(), failed));
+        EXPECT_EQ(1u, failed);
+        EXPECT_EQ(start.energy, ledger.energy);
+        EXPECT_EQ(start.solaris, ledger.solaris);
+        EXPECT_EQ(start.spice, ledger.spice);
+        for (const StepResult& result : results)
+        {
+            EXPECT_EQ(0, result.delta);
+            EXPECT_EQ(0u, result.runs);
+        }
+    }
+
+    TEST(Transaction, Overflow)
+    {
+        // The safe arithmetic of the single operations decides the rollback
+        Ledger ledger = { INT64_MAX, 400000, 10 };
+        Rng rng(1);
+        const Step steps[] = { { Op::sell, 1, always, 1 }, { Op::eat, 1, always, 1 } };
+        StepResult results[2];
+        size_t failed;
+        EXPECT_EQ(Status::overflow, transact(ledger, rng, steps, 2, results, failed));
+        EXPECT_EQ(1u, failed);
+        EXPECT_EQ(400000, ledger.solaris);
+        EXPECT_EQ(10, ledger.spice);
+    }
+
+    TEST(Transaction, Conditions)
+    {
+        Ledger ledger = { 1000, 400000, 0 };
+        Rng rng(1);
+        const Step steps[] =
+        {
+            { Op::sell, all_spice, { Field::spice, Compare::greater, 0 }, 1 },   // Nothing to sell
+            { Op::mine, 1, { Field::energy, Compare::greater_equal, 0 }, 2 }     // Bounded by max_runs
+        };
+        StepResult results[2];
+        size_t failed;
+        EXPECT_EQ(Status::ok, transact(ledger, rng, steps, 2, results, failed));
+        EXPECT_EQ(0u, results[0].runs);
+        EXPECT_EQ(2u, results[1].runs);
+        EXPECT_EQ(results[1].delta, ledger.spice);
+    }
+
+    TEST(Transaction, Arrakeener)
+    {
+        Arrakeener paul(Ledger{ 1000, INT64_MAX / 2, 0 }, 1);
+        const std::vector<Step> steps = refill();
+        std::vector<StepResult> results(steps.size());
+        size_t failed;
+        ASSERT_EQ(Status::ok, paul.transact(steps.data(), steps.size(), results.data(), failed));
+        EXPECT_EQ(0, paul.spice());
+
+        const Ledger before = paul.ledger();
+        const Step fail[] = { { Op::mine, 1, always, 1 }, { Op::sell, INT64_MAX, always, 1 } };
+        EXPECT_EQ(Status::no_spice, paul.transact(fail, 2, results.data(), failed));
+        EXPECT_EQ(before.spice, paul.spice());
+        EXPECT_EQ(before.energy, paul.energy());
+        EXPECT_EQ(before.solaris, paul.solaris());
+    }
+}
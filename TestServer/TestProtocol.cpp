@@ -0,0 +1,145 @@
+// TestProtocol.cpp: Unit tests for the frames of the socket protocol
+
+#include "protocol.h"
+#include <gtest/gtest.h>
+
+using namespace arrakis;
+using namespace arrakis::protocol;
+
+namespace TestServer
+{
+    TEST(Protocol, Requests)
+    {
+        Request put;
+        put.tag = 7;
+        put.method = Method::put;
+        put.handle = 0x123456789ull;
+        put.property = Property::affiliation;
+        put.text = L"Atreides";
+        Request mine;
+        mine.tag = 8;
+        mine.method = Method::mine;
+        mine.handle = 3;
+        mine.arg = -5;
+
+        std::vector<uint8_t> out;
+        encode(put, out);
+        const size_t first = out.size();
+        encode(mine, out);
+
+        EXPECT_EQ(0u, frame_size(out.data(), 3));
+        ASSERT_EQ(first, frame_size(out.data(), out.size()));
+        Request decoded;
+        ASSERT_TRUE(decode(out.data(), first, decoded));
+        EXPECT_EQ(7u, decoded.tag);
+        EXPECT_EQ(Method::put, decoded.method);
+        EXPECT_EQ(0x123456789ull, decoded.handle);
+        EXPECT_EQ(Property::affiliation, decoded.property);
+        EXPECT_EQ(L"Atreides", decoded.text);
+
+        ASSERT_EQ(out.size() - first, frame_size(out.data() + first, out.size() - first));
+        ASSERT_TRUE(decode(out.data() + first, out.size() - first, decoded));
+        EXPECT_EQ(Method::mine, decoded.method);
+        EXPECT_EQ(3u, decoded.handle);
+        EXPECT_EQ(-5, decoded.arg);
+    }
+
+
+    TEST(Protocol, Responses)
+    {
+        Response text;
+        text.tag = 1;
+        text.payload = Payload::text;
+        text.text = L"Muad'Dib";
+        Response failed;
+        failed.tag = 2;
+        failed.status = (uint8_t)Status::no_spice;
+        failed.payload = Payload::integer;  // Dropped: only ok carries a value
+
+        std::vector<uint8_t> out;
+        encode(text, out);
+        const size_t first = out.size();
+        encode(failed, out);
+
+        Response decoded;
+        ASSERT_TRUE(decode(out.data(), first, decoded));
+        EXPECT_EQ(1u, decoded.tag);
+        EXPECT_EQ(0, decoded.status);
+        EXPECT_EQ(Payload::text, decoded.payload);
+        EXPECT_EQ(L"Muad'Dib", decoded.text);
+        ASSERT_TRUE(decode(out.data() + first, out.size() - first, decoded));
+        EXPECT_EQ((uint8_t)Status::no_spice, decoded.status);
+        EXPECT_EQ(Payload::none, decoded.payload);
+    }
+
+
+    TEST(Protocol, Stats)
+    {
+        Request stats;
+        stats.tag = 3;
+        stats.method = Method::stats;
+        stats.format = Format::prometheus;
+        std::vector<uint8_t> out;
+        encode(stats, out);
+        EXPECT_EQ(10u, out.size());         // No handle
+
+        Request decoded;
+        ASSERT_TRUE(decode(out.data(), out.size(), decoded));
+        EXPECT_EQ(Method::stats, decoded.method);
+        EXPECT_EQ(Format::prometheus, decoded.format);
+
+        out.back() = 2;                     // Unknown format
+        EXPECT_FALSE(decode(out.data(), out.size(), decoded));
+    }
+
+
+    TEST(Protocol, Trace)
+    {
+        Request trace;
+        trace.tag = 4;
+        trace.method = Method::trace;
+        trace.on = true;
+        std::vector<uint8_t> out;
+        encode(trace, out);
+        EXPECT_EQ(10u, out.size());         // No handle
+
+        Request decoded;
+        ASSERT_TRUE(decode(out.data(), out.size(), decoded));
+        EXPECT_EQ(Method::trace, decoded.method);
+        EXPECT_TRUE(decoded.on);
+
+        out[9] = 2;                         // Neither on nor off
+        EXPECT_FALSE(decode(out.data(), out.size(), decoded));
+    }
+
+
+    TEST(Protocol, Malformed)
+    {
+        Request get;
+        get.method = Method::get;
+        get.tag = 9;
+        std::vector<uint8_t> out;
+        encode(get, out);
+        Request decoded;
+
+        // A size that disagrees with the frame
+        EXPECT_FALSE(decode(out.data(), out.size() - 1, decoded));
+
+        // Unknown property, still tagged
+        out[out.size() - 1] = 200;
+        EXPECT_FALSE(decode(out.data(), out.size(), decoded));
+        EXPECT_EQ(9u, decoded.tag);
+
+        // Unknown method
+        out[8] = 100;
+        EXPECT_FALSE(decode(out.data(), out.size(), decoded));
+
+        // Numeric properties cannot be set
+        Request put;
+        put.method = Method::put;
+        put.property = Property::spice;
+        out.clear();
+        encode(put, out);
+        EXPECT_FALSE(decode(out.data(), out.size(), decoded));
+    }
+}
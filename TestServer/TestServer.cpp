@@ -0,0 +1,423 @@
+// TestServer.cpp: Unit tests for the socket server, through the client
+
+#include "client.h"
+#include "journal.h"
+#include "server.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "totals.h"
+#include "trace.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace arrakis;
+using namespace arrakis::protocol;
+
+namespace TestServer
+{
+    class Served : public ::testing::Test
+    {
+    protected:
+        const std::string path = (std::filesystem::temp_directory_path() / ("arrakis_test_" + std::to_string(getpid()) + ".sock")).string();
+
+        static Request request(Method method, uint64_t handle = 0, int64_t arg = 0)
+        {
+            Request result;
+            result.method = method;
+            result.handle = handle;
+            result.arg = arg;
+            return result;
+        }
+
+        static Request get(uint64_t handle, Property property)
+        {
+            Request result = request(Method::get, handle);
+            result.property = property;
+            return result;
+        }
+
+        static Request put(uint64_t handle, Property property, const wchar_t* value)
+        {
+            Request result = request(Method::put, handle);
+            result.property = property;
+            result.text = value;
+            return result;
+        }
+
+        static uint64_t create(Client& client)
+        {
+            const Response response = client.call(request(Method::create));
+            EXPECT_EQ(0, response.status);
+            return (uint64_t)response.value;
+        }
+    };
+
+
+    TEST_F(Served, Methods)
+    {
+        Server server(path);
+        Client client(path);
+        const uint64_t handle = create(client);
+        EXPECT_EQ(1u, server.objects());
+
+        EXPECT_EQ(0, client.call(put(handle, Property::first_name, L"Paul")).status);
+        EXPECT_EQ(0, client.call(put(handle, Property::affiliation, L"Atreides")).status);
+        Response response = client.call(get(handle, Property::first_name));
+        EXPECT_EQ(Payload::text, response.payload);
+        EXPECT_EQ(L"Paul", response.text);
+        response = client.call(get(handle, Property::solaris));
+        EXPECT_EQ(Payload::integer, response.payload);
+        const int64_t solaris = response.value;
+
+        // Operations return their deltas, and failures their status; a new
+        // person can afford one harvester if it has the energy
+        response = client.call(request(Method::sell, handle, 1));
+        EXPECT_EQ((uint8_t)Status::no_spice, response.status);
+        EXPECT_EQ(Payload::none, response.payload);
+        response = client.call(request(Method::mine, handle, 0));
+        EXPECT_EQ((uint8_t)Status::no_harvester, response.status);
+        response = client.call(request(Method::mine, handle, 1));
+        ASSERT_TRUE(response.status == 0 || response.status == (uint8_t)Status::no_energy);
+        if (response.status == 0)
+        {
+            EXPECT_EQ(response.value, client.call(get(handle, Property::spice)).value);
+            response = client.call(request(Method::sell, handle, 1));
+            EXPECT_EQ(0, response.status);
+            EXPECT_LT(solaris, client.call(get(handle, Property::solaris)).value);
+        }
+        response = client.call(request(Method::eat, handle, 0));
+        EXPECT_EQ((uint8_t)Status::nonpos_spice, response.status);
+
+        // Clones have their own handles and share the names
+        response = client.call(request(Method::clone, handle));
+        ASSERT_EQ(0, response.status);
+        const uint64_t clone = (uint64_t)response.value;
+        EXPECT_NE(handle, clone);
+        EXPECT_EQ(L"Atreides", client.call(get(clone, Property::affiliation)).text);
+        EXPECT_EQ(2u, server.objects());
+
+        EXPECT_EQ(0, client.call(request(Method::release, handle)).status);
+        EXPECT_EQ(no_object, client.call(request(Method::release, handle)).status);
+        EXPECT_EQ(no_object, client.call(get(handle, Property::spice)).status);
+        EXPECT_EQ(no_object, client.call(request(Method::mine, 12345, 1)).status);
+        EXPECT_EQ(bad_request, client.call(put(clone, Property::spice, L"")).status);
+        EXPECT_EQ(1u, server.objects());
+    }
+
+
+#if !defined(ARRAKIS_NO_STATS)
+    TEST_F(Served, Stats)
+    {
+        Server server(path);
+        Client client(path);
+        stats::enable(true);
+        const uint64_t handle = create(client);
+        client.call(request(Method::eat, handle, 0));
+        stats::enable(false);
+
+        Request query = request(Method::stats);
+        Response response = client.call(query);
+        ASSERT_EQ(0, response.status);
+        EXPECT_EQ(Payload::text, response.payload);
+        EXPECT_NE(std::wstring::npos, response.text.find(L"eat_spice calls="));
+        EXPECT_NE(std::wstring::npos, response.text.find(L" nonpos_spice="));
+
+        query.format = Format::prometheus;
+        response = client.call(query);
+        ASSERT_EQ(0, response.status);
+        EXPECT_NE(std::wstring::npos, response.text.find(L"arrakis_errors_total{method=\"eat_spice\",status=\"nonpos_spice\"} "));
+    }
+#endif
+
+
+    TEST_F(Served, Trace)
+    {
+        Server server(path);
+        Client client(path);
+
+        Request start = request(Method::trace);
+        start.on = true;
+        Response response = client.call(start);
+        EXPECT_EQ(0, response.status);
+        EXPECT_EQ(Payload::none, response.payload);
+        EXPECT_TRUE(trace::enabled());
+        const uint64_t handle = create(client);
+        client.call(request(Method::mine, handle, 1));
+
+        response = client.call(request(Method::trace));
+        EXPECT_EQ(0, response.status);
+        EXPECT_FALSE(trace::enabled());
+
+        // The server's spans hold the engine's
+        ASSERT_EQ(Payload::text, response.payload);
+        const std::string text(response.text.begin(), response.text.end());
+        EXPECT_EQ(0u, text.find("{\"traceEvents\":["));
+#if !defined(ARRAKIS_NO_TRACE)
+        EXPECT_NE(std::string::npos, text.find("{\"name\":\"create\",\"cat\":\"server\""));
+        EXPECT_NE(std::string::npos, text.find("{\"name\":\"mine\",\"cat\":\"server\""));
+        EXPECT_NE(std::string::npos, text.find("{\"name\":\"seed\",\"cat\":\"engine\""));
+        EXPECT_NE(std::string::npos, text.find("{\"name\":\"lock\",\"cat\":\"engine\""));
+#endif
+    }
+
+
+    // Thousands of requests in one write come back in order
+
+    TEST_F(Served, Pipelining)
+    {
+        Server server(path);
+        Client client(path);
+        const uint64_t handle = create(client);
+        const uint32_t n = 100000;     // Enough responses to pass the server's limit on unsent bytes
+        std::vector<uint32_t> tags;
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            tags.push_back(client.send(get(handle, i % 2 ? Property::first_name : Property::energy)));
+        }
+        client.flush();
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            const Response response = client.receive();
+            ASSERT_EQ(tags[i], response.tag);
+            EXPECT_EQ(0, response.status);
+            EXPECT_EQ(i % 2 ? Payload::text : Payload::integer, response.payload);
+        }
+        Response extra;
+        EXPECT_FALSE(client.try_receive(extra));
+    }
+
+
+    // Requests left buffered when the responses ahead of them drain in one
+    // pass, with nothing more to read, still run. With a limit of one unsent
+    // byte, every wake for writing finds the limit reached and drains the
+    // rest; the watchdog turns a hang into a failure.
+
+    TEST_F(Served, BufferedAfterDrain)
+    {
+        Server::Options options;
+        options.max_unsent = 1;
+        Server server(path, options);
+        Client client(path);
+        const uint64_t handle = create(client);
+        const std::wstring name(16 * 1024, L'F');
+        ASSERT_EQ(0, client.call(put(handle, Property::first_name, name.c_str())).status);
+
+        const uint32_t n = 400;             // Small requests, all read at once; 13 MB of responses
+        for (uint32_t i = 0; i < n; ++i) client.send(get(handle, Property::first_name));
+        client.flush();
+
+        std::mutex mutex;
+        std::condition_variable finished;
+        bool done = false;
+        std::thread watchdog([&]
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!finished.wait_for(lock, std::chrono::seconds(20), [&] { return done; })) shutdown(client.fd(), SHUT_RDWR);
+        });
+        uint32_t received = 0;
+        try
+        {
+            for (; received < n; ++received)
+            {
+                if (client.receive().text.size() != name.size()) break;
+            }
+        }
+        catch (const std::runtime_error&)
+        {
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        finished.notify_one();
+        watchdog.join();
+        EXPECT_EQ(n, received);
+    }
+
+
+    // Saved objects are read in place, created in the table on first write,
+    // and saved back with the rest
+
+    TEST_F(Served, Snapshot)
+    {
+        const std::string file = path + ".arks";
+        std::vector<Ledger> ledgers;
+        for (int64_t i = 0; i < 100; ++i) ledgers.push_back(Ledger{ 100 + i, 1000 * i, i });
+        Snapshot::write(file, ledgers.size(), [&](size_t i)
+        {
+            return State{ Names{ L"Paul", std::to_wstring(i), L"Atreides", L"Duke" }, ledgers[i] };
+        });
+
+        Totals totals;
+        Server::Options options;
+        options.observer = &totals;
+        options.snapshot = file;
+        std::unique_ptr<Server> server(new Server(path, options));
+        Client client(path);
+        EXPECT_EQ(100u, server->objects());
+        EXPECT_EQ(L"41", client.call(get(42, Property::last_name)).text);
+        EXPECT_EQ(141, client.call(get(42, Property::energy)).value);
+        EXPECT_EQ(0, totals.affiliation(L"Atreides").count);   // Reads create nothing
+
+        // A write creates the object, observed from then on
+        EXPECT_EQ(0, client.call(put(42, Property::first_name, L"Leto")).status);
+        EXPECT_EQ(1, totals.affiliation(L"Atreides").count);
+        EXPECT_EQ(L"Leto", client.call(get(42, Property::first_name)).text);
+        EXPECT_EQ(141, client.call(get(42, Property::energy)).value);
+        Response response = client.call(request(Method::clone, 7));
+        ASSERT_EQ(0, response.status);
+        const uint64_t clone = (uint64_t)response.value;
+        EXPECT_EQ(101u, clone);
+        EXPECT_EQ(L"6", client.call(get(clone, Property::last_name)).text);
+        EXPECT_EQ(3, totals.affiliation(L"Atreides").count);
+        EXPECT_EQ(101u, server->objects());
+
+        // Released, saved or created, they are gone
+        EXPECT_EQ(0, client.call(request(Method::release, 1)).status);
+        EXPECT_EQ(0, client.call(request(Method::release, 42)).status);
+        EXPECT_EQ(no_object, client.call(request(Method::release, 1)).status);
+        EXPECT_EQ(no_object, client.call(get(1, Property::spice)).status);
+        EXPECT_EQ(no_object, client.call(request(Method::mine, 1, 1)).status);
+        EXPECT_EQ(no_object, client.call(get(42, Property::spice)).status);
+        EXPECT_EQ(99u, server->objects());
+
+        // Over the file being served; handles are renumbered in order
+        server->save(file);
+        server.reset();
+        EXPECT_EQ(0, totals.affiliation(L"Atreides").count);
+        Snapshot saved(file);
+        ASSERT_EQ(99u, saved.size());
+        EXPECT_EQ(L"1", saved.names(0).last_name);
+        EXPECT_EQ(L"43", saved.names(41).last_name);
+        EXPECT_EQ(L"6", saved.names(98).last_name);
+        EXPECT_EQ(106, saved.ledger(98).energy);
+        std::remove(file.c_str());
+
+        options.snapshot = file;
+        EXPECT_THROW(Server(path, options), std::system_error);
+    }
+
+
+    // Objects restored from a journal take the first handles and are
+    // recorded from then on; stopped and closed, they are not recorded as
+    // destroyed
+
+    TEST_F(Served, Journal)
+    {
+        const std::string file = path + ".journal";
+        {
+            Journal journal(file);
+            Server::Options options;
+            options.observer = &journal;
+            journal.restore([&]
+            {
+                for (int64_t i = 0; i < 3; ++i)
+                {
+                    auto obj = std::make_shared<Arrakeener>(Names{ L"Paul", std::to_wstring(i), L"", L"" }, Ledger{ 1000, 100000000, i }, 1);
+                    journal.attach(*obj);
+                    options.objects.push_back(std::move(obj));
+                }
+            });
+            Server server(path, options);
+            options.objects.clear();
+            Client client(path);
+            EXPECT_EQ(3u, server.objects());
+            EXPECT_EQ(L"2", client.call(get(3, Property::last_name)).text);
+            EXPECT_EQ(0, client.call(request(Method::release, 1)).status);
+            EXPECT_EQ(0, client.call(put(2, Property::first_name, L"Leto")).status);
+            EXPECT_EQ(4u, create(client));
+
+            server.stop();
+            EXPECT_EQ(0u, server.connections());
+            EXPECT_EQ(3u, server.objects());
+            journal.close();
+        }
+
+        Replay replay = Journal::replay(file);
+        std::remove(file.c_str());
+        std::vector<State> states = replay.take();
+        ASSERT_EQ(3u, states.size());
+        EXPECT_EQ(L"Leto", states[0].names.first_name);
+        EXPECT_EQ(L"2", states[1].names.last_name);
+        EXPECT_EQ(2, states[1].ledger.spice);
+    }
+
+
+    // Clients on several reactors share objects; every delta is counted once
+
+    TEST_F(Served, Reactors)
+    {
+        Totals totals;
+        std::unique_ptr<Server> server(new Server(path, 4, &totals));
+        uint64_t shared;
+        {
+            Client client(path);
+            shared = create(client);
+        }
+
+        const int threads = 8, rounds = 200;
+        std::atomic<int64_t> mined(0);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&]
+            {
+                Client client(path);
+                const uint64_t own = create(client);
+                int64_t sum = 0;
+                for (int round = 0; round < rounds; ++round)
+                {
+                    client.send(request(Method::mine, shared, 1));
+                    client.send(request(Method::mine, own, 1));
+                    sum += client.receive().value;
+                    client.receive();
+                }
+                mined += sum;
+            });
+        }
+        for (auto& worker : workers) worker.join();
+
+        Client client(path);
+        EXPECT_EQ(mined.load(), client.call(get(shared, Property::spice)).value);
+        EXPECT_EQ(threads + 1, totals.affiliation(L"").count);
+        server.reset();                     // Destroys the objects
+        EXPECT_EQ(0, totals.affiliation(L"").count);
+    }
+
+
+    // A frame beyond the limit ends the connection but not the server
+
+    TEST_F(Served, Oversized)
+    {
+        Server server(path, 2);
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        ASSERT_GE(fd, 0);
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        std::snprintf(address.sun_path, sizeof(address.sun_path), "%s", path.c_str());
+        ASSERT_EQ(0, connect(fd, (const sockaddr*)&address, sizeof(address)));
+        const uint8_t header[] = { 0, 0, 0x10, 0 };     // 1 MB
+        ASSERT_EQ((ssize_t)sizeof(header), send(fd, header, sizeof(header), MSG_NOSIGNAL));
+        uint8_t byte;
+        EXPECT_EQ(0, recv(fd, &byte, 1, 0));
+        close(fd);
+
+        Client client(path);
+        create(client);
+        EXPECT_THROW(Client(path + ".missing"), std::system_error);
+    }
+}
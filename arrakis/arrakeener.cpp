@@ -1,142 +1,257 @@
 // arrakeener.cpp
 #include "arrakeener.h"
 #include "arrakis.h"
+#include "directory.h"
+#include "journal.h"
+#include "leaderboard.h"
 #include "resource.h"
+#include "rng.h"
+#include "simulation.h"
+#include "stats.h"
+#include "totals.h"
+#include "trace.h"
 #include <cassert>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-// COMPUTATIONS
+// HELPERS
 //
 
-// Generate a random number within the provided range
+// Copy a string property into a new BSTR
 
-static LONGLONG randrange(int lower, int upper)
+static HRESULT get_string(std::wstring const& value, BSTR* pRet) noexcept
 {
-    assert(lower < upper);
-    int num = (rand() % (upper - lower + 1)) + lower;
-    return (LONGLONG)num;
+    *pRet = SysAllocString(value.c_str());  // c_str is nothrow
+    return *pRet ? S_OK : E_OUTOFMEMORY;
 }
 
 
-// Safe add (see C CERT rule 04  which addresses integer safety)
+// Call a property getter or setter of the engine, translating exceptions
 
-static bool safe_add(int64_t const a, int64_t const b, int64_t& sum)
+template <typename F>
+static HRESULT call_core(F f) noexcept
 {
-    assert(b >= 0);
-    if ((b > 0) && (a > (INT64_MAX - b))) return false;
-    sum = a + b;
-    return true;
+    try
+    {
+        return f();
+    }
+    catch (std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+    catch (...)
+    {
+        return E_FAIL;
+    }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// CArrakeener: Instance class for Arrakeener
+//
+
+ITypeInfo* CArrakeener::s_pti = nullptr;
+IErrorInfo* CArrakeener::s_errors[arrakis::status_count] = {};
+
 
-// Safe multiply (see C CERT rule 04  which addresses integer safety)
+// Never destroyed, like the pool; every person is counted and ranked from
+// creation
 
-static bool safe_multiply(int64_t const a, int64_t const b, int64_t& prod)
+static arrakis::Totals& totals()
 {
-    assert(a > 0);
-    assert(b > 0);
-    if (a > (INT64_MAX / b)) return false;
-    prod = a * b;
-    return true;
+    static auto* instance = new arrakis::Totals;
+    return *instance;
+}
+
+
+static arrakis::Leaderboard& leaderboard(arrakis::Field field)
+{
+    static auto* energy = new arrakis::Leaderboard(arrakis::Field::energy);
+    static auto* solaris = new arrakis::Leaderboard(arrakis::Field::solaris);
+    static auto* spice = new arrakis::Leaderboard(arrakis::Field::spice);
+    switch (field)
+    {
+    case arrakis::Field::energy: return *energy;
+    case arrakis::Field::solaris: return *solaris;
+    default: return *spice;
+    }
+}
+
+
+// Set by Restore before the first person, if at all, and never destroyed
+
+static arrakis::Journal* s_journal = nullptr;
+
+
+static arrakis::Observer& observers()
+{
+    static auto* instance = []
+    {
+        std::vector<arrakis::Observer*> all = { &totals(),
+            &leaderboard(arrakis::Field::energy), &leaderboard(arrakis::Field::solaris), &leaderboard(arrakis::Field::spice) };
+        if (s_journal) all.push_back(s_journal);
+        return new arrakis::Observers(std::move(all));
+    }();
+    return *instance;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-//
-// CArrakeener: Instance class for Arrakeener
-//
 
 CArrakeener::CArrakeener() :
+    m_rc(0)
+{
+    assert(s_pti);
+    m_core.observe(&observers());       // Clones inherit the observer
+}
+
+
+CArrakeener::CArrakeener(const CArrakeener& obj) :
     m_rc(0),
-    m_pti(nullptr),
-    m_energy(randrange(1, 100)),
-    m_solaris(randrange(200000, 400000)),
-    m_spice(0)
+    m_core(obj.m_core)
 {
-    ITypeLib* ptl = nullptr;
-    HRESULT hr = LoadRegTypeLib(LIBID_Arrakis, 1, 0, 0, &ptl);
-    if(FAILED(hr)) throw hr;
-    hr = ptl->GetTypeInfoOfGuid(IID_IArrakeener, &m_pti);
-    ptl->Release();
-    if (FAILED(hr)) throw hr;
-    assert(m_pti);
+}
+
 
-    InitializeCriticalSection(&m_cs);
+CArrakeener::CArrakeener(arrakis::Arrakeener::Clones& clones) noexcept :
+    m_rc(0),
+    m_core(clones)
+{
 }
 
 
-CArrakeener::CArrakeener(const CArrakeener& obj) :
+CArrakeener::CArrakeener(arrakis::Names names, const arrakis::Ledger& ledger, uint64_t seed) :
     m_rc(0),
-    m_pti(obj.m_pti),
-    m_first_name(obj.m_first_name),
-    m_last_name(obj.m_last_name),
-    m_affiliation(obj.m_affiliation),
-    m_occupation(obj.m_occupation),
-    m_energy(obj.m_energy),
-    m_solaris(obj.m_solaris),
-    m_spice(obj.m_spice)
+    m_core(std::move(names), ledger, seed)
 {
-    m_pti->AddRef();
-    InitializeCriticalSection(&m_cs);
+    assert(s_pti);
+    m_core.observe(&observers());
 }
 
 
 CArrakeener::~CArrakeener() noexcept
 {
-    m_pti->Release();
-    DeleteCriticalSection(&m_cs);
 }
 
 
-void CArrakeener::Lock() noexcept
+// The pool is never destroyed, so objects released during shutdown still
+// have somewhere to go
+
+arrakis::Pool& CArrakeener::pool()
 {
-    EnterCriticalSection(&m_cs);
+    static arrakis::Pool* instance = new arrakis::Pool(sizeof(CArrakeener));
+    return *instance;
 }
 
 
-void CArrakeener::Unlock() noexcept
+void* CArrakeener::operator new(size_t size)
 {
-    LeaveCriticalSection(&m_cs);
+    assert(size == sizeof(CArrakeener));
+    return pool().allocate();
 }
 
 
-void CArrakeener::SetError(UINT id) noexcept
+void CArrakeener::operator delete(void* p) noexcept
 {
+    pool().deallocate(p);
+}
+
+
+// Build an error object with the description from the resources, or the
+// engine's text if the resource is missing
+
+HRESULT CArrakeener::CreateError(UINT id, const wchar_t* fallback, IErrorInfo** ppei) noexcept
+{
+    *ppei = nullptr;
     ICreateErrorInfo* pcei = nullptr;
     HRESULT hr = CreateErrorInfo(&pcei);
-    if (FAILED(hr)) return;
+    if (FAILED(hr)) return hr;
 
     pcei->SetSource(const_cast<wchar_t*>(L"Arrakis.Arrakeener.1"));
     pcei->SetGUID(IID_IArrakeener);
 
-    wchar_t buf[1024];
-    int cch = LoadStringW(GetModuleHandle(nullptr), id, buf, sizeof(buf) / sizeof(buf[0]));
-    if (cch > 0)
+    const wchar_t* text = nullptr;
+    int cch = LoadStringW(GetModuleHandle(nullptr), id, (LPWSTR)&text, 0);   // Read-only pointer to the resource
+    BSTR description = cch > 0 ? SysAllocStringLen(text, cch) : nullptr;   // Resource strings are not terminated
+    pcei->SetDescription(description ? description : const_cast<wchar_t*>(fallback));
+    SysFreeString(description);
+
+    hr = pcei->QueryInterface(IID_IErrorInfo, (void**)ppei);
+    pcei->Release();
+    return hr;
+}
+
+
+// LoadRegTypeLib reads the registry and the type library file, and error
+// objects need a resource lookup, so both are done once per process rather
+// than once per object or per failure
+
+HRESULT CArrakeener::Initialize() noexcept
+{
+    assert(!s_pti);
+    ITypeLib* ptl = nullptr;
+    HRESULT hr = LoadRegTypeLib(LIBID_Arrakis, 1, 0, 0, &ptl);
+    if (FAILED(hr)) return hr;
+    hr = ptl->GetTypeInfoOfGuid(IID_IArrakeener2, &s_pti);  // Describes both interfaces
+    ptl->Release();
+    if (FAILED(hr)) return hr;
+
+    static const UINT ids[arrakis::status_count] =
     {
-        assert(cch < sizeof(buf) / sizeof(buf[0]));
-        buf[cch + 1] = (wchar_t)0;
-        pcei->SetDescription(buf);
-    }
-    else
+        0,
+        IDS_OVERFLOW,
+        IDS_NONPOSSPICE,
+        IDS_NOSPICE,
+        IDS_NOENERGY,
+        IDS_NOSOLARIS,
+        IDS_NOHARVESTER
+    };
+
+    for (int i = 1; i < arrakis::status_count; ++i)
     {
-        pcei->SetDescription(const_cast<wchar_t*>(L"Could not load resource string"));
+        const wchar_t* fallback = arrakis::status_info((arrakis::Status)i).message;
+        hr = CreateError(ids[i], fallback, &s_errors[i]);
+        if (FAILED(hr))
+        {
+            Uninitialize();
+            return hr;
+        }
     }
+    return S_OK;
+}
 
-    IErrorInfo* pei = nullptr;
-    hr = pcei->QueryInterface(IID_IErrorInfo, (void**)&pei);
-    if (SUCCEEDED(hr))
+
+void CArrakeener::Uninitialize() noexcept
+{
+    for (IErrorInfo*& pei : s_errors)
     {
-        SetErrorInfo(0, pei);
-        pei->Release();
+        if (pei) pei->Release();
+        pei = nullptr;
     }
+    if (s_pti) s_pti->Release();
+    s_pti = nullptr;
 
-    pcei->Release();
+    // Everyone is gone by now; unless that is on disk, they come back
+    if (s_journal) call_core([] { s_journal->flush(); return S_OK; });
+}
+
+
+// Translate the outcome of an engine operation into an HRESULT
+// The error objects are immutable, so every failure of a kind reuses one.
+
+HRESULT CArrakeener::Result(arrakis::Status status) noexcept
+{
+    if (status == arrakis::Status::ok) return S_OK;
+    arrakis::trace::Span span("com", "SetError");
+    SetErrorInfo(0, s_errors[(int)status]);
+    return arrakis::status_info(status).invalid_argument ? E_INVALIDARG : E_FAIL;
 }
 
 
 STDMETHODIMP CArrakeener::InterfaceSupportsErrorInfo(REFIID riid)
 {
-    return riid == IID_IArrakeener ? S_OK : S_FALSE;
+    return riid == IID_IArrakeener || riid == IID_IArrakeener2 ? S_OK : S_FALSE;
 }
 
 
@@ -149,7 +264,7 @@ STDMETHODIMP CArrakeener::QueryInterface(REFIID riid, void** ppv)
 
     assert(ppv);
     if (riid == IID_IUnknown || riid == IID_IDispatch) *ppv = static_cast<IDispatch*>(this);
-    else if (riid == IID_IArrakeener) *ppv = static_cast<IArrakeener*>(this);
+    else if (riid == IID_IArrakeener || riid == IID_IArrakeener2) *ppv = static_cast<IArrakeener2*>(this);
     else if (riid == IID_ISupportErrorInfo) *ppv = static_cast<ISupportErrorInfo*>(this);
     else return (*ppv = nullptr), E_NOINTERFACE;
     reinterpret_cast<IUnknown*>(this)->AddRef();
@@ -188,7 +303,7 @@ STDMETHODIMP CArrakeener::GetTypeInfo(UINT iTInfo, LCID lcid, ITypeInfo** ppTInf
 {
     assert(!iTInfo);
     assert(ppTInfo);
-    (*ppTInfo = m_pti)->AddRef();
+    (*ppTInfo = s_pti)->AddRef();
     return S_OK;
 }
 
@@ -201,7 +316,7 @@ STDMETHODIMP CArrakeener::GetIDsOfNames(
     DISPID* rgDispId)
 {
     assert(riid == IID_NULL);
-    return m_pti->GetIDsOfNames(rgszNames, cNames, rgDispId);
+    return s_pti->GetIDsOfNames(rgszNames, cNames, rgDispId);
 }
 
 
@@ -216,7 +331,7 @@ STDMETHODIMP CArrakeener::Invoke(
     UINT* puArgErr)
 {
     assert(riid == IID_NULL);
-    return m_pti->Invoke(
+    return s_pti->Invoke(
         static_cast<IDispatch*>(this),
         dispIdMember,
         wFlags,
@@ -229,97 +344,116 @@ STDMETHODIMP CArrakeener::Invoke(
 
 STDMETHODIMP CArrakeener::get_FirstName(BSTR* pRet)
 {
-    HRESULT hr;
     assert(pRet);
-    Lock();
-    *pRet = SysAllocString(m_first_name.c_str());   // c_str is nothrow
-    hr = *pRet ? S_OK : E_OUTOFMEMORY;
-    Unlock();
-    return hr;
+    return call_core([&] { return get_string(m_core.first_name(), pRet); });
 }
 
 
 STDMETHODIMP CArrakeener::put_FirstName(BSTR value)
 {
-    HRESULT hr;
-    Lock();
+    return call_core([&] { m_core.set_first_name(value); return S_OK; });
+}
 
-    try
-    {
-        m_first_name = value ? value : L"";
-        hr = S_OK;
-    }
-    catch (std::bad_alloc&)
-    {
-        hr = E_OUTOFMEMORY;
-    }
-    catch (...)
-    {
-        hr = E_FAIL;
-    }
 
-    Unlock();
-    return hr;
+STDMETHODIMP CArrakeener::get_LastName(BSTR* pRet)
+{
+    assert(pRet);
+    return call_core([&] { return get_string(m_core.last_name(), pRet); });
 }
 
 
-STDMETHODIMP::CArrakeener::get_LastName(BSTR* pRet)
+STDMETHODIMP CArrakeener::put_LastName(BSTR value)
+{
+    return call_core([&] { m_core.set_last_name(value); return S_OK; });
+}
+
+
+STDMETHODIMP CArrakeener::get_Affiliation(BSTR* pRet)
 {
-    HRESULT hr;
     assert(pRet);
-    Lock();
-    *pRet = SysAllocString(m_last_name.c_str());
-    hr = *pRet ? S_OK : E_OUTOFMEMORY;
-    Unlock();
-    return hr;
+    return call_core([&] { return get_string(m_core.affiliation(), pRet); });
 }
 
 
-STDMETHODIMP CArrakeener::put_LastName(BSTR value)
+STDMETHODIMP CArrakeener::put_Affiliation(BSTR value)
 {
-    HRESULT hr;
-    Lock();
+    return call_core([&] { m_core.set_affiliation(value); return S_OK; });
+}
 
-    try
-    {
-        m_last_name = value ? value : L"";
-        hr = S_OK;
-    }
-    catch (std::bad_alloc&)
-    {
-        hr = E_OUTOFMEMORY;
-    }
-    catch (...)
-    {
-        hr = E_FAIL;
-    }
 
-    Unlock();
-    return hr;
+STDMETHODIMP CArrakeener::get_Occupation(BSTR* pRet)
+{
+    assert(pRet);
+    return call_core([&] { return get_string(m_core.occupation(), pRet); });
 }
 
 
-STDMETHODIMP::CArrakeener::get_Affiliation(BSTR* pRet)
+STDMETHODIMP CArrakeener::put_Occupation(BSTR value)
+{
+    return call_core([&] { m_core.set_occupation(value); return S_OK; });
+}
+
+
+STDMETHODIMP CArrakeener::get_Energy(LONGLONG* pRet)
 {
-    HRESULT hr;
     assert(pRet);
-    Lock();
-    *pRet = SysAllocString(m_affiliation.c_str());
-    hr = *pRet ? S_OK : E_OUTOFMEMORY;
-    Unlock();
-    return hr;
+    *pRet = m_core.energy();
+    return S_OK;
 }
 
 
-STDMETHODIMP CArrakeener::put_Affiliation(BSTR value)
+STDMETHODIMP CArrakeener::get_Solaris(LONGLONG* pRet)
+{
+    assert(pRet);
+    *pRet = m_core.solaris();
+    return S_OK;
+}
+
+
+STDMETHODIMP CArrakeener::get_Spice(LONGLONG* pRet)
+{
+    assert(pRet);
+    *pRet = m_core.spice();
+    return S_OK;
+}
+
+
+STDMETHODIMP CArrakeener::EatSpice(LONGLONG units, LONGLONG* pDeltaEnergy)
+{
+    arrakis::trace::Span span("com", "EatSpice");
+    assert(pDeltaEnergy);
+    return Result(m_core.eat_spice(units, *pDeltaEnergy));
+}
+
+
+STDMETHODIMP CArrakeener::SellSpice(LONGLONG units, LONGLONG* pDeltaSolaris)
+{
+    arrakis::trace::Span span("com", "SellSpice");
+    assert(pDeltaSolaris);
+    return Result(m_core.sell_spice(units, *pDeltaSolaris));
+}
+
+
+STDMETHODIMP CArrakeener::MineSpice(LONGLONG harvesters, LONGLONG* pDeltaSpice)
+{
+    arrakis::trace::Span span("com", "MineSpice");
+    assert(pDeltaSpice);
+    return Result(m_core.mine_spice(harvesters, *pDeltaSpice));
+}
+
+
+STDMETHODIMP CArrakeener::Clone(IArrakeener** ppArrakeener)
 {
     HRESULT hr;
-    Lock();
+    assert(ppArrakeener);
+    *ppArrakeener = nullptr;
 
     try
     {
-        m_affiliation = value ? value : L"";
-        hr = S_OK;
+        CArrakeener* p = new CArrakeener(*this);
+        p->AddRef();
+        hr = p->QueryInterface(IID_IArrakeener, reinterpret_cast<void**>(ppArrakeener));
+        p->Release();
     }
     catch (std::bad_alloc&)
     {
@@ -330,263 +464,574 @@ STDMETHODIMP CArrakeener::put_Affiliation(BSTR value)
         hr = E_FAIL;
     }
 
-    Unlock();
     return hr;
 }
 
+// Everything that can fail is done before the first clone is constructed:
+// the array, the storage for all clones, and the identity references
 
-STDMETHODIMP CArrakeener::get_Occupation(BSTR* pRet)
+STDMETHODIMP CArrakeener::CloneMany(LONG count, SAFEARRAY** pClones)
 {
-    HRESULT hr;
-    assert(pRet);
-    Lock();
-    *pRet = SysAllocString(m_occupation.c_str());
-    hr = *pRet ? S_OK : E_OUTOFMEMORY;
-    Unlock();
-    return hr;
+    assert(pClones);
+    *pClones = nullptr;
+    if (count <= 0) return E_INVALIDARG;
+    const size_t n = (size_t)count;
+
+    SAFEARRAYBOUND bound = { (ULONG)n, 0 };
+    SAFEARRAY* psa = SafeArrayCreateEx(VT_DISPATCH, 1, &bound, const_cast<IID*>(&IID_IArrakeener));
+    if (!psa) return E_OUTOFMEMORY;
+
+    std::vector<void*> slots;
+    HRESULT hr = call_core([&]
+    {
+        slots.resize(n);
+        pool().allocate_many(slots.data(), n);
+        try
+        {
+            arrakis::Arrakeener::Clones clones = m_core.clones(n);
+
+            IArrakeener** data = nullptr;
+            SafeArrayAccessData(psa, (void**)&data);
+            for (size_t i = 0; i < n; ++i)
+            {
+                CArrakeener* p = new (slots[i]) CArrakeener(clones);
+                p->AddRef();
+                data[i] = static_cast<IArrakeener*>(p);
+            }
+            SafeArrayUnaccessData(psa);
+        }
+        catch (...)
+        {
+            for (void* slot : slots) pool().deallocate(slot);
+            throw;
+        }
+        return S_OK;
+    });
+
+    if (FAILED(hr))
+    {
+        SafeArrayDestroy(psa);
+        return hr;
+    }
+    *pClones = psa;
+    return S_OK;
 }
 
+// Run a batch operation over a one-dimensional array of LONGLONG
+// Returns S_FALSE if any element failed; see pResults for the outcomes
 
-STDMETHODIMP CArrakeener::put_Occupation(BSTR value)
+HRESULT CArrakeener::Batch(BatchFn fn, SAFEARRAY* psa, SAFEARRAY** ppDeltas, SAFEARRAY** ppResults) noexcept
 {
-    HRESULT hr;
-    Lock();
+    static_assert((LONG)arrakis::Status::no_harvester == ArrakeenerNoHarvester, "Status must match ArrakeenerStatus");
 
-    try
+    assert(ppDeltas);
+    assert(ppResults);
+    *ppDeltas = nullptr;
+    *ppResults = nullptr;
+
+    VARTYPE vt = VT_EMPTY;
+    if (!psa || SafeArrayGetDim(psa) != 1 || FAILED(SafeArrayGetVartype(psa, &vt)) || vt != VT_I8)
     {
-        m_occupation = value ? value : L"";
-        hr = S_OK;
+        return E_INVALIDARG;
     }
-    catch (std::bad_alloc&)
+
+    LONG lower = 0, upper = -1;
+    SafeArrayGetLBound(psa, 1, &lower);
+    SafeArrayGetUBound(psa, 1, &upper);
+    const ULONG n = (ULONG)(upper - lower + 1);
+
+    HRESULT hr = E_OUTOFMEMORY;
+    SAFEARRAY* psaDeltas = SafeArrayCreateVector(VT_I8, 0, n);
+    SAFEARRAY* psaResults = SafeArrayCreateVector(VT_I4, 0, n);
+    if (psaDeltas && psaResults)
     {
-        hr = E_OUTOFMEMORY;
+        LONGLONG* values = nullptr;
+        LONGLONG* deltas = nullptr;
+        LONG* results = nullptr;
+        SafeArrayAccessData(psa, (void**)&values);
+        SafeArrayAccessData(psaDeltas, (void**)&deltas);
+        SafeArrayAccessData(psaResults, (void**)&results);
+
+        hr = call_core([&]
+        {
+            std::vector<arrakis::Status> status(n);
+            size_t succeeded = (m_core.*fn)(values, n, deltas, status.data());
+            for (ULONG i = 0; i < n; ++i) results[i] = (LONG)status[i];
+            return succeeded == n ? S_OK : S_FALSE;
+        });
+
+        SafeArrayUnaccessData(psaResults);
+        SafeArrayUnaccessData(psaDeltas);
+        SafeArrayUnaccessData(psa);
     }
-    catch (...)
+
+    if (SUCCEEDED(hr))
     {
-        hr = E_FAIL;
+        *ppDeltas = psaDeltas;
+        *ppResults = psaResults;
+    }
+    else
+    {
+        if (psaDeltas) SafeArrayDestroy(psaDeltas);
+        if (psaResults) SafeArrayDestroy(psaResults);
     }
-
-    Unlock();
     return hr;
 }
 
 
-STDMETHODIMP CArrakeener::get_Energy(LONGLONG* pRet)
+STDMETHODIMP CArrakeener::EatSpiceBatch(SAFEARRAY* units, SAFEARRAY** pDeltaEnergy, SAFEARRAY** pResults)
 {
-    assert(pRet);
-    Lock();
-    *pRet = m_energy;
-    Unlock();
-    return S_OK;
+    return Batch(&arrakis::Arrakeener::eat_spice_batch, units, pDeltaEnergy, pResults);
 }
 
 
-STDMETHODIMP CArrakeener::get_Solaris(LONGLONG* pRet)
+STDMETHODIMP CArrakeener::SellSpiceBatch(SAFEARRAY* units, SAFEARRAY** pDeltaSolaris, SAFEARRAY** pResults)
 {
-    assert(pRet);
-    Lock();
-    *pRet = m_solaris;
-    Unlock();
-    return S_OK;
+    return Batch(&arrakis::Arrakeener::sell_spice_batch, units, pDeltaSolaris, pResults);
 }
 
 
-STDMETHODIMP CArrakeener::get_Spice(LONGLONG* pRet)
+STDMETHODIMP CArrakeener::MineSpiceBatch(SAFEARRAY* harvesters, SAFEARRAY** pDeltaSpice, SAFEARRAY** pResults)
 {
-    assert(pRet);
-    Lock();
-    *pRet = m_spice;
-    Unlock();
-    return S_OK;
+    return Batch(&arrakis::Arrakeener::mine_spice_batch, harvesters, pDeltaSpice, pResults);
 }
 
 
-STDMETHODIMP CArrakeener::EatSpice(LONGLONG units, LONGLONG* pDeltaEnergy)
+STDMETHODIMP CArrakeener::GetState(ArrakeenerState* pState)
 {
-    HRESULT hr;
-    assert(pDeltaEnergy);
-    Lock();
-    *pDeltaEnergy = 0;
+    assert(pState);
+    ZeroMemory(pState, sizeof(*pState));
 
-    if (units < 1)
+    HRESULT hr = call_core([&]
+    {
+        const arrakis::State state = m_core.state();
+        pState->FirstName = SysAllocString(state.names.first_name.c_str());
+        pState->LastName = SysAllocString(state.names.last_name.c_str());
+        pState->Affiliation = SysAllocString(state.names.affiliation.c_str());
+        pState->Occupation = SysAllocString(state.names.occupation.c_str());
+        pState->Energy = state.ledger.energy;
+        pState->Solaris = state.ledger.solaris;
+        pState->Spice = state.ledger.spice;
+        return pState->FirstName && pState->LastName && pState->Affiliation && pState->Occupation ? S_OK : E_OUTOFMEMORY;
+    });
+
+    if (FAILED(hr))
     {
-        SetError(IDS_NONPOSSPICE);
-        hr = E_INVALIDARG;
+        SysFreeString(pState->FirstName);   // SysFreeString accepts null
+        SysFreeString(pState->LastName);
+        SysFreeString(pState->Affiliation);
+        SysFreeString(pState->Occupation);
+        ZeroMemory(pState, sizeof(*pState));
     }
-    else if (m_spice < units)
+    return hr;
+}
+
+// Decode steps of six LONGLONG values (see arrakis.idl)
+
+static HRESULT decode_steps(SAFEARRAY* psa, std::vector<arrakis::Step>& steps)
+{
+    static_assert((int)arrakis::Op::mine == ArrakeenerMine, "Op must match ArrakeenerOp");
+    static_assert((int)arrakis::Field::spice == ArrakeenerSpice, "Field must match ArrakeenerField");
+    static_assert((int)arrakis::Compare::greater_equal == ArrakeenerGreaterEqual, "Compare must match ArrakeenerCompare");
+    const ULONG values_per_step = 6;
+    const ULONG max_steps = 256;
+
+    VARTYPE vt = VT_EMPTY;
+    if (!psa || SafeArrayGetDim(psa) != 1 || FAILED(SafeArrayGetVartype(psa, &vt)) || vt != VT_I8)
     {
-        SetError(IDS_NOSPICE);
-        hr = E_FAIL;
+        return E_INVALIDARG;
     }
-    else
+
+    LONG lower = 0, upper = -1;
+    SafeArrayGetLBound(psa, 1, &lower);
+    SafeArrayGetUBound(psa, 1, &upper);
+    const ULONG count = (ULONG)(upper - lower + 1);
+    const ULONG n = count / values_per_step;
+    if (n == 0 || n > max_steps || count % values_per_step) return E_INVALIDARG;
+
+    LONGLONG* values = nullptr;
+    HRESULT hr = SafeArrayAccessData(psa, (void**)&values);
+    if (FAILED(hr)) return hr;
+
+    steps.resize(n);
+    for (ULONG i = 0; i < n && SUCCEEDED(hr); ++i)
     {
-        LONGLONG delta_energy = 0;
-        if (!safe_multiply(randrange(1, 100), units, delta_energy))
+        const LONGLONG* v = values + i * values_per_step;
+        if (v[0] < 0 || v[0] > ArrakeenerMine || v[2] < 0 || v[2] > ArrakeenerSpice ||
+            v[3] < 0 || v[3] > ArrakeenerGreaterEqual || v[5] < 1 || v[5] > arrakis::max_step_runs)
         {
-            SetError(IDS_OVERFLOW);
-            hr = E_FAIL;
+            hr = E_INVALIDARG;
+            break;
         }
-        else
-        {
-            LONGLONG new_energy = 0;
-            if (!safe_add(m_energy, delta_energy, new_energy))
-            {
-                SetError(IDS_OVERFLOW);
-                hr = E_FAIL;
-            }
-            else
-            {
-                m_spice -= units;           // This cannot overflow
-                m_energy = new_energy;      // This has been checked
 
-                *pDeltaEnergy = delta_energy;
-                hr = S_OK;
-            }
-        }
+        arrakis::Step& step = steps[i];
+        step.op = (arrakis::Op)v[0];
+        step.arg = (v[1] == 0 && step.op != arrakis::Op::mine) ? arrakis::all_spice : v[1];
+        step.condition = { (arrakis::Field)v[2], (arrakis::Compare)v[3], v[4] };
+        step.max_runs = (uint32_t)v[5];
+        if (!arrakis::valid(step)) hr = E_INVALIDARG;
     }
 
-    Unlock();
+    SafeArrayUnaccessData(psa);
     return hr;
 }
 
 
-STDMETHODIMP CArrakeener::SellSpice(LONGLONG units, LONGLONG* pDeltaSolaris)
+// Run steps as one transaction
+// Returns S_FALSE, with the error of the failing step, if it rolled back
+
+STDMETHODIMP CArrakeener::Transact(SAFEARRAY* psa, SAFEARRAY** pDeltas, LONG* pFailedStep, ArrakeenerStatus* pStatus)
 {
-    HRESULT hr;
-    assert(pDeltaSolaris);
-    Lock();
-    *pDeltaSolaris = 0;
+    assert(pDeltas);
+    assert(pFailedStep);
+    assert(pStatus);
+    *pDeltas = nullptr;
+    *pFailedStep = -1;
+    *pStatus = ArrakeenerOK;
+
+    std::vector<arrakis::Step> steps;
+    std::vector<arrakis::StepResult> results;
+    arrakis::Status status = arrakis::Status::ok;
+    size_t failed = 0;
+    HRESULT hr = call_core([&]
+    {
+        HRESULT hr = decode_steps(psa, steps);
+        if (FAILED(hr)) return hr;
+        results.resize(steps.size());
+        status = m_core.transact(steps.data(), steps.size(), results.data(), failed);
+        return S_OK;
+    });
+    if (FAILED(hr)) return hr;
+
+    SAFEARRAY* psaDeltas = SafeArrayCreateVector(VT_I8, 0, (ULONG)results.size());
+    if (!psaDeltas) return E_OUTOFMEMORY;
+    LONGLONG* deltas = nullptr;
+    SafeArrayAccessData(psaDeltas, (void**)&deltas);
+    for (size_t i = 0; i < results.size(); ++i) deltas[i] = results[i].delta;
+    SafeArrayUnaccessData(psaDeltas);
+
+    *pDeltas = psaDeltas;
+    *pStatus = (ArrakeenerStatus)status;
+    if (status == arrakis::Status::ok) return S_OK;
+    *pFailedStep = (LONG)failed;
+    arrakis::trace::Span span("com", "SetError");
+    SetErrorInfo(0, s_errors[(int)status]);
+    return S_FALSE;
+}
 
-    if (units < 1)
+
+// Run trajectories from the current ledger on every core
+// The statistics are laid out as documented in arrakis.idl
+
+STDMETHODIMP CArrakeener::Simulate(SAFEARRAY* policy, LONG cycles, LONG trajectories, LONGLONG seed, SAFEARRAY** pStats)
+{
+    assert(pStats);
+    *pStats = nullptr;
+    if (cycles < 1 || trajectories < 1) return E_INVALIDARG;
+
+    arrakis::Outcome outcome;
+    HRESULT hr = call_core([&]
     {
-        SetError(IDS_NONPOSSPICE);
-        hr = E_INVALIDARG;
-    }
-    else if (m_spice < units)
+        arrakis::Simulation simulation;
+        HRESULT hr = decode_steps(policy, simulation.policy);
+        if (FAILED(hr)) return hr;
+        simulation.start = m_core.current_ledger();
+        simulation.cycles = (uint32_t)cycles;
+        simulation.trajectories = (size_t)trajectories;
+        simulation.seed = (uint64_t)seed;
+        outcome = arrakis::simulate(simulation);
+        return S_OK;
+    });
+    if (FAILED(hr)) return hr;
+
+    const arrakis::Distribution* distributions[] = { &outcome.energy, &outcome.solaris, &outcome.spice };
+    SAFEARRAY* psa = SafeArrayCreateVector(VT_R8, 0, 14);
+    if (!psa) return E_OUTOFMEMORY;
+    double* stats = nullptr;
+    SafeArrayAccessData(psa, (void**)&stats);
+    for (const arrakis::Distribution* d : distributions)
     {
-        SetError(IDS_NOSPICE);
-        hr = E_FAIL;
+        *stats++ = d->mean;
+        for (int64_t q : d->quantiles) *stats++ = (double)q;
     }
-    else
+    *stats++ = outcome.ruin_probability;
+    *stats++ = outcome.mean_cycles;
+    SafeArrayUnaccessData(psa);
+
+    *pStats = psa;
+    return S_OK;
+}
+
+// Reference to a person held by the directory; copies AddRef
+
+class Listed
+{
+    IArrakeener* m_p;
+
+public:
+    Listed() noexcept : m_p(nullptr) {}
+    explicit Listed(IArrakeener* p) noexcept : m_p(p) { if (m_p) m_p->AddRef(); }
+    Listed(const Listed& other) noexcept : Listed(other.m_p) {}
+    Listed(Listed&& other) noexcept : m_p(other.m_p) { other.m_p = nullptr; }
+    Listed& operator=(Listed other) noexcept { std::swap(m_p, other.m_p); return *this; }
+    ~Listed() { if (m_p) m_p->Release(); }
+
+    bool operator==(const Listed& other) const noexcept { return m_p == other.m_p; }
+    IArrakeener* detach() noexcept { IArrakeener* p = m_p; m_p = nullptr; return p; }
+};
+
+
+// Never destroyed, like the pool; listed people stay alive until unlisted
+
+static arrakis::Directory<Listed>& directory()
+{
+    static auto* instance = new arrakis::Directory<Listed>;
+    return *instance;
+}
+
+
+// Only the directory hands people back to clients, so the people recorded
+// in a journal are recreated and listed again, in the order created; one
+// whose names an earlier one took could not be found, and is left out
+
+HRESULT CArrakeener::Restore(const std::string& journal) noexcept
+{
+    assert(s_pti && !s_journal);
+    return call_core([&]
     {
-        LONGLONG delta_solaris = 0;
-        if (!safe_multiply(randrange(200000, 700000), units, delta_solaris))
-        {
-            SetError(IDS_OVERFLOW);
-            hr = E_FAIL;
-        }
-        else
+        std::vector<arrakis::State> states = arrakis::Journal::recover(journal).take();
+        s_journal = new arrakis::Journal(journal);
+        s_journal->restore([&]
         {
-            LONGLONG new_solaris;
-            if (!safe_add(m_solaris, delta_solaris, new_solaris))
+            const uint64_t seed = arrakis::Rng().next();
+            for (size_t i = 0; i < states.size(); ++i)
             {
-                SetError(IDS_OVERFLOW);
-                hr = E_FAIL;
+                const arrakis::Names& names = states[i].names;
+                Listed found;
+                if (directory().find(names.first_name, names.last_name, found)) continue;
+                Listed listed(static_cast<IArrakeener*>(new CArrakeener(names, states[i].ledger, seed + i)));
+                directory().insert(names.first_name, names.last_name, std::move(listed));
             }
-            else
-            {
-                m_spice -= units;           // This cannot overflow
-                m_solaris = new_solaris;    // This has been checked
+        });
+        arrakis::Journal::recovered(journal);
+        return S_OK;
+    });
+}
 
-                *pDeltaSolaris = delta_solaris;
-                hr = S_OK;
-            }
-        }
-    }
 
-    Unlock();
-    return hr;
+// Enumeration cursors pack the shard above the bucket; a finished
+// enumeration is 0, like a new one
+
+static const int cursor_shard_shift = 56;
+
+
+STDMETHODIMP CArrakeener::Register()
+{
+    return call_core([&]
+    {
+        const arrakis::Names names = m_core.current_names();
+        Listed self(static_cast<IArrakeener*>(this));
+        if (!directory().insert(names.first_name, names.last_name, std::move(self))) return HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+        return S_OK;
+    });
 }
 
 
-STDMETHODIMP CArrakeener::MineSpice(LONGLONG harvesters, LONGLONG* pDeltaSpice)
+STDMETHODIMP CArrakeener::Unregister()
 {
-    HRESULT hr;
-    assert(pDeltaSpice);
-    Lock();
-    *pDeltaSpice = 0;
+    return call_core([&]
+    {
+        const arrakis::Names names = m_core.current_names();
+        const Listed self(static_cast<IArrakeener*>(this));
+        return directory().remove(names.first_name, names.last_name, self) ? S_OK : S_FALSE;
+    });
+}
+
 
-    if (harvesters < 1)
+STDMETHODIMP CArrakeener::Find(BSTR firstName, BSTR lastName, IArrakeener** ppArrakeener)
+{
+    assert(ppArrakeener);
+    *ppArrakeener = nullptr;
+    return call_core([&]
     {
-        SetError(IDS_NOHARVESTER);
-        hr = E_INVALIDARG;
-    }
-    else
+        Listed found;
+        const std::wstring_view first(firstName ? firstName : L"", SysStringLen(firstName));
+        const std::wstring_view last(lastName ? lastName : L"", SysStringLen(lastName));
+        if (!directory().find(first, last, found)) return S_FALSE;
+        *ppArrakeener = found.detach();
+        return S_OK;
+    });
+}
+
+
+STDMETHODIMP CArrakeener::Enumerate(LONGLONG* pCursor, LONG count, SAFEARRAY** pBatch)
+{
+    assert(pCursor);
+    assert(pBatch);
+    *pBatch = nullptr;
+    if (count <= 0 || *pCursor < 0) return E_INVALIDARG;
+
+    arrakis::Directory<Listed>::Cursor cursor;
+    cursor.shard = (size_t)((uint64_t)*pCursor >> cursor_shard_shift);
+    cursor.bucket = (uint64_t)*pCursor & (((uint64_t)1 << cursor_shard_shift) - 1);
+    std::vector<Listed> batch;
+    HRESULT hr = call_core([&]
+    {
+        directory().next(cursor, (size_t)count, batch);
+        return S_OK;
+    });
+    if (FAILED(hr)) return hr;
+
+    SAFEARRAYBOUND bound = { (ULONG)batch.size(), 0 };
+    SAFEARRAY* psa = SafeArrayCreateEx(VT_DISPATCH, 1, &bound, const_cast<IID*>(&IID_IArrakeener));
+    if (!psa) return E_OUTOFMEMORY;
+    IArrakeener** data = nullptr;
+    SafeArrayAccessData(psa, (void**)&data);
+    for (size_t i = 0; i < batch.size(); ++i) data[i] = batch[i].detach();
+    SafeArrayUnaccessData(psa);
+
+    *pCursor = cursor.done() ? 0 : (LONGLONG)(((uint64_t)cursor.shard << cursor_shard_shift) | cursor.bucket);
+    *pBatch = psa;
+    return S_OK;
+}
+
+
+// Four values per affiliation, in the order documented in arrakis.idl
+
+STDMETHODIMP CArrakeener::AffiliationTotals(SAFEARRAY** pAffiliations, SAFEARRAY** pTotals)
+{
+    assert(pAffiliations);
+    assert(pTotals);
+    *pAffiliations = nullptr;
+    *pTotals = nullptr;
+
+    std::vector<arrakis::Aggregate> aggregates;
+    HRESULT hr = call_core([&]
     {
-        LONGLONG delta_energy = randrange(1, 10);
-        if (m_energy < delta_energy)
+        aggregates = totals().by_affiliation();
+        return S_OK;
+    });
+    if (FAILED(hr)) return hr;
+
+    SAFEARRAY* psaAffiliations = SafeArrayCreateVector(VT_BSTR, 0, (ULONG)aggregates.size());
+    SAFEARRAY* psaTotals = SafeArrayCreateVector(VT_I8, 0, (ULONG)(4 * aggregates.size()));
+    hr = psaAffiliations && psaTotals ? S_OK : E_OUTOFMEMORY;
+    if (SUCCEEDED(hr))
+    {
+        BSTR* names = nullptr;
+        LONGLONG* values = nullptr;
+        SafeArrayAccessData(psaAffiliations, (void**)&names);
+        SafeArrayAccessData(psaTotals, (void**)&values);
+        for (const arrakis::Aggregate& aggregate : aggregates)
         {
-            SetError(IDS_NOENERGY);
-            hr = E_FAIL;
-        }
-        else
-        {
-            LONGLONG delta_solaris = 0, delta_spice = 0;
-            if (!safe_multiply(randrange(100000, 200000), harvesters, delta_solaris) ||
-                !safe_multiply(randrange(1, 50), harvesters, delta_spice))
-            {
-                SetError(IDS_OVERFLOW);
-                hr = E_FAIL;
-            }
-            else
-            {
-                if (m_solaris < delta_solaris)
-                {
-                    SetError(IDS_NOSOLARIS);
-                    hr = E_FAIL;
-                }
-                else
-                {
-                    LONGLONG new_spice;
-                    if (!safe_add(m_spice, delta_spice, new_spice))
-                    {
-                        SetError(IDS_OVERFLOW);
-                        hr = E_FAIL;
-                    }
-                    else
-                    {
-                        m_energy -= delta_energy;       // This cannot overflow
-                        m_solaris -= delta_solaris;     // This cannot overflow
-                        m_spice = new_spice;            // This has been checked
-
-                        *pDeltaSpice = delta_spice;
-                        hr = S_OK;
-                    }
-                }
-            }
+            *names = SysAllocString(aggregate.affiliation.c_str());
+            if (!*names++) hr = E_OUTOFMEMORY;
+            *values++ = aggregate.count;
+            *values++ = aggregate.totals.energy;
+            *values++ = aggregate.totals.solaris;
+            *values++ = aggregate.totals.spice;
         }
+        SafeArrayUnaccessData(psaTotals);
+        SafeArrayUnaccessData(psaAffiliations);
+    }
+    if (FAILED(hr))
+    {
+        if (psaAffiliations) SafeArrayDestroy(psaAffiliations);
+        if (psaTotals) SafeArrayDestroy(psaTotals);
+        return hr;
     }
 
-    Unlock();
-    return hr;
+    *pAffiliations = psaAffiliations;
+    *pTotals = psaTotals;
+    return S_OK;
 }
 
 
-STDMETHODIMP CArrakeener::Clone(IArrakeener** ppArrakeener)
-{
-    HRESULT hr;
-    assert(ppArrakeener);
-    Lock();
-    *ppArrakeener = nullptr;
+// First and last names of each person, in the order documented in
+// arrakis.idl
 
-    try
+STDMETHODIMP CArrakeener::Leaders(ArrakeenerField field, LONG count, SAFEARRAY** pNames, SAFEARRAY** pValues)
+{
+    assert(pNames);
+    assert(pValues);
+    *pNames = nullptr;
+    *pValues = nullptr;
+    if (field < ArrakeenerEnergy || field > ArrakeenerSpice || count < 0 || (size_t)count > arrakis::Leaderboard::max_top) return E_INVALIDARG;
+
+    std::vector<arrakis::Standing> standings;
+    HRESULT hr = call_core([&]
     {
-        CArrakeener* p = new CArrakeener(*this);
-        p->AddRef();
-        hr = p->QueryInterface(IID_IArrakeener, reinterpret_cast<void**>(ppArrakeener));
-        p->Release();
-    }
-    catch (std::bad_alloc&)
+        standings = leaderboard((arrakis::Field)field).top((size_t)count);
+        return S_OK;
+    });
+    if (FAILED(hr)) return hr;
+
+    SAFEARRAY* psaNames = SafeArrayCreateVector(VT_BSTR, 0, (ULONG)(2 * standings.size()));
+    SAFEARRAY* psaValues = SafeArrayCreateVector(VT_I8, 0, (ULONG)standings.size());
+    hr = psaNames && psaValues ? S_OK : E_OUTOFMEMORY;
+    if (SUCCEEDED(hr))
     {
-        hr = E_OUTOFMEMORY;
+        BSTR* names = nullptr;
+        LONGLONG* values = nullptr;
+        SafeArrayAccessData(psaNames, (void**)&names);
+        SafeArrayAccessData(psaValues, (void**)&values);
+        for (const arrakis::Standing& standing : standings)
+        {
+            *names = SysAllocString(standing.names.first_name.c_str());
+            if (!*names++) hr = E_OUTOFMEMORY;
+            *names = SysAllocString(standing.names.last_name.c_str());
+            if (!*names++) hr = E_OUTOFMEMORY;
+            *values++ = standing.value;
+        }
+        SafeArrayUnaccessData(psaValues);
+        SafeArrayUnaccessData(psaNames);
     }
-    catch (...)
+    if (FAILED(hr))
     {
-        hr = E_FAIL;
+        if (psaNames) SafeArrayDestroy(psaNames);
+        if (psaValues) SafeArrayDestroy(psaValues);
+        return hr;
     }
 
-    Unlock();
-    return hr;
+    *pNames = psaNames;
+    *pValues = psaValues;
+    return S_OK;
+}
+
+STDMETHODIMP CArrakeener::Stats(ArrakeenerStatsFormat format, BSTR* pText)
+{
+    assert(pText);
+    *pText = nullptr;
+    if (format != ArrakeenerSummary && format != ArrakeenerPrometheus) return E_INVALIDARG;
+
+    return call_core([&]
+    {
+        const auto collected = arrakis::stats::collect();
+        const std::string text = format == ArrakeenerPrometheus ? arrakis::stats::prometheus(collected) : arrakis::stats::summary(collected);
+        const std::wstring wide(text.begin(), text.end());
+        return get_string(wide, pText);
+    });
+}
+
+// Starting discards what was traced before; stopping returns it
+
+STDMETHODIMP CArrakeener::Trace(VARIANT_BOOL on, BSTR* pTrace)
+{
+    assert(pTrace);
+    *pTrace = nullptr;
+    return call_core([&]
+    {
+        if (on)
+        {
+            arrakis::trace::flush();
+            arrakis::trace::enable(true);
+            return get_string(std::wstring(), pTrace);
+        }
+        arrakis::trace::enable(false);
+        const std::string text = arrakis::trace::flush();
+        const std::wstring wide(text.begin(), text.end());
+        return get_string(wide, pTrace);
+    });
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -616,6 +1061,7 @@ STDMETHODIMP_(ULONG) CArrakeenerClass::Release()
 
 STDMETHODIMP CArrakeenerClass::CreateInstance(IUnknown* pUnkOuter, REFIID riid, void** ppv)
 {
+    arrakis::trace::Span span("com", "CreateInstance");
     HRESULT hr;
     assert(ppv);    // For out-of-process servers, this is never null
     LockModule();
@@ -645,10 +1091,6 @@ STDMETHODIMP CArrakeenerClass::CreateInstance(IUnknown* pUnkOuter, REFIID riid,
             {
                 hr = E_OUTOFMEMORY;
             }
-            catch (HRESULT& hr2)
-            {
-                hr = hr2;
-            }
             catch (...)
             {
                 hr = E_FAIL;
@@ -2,34 +2,50 @@
 #pragma once
 
 #include "arrakis_h.h"
+#include "core.h"
+#include "pool.h"
+#include <cstdint>
 #include <string>
 
-class CArrakeener : public IArrakeener, public ISupportErrorInfo
+class CArrakeener : public IArrakeener2, public ISupportErrorInfo
 {
     LONG m_rc;                          // Reference count
-    ITypeInfo* m_pti;                   // Pointer to type information
+    static ITypeInfo* s_pti;            // Type information, shared by all objects
+    static IErrorInfo* s_errors[arrakis::status_count];    // Error object for each failure
+    static arrakis::Pool& pool();       // Storage for objects
 
-    CRITICAL_SECTION m_cs;              // Protect access to object
-    void Lock() noexcept;
-    void Unlock() noexcept;
+    arrakis::Arrakeener m_core;         // Object data and game logic
 
-    // Object data
-    std::wstring m_first_name;
-    std::wstring m_last_name;
-    std::wstring m_affiliation;
-    std::wstring m_occupation;
-    LONGLONG m_energy;
-    LONGLONG m_solaris;
-    LONGLONG m_spice;
+    static HRESULT CreateError(UINT id, const wchar_t* fallback, IErrorInfo** ppei) noexcept;
+    HRESULT Result(arrakis::Status status) noexcept;
 
-    void SetError(UINT id) noexcept;    // SetErrorInfo wrapper
+    using BatchFn = size_t (arrakis::Arrakeener::*)(const int64_t*, size_t, int64_t*, arrakis::Status*);
+    HRESULT Batch(BatchFn fn, SAFEARRAY* psa, SAFEARRAY** ppDeltas, SAFEARRAY** ppResults) noexcept;
 
     CArrakeener(const CArrakeener& obj);
+    explicit CArrakeener(arrakis::Arrakeener::Clones& clones) noexcept;
+    CArrakeener(arrakis::Names names, const arrakis::Ledger& ledger, uint64_t seed);   // Restored
 
 public:
     CArrakeener();
     virtual ~CArrakeener() noexcept;
 
+    // Objects are created often; take them from a pool
+    static void* operator new(size_t size);
+    static void operator delete(void* p) noexcept;
+    static void* operator new(size_t, void* p) noexcept { return p; }
+    static void operator delete(void*, void*) noexcept {}
+
+    // Load the type information and error objects once, before the first
+    // object is created
+    static HRESULT Initialize() noexcept;
+    static void Uninitialize() noexcept;
+
+    // After Initialize and before the first object, recreate and register
+    // the people recorded in the journal at the path, and record every
+    // change from then on
+    static HRESULT Restore(const std::string& journal) noexcept;
+
     // IUnknown methods
     STDMETHODIMP QueryInterface(REFIID riid, void** ppv) override;
     STDMETHODIMP_(ULONG) AddRef() override;
@@ -73,6 +89,23 @@ public:
     STDMETHODIMP SellSpice(LONGLONG units, LONGLONG* pDeltaSolaris) override;
     STDMETHODIMP MineSpice(LONGLONG harvesters, LONGLONG* pDeltaSpice) override;
     STDMETHODIMP Clone(IArrakeener** ppArrakeener) override;
+
+    // IArrakeener2 methods
+    STDMETHODIMP EatSpiceBatch(SAFEARRAY* units, SAFEARRAY** pDeltaEnergy, SAFEARRAY** pResults) override;
+    STDMETHODIMP SellSpiceBatch(SAFEARRAY* units, SAFEARRAY** pDeltaSolaris, SAFEARRAY** pResults) override;
+    STDMETHODIMP MineSpiceBatch(SAFEARRAY* harvesters, SAFEARRAY** pDeltaSpice, SAFEARRAY** pResults) override;
+    STDMETHODIMP GetState(ArrakeenerState* pState) override;
+    STDMETHODIMP CloneMany(LONG count, SAFEARRAY** pClones) override;
+    STDMETHODIMP Transact(SAFEARRAY* steps, SAFEARRAY** pDeltas, LONG* pFailedStep, ArrakeenerStatus* pStatus) override;
+    STDMETHODIMP Simulate(SAFEARRAY* policy, LONG cycles, LONG trajectories, LONGLONG seed, SAFEARRAY** pStats) override;
+    STDMETHODIMP Register() override;
+    STDMETHODIMP Unregister() override;
+    STDMETHODIMP Find(BSTR firstName, BSTR lastName, IArrakeener** ppArrakeener) override;
+    STDMETHODIMP Enumerate(LONGLONG* pCursor, LONG count, SAFEARRAY** pBatch) override;
+    STDMETHODIMP AffiliationTotals(SAFEARRAY** pAffiliations, SAFEARRAY** pTotals) override;
+    STDMETHODIMP Leaders(ArrakeenerField field, LONG count, SAFEARRAY** pNames, SAFEARRAY** pValues) override;
+    STDMETHODIMP Stats(ArrakeenerStatsFormat format, BSTR* pText) override;
+    STDMETHODIMP Trace(VARIANT_BOOL on, BSTR* pTrace) override;
 };
 
 class CArrakeenerClass : public IClassFactory
@@ -3,8 +3,8 @@
 #include "arrakis.h"
 #include "arrakis_i.c"
 #include "arrakeener.h"
+#include "stats.h"
 #include <OleCtl.h>
-#include <ctime>
 
 HANDLE g_done = CreateEvent(nullptr, TRUE, FALSE, nullptr);
 
@@ -116,8 +116,6 @@ STDAPI RegisterServer(bool user)
 
 int APIENTRY wWinMain(HINSTANCE, HINSTANCE, LPWSTR lpCmdLine, int)
 {
-    srand((unsigned int)time(nullptr));     // Initialize random seed
-
     HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
     if (FAILED(hr))
     {
@@ -153,20 +151,33 @@ int APIENTRY wWinMain(HINSTANCE, HINSTANCE, LPWSTR lpCmdLine, int)
         return hr;
     }
 
-    DWORD dwReg;
-    static CArrakeenerClass cac;
-    hr = CoRegisterClassObject(
-        CLSID_Arrakeener,
-        &cac,
-        CLSCTX_LOCAL_SERVER,
-        REGCLS_SUSPENDED | REGCLS_MULTIPLEUSE,
-        &dwReg);
+    // Two clock reads a call are little beside a call between processes
+    arrakis::stats::enable(true);
+
+    hr = CArrakeener::Initialize();
+
+    // With ARRAKIS_JOURNAL set to a file, people survive the process
+    char journal[MAX_PATH];
+    const DWORD length = GetEnvironmentVariableA("ARRAKIS_JOURNAL", journal, MAX_PATH);
+    if (SUCCEEDED(hr) && length > 0 && length < MAX_PATH) hr = CArrakeener::Restore(journal);
 
     if (SUCCEEDED(hr))
     {
-        hr = CoResumeClassObjects();
-        if (SUCCEEDED(hr)) WaitForSingleObject(g_done, INFINITE);
-        CoRevokeClassObject(dwReg);
+        DWORD dwReg;
+        static CArrakeenerClass cac;
+        hr = CoRegisterClassObject(
+            CLSID_Arrakeener,
+            &cac,
+            CLSCTX_LOCAL_SERVER,
+            REGCLS_SUSPENDED | REGCLS_MULTIPLEUSE,
+            &dwReg);
+
+        if (SUCCEEDED(hr))
+        {
+            hr = CoResumeClassObjects();
+            if (SUCCEEDED(hr)) WaitForSingleObject(g_done, INFINITE);
+            CoRevokeClassObject(dwReg);
+        }
     }
 
     if (FAILED(hr))
@@ -174,6 +185,7 @@ int APIENTRY wWinMain(HINSTANCE, HINSTANCE, LPWSTR lpCmdLine, int)
         MessageBox(nullptr, L"Error starting Arrakis server", L"Arrakis", MB_SETFOREGROUND | MB_ICONERROR);
     }
 
+    CArrakeener::Uninitialize();
     CoUninitialize();
     return 0;
 }
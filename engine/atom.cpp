@@ -0,0 +1,95 @@
+// atom.cpp: Process-wide interned strings
+
+#include "atom.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+
+namespace arrakis
+{
+    // The table is split into shards by hash so that interning different
+    // strings rarely contends. Lookups take a shard's lock shared; only the
+    // first intern of a string takes it exclusively.
+
+    class Table
+    {
+        static const size_t shards = 16;
+
+        struct Shard
+        {
+            std::shared_mutex mutex;
+            std::unordered_map<std::wstring_view, const Atom::Entry*> entries;   // Views into the entries
+        };
+
+        Shard m_shards[shards];
+        std::atomic<uint32_t> m_count;
+
+    public:
+        const Atom::Entry* const empty;
+
+        Table() :
+            m_count(0),
+            empty(intern(L"", 0))
+        {
+        }
+
+        uint32_t count() const noexcept
+        {
+            return m_count.load(std::memory_order_acquire);
+        }
+
+        const Atom::Entry* intern(const wchar_t* text, size_t length)
+        {
+            const std::wstring_view key(text, length);
+            const size_t hash = std::hash<std::wstring_view>()(key);
+            Shard& shard = m_shards[hash % shards];
+            {
+                std::shared_lock<std::shared_mutex> lock(shard.mutex);
+                auto it = shard.entries.find(key);
+                if (it != shard.entries.end()) return it->second;
+            }
+
+            // Build the entry before locking; a thread that loses the race
+            // discards its copy
+            std::unique_ptr<Atom::Entry> entry(new Atom::Entry{ std::wstring(text, length), 0 });
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            auto result = shard.entries.emplace(std::wstring_view(entry->text), entry.get());
+            if (result.second)
+            {
+                entry->id = m_count.fetch_add(1, std::memory_order_acq_rel);
+                return entry.release();
+            }
+            return result.first->second;
+        }
+    };
+
+
+    // Never destroyed, so atoms stay valid during shutdown
+
+    static Table& table()
+    {
+        static Table* instance = new Table;
+        return *instance;
+    }
+
+
+    Atom::Atom() :
+        m_entry(table().empty)
+    {
+    }
+
+
+    const Atom::Entry* Atom::intern(const wchar_t* text, size_t length)
+    {
+        return table().intern(text, length);
+    }
+
+
+    uint32_t Atom::count() noexcept
+    {
+        return table().count();
+    }
+}
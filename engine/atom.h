@@ -0,0 +1,71 @@
+// atom.h: Process-wide interned strings
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace arrakis
+{
+    // Handle to an interned string. Equal strings share one immortal entry,
+    // so a handle is one pointer, copies never allocate, and equality and
+    // hashing work on the pointer. Each entry also has a small, dense id for
+    // indexing arrays when grouping by handle. Interning is thread safe.
+    //
+    // Meant for values with few distinct strings, such as affiliations and
+    // occupations; entries are never freed.
+
+    class Atom
+    {
+    public:
+        struct Entry
+        {
+            std::wstring text;
+            uint32_t id;
+        };
+
+    private:
+        const Entry* m_entry;
+
+        static const Entry* intern(const wchar_t* text, size_t length);
+
+    public:
+        Atom();                             // The empty string, id 0
+        Atom(const std::wstring& text) : m_entry(intern(text.data(), text.size())) {}
+        Atom(const wchar_t* text) : m_entry(intern(text, std::char_traits<wchar_t>::length(text))) {}
+
+        const std::wstring& str() const noexcept { return m_entry->text; }
+        operator const std::wstring&() const noexcept { return m_entry->text; }
+        const wchar_t* c_str() const noexcept { return m_entry->text.c_str(); }
+        bool empty() const noexcept { return m_entry->text.empty(); }
+        uint32_t id() const noexcept { return m_entry->id; }
+
+        // Number of distinct atoms so far; every id is less than this
+        static uint32_t count() noexcept;
+
+        friend bool operator==(Atom a, Atom b) noexcept { return a.m_entry == b.m_entry; }
+        friend bool operator!=(Atom a, Atom b) noexcept { return a.m_entry != b.m_entry; }
+        friend bool operator==(Atom a, const std::wstring& b) noexcept { return a.str() == b; }
+        friend bool operator==(const std::wstring& a, Atom b) noexcept { return a == b.str(); }
+        friend bool operator==(Atom a, const wchar_t* b) noexcept { return a.str() == b; }
+        friend bool operator==(const wchar_t* a, Atom b) noexcept { return a == b.str(); }
+        friend bool operator!=(Atom a, const std::wstring& b) noexcept { return a.str() != b; }
+        friend bool operator!=(const std::wstring& a, Atom b) noexcept { return a != b.str(); }
+        friend bool operator!=(Atom a, const wchar_t* b) noexcept { return a.str() != b; }
+        friend bool operator!=(const wchar_t* a, Atom b) noexcept { return a != b.str(); }
+    };
+}
+
+
+namespace std
+{
+    template <>
+    struct hash<arrakis::Atom>
+    {
+        size_t operator()(arrakis::Atom atom) const noexcept
+        {
+            return hash<uint32_t>()(atom.id());
+        }
+    };
+}
@@ -0,0 +1,479 @@
+// core.cpp: Portable, in-process Arrakeener
+
+#include "core.h"
+#include "hazard.h"
+#include "stats.h"
+#include "trace.h"
+#include <cassert>
+#include <memory>
+#include <utility>
+
+namespace arrakis
+{
+    using Guard = std::lock_guard<std::mutex>;
+
+    Arrakeener::Arrakeener() :
+        m_ledger(initial_ledger(m_rng)),
+        m_published(m_ledger),
+        m_identity(new Identity),
+        m_observer(nullptr)
+    {
+        stats::count(stats::Method::create);
+    }
+
+
+    Arrakeener::Arrakeener(uint64_t seed) :
+        m_rng(seed),
+        m_ledger(initial_ledger(m_rng)),
+        m_published(m_ledger),
+        m_identity(new Identity),
+        m_observer(nullptr)
+    {
+        stats::count(stats::Method::create);
+    }
+
+
+    Arrakeener::Arrakeener(const Ledger& ledger, uint64_t seed) :
+        m_rng(seed),
+        m_ledger(ledger),
+        m_published(m_ledger),
+        m_identity(new Identity),
+        m_observer(nullptr)
+    {
+        stats::count(stats::Method::create);
+    }
+
+
+    Arrakeener::Arrakeener(Names names, const Ledger& ledger, uint64_t seed) :
+        m_rng(seed),
+        m_ledger(ledger),
+        m_published(m_ledger),
+        m_identity(new Identity{ std::move(names) }),
+        m_observer(nullptr)
+    {
+        stats::count(stats::Method::create);
+    }
+
+
+    // The clone gets its own stream derived from the source, so that the
+    // source and its clones do not replay the same numbers. The clone shares
+    // the source's identity record until either is renamed.
+
+    Arrakeener::Arrakeener(const Arrakeener& obj) :
+        m_rng(0),
+        m_identity(obj.acquire_identity()),
+        m_observer(nullptr)
+    {
+        stats::Call call(stats::Method::clone);
+        Guard guard(call.lock(obj.m_mutex), std::adopt_lock);
+        m_ledger = obj.m_ledger;
+        m_rng = obj.m_rng.split();
+        m_published.store(m_ledger);
+        m_observer = obj.m_observer;
+        if (m_observer) m_observer->attached(*this, State{ current_names(), m_ledger });
+    }
+
+
+    Arrakeener::Arrakeener(Clones& clones) noexcept :
+        m_rng(clones.m_rng.split()),
+        m_ledger(clones.m_state.ledger),
+        m_published(m_ledger),
+        m_identity(clones.m_identity),
+        m_observer(clones.m_observer)
+    {
+        assert(clones.m_remaining > 0);
+        if (--clones.m_remaining == 0) clones.m_identity = nullptr;
+        if (m_observer) m_observer->attached(*this, clones.m_state);
+    }
+
+
+    Arrakeener::~Arrakeener()
+    {
+        if (m_observer) m_observer->detached(*this);
+        release_identity(m_identity.load(std::memory_order_relaxed));
+    }
+
+
+    // Cloning many shares one identity and one lock acquisition; the clones
+    // split a stream that was itself split from the source. The names are
+    // copied before locking, from the identity the clones hold; if that
+    // fails, the Clones gives back the references.
+
+    Arrakeener::Clones Arrakeener::clones(size_t n) const
+    {
+        assert(n <= UINT32_MAX);
+        stats::Call call(stats::Method::clones);
+        Clones result(n ? acquire_identity((uint32_t)n) : nullptr, n);
+        if (result.m_identity) result.m_state.names = result.m_identity->names;
+        Guard guard(call.lock(m_mutex), std::adopt_lock);
+        result.m_state.ledger = m_ledger;
+        result.m_rng = m_rng.split();
+        result.m_observer = m_observer;
+        return result;
+    }
+
+
+    void Arrakeener::observe(Observer* observer)
+    {
+        Guard guard(m_mutex);
+        if (observer == m_observer) return;
+        if (m_observer) m_observer->detached(*this);
+        m_observer = observer;
+        if (m_observer) m_observer->attached(*this, State{ current_names(), m_ledger });
+    }
+
+
+    Arrakeener::Clones::Clones(Identity* identity, size_t n) noexcept :
+        m_identity(identity),
+        m_rng(0),
+        m_observer(nullptr),
+        m_remaining(n)
+    {
+    }
+
+
+    Arrakeener::Clones::Clones(Clones&& other) noexcept :
+        m_identity(other.m_identity),
+        m_state(std::move(other.m_state)),
+        m_rng(other.m_rng),
+        m_observer(other.m_observer),
+        m_remaining(other.m_remaining)
+    {
+        other.m_identity = nullptr;
+        other.m_remaining = 0;
+    }
+
+
+    // Give back the references of clones that were never constructed
+
+    Arrakeener::Clones::~Clones()
+    {
+        if (!m_identity) return;
+        if (m_identity->references.fetch_sub((uint32_t)m_remaining, std::memory_order_acq_rel) == m_remaining)
+        {
+            hazard::retire(m_identity);
+        }
+    }
+
+
+    // Take references to the current identity record. The hazard keeps the
+    // record alive between loading the pointer and counting the reference;
+    // a record whose count already reached zero has been replaced, so reload.
+
+    Arrakeener::Identity* Arrakeener::acquire_identity(uint32_t references) const
+    {
+        hazard::Guard hazard;
+        for (;;)
+        {
+            Identity* identity = hazard.protect(m_identity);
+            uint32_t count = identity->references.load(std::memory_order_relaxed);
+            while (count != 0)
+            {
+                if (identity->references.compare_exchange_weak(count, count + references, std::memory_order_acquire))
+                {
+                    return identity;
+                }
+            }
+        }
+    }
+
+
+    void Arrakeener::release_identity(Identity* identity) noexcept
+    {
+        if (identity->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            hazard::retire(identity);
+        }
+    }
+
+
+    // Copy the current record with one field changed and swap it in. The copy
+    // is made before taking the lock, and made again only if another rename
+    // got in first; writers swap under the lock, so the record cannot change
+    // or be freed while it is held.
+
+    template <typename Field>
+    void Arrakeener::rename(stats::Method method, Field Names::* field, const wchar_t* value)
+    {
+        stats::Call call(method);
+        const Field replacement(value ? value : L"");
+        std::unique_ptr<Identity> next(new Identity);
+        hazard::Guard hazard;
+        Identity* current = hazard.protect(m_identity);
+        next->names = current->names;
+        next->names.*field = replacement;
+        {
+            Guard guard(call.lock(m_mutex), std::adopt_lock);
+            while (m_identity.load(std::memory_order_relaxed) != current)
+            {
+                current = m_identity.load(std::memory_order_relaxed);
+                next->names = current->names;
+                next->names.*field = replacement;
+            }
+            m_identity.store(next.get(), std::memory_order_seq_cst);
+            if (m_observer) m_observer->renamed(*this, current->names, next->names);
+        }
+        next.release();
+        hazard.reset();
+        release_identity(current);
+    }
+
+
+    template <typename Field>
+    Field Arrakeener::name(Field Names::* field) const
+    {
+        hazard::Guard hazard;
+        return hazard.protect(m_identity)->names.*field;
+    }
+
+
+    std::wstring Arrakeener::first_name() const
+    {
+        stats::Call call(stats::Method::first_name);
+        return name(&Names::first_name);
+    }
+
+
+    void Arrakeener::set_first_name(const wchar_t* value)
+    {
+        rename(stats::Method::set_first_name, &Names::first_name, value);
+    }
+
+
+    std::wstring Arrakeener::last_name() const
+    {
+        stats::Call call(stats::Method::last_name);
+        return name(&Names::last_name);
+    }
+
+
+    void Arrakeener::set_last_name(const wchar_t* value)
+    {
+        rename(stats::Method::set_last_name, &Names::last_name, value);
+    }
+
+
+    std::wstring Arrakeener::affiliation() const
+    {
+        stats::Call call(stats::Method::affiliation);
+        return name(&Names::affiliation).str();
+    }
+
+
+    void Arrakeener::set_affiliation(const wchar_t* value)
+    {
+        rename(stats::Method::set_affiliation, &Names::affiliation, value);
+    }
+
+
+    std::wstring Arrakeener::occupation() const
+    {
+        stats::Call call(stats::Method::occupation);
+        return name(&Names::occupation).str();
+    }
+
+
+    void Arrakeener::set_occupation(const wchar_t* value)
+    {
+        rename(stats::Method::set_occupation, &Names::occupation, value);
+    }
+
+
+    int64_t Arrakeener::energy() const noexcept
+    {
+        stats::Call call(stats::Method::energy);
+        return m_published.load().energy;
+    }
+
+
+    int64_t Arrakeener::solaris() const noexcept
+    {
+        stats::Call call(stats::Method::solaris);
+        return m_published.load().solaris;
+    }
+
+
+    int64_t Arrakeener::spice() const noexcept
+    {
+        stats::Call call(stats::Method::spice);
+        return m_published.load().spice;
+    }
+
+
+    Ledger Arrakeener::ledger() const noexcept
+    {
+        stats::Call call(stats::Method::ledger);
+        return current_ledger();
+    }
+
+
+    Ledger Arrakeener::current_ledger() const noexcept
+    {
+        return m_published.load();
+    }
+
+
+    Atom Arrakeener::affiliation_atom() const
+    {
+        return name(&Names::affiliation);
+    }
+
+
+    Atom Arrakeener::occupation_atom() const
+    {
+        return name(&Names::occupation);
+    }
+
+
+    Names Arrakeener::names() const
+    {
+        stats::Call call(stats::Method::names);
+        return current_names();
+    }
+
+
+    Names Arrakeener::current_names() const
+    {
+        hazard::Guard hazard;
+        return hazard.protect(m_identity)->names;
+    }
+
+
+    // Renames and changes to the ledger both happen under the mutex, so
+    // holding it gives a state that existed. The object's reference keeps
+    // the identity record alive until a rename, which must wait for us.
+
+    State Arrakeener::state() const
+    {
+        stats::Call call(stats::Method::state);
+        Guard guard(call.lock(m_mutex), std::adopt_lock);
+        return State{ m_identity.load(std::memory_order_relaxed)->names, m_ledger };
+    }
+
+
+    State Arrakeener::current_state() const
+    {
+        Guard guard(m_mutex);
+        return State{ m_identity.load(std::memory_order_relaxed)->names, m_ledger };
+    }
+
+
+    Status Arrakeener::eat_spice(int64_t units, int64_t& delta_energy)
+    {
+        stats::Call call(stats::Method::eat_spice);
+        Guard guard(call.lock(m_mutex), std::adopt_lock);
+        const Ledger before = m_ledger;
+        trace::Span rules("engine", "rules");
+        Status status = arrakis::eat_spice(m_ledger, m_rng, units, delta_energy);
+        rules.end();
+        if (status == Status::ok) publish(Change::eat, units, before);
+        return call.result(status);
+    }
+
+
+    Status Arrakeener::sell_spice(int64_t units, int64_t& delta_solaris)
+    {
+        stats::Call call(stats::Method::sell_spice);
+        Guard guard(call.lock(m_mutex), std::adopt_lock);
+        const Ledger before = m_ledger;
+        trace::Span rules("engine", "rules");
+        Status status = arrakis::sell_spice(m_ledger, m_rng, units, delta_solaris);
+        rules.end();
+        if (status == Status::ok) publish(Change::sell, units, before);
+        return call.result(status);
+    }
+
+
+    Status Arrakeener::mine_spice(int64_t harvesters, int64_t& delta_spice)
+    {
+        stats::Call call(stats::Method::mine_spice);
+        Guard guard(call.lock(m_mutex), std::adopt_lock);
+        const Ledger before = m_ledger;
+        trace::Span rules("engine", "rules");
+        Status status = arrakis::mine_spice(m_ledger, m_rng, harvesters, delta_spice);
+        rules.end();
+        if (status == Status::ok) publish(Change::mine, harvesters, before);
+        return call.result(status);
+    }
+
+
+    size_t Arrakeener::eat_spice_batch(const int64_t* units, size_t n, int64_t* delta_energy, Status* results)
+    {
+        stats::Call call(stats::Method::eat_spice_batch);
+        size_t succeeded = 0;
+        Guard guard(call.lock(m_mutex), std::adopt_lock);
+        const Ledger before = m_ledger;
+        trace::Span rules("engine", "rules");
+        for (size_t i = 0; i < n; ++i)
+        {
+            results[i] = arrakis::eat_spice(m_ledger, m_rng, units[i], delta_energy[i]);
+            if (results[i] == Status::ok) ++succeeded;
+        }
+        rules.end();
+        if (succeeded) publish(Change::eat_batch, (int64_t)succeeded, before);  // Readers see the whole batch at once
+        return succeeded;
+    }
+
+
+    size_t Arrakeener::sell_spice_batch(const int64_t* units, size_t n, int64_t* delta_solaris, Status* results)
+    {
+        stats::Call call(stats::Method::sell_spice_batch);
+        size_t succeeded = 0;
+        Guard guard(call.lock(m_mutex), std::adopt_lock);
+        const Ledger before = m_ledger;
+        trace::Span rules("engine", "rules");
+        for (size_t i = 0; i < n; ++i)
+        {
+            results[i] = arrakis::sell_spice(m_ledger, m_rng, units[i], delta_solaris[i]);
+            if (results[i] == Status::ok) ++succeeded;
+        }
+        rules.end();
+        if (succeeded) publish(Change::sell_batch, (int64_t)succeeded, before);  // Readers see the whole batch at once
+        return succeeded;
+    }
+
+
+    size_t Arrakeener::mine_spice_batch(const int64_t* harvesters, size_t n, int64_t* delta_spice, Status* results)
+    {
+        stats::Call call(stats::Method::mine_spice_batch);
+        size_t succeeded = 0;
+        Guard guard(call.lock(m_mutex), std::adopt_lock);
+        const Ledger before = m_ledger;
+        trace::Span rules("engine", "rules");
+        for (size_t i = 0; i < n; ++i)
+        {
+            results[i] = arrakis::mine_spice(m_ledger, m_rng, harvesters[i], delta_spice[i]);
+            if (results[i] == Status::ok) ++succeeded;
+        }
+        rules.end();
+        if (succeeded) publish(Change::mine_batch, (int64_t)succeeded, before);  // Readers see the whole batch at once
+        return succeeded;
+    }
+
+
+    Status Arrakeener::transact(const Step* steps, size_t n, StepResult* results, size_t& failed)
+    {
+        stats::Call call(stats::Method::transact);
+        Guard guard(call.lock(m_mutex), std::adopt_lock);
+        const Ledger before = m_ledger;
+        trace::Span rules("engine", "rules");
+        Status status = arrakis::transact(m_ledger, m_rng, steps, n, results, failed);
+        rules.end();
+        if (status == Status::ok) publish(Change::transaction, (int64_t)n, before);
+        return call.result(status);
+    }
+
+
+    // Make a successful change visible to readers and to the observer
+    // Called with the mutex held.
+
+    void Arrakeener::publish(Change change, int64_t arg, const Ledger& before) noexcept
+    {
+        m_published.store(m_ledger);
+        if (m_observer)
+        {
+            trace::Span span("engine", "observer");
+            m_observer->changed(*this, change, arg, before, m_ledger);
+        }
+    }
+}
@@ -0,0 +1,162 @@
+// core.h: Portable, in-process Arrakeener
+#pragma once
+
+#include "atom.h"
+#include "observer.h"
+#include "rules.h"
+#include "seqlock.h"
+#include "transaction.h"
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+namespace arrakis
+{
+    namespace stats
+    {
+        enum class Method : uint8_t;
+    }
+
+
+    // Identity of an Arrakeener
+    // Few distinct affiliations and occupations exist, so they are interned
+
+    struct Names
+    {
+        std::wstring first_name;
+        std::wstring last_name;
+        Atom affiliation;
+        Atom occupation;
+    };
+
+
+    // Complete state of an Arrakeener at one instant
+
+    struct State
+    {
+        Names names;
+        Ledger ledger;
+    };
+
+
+    // An Arrakeener that can be used directly from C++ without COM
+    // All members are thread safe. Operations are serialized by a mutex;
+    // the numeric getters read a published copy of the ledger and never
+    // wait for the mutex. Names live in an immutable record that setters
+    // replace and readers protect with a hazard pointer, so name readers
+    // never take a lock; setters hold the mutex only for the swap, so that
+    // an observer sees renames in order with the other changes, and state()
+    // takes the mutex to read names and ledger of one instant. Members are
+    // counted and timed while stats are recorded (see stats.h).
+
+    class Arrakeener
+    {
+        // Immutable once published; shared by clones
+        struct Identity
+        {
+            Names names;
+            std::atomic<uint32_t> references{ 1 };
+        };
+
+        mutable std::mutex m_mutex;         // Serialize operations on the ledger
+        mutable Rng m_rng;                  // Clone splits the source stream
+        Ledger m_ledger;
+        Seqlock<Ledger> m_published;        // Copy of m_ledger for lock-free readers
+        std::atomic<Identity*> m_identity;  // Never null
+        Observer* m_observer;               // Guarded by m_mutex; shared with clones
+
+    public:
+        // What a family of clones needs from its source, taken under one lock
+        // acquisition. Each clone constructed from it takes one of the
+        // identity references and its own split of the stream. The state for
+        // the observer is copied here, so constructing a clone never
+        // allocates. Not thread safe.
+
+        class Clones
+        {
+            friend class Arrakeener;
+
+            Identity* m_identity;           // Holds one reference per remaining clone
+            State m_state;                  // Names of m_identity, and the source's ledger
+            Rng m_rng;
+            Observer* m_observer;
+            size_t m_remaining;
+
+            Clones(Identity* identity, size_t n) noexcept;
+
+        public:
+            Clones(Clones&& other) noexcept;
+            Clones& operator=(Clones&&) = delete;
+            ~Clones();
+
+            size_t remaining() const noexcept { return m_remaining; }
+        };
+
+        Arrakeener();
+        explicit Arrakeener(uint64_t seed); // Reproducible random stream
+        Arrakeener(const Ledger& ledger, uint64_t seed);
+        Arrakeener(Names names, const Ledger& ledger, uint64_t seed);  // Restored in one step
+        Arrakeener(const Arrakeener& obj);  // Clone
+        explicit Arrakeener(Clones& clones) noexcept;   // Next clone; clones.remaining() > 0
+        Arrakeener& operator=(const Arrakeener&) = delete;
+        ~Arrakeener();
+
+        Clones clones(size_t n) const;      // Source for n clones
+
+        // Report every change to observer, or to nothing when null. The
+        // previous observer, if any, is detached first. Clones made from now
+        // on are observed too. The observer must outlive the object or be
+        // replaced first.
+        void observe(Observer* observer);
+
+        // Properties
+        std::wstring first_name() const;
+        void set_first_name(const wchar_t* value);
+        std::wstring last_name() const;
+        void set_last_name(const wchar_t* value);
+        std::wstring affiliation() const;
+        void set_affiliation(const wchar_t* value);
+        std::wstring occupation() const;
+        void set_occupation(const wchar_t* value);
+        Atom affiliation_atom() const;      // For comparing and grouping
+        Atom occupation_atom() const;
+        int64_t energy() const noexcept;    // Lock free
+        int64_t solaris() const noexcept;   // Lock free
+        int64_t spice() const noexcept;     // Lock free
+        Ledger ledger() const noexcept;     // Energy, solaris and spice together; lock free
+        Names names() const;                // Consistent with each other; lock free
+        State state() const;                // Names and ledger at one instant, under the mutex
+
+        // The same reads, not counted as calls; for the engine's observers
+        // and containers, so that stats count only what callers asked for
+        Ledger current_ledger() const noexcept;
+        Names current_names() const;
+        State current_state() const;        // Takes the mutex, so not from an observer
+
+        // Operations
+        Status eat_spice(int64_t units, int64_t& delta_energy);
+        Status sell_spice(int64_t units, int64_t& delta_solaris);
+        Status mine_spice(int64_t harvesters, int64_t& delta_spice);
+
+        // Batch operations
+        // Apply the operation to each of n elements under a single lock
+        // acquisition. Elements are independent and have the same semantics
+        // as the single calls. Returns the number of elements that succeeded.
+
+        size_t eat_spice_batch(const int64_t* units, size_t n, int64_t* delta_energy, Status* results);
+        size_t sell_spice_batch(const int64_t* units, size_t n, int64_t* delta_solaris, Status* results);
+        size_t mine_spice_batch(const int64_t* harvesters, size_t n, int64_t* delta_spice, Status* results);
+
+        // Apply a sequence of steps under one lock acquisition, all or nothing
+        // (see arrakis::transact). Readers see the ledger before or after.
+        Status transact(const Step* steps, size_t n, StepResult* results, size_t& failed);
+
+    private:
+        Identity* acquire_identity(uint32_t references = 1) const;
+        static void release_identity(Identity* identity) noexcept;
+        void publish(Change change, int64_t arg, const Ledger& before) noexcept;
+        template <typename Field> void rename(stats::Method method, Field Names::* field, const wchar_t* value);
+        template <typename Field> Field name(Field Names::* field) const;
+    };
+}
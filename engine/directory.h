@@ -0,0 +1,369 @@
+// directory.h: Concurrent directory of objects by first and last name
+#pragma once
+
+#include "hazard.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace arrakis
+{
+    // Maps (first name, last name) to a T, typically a pointer or handle to
+    // an object; copies of T are handed out, so a counted handle keeps the
+    // object alive while a caller uses it.
+    //
+    // The map is split into shards, each a power-of-two table of buckets
+    // that grows when it holds more entries than buckets. Buckets are
+    // immutable: writers copy one, change the copy and swap it in under the
+    // shard's mutex, and retire the old one through hazard pointers. Readers
+    // take no lock and write nothing shared, so lookups from any number of
+    // threads do not contend with each other, and only briefly with writers.
+    // Growing copies the shard into a new table and marks the old buckets
+    // moved, which sends readers still on the old table to the new one.
+    // A bucket and its entries are one allocation, and each entry keeps
+    // both names in one string, so a lookup follows few pointers.
+    //
+    // Enumeration visits each shard's buckets in bit-reversed order, so a
+    // cursor stays valid across growth: entries present for the whole
+    // enumeration are returned exactly once; entries added or removed
+    // meanwhile may or may not be. Tables do not shrink.
+
+    template <typename T>
+    class Directory
+    {
+        struct Entry
+        {
+            uint64_t hash;
+            size_t first_length;
+            std::wstring names;             // First name, then last name
+            T value;
+
+            bool matches(uint64_t h, std::wstring_view first_name, std::wstring_view last_name) const noexcept
+            {
+                const std::wstring_view both(names);
+                return hash == h && first_length == first_name.size() && both.size() == first_length + last_name.size() &&
+                    both.substr(0, first_length) == first_name && both.substr(first_length) == last_name;
+            }
+        };
+
+        // Entries follow the header in the same allocation
+        struct alignas(Entry) Bucket
+        {
+            size_t size;
+
+            Entry* begin() noexcept { return reinterpret_cast<Entry*>(this + 1); }
+            Entry* end() noexcept { return begin() + size; }
+            const Entry* begin() const noexcept { return reinterpret_cast<const Entry*>(this + 1); }
+            const Entry* end() const noexcept { return begin() + size; }
+
+            static Bucket* allocate(size_t capacity)
+            {
+                return new (::operator new(sizeof(Bucket) + capacity * sizeof(Entry))) Bucket{ 0 };
+            }
+
+            // Within the capacity allocated
+            template <typename E>
+            void push(E&& entry)
+            {
+                new (end()) Entry(std::forward<E>(entry));
+                ++size;
+            }
+
+            static void destroy(void* p) noexcept
+            {
+                Bucket* bucket = static_cast<Bucket*>(p);
+                for (Entry& entry : *bucket) entry.~Entry();
+                ::operator delete(bucket);
+            }
+        };
+
+        struct Destroy
+        {
+            void operator()(Bucket* bucket) const noexcept { Bucket::destroy(bucket); }
+        };
+        using Building = std::unique_ptr<Bucket, Destroy>;
+
+        struct Table
+        {
+            const uint64_t mask;
+            std::unique_ptr<std::atomic<Bucket*>[]> buckets;    // Null when empty
+
+            explicit Table(size_t size) : mask(size - 1), buckets(new std::atomic<Bucket*>[size]()) {}
+
+            ~Table()
+            {
+                for (size_t i = 0; i <= mask; ++i)
+                {
+                    Bucket* bucket = buckets[i].load(std::memory_order_relaxed);
+                    if (bucket && bucket != moved()) Bucket::destroy(bucket);
+                }
+            }
+        };
+
+        struct alignas(64) Shard
+        {
+            std::mutex mutex;               // Serializes writers
+            std::atomic<Table*> table;
+            std::atomic<size_t> count{ 0 }; // Written under the mutex
+        };
+
+        static const int shard_bits = 6;
+        static const size_t shards = (size_t)1 << shard_bits;
+        static const size_t initial_buckets = 16;
+
+        std::unique_ptr<Shard[]> m_shards;
+
+        // In place of the buckets of a table that has been replaced
+        static Bucket* moved() noexcept
+        {
+            static Bucket sentinel{ 0 };
+            return &sentinel;
+        }
+
+        static uint64_t hash_of(std::wstring_view first_name, std::wstring_view last_name) noexcept
+        {
+            uint64_t h = (uint64_t)std::hash<std::wstring_view>()(first_name) * 0x9E3779B97F4A7C15ull;
+            h ^= (uint64_t)std::hash<std::wstring_view>()(last_name) + (h >> 29);
+            h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+            h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+            return h ^ (h >> 31);
+        }
+
+        Shard& shard_of(uint64_t hash) const noexcept
+        {
+            return m_shards[(size_t)(hash >> (64 - shard_bits))];
+        }
+
+        static uint64_t reverse(uint64_t v) noexcept
+        {
+            v = ((v >> 1) & 0x5555555555555555ull) | ((v & 0x5555555555555555ull) << 1);
+            v = ((v >> 2) & 0x3333333333333333ull) | ((v & 0x3333333333333333ull) << 2);
+            v = ((v >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((v & 0x0F0F0F0F0F0F0F0Full) << 4);
+            v = ((v >> 8) & 0x00FF00FF00FF00FFull) | ((v & 0x00FF00FF00FF00FFull) << 8);
+            v = ((v >> 16) & 0x0000FFFF0000FFFFull) | ((v & 0x0000FFFF0000FFFFull) << 16);
+            return (v >> 32) | (v << 32);
+        }
+
+        // Swap a bucket in; the caller holds the shard's mutex
+        static void replace(std::atomic<Bucket*>& slot, Bucket* old, Bucket* next)
+        {
+            slot.store(next, std::memory_order_seq_cst);
+            if (old) hazard::retire(old, &Bucket::destroy);
+        }
+
+        // Double the shard's table; the caller holds its mutex. Each bucket
+        // splits in two. On failure the table stays as it is and the next
+        // insert tries again.
+        static void grow(Shard& shard) noexcept
+        {
+            Table* old = shard.table.load(std::memory_order_relaxed);
+            const size_t size = (size_t)old->mask + 1;
+            std::unique_ptr<Table> table;
+            try
+            {
+                table.reset(new Table(2 * size));
+                for (size_t i = 0; i < size; ++i)
+                {
+                    const Bucket* bucket = old->buckets[i].load(std::memory_order_relaxed);
+                    if (!bucket) continue;
+                    size_t high = 0;
+                    for (const Entry& entry : *bucket) high += (entry.hash & size) != 0;
+                    Building halves[2];
+                    if (high < bucket->size) halves[0].reset(Bucket::allocate(bucket->size - high));
+                    if (high) halves[1].reset(Bucket::allocate(high));
+                    for (const Entry& entry : *bucket) halves[(entry.hash & size) != 0]->push(entry);
+                    table->buckets[i].store(halves[0].release(), std::memory_order_relaxed);
+                    table->buckets[i + size].store(halves[1].release(), std::memory_order_relaxed);
+                }
+            }
+            catch (...)
+            {
+                return;
+            }
+
+            shard.table.store(table.release(), std::memory_order_seq_cst);
+            for (size_t i = 0; i < size; ++i)
+            {
+                Bucket* bucket = old->buckets[i].exchange(moved(), std::memory_order_seq_cst);
+                if (bucket) hazard::retire(bucket, &Bucket::destroy);
+            }
+            hazard::retire(old);
+        }
+
+    public:
+        // Where an enumeration has got to
+        struct Cursor
+        {
+            size_t shard = 0;
+            uint64_t bucket = 0;            // Visited in bit-reversed order
+
+            bool done() const noexcept { return shard >= shards; }
+        };
+
+        Directory() :
+            m_shards(new Shard[shards])
+        {
+            for (size_t s = 0; s < shards; ++s)
+            {
+                m_shards[s].table.store(new Table(initial_buckets), std::memory_order_relaxed);
+            }
+        }
+
+        // No other thread may be using the directory
+        ~Directory()
+        {
+            for (size_t s = 0; s < shards; ++s) delete m_shards[s].table.load(std::memory_order_relaxed);
+            hazard::scan();
+        }
+
+        Directory(const Directory&) = delete;
+        Directory& operator=(const Directory&) = delete;
+
+        // Copy the value registered under the names to value; lock free
+        bool find(std::wstring_view first_name, std::wstring_view last_name, T& value) const
+        {
+            const uint64_t hash = hash_of(first_name, last_name);
+            const Shard& shard = shard_of(hash);
+            hazard::Guard table_guard, bucket_guard;
+            for (;;)
+            {
+                const Table* table = table_guard.protect(shard.table);
+                const Bucket* bucket = bucket_guard.protect(table->buckets[hash & table->mask]);
+                if (bucket == moved()) continue;
+                if (!bucket) return false;
+                for (const Entry& entry : *bucket)
+                {
+                    if (entry.matches(hash, first_name, last_name))
+                    {
+                        value = entry.value;
+                        return true;
+                    }
+                }
+                return false;
+            }
+        }
+
+        // Register value under the names; false if they are taken
+        bool insert(std::wstring_view first_name, std::wstring_view last_name, T value)
+        {
+            const uint64_t hash = hash_of(first_name, last_name);
+            Shard& shard = shard_of(hash);
+            std::wstring names;
+            names.reserve(first_name.size() + last_name.size());
+            names.append(first_name).append(last_name);
+
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            Table* table = shard.table.load(std::memory_order_relaxed);
+            std::atomic<Bucket*>& slot = table->buckets[hash & table->mask];
+            Bucket* old = slot.load(std::memory_order_relaxed);
+            const size_t size = old ? old->size : 0;
+            if (old)
+            {
+                for (const Entry& entry : *old)
+                {
+                    if (entry.matches(hash, first_name, last_name)) return false;
+                }
+            }
+
+            Building next(Bucket::allocate(size + 1));
+            if (old)
+            {
+                for (const Entry& entry : *old) next->push(entry);
+            }
+            next->push(Entry{ hash, first_name.size(), std::move(names), std::move(value) });
+            replace(slot, old, next.release());
+
+            const size_t count = shard.count.load(std::memory_order_relaxed) + 1;
+            shard.count.store(count, std::memory_order_relaxed);
+            if (count > table->mask + 1) grow(shard);
+            return true;
+        }
+
+        // Unregister the names; false if they were not registered
+        bool remove(std::wstring_view first_name, std::wstring_view last_name)
+        {
+            return remove_if(first_name, last_name, [](const T&) { return true; });
+        }
+
+        // Unregister the names only if they map to value
+        bool remove(std::wstring_view first_name, std::wstring_view last_name, const T& value)
+        {
+            return remove_if(first_name, last_name, [&](const T& current) { return current == value; });
+        }
+
+        template <typename Predicate>
+        bool remove_if(std::wstring_view first_name, std::wstring_view last_name, Predicate predicate)
+        {
+            const uint64_t hash = hash_of(first_name, last_name);
+            Shard& shard = shard_of(hash);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            Table* table = shard.table.load(std::memory_order_relaxed);
+            std::atomic<Bucket*>& slot = table->buckets[hash & table->mask];
+            Bucket* old = slot.load(std::memory_order_relaxed);
+            if (!old) return false;
+
+            const Entry* found = old->end();
+            for (const Entry& entry : *old)
+            {
+                if (entry.matches(hash, first_name, last_name)) found = &entry;
+            }
+            if (found == old->end() || !predicate(found->value)) return false;
+
+            Building next;
+            if (old->size > 1)
+            {
+                next.reset(Bucket::allocate(old->size - 1));
+                for (const Entry& entry : *old)
+                {
+                    if (&entry != found) next->push(entry);
+                }
+            }
+            replace(slot, old, next.release());
+            shard.count.store(shard.count.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        // Append up to about count values to out, starting at cursor, and
+        // advance it; returns how many were appended. A bucket is never
+        // split, so a batch can stop short of count, or exceed it when a
+        // single bucket holds more. Lock free.
+        size_t next(Cursor& cursor, size_t count, std::vector<T>& out) const
+        {
+            size_t added = 0;
+            hazard::Guard table_guard, bucket_guard;
+            while (!cursor.done() && added < count)
+            {
+                const Shard& shard = m_shards[cursor.shard];
+                const Table* table = table_guard.protect(shard.table);
+                const Bucket* bucket = bucket_guard.protect(table->buckets[cursor.bucket & table->mask]);
+                if (bucket == moved()) continue;
+                if (bucket)
+                {
+                    if (added && added + bucket->size > count) break;
+                    for (const Entry& entry : *bucket) out.push_back(entry.value);
+                    added += bucket->size;
+                }
+
+                // Increment the reversed bucket index within this table
+                cursor.bucket = reverse(reverse(cursor.bucket | ~table->mask) + 1);
+                if (cursor.bucket == 0) ++cursor.shard;
+            }
+            return added;
+        }
+
+        // Registered entries; exact when no writer is active
+        size_t size() const noexcept
+        {
+            size_t total = 0;
+            for (size_t s = 0; s < shards; ++s) total += m_shards[s].count.load(std::memory_order_relaxed);
+            return total;
+        }
+    };
+}
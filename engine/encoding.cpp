@@ -0,0 +1,160 @@
+// encoding.cpp: Portable binary encoding of Arrakeener state
+
+#include "encoding.h"
+#include <utility>
+
+namespace arrakis
+{
+    namespace encoding
+    {
+        void put_u8(std::vector<uint8_t>& out, uint8_t value)
+        {
+            out.push_back(value);
+        }
+
+
+        void put_u32(std::vector<uint8_t>& out, uint32_t value)
+        {
+            for (int i = 0; i < 4; ++i) out.push_back((uint8_t)(value >> (8 * i)));
+        }
+
+
+        void put_i64(std::vector<uint8_t>& out, int64_t value)
+        {
+            for (int i = 0; i < 8; ++i) out.push_back((uint8_t)((uint64_t)value >> (8 * i)));
+        }
+
+
+        void put_string(std::vector<uint8_t>& out, const std::wstring& value)
+        {
+            // Convert to UTF-16 if wchar_t holds UTF-32
+            uint32_t units = 0;
+            for (wchar_t c : value) units += (uint32_t)c > 0xFFFF ? 2 : 1;
+
+            put_u32(out, units);
+            out.reserve(out.size() + 2 * (size_t)units);
+            for (wchar_t c : value)
+            {
+                uint32_t cp = (uint32_t)c;
+                if (cp > 0xFFFF)
+                {
+                    cp -= 0x10000;
+                    const uint16_t high = (uint16_t)(0xD800 + (cp >> 10));
+                    const uint16_t low = (uint16_t)(0xDC00 + (cp & 0x3FF));
+                    out.push_back((uint8_t)high);
+                    out.push_back((uint8_t)(high >> 8));
+                    out.push_back((uint8_t)low);
+                    out.push_back((uint8_t)(low >> 8));
+                }
+                else
+                {
+                    out.push_back((uint8_t)cp);
+                    out.push_back((uint8_t)(cp >> 8));
+                }
+            }
+        }
+
+
+        Reader::Reader(const uint8_t* data, size_t size) noexcept :
+            m_begin(data),
+            m_p(data),
+            m_end(data + size),
+            m_ok(true)
+        {
+        }
+
+
+        bool Reader::need(size_t n) noexcept
+        {
+            if (m_ok && (size_t)(m_end - m_p) >= n) return true;
+            m_ok = false;
+            return false;
+        }
+
+
+        uint8_t Reader::get_u8() noexcept
+        {
+            if (!need(1)) return 0;
+            return *m_p++;
+        }
+
+
+        uint32_t Reader::get_u32() noexcept
+        {
+            if (!need(4)) return 0;
+            uint32_t value = 0;
+            for (int i = 0; i < 4; ++i) value |= (uint32_t)m_p[i] << (8 * i);
+            m_p += 4;
+            return value;
+        }
+
+
+        int64_t Reader::get_i64() noexcept
+        {
+            if (!need(8)) return 0;
+            uint64_t value = 0;
+            for (int i = 0; i < 8; ++i) value |= (uint64_t)m_p[i] << (8 * i);
+            m_p += 8;
+            return (int64_t)value;
+        }
+
+
+        std::wstring Reader::get_string()
+        {
+            const uint32_t units = get_u32();
+            if (!need(2 * (size_t)units)) return std::wstring();
+
+            std::wstring value;
+            value.reserve(units);
+            for (uint32_t i = 0; i < units; ++i)
+            {
+                uint32_t unit = (uint32_t)m_p[2 * i] | ((uint32_t)m_p[2 * i + 1] << 8);
+                if (sizeof(wchar_t) > 2 && unit >= 0xD800 && unit < 0xDC00 && i + 1 < units)
+                {
+                    const uint32_t low = (uint32_t)m_p[2 * i + 2] | ((uint32_t)m_p[2 * i + 3] << 8);
+                    if (low >= 0xDC00 && low < 0xE000)
+                    {
+                        unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                        ++i;
+                    }
+                }
+                value.push_back((wchar_t)unit);
+            }
+            m_p += 2 * (size_t)units;
+            return value;
+        }
+    }
+
+
+    void encode(const State& state, std::vector<uint8_t>& out)
+    {
+        encoding::put_u8(out, state_version);
+        encoding::put_i64(out, state.ledger.energy);
+        encoding::put_i64(out, state.ledger.solaris);
+        encoding::put_i64(out, state.ledger.spice);
+        encoding::put_string(out, state.names.first_name);
+        encoding::put_string(out, state.names.last_name);
+        encoding::put_string(out, state.names.affiliation.str());
+        encoding::put_string(out, state.names.occupation.str());
+    }
+
+
+    size_t decode(const uint8_t* data, size_t size, State& state)
+    {
+        encoding::Reader reader(data, size);
+        if (reader.get_u8() != state_version) return 0;
+
+        State result;
+        result.ledger.energy = reader.get_i64();
+        result.ledger.solaris = reader.get_i64();
+        result.ledger.spice = reader.get_i64();
+        result.names.first_name = reader.get_string();
+        result.names.last_name = reader.get_string();
+        result.names.affiliation = reader.get_string();
+        result.names.occupation = reader.get_string();
+        if (!reader.ok()) return 0;
+
+        state = std::move(result);
+        return reader.consumed();
+    }
+}
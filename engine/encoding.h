@@ -0,0 +1,60 @@
+// encoding.h: Portable binary encoding of Arrakeener state
+#pragma once
+
+#include "core.h"
+#include <cstddef>
+#include <vector>
+
+namespace arrakis
+{
+    // Building blocks, shared by the other binary formats of the engine
+    // Integers are little endian. Strings are a 32-bit count of UTF-16 code
+    // units followed by the code units, whatever the size of wchar_t.
+
+    namespace encoding
+    {
+        void put_u8(std::vector<uint8_t>& out, uint8_t value);
+        void put_u32(std::vector<uint8_t>& out, uint32_t value);
+        void put_i64(std::vector<uint8_t>& out, int64_t value);
+        void put_string(std::vector<uint8_t>& out, const std::wstring& value);
+
+        // Reads from a buffer; after any read runs past the end, ok() is
+        // false and every later read returns zero or an empty string
+
+        class Reader
+        {
+            const uint8_t* m_begin;
+            const uint8_t* m_p;
+            const uint8_t* m_end;
+            bool m_ok;
+
+            bool need(size_t n) noexcept;
+
+        public:
+            Reader(const uint8_t* data, size_t size) noexcept;
+
+            uint8_t get_u8() noexcept;
+            uint32_t get_u32() noexcept;
+            int64_t get_i64() noexcept;
+            std::wstring get_string();
+
+            bool ok() const noexcept { return m_ok; }
+            size_t consumed() const noexcept { return (size_t)(m_p - m_begin); }
+            size_t remaining() const noexcept { return (size_t)(m_end - m_p); }
+        };
+    }
+
+
+    // State record
+    //   u8 version, i64 energy, i64 solaris, i64 spice,
+    //   string first name, last name, affiliation, occupation
+
+    const uint8_t state_version = 1;
+
+    // Append the record for state to out
+    void encode(const State& state, std::vector<uint8_t>& out);
+
+    // Decode one record; returns the number of bytes used, or zero if the
+    // data is truncated or not a state record
+    size_t decode(const uint8_t* data, size_t size, State& state);
+}
@@ -0,0 +1,162 @@
+// executor.cpp: Asynchronous operations on Arrakeeners
+
+#include "executor.h"
+#include <cstdint>
+
+namespace arrakis
+{
+    // Runs the jobs queued on one strand
+
+    class Executor::Drain : public Task
+    {
+        Executor& m_executor;
+        Strand& m_strand;
+
+    public:
+        Drain(Executor& executor, Strand& strand) : m_executor(executor), m_strand(strand) {}
+        void execute() override { m_executor.drain(m_strand); }
+    };
+
+
+    static size_t round_up(size_t n) noexcept
+    {
+        size_t power = 1;
+        while (power < n) power <<= 1;
+        return power;
+    }
+
+
+    Executor::Executor(Scheduler& scheduler, size_t strands) :
+        m_strands(new Strand[round_up(strands)]),
+        m_strand_mask(round_up(strands) - 1),
+        m_tasks(scheduler)
+    {
+    }
+
+
+    Executor::~Executor()
+    {
+        m_tasks.wait();
+    }
+
+
+    Executor::Strand& Executor::strand(const Arrakeener& obj) const noexcept
+    {
+        const uint64_t hash = (uint64_t)(uintptr_t)&obj * 0x9E3779B97F4A7C15ull;
+        return m_strands[(size_t)(hash >> 32) & m_strand_mask];
+    }
+
+
+    // Append the job, and queue a drain task if the strand is idle
+    // Takes ownership of the job unless it throws.
+
+    void Executor::enqueue(Strand& strand, Job* job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(strand.mutex);
+            if (strand.tail) strand.tail->next = job;
+            else strand.head = job;
+            strand.tail = job;
+            if (strand.scheduled) return;
+            strand.scheduled = true;
+        }
+
+        try
+        {
+            m_tasks.spawn(new Drain(*this, strand));
+        }
+        catch (...)
+        {
+            // Nothing will drain the strand; run the queue here
+            drain(strand);
+        }
+    }
+
+
+    // Run what is queued now, then hand the strand back to the scheduler if
+    // more arrived meanwhile so that other strands get their turn
+
+    void Executor::drain(Strand& strand) noexcept
+    {
+        Job* job;
+        {
+            std::lock_guard<std::mutex> lock(strand.mutex);
+            job = strand.head;
+            strand.head = strand.tail = nullptr;
+        }
+
+        while (job)
+        {
+            Job* next = job->next;
+            job->run();
+            delete job;
+            job = next;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(strand.mutex);
+            if (!strand.head)
+            {
+                strand.scheduled = false;
+                return;
+            }
+        }
+
+        try
+        {
+            m_tasks.spawn(new Drain(*this, strand));
+        }
+        catch (...)
+        {
+            drain(strand);
+        }
+    }
+
+
+    Future<OperationResult> Executor::eat_spice(Arrakeener& obj, int64_t units)
+    {
+        return post(obj, [&obj, units]
+        {
+            OperationResult result = { Status::ok, 0 };
+            result.status = obj.eat_spice(units, result.delta);
+            return result;
+        });
+    }
+
+
+    Future<OperationResult> Executor::sell_spice(Arrakeener& obj, int64_t units)
+    {
+        return post(obj, [&obj, units]
+        {
+            OperationResult result = { Status::ok, 0 };
+            result.status = obj.sell_spice(units, result.delta);
+            return result;
+        });
+    }
+
+
+    Future<OperationResult> Executor::mine_spice(Arrakeener& obj, int64_t harvesters)
+    {
+        return post(obj, [&obj, harvesters]
+        {
+            OperationResult result = { Status::ok, 0 };
+            result.status = obj.mine_spice(harvesters, result.delta);
+            return result;
+        });
+    }
+
+
+    Future<std::unique_ptr<Arrakeener>> Executor::clone(const Arrakeener& obj)
+    {
+        return post(obj, [&obj]
+        {
+            return std::unique_ptr<Arrakeener>(new Arrakeener(obj));
+        });
+    }
+
+
+    void Executor::wait()
+    {
+        m_tasks.wait();
+    }
+}
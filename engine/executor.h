@@ -0,0 +1,110 @@
+// executor.h: Asynchronous operations on Arrakeeners
+#pragma once
+
+#include "core.h"
+#include "future.h"
+#include "scheduler.h"
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace arrakis
+{
+    // Outcome of one asynchronous operation, as returned by the blocking call
+    // and its delta argument
+
+    struct OperationResult
+    {
+        Status status;
+        int64_t delta;
+    };
+
+
+    // Queues operations on Arrakeeners and runs them on a scheduler, so that
+    // one client thread can keep many operations in flight. Operations on
+    // the same object run one at a time in the order they were queued, so
+    // they draw the same random numbers as the blocking calls would.
+    // Ordering is kept per strand: objects are hashed onto a fixed set of
+    // strands, and each strand drains its queue in one scheduler task.
+    //
+    // Objects must outlive the operations queued on them. Thread safe.
+
+    class Executor
+    {
+        struct Job
+        {
+            Job* next = nullptr;
+            virtual ~Job() = default;
+            virtual void run() noexcept = 0;
+        };
+
+        template <typename F, typename T>
+        struct FunctionJob : Job
+        {
+            F function;
+            Promise<T> promise;
+
+            explicit FunctionJob(F&& function) : function(std::move(function)) {}
+
+            void run() noexcept override
+            {
+                try
+                {
+                    promise.set_value(function());
+                }
+                catch (...)
+                {
+                    promise.set_exception(std::current_exception());
+                }
+            }
+        };
+
+        // Queue of jobs for the objects hashed here, first in first out
+        struct alignas(64) Strand
+        {
+            std::mutex mutex;
+            Job* head = nullptr;
+            Job* tail = nullptr;
+            bool scheduled = false;         // A drain task is queued or running
+        };
+
+        class Drain;
+
+        std::unique_ptr<Strand[]> m_strands;
+        const size_t m_strand_mask;
+        TaskGroup m_tasks;                  // Declared last so it is waited on first
+
+        Strand& strand(const Arrakeener& obj) const noexcept;
+        void enqueue(Strand& strand, Job* job);
+        void drain(Strand& strand) noexcept;
+
+    public:
+        // strands is rounded up to a power of two
+        explicit Executor(Scheduler& scheduler = Scheduler::shared(), size_t strands = 1024);
+        ~Executor();                        // Finishes every queued operation
+        Executor(const Executor&) = delete;
+        Executor& operator=(const Executor&) = delete;
+
+        Future<OperationResult> eat_spice(Arrakeener& obj, int64_t units);
+        Future<OperationResult> sell_spice(Arrakeener& obj, int64_t units);
+        Future<OperationResult> mine_spice(Arrakeener& obj, int64_t harvesters);
+        Future<std::unique_ptr<Arrakeener>> clone(const Arrakeener& obj);
+
+        // Run function() in order with the other operations on obj
+        template <typename F>
+        auto post(const Arrakeener& obj, F function) -> Future<std::invoke_result_t<F>>
+        {
+            using T = std::invoke_result_t<F>;
+            std::unique_ptr<FunctionJob<F, T>> job(new FunctionJob<F, T>(std::move(function)));
+            Future<T> future = job->promise.future();
+            enqueue(strand(obj), job.get());
+            job.release();
+            return future;
+        }
+
+        // Wait until every operation queued so far has run
+        void wait();
+    };
+}
@@ -0,0 +1,181 @@
+// future.h: Results of asynchronous operations, with continuations
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace arrakis
+{
+    template <typename T> class Future;
+    template <typename T> class Promise;
+
+
+    // Shared by a promise and its future
+
+    template <typename T>
+    class FutureState
+    {
+        friend class Future<T>;
+        friend class Promise<T>;
+
+        std::mutex m_mutex;
+        std::condition_variable m_done;
+        bool m_ready = false;
+        std::optional<T> m_value;
+        std::exception_ptr m_error;
+        std::function<void()> m_continuation;
+
+        void complete()
+        {
+            std::function<void()> continuation;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_ready = true;
+                continuation.swap(m_continuation);
+            }
+            m_done.notify_all();
+            if (continuation) continuation();
+        }
+    };
+
+
+    // Value that becomes available later, like std::future, plus then() to
+    // chain work onto its completion without blocking. A future is consumed
+    // by get() or then(), at most once. Blocking in get() from a scheduler
+    // task may starve the workers; chain with then() instead.
+
+    template <typename T>
+    class Future
+    {
+        friend class Promise<T>;
+        using State = FutureState<T>;
+
+        std::shared_ptr<State> m_state;
+
+        explicit Future(std::shared_ptr<State> state) : m_state(std::move(state)) {}
+
+    public:
+        Future() = default;
+
+        // Already completed
+        static Future ready(T value)
+        {
+            Promise<T> promise;
+            Future future = promise.future();
+            promise.set_value(std::move(value));
+            return future;
+        }
+
+        bool valid() const noexcept { return m_state != nullptr; }
+
+        bool is_ready() const
+        {
+            std::lock_guard<std::mutex> lock(m_state->m_mutex);
+            return m_state->m_ready;
+        }
+
+        void wait() const
+        {
+            std::unique_lock<std::mutex> lock(m_state->m_mutex);
+            m_state->m_done.wait(lock, [&] { return m_state->m_ready; });
+        }
+
+        // Wait, then return the value or rethrow the exception
+        T get()
+        {
+            wait();
+            std::shared_ptr<State> state = std::move(m_state);
+            if (state->m_error) std::rethrow_exception(state->m_error);
+            return std::move(*state->m_value);
+        }
+
+        // Future of function(value). The function runs on the thread that
+        // completes this future, or right away if it is complete already.
+        // An exception, from this future or from the function, passes to the
+        // returned future instead.
+        template <typename F>
+        auto then(F function) -> Future<std::invoke_result_t<F, T>>
+        {
+            using U = std::invoke_result_t<F, T>;
+            static_assert(!std::is_void<U>::value, "continuations return a value");
+
+            auto next = std::make_shared<Promise<U>>();
+            Future<U> result = next->future();
+            std::shared_ptr<State> state = std::move(m_state);
+            auto continuation = [state, next, function = std::move(function)]() mutable
+            {
+                try
+                {
+                    if (state->m_error) next->set_exception(state->m_error);
+                    else next->set_value(function(std::move(*state->m_value)));
+                }
+                catch (...)
+                {
+                    next->set_exception(std::current_exception());
+                }
+            };
+
+            {
+                std::unique_lock<std::mutex> lock(state->m_mutex);
+                if (!state->m_ready)
+                {
+                    state->m_continuation = std::move(continuation);
+                    return result;
+                }
+            }
+            continuation();
+            return result;
+        }
+    };
+
+
+    // Producer side of a future. Destroying a promise that was never
+    // satisfied completes its future with std::future_errc::broken_promise.
+
+    template <typename T>
+    class Promise
+    {
+        using State = FutureState<T>;
+
+        std::shared_ptr<State> m_state;
+        bool m_satisfied = false;
+
+    public:
+        Promise() : m_state(std::make_shared<State>()) {}
+        Promise(Promise&&) noexcept = default;
+        Promise& operator=(Promise&&) = delete;
+        Promise(const Promise&) = delete;
+
+        ~Promise()
+        {
+            if (m_state && !m_satisfied)
+            {
+                set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+            }
+        }
+
+        // Call at most once
+        Future<T> future() const { return Future<T>(m_state); }
+
+        void set_value(T value)
+        {
+            m_satisfied = true;
+            m_state->m_value.emplace(std::move(value));
+            m_state->complete();
+        }
+
+        void set_exception(std::exception_ptr error)
+        {
+            m_satisfied = true;
+            m_state->m_error = std::move(error);
+            m_state->complete();
+        }
+    };
+}
@@ -0,0 +1,160 @@
+// hazard.cpp: Hazard pointers for lock-free readers of shared records
+
+#include "hazard.h"
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace arrakis
+{
+    namespace hazard
+    {
+        // Slots live on a global, grow-only list. A thread claims slots on
+        // first use and gives them back when it exits.
+
+        struct Slot
+        {
+            std::atomic<const void*> pointer{ nullptr };
+            std::atomic<bool> active{ true };
+            Slot* next = nullptr;
+        };
+
+        static std::atomic<Slot*> slots(nullptr);
+        static std::atomic<size_t> slot_count(0);
+
+
+        static Slot* acquire_slot()
+        {
+            for (Slot* slot = slots.load(std::memory_order_acquire); slot; slot = slot->next)
+            {
+                bool active = false;
+                if (!slot->active.load(std::memory_order_relaxed) &&
+                    slot->active.compare_exchange_strong(active, true, std::memory_order_acquire))
+                {
+                    return slot;
+                }
+            }
+
+            Slot* slot = new Slot;
+            slot_count.fetch_add(1, std::memory_order_relaxed);
+            Slot* head = slots.load(std::memory_order_relaxed);
+            do
+            {
+                slot->next = head;
+            } while (!slots.compare_exchange_weak(head, slot, std::memory_order_release, std::memory_order_relaxed));
+            return slot;
+        }
+
+
+        struct Retired
+        {
+            void* pointer;
+            void (*deleter)(void*);
+        };
+
+        // Records retired by threads that exited while they were still
+        // protected; adopted by the next scan on any thread
+
+        static std::mutex orphan_mutex;
+        static std::vector<Retired>& orphans()
+        {
+            static auto* orphans = new std::vector<Retired>;   // Outlives thread exit during shutdown
+            return *orphans;
+        }
+
+
+        static void reclaim(std::vector<Retired>& retired)
+        {
+            std::vector<const void*> hazards;
+            for (Slot* slot = slots.load(std::memory_order_acquire); slot; slot = slot->next)
+            {
+                const void* p = slot->pointer.load(std::memory_order_seq_cst);
+                if (p) hazards.push_back(p);
+            }
+            std::sort(hazards.begin(), hazards.end());
+
+            auto kept = std::partition(retired.begin(), retired.end(), [&](const Retired& r)
+            {
+                return std::binary_search(hazards.begin(), hazards.end(), r.pointer);
+            });
+
+            // Deleters may retire more records, so take these off the list first
+            std::vector<Retired> reclaimed(kept, retired.end());
+            retired.erase(kept, retired.end());
+            for (const Retired& r : reclaimed) r.deleter(r.pointer);
+        }
+
+
+        // Per-thread slots and retired list
+
+        struct Thread
+        {
+            Slot* slots[slots_per_thread] = {};
+            int depth = 0;
+            std::vector<Retired> retired;
+
+            ~Thread()
+            {
+                for (Slot*& slot : slots)
+                {
+                    if (!slot) continue;
+                    slot->pointer.store(nullptr, std::memory_order_release);
+                    slot->active.store(false, std::memory_order_release);
+                    slot = nullptr;
+                }
+                reclaim(retired);
+                if (!retired.empty())
+                {
+                    std::lock_guard<std::mutex> guard(orphan_mutex);
+                    orphans().insert(orphans().end(), retired.begin(), retired.end());
+                }
+            }
+        };
+
+        static thread_local Thread thread;
+
+        // Reclaim once the list holds twice as many records as there could
+        // be hazards, so each scan frees at least half of what it examines,
+        // and at least min_scan, so scans stay rare with few threads
+        static const size_t min_scan = 64;
+
+
+        // Nesting deeper than the slots is a bug that would overwrite a live
+        // hazard, so it fails in every build
+
+        Guard::Guard()
+        {
+            if (thread.depth >= slots_per_thread) throw std::logic_error("hazard guards nested too deeply");
+            Slot*& slot = thread.slots[thread.depth];
+            if (!slot) slot = acquire_slot();   // May throw; depth is counted only once it is ours
+            m_slot = &slot->pointer;
+            ++thread.depth;
+        }
+
+
+        Guard::~Guard()
+        {
+            m_slot->store(nullptr, std::memory_order_release);
+            --thread.depth;
+        }
+
+
+        void retire(void* p, void (*deleter)(void*))
+        {
+            thread.retired.push_back(Retired{ p, deleter });
+            if (thread.retired.size() >= std::max(min_scan, 2 * slot_count.load(std::memory_order_relaxed))) scan();
+        }
+
+
+        void scan()
+        {
+            {
+                std::lock_guard<std::mutex> guard(orphan_mutex);
+                thread.retired.insert(thread.retired.end(), orphans().begin(), orphans().end());
+                orphans().clear();
+            }
+            reclaim(thread.retired);
+        }
+    }
+}
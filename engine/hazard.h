@@ -0,0 +1,66 @@
+// hazard.h: Hazard pointers for lock-free readers of shared records
+#pragma once
+
+#include <atomic>
+
+namespace arrakis
+{
+    // Safe memory reclamation (Michael, 2004). A reader publishes the pointer
+    // it is about to use in a hazard slot; a writer that has unlinked a
+    // record retires it, and the record is deleted only once no slot holds
+    // it. Each thread owns a few slots, so guards may nest a few deep;
+    // constructing one more throws std::logic_error.
+
+    namespace hazard
+    {
+        const int slots_per_thread = 4;
+
+        // Protect one pointer for the lifetime of the guard
+
+        class Guard
+        {
+            std::atomic<const void*>* m_slot;
+
+        public:
+            Guard();
+            ~Guard();
+            Guard(const Guard&) = delete;
+            Guard& operator=(const Guard&) = delete;
+
+            // Load src and keep the record it points to alive
+            template <typename T>
+            T* protect(const std::atomic<T*>& src) noexcept
+            {
+                T* p = src.load(std::memory_order_relaxed);
+                for (;;)
+                {
+                    m_slot->store(p, std::memory_order_seq_cst);
+                    T* q = src.load(std::memory_order_seq_cst);
+                    if (p == q) return p;
+                    p = q;
+                }
+            }
+
+            void reset() noexcept
+            {
+                m_slot->store(nullptr, std::memory_order_release);
+            }
+        };
+
+        // Delete p once no guard protects it. p must already be unreachable
+        // for new readers.
+
+        void retire(void* p, void (*deleter)(void*));
+
+        template <typename T>
+        void retire(T* p)
+        {
+            retire(const_cast<void*>(static_cast<const void*>(p)), [](void* q) { delete static_cast<T*>(q); });
+        }
+
+        // Delete what the calling thread has retired and is no longer
+        // protected. Runs automatically as retired records accumulate.
+
+        void scan();
+    }
+}
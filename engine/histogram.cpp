@@ -0,0 +1,116 @@
+// histogram.cpp: Latency histograms with bounded relative error
+
+#include "histogram.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace arrakis
+{
+    // Index of the highest set bit of a non-zero value
+
+    static unsigned highest_bit(uint64_t value) noexcept
+    {
+#if defined(_MSC_VER)
+        unsigned long bit;
+        _BitScanReverse64(&bit, value);
+        return (unsigned)bit;
+#else
+        return 63 - (unsigned)__builtin_clzll(value);
+#endif
+    }
+
+
+    Histogram::Histogram(int64_t highest, unsigned precision) :
+        m_precision(precision),
+        m_highest(std::max<int64_t>(highest, 1)),
+        m_total(0),
+        m_min(0),
+        m_max(0),
+        m_sum(0)
+    {
+        assert(precision >= 1 && precision <= 20);
+        m_counts.resize(index(m_highest) + 1);
+    }
+
+
+    // Values below 2^(precision+1) have a bucket each. Above that, the
+    // buckets from 2^e to 2^(e+1) are 2^(e-precision) wide: the value is
+    // shifted right until it has precision+1 bits, and the shift picks the
+    // group of 2^precision buckets.
+
+    size_t Histogram::index(int64_t value) const noexcept
+    {
+        if (value <= 0) return 0;
+        const unsigned bit = highest_bit((uint64_t)value);
+        const unsigned shift = bit > m_precision ? bit - m_precision : 0;
+        return ((size_t)shift << m_precision) + (size_t)((uint64_t)value >> shift);
+    }
+
+
+    int64_t Histogram::lowest(size_t index) const noexcept
+    {
+        const size_t group = index >> m_precision;
+        if (group < 2) return (int64_t)index;
+        const unsigned shift = (unsigned)(group - 1);
+        return (int64_t)((uint64_t)(index - ((size_t)shift << m_precision)) << shift);
+    }
+
+
+    int64_t Histogram::highest(size_t index) const noexcept
+    {
+        const size_t group = index >> m_precision;
+        if (group < 2) return (int64_t)index;
+        return lowest(index) + ((int64_t)1 << (group - 1)) - 1;
+    }
+
+
+    void Histogram::record(int64_t value, uint64_t count) noexcept
+    {
+        value = std::min(std::max<int64_t>(value, 0), m_highest);
+        m_counts[index(value)] += count;
+        if (m_total == 0 || value < m_min) m_min = value;
+        if (m_total == 0 || value > m_max) m_max = value;
+        m_total += count;
+        m_sum += (double)value * (double)count;
+    }
+
+
+    void Histogram::merge(const Histogram& other) noexcept
+    {
+        assert(other.m_precision == m_precision && other.m_counts.size() == m_counts.size());
+        if (other.m_total == 0) return;
+        for (size_t i = 0; i < m_counts.size(); ++i) m_counts[i] += other.m_counts[i];
+        if (m_total == 0 || other.m_min < m_min) m_min = other.m_min;
+        if (m_total == 0 || other.m_max > m_max) m_max = other.m_max;
+        m_total += other.m_total;
+        m_sum += other.m_sum;
+    }
+
+
+    void Histogram::reset() noexcept
+    {
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        m_total = 0;
+        m_min = m_max = 0;
+        m_sum = 0;
+    }
+
+
+    int64_t Histogram::percentile(double percent) const noexcept
+    {
+        if (m_total == 0) return 0;
+        const double clamped = std::min(std::max(percent, 0.0), 100.0);
+        const uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(clamped / 100 * (double)m_total));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < m_counts.size(); ++i)
+        {
+            seen += m_counts[i];
+            if (seen >= rank) return std::min(std::max(highest(i), m_min), m_max);
+        }
+        return m_max;
+    }
+}
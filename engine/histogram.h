@@ -0,0 +1,70 @@
+// histogram.h: Latency histograms with bounded relative error
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace arrakis
+{
+    // Counts values in buckets whose width grows with the value, as in
+    // HdrHistogram: values below 2^(precision+1) are kept exactly, and the
+    // others to within a relative error of 2^-precision (under 1% by
+    // default), in memory that grows with the log of the range. Values are
+    // non-negative, usually nanoseconds; larger values than the histogram
+    // was made for count as its largest, and negative ones as zero.
+    //
+    // Not thread safe: record on one thread each and merge the results.
+
+    class Histogram
+    {
+        unsigned m_precision;
+        int64_t m_highest;
+        std::vector<uint64_t> m_counts;
+        uint64_t m_total;
+        int64_t m_min;
+        int64_t m_max;
+        double m_sum;
+
+        size_t index(int64_t value) const noexcept;
+        int64_t lowest(size_t index) const noexcept;   // Smallest value counted in the bucket
+        int64_t highest(size_t index) const noexcept;  // Largest value counted in the bucket
+
+    public:
+        explicit Histogram(int64_t highest = (int64_t)1 << 40, unsigned precision = 7);
+
+        void record(int64_t value, uint64_t count = 1) noexcept;
+
+        // Add the counts of other, which must have the same range and precision
+        void merge(const Histogram& other) noexcept;
+        void reset() noexcept;
+
+        uint64_t count() const noexcept { return m_total; }
+        int64_t min() const noexcept { return m_total ? m_min : 0; }
+        int64_t max() const noexcept { return m_total ? m_max : 0; }
+        double mean() const noexcept { return m_total ? m_sum / (double)m_total : 0; }
+
+        // Buckets by index, for counts kept elsewhere, such as in atomic
+        // counters: bucket(value) is where record(value) counts, and adding
+        // n values back with record(bucket_highest(i), n) puts them there
+        // too, with the minimum and maximum rounded up to their buckets' tops
+        size_t buckets() const noexcept { return m_counts.size(); }
+        size_t bucket(int64_t value) const noexcept { return index(value < m_highest ? value : m_highest); }
+        int64_t bucket_lowest(size_t index) const noexcept { return lowest(index); }
+        int64_t bucket_highest(size_t index) const noexcept { return highest(index); }
+
+        // The value at or below which percent of the recorded values lie, as
+        // the top of its bucket; 0 if nothing was recorded
+        int64_t percentile(double percent) const noexcept;
+
+        // Visit each non-empty bucket, smallest first, as f(lowest, highest, count)
+        template <typename F>
+        void for_each(F f) const
+        {
+            for (size_t i = 0; i < m_counts.size(); ++i)
+            {
+                if (m_counts[i]) f(lowest(i), highest(i), m_counts[i]);
+            }
+        }
+    };
+}
@@ -0,0 +1,513 @@
+// journal.cpp: Append-only journal of changes to Arrakeeners
+
+#include "journal.h"
+#include "encoding.h"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace arrakis
+{
+    using namespace encoding;
+
+    static const uint32_t journal_magic = 0x4A4B5241;   // "ARKJ"
+    static const uint32_t journal_version = 1;
+    static const size_t header_size = 8;
+    static const size_t frame_size = 8;             // Size and hash before each payload
+    static const size_t write_threshold = 1 << 20;  // Write early once this much is buffered
+
+    enum RecordType : uint8_t
+    {
+        created_record = 1,
+        renamed_record,
+        changed_record,
+        detached_record
+    };
+
+
+    static uint32_t fnv1a(const uint8_t* p, size_t n) noexcept
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < n; ++i) hash = (hash ^ p[i]) * 16777619u;
+        return hash;
+    }
+
+
+    static void put_u32_at(std::vector<uint8_t>& out, size_t offset, uint32_t value) noexcept
+    {
+        for (int i = 0; i < 4; ++i) out[offset + i] = (uint8_t)(value >> (8 * i));
+    }
+
+
+    static void put_names(std::vector<uint8_t>& out, const Names& names)
+    {
+        put_string(out, names.first_name);
+        put_string(out, names.last_name);
+        put_string(out, names.affiliation.str());
+        put_string(out, names.occupation.str());
+    }
+
+
+    static void get_names(Reader& reader, Names& names)
+    {
+        names.first_name = reader.get_string();
+        names.last_name = reader.get_string();
+        names.affiliation = reader.get_string();
+        names.occupation = reader.get_string();
+    }
+
+
+    // Flush the C library buffer and then the operating system's
+
+    static bool sync(std::FILE* file) noexcept
+    {
+        if (std::fflush(file) != 0) return false;
+#if defined(_WIN32)
+        return _commit(_fileno(file)) == 0;
+#elif defined(__linux__)
+        return fdatasync(fileno(file)) == 0;
+#else
+        return fsync(fileno(file)) == 0;
+#endif
+    }
+
+
+    Journal::Journal(const std::string& path, Durability durability, std::chrono::microseconds window) :
+        m_file(std::fopen(path.c_str(), "wb")),
+        m_durability(durability),
+        m_window(window),
+        m_appended(0),
+        m_durable(0),
+        m_waiting(0),
+        m_stop(false),
+        m_failed(false),
+        m_restoring(false),
+        m_closed(false),
+        m_records(0),
+        m_syncs(0),
+        m_next_id(1)
+    {
+        if (!m_file) throw std::system_error(errno, std::generic_category(), path);
+
+        put_u32(m_buffer, journal_magic);
+        put_u32(m_buffer, journal_version);
+        m_appended = m_buffer.size();
+
+        try
+        {
+            m_writer = std::thread([this] { write(); });
+        }
+        catch (...)
+        {
+            std::fclose(m_file);
+            throw;
+        }
+    }
+
+
+    Journal::~Journal()
+    {
+        assert(m_ids.empty());
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        m_writer.join();
+        std::fclose(m_file);
+    }
+
+
+    // Background thread: write and sync whatever is buffered when a writer
+    // waits for it, when enough has accumulated, or once the oldest change
+    // has waited a window; then wake the writers it covered
+
+    void Journal::write()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+            m_wake.wait(lock, [&] { return m_stop || !m_buffer.empty(); });
+            m_wake.wait_for(lock, m_window, [&]
+            {
+                return m_stop || (m_waiting && !m_buffer.empty()) || m_buffer.size() >= write_threshold;
+            });
+            if (m_buffer.empty())
+            {
+                if (m_stop) return;
+                continue;
+            }
+
+            m_writing.swap(m_buffer);
+            const uint64_t end = m_appended;
+            const bool failed = m_failed;
+            lock.unlock();
+            const bool ok = !failed && write_out(m_writing);
+            m_writing.clear();
+            lock.lock();
+
+            // After a failure nothing more is written, so that the file
+            // stays a valid prefix of the changes
+            if (ok) m_durable = end;
+            else m_failed = true;
+            ++m_syncs;
+            m_synced.notify_all();
+        }
+    }
+
+
+    bool Journal::write_out(const std::vector<uint8_t>& data) noexcept
+    {
+        if (std::fwrite(data.data(), 1, data.size(), m_file) != data.size()) return false;
+        return sync(m_file);
+    }
+
+
+    void Journal::wait_for(uint64_t lsn) noexcept
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ++m_waiting;
+        m_wake.notify_one();
+        m_synced.wait(lock, [&] { return m_durable >= lsn || m_failed; });
+        --m_waiting;
+    }
+
+
+    void Journal::flush()
+    {
+        uint64_t lsn;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            lsn = m_appended;
+        }
+        wait_for(lsn);
+        if (failed()) throw std::runtime_error("journal write failed");
+    }
+
+
+    void Journal::close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+            m_ids.clear();
+        }
+        flush();
+    }
+
+
+    void Journal::restoring(bool restoring)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_restoring = restoring;
+    }
+
+
+    bool Journal::failed() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_failed;
+    }
+
+
+    uint64_t Journal::records() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_records;
+    }
+
+
+    uint64_t Journal::syncs() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_syncs;
+    }
+
+
+    // Frame a record in the buffer. Encoding straight into the buffer under
+    // the lock keeps records whole and in order without a copy. Allocation
+    // failures mark the journal failed rather than escape an observer.
+
+    template <typename Encode>
+    static bool encode_record(std::vector<uint8_t>& buffer, Encode encode) noexcept
+    {
+        const size_t start = buffer.size();
+        try
+        {
+            buffer.resize(start + frame_size);
+            encode(buffer);
+        }
+        catch (...)
+        {
+            buffer.resize(start);
+            return false;
+        }
+        const size_t size = buffer.size() - start - frame_size;
+        put_u32_at(buffer, start, (uint32_t)size);
+        put_u32_at(buffer, start + 4, fnv1a(buffer.data() + start + frame_size, size));
+        return true;
+    }
+
+
+    template <typename Encode>
+    uint64_t Journal::append(Encode encode) noexcept
+    {
+        const bool was_empty = m_buffer.empty();
+        const size_t before = m_buffer.size();
+        if (!encode_record(m_buffer, encode))
+        {
+            m_failed = true;
+            return m_appended;
+        }
+        m_appended += m_buffer.size() - before;
+        ++m_records;
+        if (was_empty || m_buffer.size() >= write_threshold) m_wake.notify_one();
+        return m_appended;
+    }
+
+
+    void Journal::attached(const Arrakeener& obj, const State& state) noexcept
+    {
+        uint64_t lsn = 0;
+        bool wait = m_durability == Durability::synchronous;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_closed) return;
+            wait = wait && !m_restoring;
+            uint64_t id = m_next_id++;
+            try
+            {
+                m_ids.emplace(&obj, id);
+            }
+            catch (...)
+            {
+                m_failed = true;
+                return;
+            }
+            lsn = append([&](std::vector<uint8_t>& out)
+            {
+                put_u8(out, created_record);
+                put_i64(out, (int64_t)id);
+                put_i64(out, state.ledger.energy);
+                put_i64(out, state.ledger.solaris);
+                put_i64(out, state.ledger.spice);
+                put_names(out, state.names);
+            });
+        }
+        if (wait) wait_for(lsn);
+    }
+
+
+    void Journal::renamed(const Arrakeener& obj, const Names&, const Names& after) noexcept
+    {
+        uint64_t lsn = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_ids.find(&obj);
+            if (it == m_ids.end()) return;
+            const uint64_t id = it->second;
+            lsn = append([&](std::vector<uint8_t>& out)
+            {
+                put_u8(out, renamed_record);
+                put_i64(out, (int64_t)id);
+                put_names(out, after);
+            });
+        }
+        if (m_durability == Durability::synchronous) wait_for(lsn);
+    }
+
+
+    void Journal::changed(const Arrakeener& obj, Change change, int64_t arg, const Ledger& before, const Ledger& after) noexcept
+    {
+        uint64_t lsn = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_ids.find(&obj);
+            if (it == m_ids.end()) return;
+            const uint64_t id = it->second;
+            lsn = append([&](std::vector<uint8_t>& out)
+            {
+                put_u8(out, changed_record);
+                put_i64(out, (int64_t)id);
+                put_u8(out, (uint8_t)change);
+                put_i64(out, arg);
+                put_i64(out, (int64_t)((uint64_t)after.energy - (uint64_t)before.energy));
+                put_i64(out, (int64_t)((uint64_t)after.solaris - (uint64_t)before.solaris));
+                put_i64(out, (int64_t)((uint64_t)after.spice - (uint64_t)before.spice));
+            });
+        }
+        if (m_durability == Durability::synchronous) wait_for(lsn);
+    }
+
+
+    // Destruction is not waited for; losing it only resurrects the object
+
+    void Journal::detached(const Arrakeener& obj) noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_ids.find(&obj);
+        if (it == m_ids.end()) return;
+        const uint64_t id = it->second;
+        m_ids.erase(it);
+        append([&](std::vector<uint8_t>& out)
+        {
+            put_u8(out, detached_record);
+            put_i64(out, (int64_t)id);
+        });
+    }
+
+
+    Replay Journal::replay(const std::string& path)
+    {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file) throw std::system_error(errno, std::generic_category(), path);
+
+        std::vector<uint8_t> data;
+        uint8_t chunk[1 << 16];
+        size_t n;
+        while ((n = std::fread(chunk, 1, sizeof(chunk), file)) > 0) data.insert(data.end(), chunk, chunk + n);
+        const bool error = std::ferror(file) != 0;
+        std::fclose(file);
+        if (error) throw std::system_error(EIO, std::generic_category(), path);
+
+        Reader header(data.data(), data.size());
+        if (header.get_u32() != journal_magic) throw std::runtime_error("not a journal: " + path);
+        if (header.get_u32() != journal_version) throw std::runtime_error("unsupported journal version: " + path);
+
+        Replay replay;
+        size_t offset = header_size;
+        while (offset < data.size())
+        {
+            if (data.size() - offset < frame_size)
+            {
+                replay.complete = false;
+                break;
+            }
+            Reader prefix(data.data() + offset, frame_size);
+            const uint32_t size = prefix.get_u32();
+            const uint32_t hash = prefix.get_u32();
+            const uint8_t* payload = data.data() + offset + frame_size;
+            if (data.size() - offset - frame_size < size || fnv1a(payload, size) != hash)
+            {
+                replay.complete = false;
+                break;
+            }
+
+            Reader reader(payload, size);
+            const uint8_t type = reader.get_u8();
+            const uint64_t id = (uint64_t)reader.get_i64();
+            switch (type)
+            {
+            case created_record:
+            {
+                State state;
+                state.ledger.energy = reader.get_i64();
+                state.ledger.solaris = reader.get_i64();
+                state.ledger.spice = reader.get_i64();
+                get_names(reader, state.names);
+                replay.objects[id] = std::move(state);
+                break;
+            }
+            case renamed_record:
+            {
+                Names names;
+                get_names(reader, names);
+                auto it = replay.objects.find(id);
+                if (it != replay.objects.end()) it->second.names = std::move(names);
+                break;
+            }
+            case changed_record:
+            {
+                reader.get_u8();            // Change and argument are informative
+                reader.get_i64();
+                const int64_t energy = reader.get_i64();
+                const int64_t solaris = reader.get_i64();
+                const int64_t spice = reader.get_i64();
+                auto it = replay.objects.find(id);
+                if (it != replay.objects.end())
+                {
+                    Ledger& ledger = it->second.ledger;
+                    ledger.energy = (int64_t)((uint64_t)ledger.energy + (uint64_t)energy);
+                    ledger.solaris = (int64_t)((uint64_t)ledger.solaris + (uint64_t)solaris);
+                    ledger.spice = (int64_t)((uint64_t)ledger.spice + (uint64_t)spice);
+                }
+                break;
+            }
+            case detached_record:
+                replay.objects.erase(id);
+                break;
+            default:
+                replay.complete = false;
+                break;
+            }
+            if (!reader.ok() || !replay.complete)
+            {
+                replay.complete = false;
+                break;
+            }
+
+            offset += frame_size + size;
+            ++replay.records;
+        }
+        replay.bytes = offset;
+        return replay;
+    }
+
+
+    std::vector<State> Replay::take()
+    {
+        std::vector<uint64_t> ids;
+        ids.reserve(objects.size());
+        for (const auto& entry : objects) ids.push_back(entry.first);
+        std::sort(ids.begin(), ids.end());
+
+        std::vector<State> result;
+        result.reserve(ids.size());
+        for (uint64_t id : ids) result.push_back(std::move(objects[id]));
+        objects.clear();
+        return result;
+    }
+
+
+    static std::string old_path(const std::string& path)
+    {
+        return path + ".old";
+    }
+
+
+    Replay Journal::recover(const std::string& path)
+    {
+        const std::string old = old_path(path);
+        std::error_code error;
+        if (!std::filesystem::exists(old, error))
+        {
+            if (error) throw std::system_error(error, old);
+            if (!std::filesystem::exists(path, error))
+            {
+                if (error) throw std::system_error(error, path);
+                return Replay();
+            }
+            std::filesystem::rename(path, old, error);
+            if (error) throw std::system_error(error, path);
+        }
+        return replay(old);
+    }
+
+
+    void Journal::recovered(const std::string& path)
+    {
+        const std::string old = old_path(path);
+        std::error_code error;
+        std::filesystem::remove(old, error);
+        if (error) throw std::system_error(error, old);
+    }
+}
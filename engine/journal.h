@@ -0,0 +1,160 @@
+// journal.h: Append-only journal of changes to Arrakeeners
+#pragma once
+
+#include "core.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace arrakis
+{
+    // When a change counts as recorded
+
+    enum class Durability : uint8_t
+    {
+        deferred,           // Written and synced within the window; a crash may lose it
+        synchronous         // The change waits until it is synced to disk
+    };
+
+
+    // State rebuilt from a journal
+
+    struct Replay
+    {
+        std::unordered_map<uint64_t, State> objects;    // Live at the end, by journal id
+        size_t records = 0;
+        size_t bytes = 0;                   // Length of the valid prefix of the file
+        bool complete = true;               // False if a torn or corrupt record ended it
+
+        std::vector<State> take();          // The objects in the order created, moved out
+    };
+
+
+    // Records every change to the Arrakeeners it observes: creation and
+    // clones with their whole state, renames, and operations with the
+    // ledger deltas they drew, and destruction. Replaying applies the deltas,
+    // so it needs no random numbers and reproduces the ledgers exactly;
+    // replayed objects start new random streams.
+    //
+    // Changes are copied to a buffer under a short lock. A background thread
+    // writes the buffer and syncs it at least once per window. With
+    // synchronous durability a writer that needs its change on disk wakes
+    // the thread at once, and every change buffered by then shares that
+    // sync (group commit). Objects block on the sync while holding their
+    // own mutex, so only changes to different objects are grouped.
+    //
+    // A file holds a header and then records of
+    //   u32 payload size, u32 FNV-1a hash of the payload, payload
+    // with payloads (see encoding.h for the types)
+    //   u8 1 attached, i64 id, i64 energy, i64 solaris, i64 spice, 4 strings
+    //   u8 2 renamed, i64 id, 4 strings
+    //   u8 3 changed, i64 id, u8 Change, i64 arg, i64 energy, i64 solaris,
+    //        i64 spice deltas
+    //   u8 4 detached or destroyed, i64 id
+    //
+    // To restart, recover the journal, create the objects, restore them into
+    // a new journal at the same path, which then starts with one record per
+    // object, and call recovered. Until then the old journal is kept aside,
+    // so a crash in between loses nothing.
+
+    class Journal : public Observer
+    {
+        std::FILE* m_file;
+        const Durability m_durability;
+        const std::chrono::microseconds m_window;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_wake;     // For the writer thread
+        std::condition_variable m_synced;   // For writers waiting on a sync
+        std::vector<uint8_t> m_buffer;      // Appended, not yet written
+        std::vector<uint8_t> m_writing;     // Being written; reused
+        uint64_t m_appended;                // Bytes appended since opening
+        uint64_t m_durable;                 // Bytes synced since opening
+        unsigned m_waiting;                 // Writers waiting on a sync
+        bool m_stop;
+        bool m_failed;
+        bool m_restoring;                   // Attached objects are not waited for
+        bool m_closed;
+        uint64_t m_records;
+        uint64_t m_syncs;
+        std::unordered_map<const Arrakeener*, uint64_t> m_ids;
+        uint64_t m_next_id;
+        std::thread m_writer;
+
+        template <typename Encode> uint64_t append(Encode encode) noexcept;
+        void wait_for(uint64_t lsn) noexcept;
+        void write();
+        void restoring(bool restoring);
+        bool write_out(const std::vector<uint8_t>& data) noexcept;
+
+    public:
+        // Creates or truncates the file; throws std::system_error on failure
+        explicit Journal(const std::string& path, Durability durability = Durability::synchronous,
+                         std::chrono::microseconds window = std::chrono::milliseconds(2));
+        ~Journal();                         // Syncs what is left; objects must be detached first, or the journal closed
+        Journal(const Journal&) = delete;
+        Journal& operator=(const Journal&) = delete;
+
+        // Start recording obj and its future clones
+        void attach(Arrakeener& obj) { obj.observe(this); }
+
+        // Call attach_all, which attaches the objects rebuilt from a replay,
+        // then flush once for all of them rather than wait for each; throws
+        // what attach_all throws, or as flush. Nothing else may attach
+        // objects meanwhile.
+        template <typename F>
+        void restore(F attach_all)
+        {
+            restoring(true);
+            try
+            {
+                attach_all();
+            }
+            catch (...)
+            {
+                restoring(false);
+                throw;
+            }
+            restoring(false);
+            flush();
+        }
+
+        // Wait until every change recorded so far is on disk; throws
+        // std::runtime_error if a write has failed
+        void flush();
+
+        // Record nothing more, so that the objects can be destroyed, still
+        // before the journal, without it being recorded, and flush; throws
+        // as flush
+        void close();
+
+        bool failed() const;
+        uint64_t records() const;           // Appended since opening
+        uint64_t syncs() const;             // Group commits since opening
+
+        // Rebuild the objects recorded in a file; throws std::system_error if
+        // it cannot be read and std::runtime_error if it is not a journal
+        static Replay replay(const std::string& path);
+
+        // Replay the journal at path, if there is one, after moving it aside
+        // to path + ".old"; an old file left by a restart that did not finish
+        // is the whole record and is replayed instead. Once the objects are
+        // restored into a new journal at path, recovered removes the old
+        // file. Both throw std::system_error, and recover as replay.
+        static Replay recover(const std::string& path);
+        static void recovered(const std::string& path);
+
+        // Observer
+        void attached(const Arrakeener& obj, const State& state) noexcept override;
+        void renamed(const Arrakeener& obj, const Names& before, const Names& after) noexcept override;
+        void changed(const Arrakeener& obj, Change change, int64_t arg, const Ledger& before, const Ledger& after) noexcept override;
+        void detached(const Arrakeener& obj) noexcept override;
+    };
+}
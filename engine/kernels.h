@@ -0,0 +1,114 @@
+// kernels.h: Column kernels used by Population (internal)
+#pragma once
+
+#include "rules.h"
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define ARRAKIS_X86_KERNELS 1
+#endif
+
+namespace arrakis
+{
+    namespace kernels
+    {
+        // Columns of a population
+        struct Columns
+        {
+            int64_t* energy;
+            int64_t* solaris;
+            int64_t* spice;
+        };
+
+
+        // Counter-based random draws
+        // Row r of step t draws hash(r + key.lo) and hash(r + key.hi), which
+        // together form a 64-bit fraction that is scaled into the range.
+        // The result depends only on (seed, step, draw, row), so every kernel
+        // produces identical numbers. The bias is below span / 2^64.
+
+        inline uint32_t mix32(uint32_t x) noexcept
+        {
+            x ^= x >> 16;
+            x *= 0x7FEB352Du;
+            x ^= x >> 15;
+            x *= 0x846CA68Bu;
+            x ^= x >> 16;
+            return x;
+        }
+
+        struct DrawKey
+        {
+            uint32_t lo;
+            uint32_t hi;
+            uint32_t lower;
+            uint32_t span;
+        };
+
+        inline DrawKey draw_key(uint64_t seed, uint64_t step, uint32_t draw, DrawRange range) noexcept
+        {
+            uint32_t k = mix32((uint32_t)(step >> 32) + draw * 0x9E3779B9u);
+            k = mix32((uint32_t)step ^ k);
+            k = mix32((uint32_t)(seed >> 32) ^ k);
+            k = mix32((uint32_t)seed ^ k);
+            DrawKey key;
+            key.lo = mix32(k);
+            key.hi = mix32(k ^ 0x85EBCA6Bu);
+            key.lower = (uint32_t)range.lower;
+            key.span = (uint32_t)(range.upper - range.lower + 1);
+            return key;
+        }
+
+        inline int64_t draw(const DrawKey& key, uint32_t row) noexcept
+        {
+            const uint64_t lo = mix32(row + key.lo);
+            const uint64_t hi = mix32(row + key.hi);
+            const uint64_t t = (hi * key.span + ((lo * key.span) >> 32)) >> 32;
+            return (int64_t)key.lower + (int64_t)t;
+        }
+
+
+        // The vector kernels are compiled for other instruction sets, so they
+        // must not call the inline functions above; the linker could keep
+        // their copies for the whole program.
+
+        // Kernels apply an operation to rows [begin, end) and return the number
+        // of rows that succeeded. The vector kernels require (end - begin) to be
+        // a multiple of their width.
+        //   keys[0] is the only draw of eat and sell
+        //   keys[0..2] are the energy, cost and yield draws of mine
+
+        using Kernel = size_t (*)(
+            const Columns& columns,
+            size_t begin,
+            size_t end,
+            const DrawKey* keys,
+            const int64_t* args,
+            int64_t* deltas,
+            Status* results);
+
+        // Kernels for one operation, indexed by arrakis::Kernel, and its draws
+        struct Operation
+        {
+            Kernel kernels[3];
+            DrawRange ranges[3];
+            uint32_t draws;
+        };
+
+        size_t eat_spice_scalar(const Columns&, size_t, size_t, const DrawKey*, const int64_t*, int64_t*, Status*);
+        size_t sell_spice_scalar(const Columns&, size_t, size_t, const DrawKey*, const int64_t*, int64_t*, Status*);
+        size_t mine_spice_scalar(const Columns&, size_t, size_t, const DrawKey*, const int64_t*, int64_t*, Status*);
+
+#ifdef ARRAKIS_X86_KERNELS
+        const size_t sse42_width = 2;
+        size_t eat_spice_sse42(const Columns&, size_t, size_t, const DrawKey*, const int64_t*, int64_t*, Status*);
+        size_t sell_spice_sse42(const Columns&, size_t, size_t, const DrawKey*, const int64_t*, int64_t*, Status*);
+        size_t mine_spice_sse42(const Columns&, size_t, size_t, const DrawKey*, const int64_t*, int64_t*, Status*);
+
+        const size_t avx2_width = 4;
+        size_t eat_spice_avx2(const Columns&, size_t, size_t, const DrawKey*, const int64_t*, int64_t*, Status*);
+        size_t sell_spice_avx2(const Columns&, size_t, size_t, const DrawKey*, const int64_t*, int64_t*, Status*);
+        size_t mine_spice_avx2(const Columns&, size_t, size_t, const DrawKey*, const int64_t*, int64_t*, Status*);
+#endif
+    }
+}
@@ -0,0 +1,213 @@
+// kernels_avx2.cpp: AVX2 column kernels, four rows per vector
+// Built with AVX2 code generation; only called when the CPU supports it.
+
+#include "kernels.h"
+
+#ifdef ARRAKIS_X86_KERNELS
+
+#include <immintrin.h>
+
+namespace arrakis
+{
+    namespace kernels
+    {
+        namespace
+        {
+            // mix32 on eight 32-bit lanes
+            inline __m256i mix32(__m256i x) noexcept
+            {
+                x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+                x = _mm256_mullo_epi32(x, _mm256_set1_epi32(0x7FEB352D));
+                x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+                x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int)0x846CA68Bu));
+                x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+                return x;
+            }
+
+
+            // draw() for rows i..i+3
+            inline __m256i draw(const DrawKey& key, __m128i rows) noexcept
+            {
+                const __m256i keys = _mm256_setr_epi32(
+                    (int)key.lo, (int)key.lo, (int)key.lo, (int)key.lo,
+                    (int)key.hi, (int)key.hi, (int)key.hi, (int)key.hi);
+                const __m256i h = mix32(_mm256_add_epi32(_mm256_set_m128i(rows, rows), keys));
+                const __m256i lo = _mm256_cvtepu32_epi64(_mm256_castsi256_si128(h));
+                const __m256i hi = _mm256_cvtepu32_epi64(_mm256_extracti128_si256(h, 1));
+                const __m256i span = _mm256_set1_epi64x(key.span);
+                __m256i t = _mm256_add_epi64(
+                    _mm256_mul_epu32(hi, span),
+                    _mm256_srli_epi64(_mm256_mul_epu32(lo, span), 32));
+                t = _mm256_srli_epi64(t, 32);
+                return _mm256_add_epi64(t, _mm256_set1_epi64x(key.lower));
+            }
+
+
+            // safe_multiply for a in [1, 2^31) and any b > 0
+            // Sets overflow in lanes where a * b > INT64_MAX.
+            inline __m256i safe_multiply(__m256i a, __m256i b, __m256i& overflow) noexcept
+            {
+                const __m256i lo = _mm256_mul_epu32(a, b);
+                const __m256i hi = _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32));
+                const __m256i prod = _mm256_add_epi64(_mm256_slli_epi64(hi, 32), lo);
+                overflow = _mm256_or_si256(
+                    _mm256_cmpgt_epi64(hi, _mm256_set1_epi64x(0x7FFFFFFF)),
+                    _mm256_cmpgt_epi64(_mm256_setzero_si256(), prod));
+                return prod;
+            }
+
+
+            // safe_add for b >= 0
+            // Sets overflow in lanes where a > INT64_MAX - b.
+            inline __m256i safe_add(__m256i a, __m256i b, __m256i& overflow) noexcept
+            {
+                overflow = _mm256_cmpgt_epi64(a, _mm256_sub_epi64(_mm256_set1_epi64x(INT64_MAX), b));
+                return _mm256_add_epi64(a, b);
+            }
+
+
+            inline __m256i load(const int64_t* p) noexcept
+            {
+                return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            }
+
+            inline void store(int64_t* p, __m256i v) noexcept
+            {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+            }
+
+
+            // Later failures are applied first so that the earliest check wins
+            inline __m256i fail(__m256i status, __m256i mask, Status code) noexcept
+            {
+                return _mm256_blendv_epi8(status, _mm256_set1_epi64x((int64_t)code), mask);
+            }
+
+
+            // Store the four statuses and return the mask of rows that succeeded
+            inline __m256i finish(__m256i status, Status* results, size_t& succeeded) noexcept
+            {
+                alignas(32) int64_t codes[4];
+                _mm256_store_si256(reinterpret_cast<__m256i*>(codes), status);
+                for (int j = 0; j < 4; ++j) results[j] = (Status)codes[j];
+                const __m256i ok = _mm256_cmpeq_epi64(status, _mm256_setzero_si256());
+                const int mask = _mm256_movemask_pd(_mm256_castsi256_pd(ok));
+                succeeded += (size_t)((mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1));
+                return ok;
+            }
+
+
+            inline __m128i row_index(size_t i) noexcept
+            {
+                return _mm_add_epi32(_mm_set1_epi32((int)(uint32_t)i), _mm_setr_epi32(0, 1, 2, 3));
+            }
+
+
+            // Shared body of eat and sell: spice is converted into target
+            size_t convert_spice(
+                int64_t* target,
+                const Columns& c,
+                size_t begin,
+                size_t end,
+                const DrawKey& key,
+                const int64_t* units,
+                int64_t* deltas,
+                Status* results) noexcept
+            {
+                const __m256i one = _mm256_set1_epi64x(1);
+                size_t succeeded = 0;
+                for (size_t i = begin; i < end; i += avx2_width)
+                {
+                    const __m256i u = load(units + i);
+                    const __m256i spice = load(c.spice + i);
+                    const __m256i value = load(target + i);
+
+                    __m256i overflow_multiply, overflow_add;
+                    const __m256i delta = safe_multiply(draw(key, row_index(i)), u, overflow_multiply);
+                    const __m256i new_value = safe_add(value, delta, overflow_add);
+
+                    __m256i status = _mm256_setzero_si256();
+                    status = fail(status, _mm256_or_si256(overflow_multiply, overflow_add), Status::overflow);
+                    status = fail(status, _mm256_cmpgt_epi64(u, spice), Status::no_spice);
+                    status = fail(status, _mm256_cmpgt_epi64(one, u), Status::nonpos_spice);
+
+                    const __m256i ok = finish(status, results + i, succeeded);
+                    store(c.spice + i, _mm256_blendv_epi8(spice, _mm256_sub_epi64(spice, u), ok));
+                    store(target + i, _mm256_blendv_epi8(value, new_value, ok));
+                    store(deltas + i, _mm256_and_si256(delta, ok));
+                }
+                return succeeded;
+            }
+        }
+
+
+        size_t eat_spice_avx2(
+            const Columns& c,
+            size_t begin,
+            size_t end,
+            const DrawKey* keys,
+            const int64_t* units,
+            int64_t* deltas,
+            Status* results)
+        {
+            return convert_spice(c.energy, c, begin, end, keys[0], units, deltas, results);
+        }
+
+
+        size_t sell_spice_avx2(
+            const Columns& c,
+            size_t begin,
+            size_t end,
+            const DrawKey* keys,
+            const int64_t* units,
+            int64_t* deltas,
+            Status* results)
+        {
+            return convert_spice(c.solaris, c, begin, end, keys[0], units, deltas, results);
+        }
+
+
+        size_t mine_spice_avx2(
+            const Columns& c,
+            size_t begin,
+            size_t end,
+            const DrawKey* keys,
+            const int64_t* harvesters,
+            int64_t* deltas,
+            Status* results)
+        {
+            const __m256i one = _mm256_set1_epi64x(1);
+            size_t succeeded = 0;
+            for (size_t i = begin; i < end; i += avx2_width)
+            {
+                const __m128i rows = row_index(i);
+                const __m256i h = load(harvesters + i);
+                const __m256i energy = load(c.energy + i);
+                const __m256i solaris = load(c.solaris + i);
+                const __m256i spice = load(c.spice + i);
+
+                const __m256i delta_energy = draw(keys[0], rows);
+                __m256i overflow_cost, overflow_yield, overflow_add;
+                const __m256i delta_solaris = safe_multiply(draw(keys[1], rows), h, overflow_cost);
+                const __m256i delta_spice = safe_multiply(draw(keys[2], rows), h, overflow_yield);
+                const __m256i new_spice = safe_add(spice, delta_spice, overflow_add);
+
+                __m256i status = _mm256_setzero_si256();
+                status = fail(status, overflow_add, Status::overflow);
+                status = fail(status, _mm256_cmpgt_epi64(delta_solaris, solaris), Status::no_solaris);
+                status = fail(status, _mm256_or_si256(overflow_cost, overflow_yield), Status::overflow);
+                status = fail(status, _mm256_cmpgt_epi64(delta_energy, energy), Status::no_energy);
+                status = fail(status, _mm256_cmpgt_epi64(one, h), Status::no_harvester);
+
+                const __m256i ok = finish(status, results + i, succeeded);
+                store(c.energy + i, _mm256_blendv_epi8(energy, _mm256_sub_epi64(energy, delta_energy), ok));
+                store(c.solaris + i, _mm256_blendv_epi8(solaris, _mm256_sub_epi64(solaris, delta_solaris), ok));
+                store(c.spice + i, _mm256_blendv_epi8(spice, new_spice, ok));
+                store(deltas + i, _mm256_and_si256(delta_spice, ok));
+            }
+            return succeeded;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,210 @@
+// kernels_sse42.cpp: SSE4.2 column kernels, two rows per vector
+// Built with SSE4.2 code generation; only called when the CPU supports it.
+
+#include "kernels.h"
+
+#ifdef ARRAKIS_X86_KERNELS
+
+#include <nmmintrin.h>
+
+namespace arrakis
+{
+    namespace kernels
+    {
+        namespace
+        {
+            // mix32 on four 32-bit lanes
+            inline __m128i mix32(__m128i x) noexcept
+            {
+                x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+                x = _mm_mullo_epi32(x, _mm_set1_epi32(0x7FEB352D));
+                x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+                x = _mm_mullo_epi32(x, _mm_set1_epi32((int)0x846CA68Bu));
+                x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+                return x;
+            }
+
+
+            // draw() for rows i and i+1, given rows = { i, i+1, i, i+1 }
+            inline __m128i draw(const DrawKey& key, __m128i rows) noexcept
+            {
+                const __m128i keys = _mm_setr_epi32((int)key.lo, (int)key.lo, (int)key.hi, (int)key.hi);
+                const __m128i h = mix32(_mm_add_epi32(rows, keys));
+                const __m128i lo = _mm_cvtepu32_epi64(h);
+                const __m128i hi = _mm_cvtepu32_epi64(_mm_srli_si128(h, 8));
+                const __m128i span = _mm_set1_epi64x(key.span);
+                __m128i t = _mm_add_epi64(
+                    _mm_mul_epu32(hi, span),
+                    _mm_srli_epi64(_mm_mul_epu32(lo, span), 32));
+                t = _mm_srli_epi64(t, 32);
+                return _mm_add_epi64(t, _mm_set1_epi64x(key.lower));
+            }
+
+
+            // safe_multiply for a in [1, 2^31) and any b > 0
+            // Sets overflow in lanes where a * b > INT64_MAX.
+            inline __m128i safe_multiply(__m128i a, __m128i b, __m128i& overflow) noexcept
+            {
+                const __m128i lo = _mm_mul_epu32(a, b);
+                const __m128i hi = _mm_mul_epu32(a, _mm_srli_epi64(b, 32));
+                const __m128i prod = _mm_add_epi64(_mm_slli_epi64(hi, 32), lo);
+                overflow = _mm_or_si128(
+                    _mm_cmpgt_epi64(hi, _mm_set1_epi64x(0x7FFFFFFF)),
+                    _mm_cmpgt_epi64(_mm_setzero_si128(), prod));
+                return prod;
+            }
+
+
+            // safe_add for b >= 0
+            // Sets overflow in lanes where a > INT64_MAX - b.
+            inline __m128i safe_add(__m128i a, __m128i b, __m128i& overflow) noexcept
+            {
+                overflow = _mm_cmpgt_epi64(a, _mm_sub_epi64(_mm_set1_epi64x(INT64_MAX), b));
+                return _mm_add_epi64(a, b);
+            }
+
+
+            inline __m128i load(const int64_t* p) noexcept
+            {
+                return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            }
+
+            inline void store(int64_t* p, __m128i v) noexcept
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+            }
+
+
+            // Later failures are applied first so that the earliest check wins
+            inline __m128i fail(__m128i status, __m128i mask, Status code) noexcept
+            {
+                return _mm_blendv_epi8(status, _mm_set1_epi64x((int64_t)code), mask);
+            }
+
+
+            // Store the two statuses and return the mask of rows that succeeded
+            inline __m128i finish(__m128i status, Status* results, size_t& succeeded) noexcept
+            {
+                results[0] = (Status)_mm_cvtsi128_si32(status);
+                results[1] = (Status)_mm_cvtsi128_si32(_mm_unpackhi_epi64(status, status));
+                const __m128i ok = _mm_cmpeq_epi64(status, _mm_setzero_si128());
+                const int mask = _mm_movemask_pd(_mm_castsi128_pd(ok));
+                succeeded += (size_t)((mask & 1) + ((mask >> 1) & 1));
+                return ok;
+            }
+
+
+            inline __m128i row_index(size_t i) noexcept
+            {
+                return _mm_add_epi32(_mm_set1_epi32((int)(uint32_t)i), _mm_setr_epi32(0, 1, 0, 1));
+            }
+
+
+            // Shared body of eat and sell: spice is converted into target
+            size_t convert_spice(
+                int64_t* target,
+                const Columns& c,
+                size_t begin,
+                size_t end,
+                const DrawKey& key,
+                const int64_t* units,
+                int64_t* deltas,
+                Status* results) noexcept
+            {
+                const __m128i one = _mm_set1_epi64x(1);
+                size_t succeeded = 0;
+                for (size_t i = begin; i < end; i += sse42_width)
+                {
+                    const __m128i u = load(units + i);
+                    const __m128i spice = load(c.spice + i);
+                    const __m128i value = load(target + i);
+
+                    __m128i overflow_multiply, overflow_add;
+                    const __m128i delta = safe_multiply(draw(key, row_index(i)), u, overflow_multiply);
+                    const __m128i new_value = safe_add(value, delta, overflow_add);
+
+                    __m128i status = _mm_setzero_si128();
+                    status = fail(status, _mm_or_si128(overflow_multiply, overflow_add), Status::overflow);
+                    status = fail(status, _mm_cmpgt_epi64(u, spice), Status::no_spice);
+                    status = fail(status, _mm_cmpgt_epi64(one, u), Status::nonpos_spice);
+
+                    const __m128i ok = finish(status, results + i, succeeded);
+                    store(c.spice + i, _mm_blendv_epi8(spice, _mm_sub_epi64(spice, u), ok));
+                    store(target + i, _mm_blendv_epi8(value, new_value, ok));
+                    store(deltas + i, _mm_and_si128(delta, ok));
+                }
+                return succeeded;
+            }
+        }
+
+
+        size_t eat_spice_sse42(
+            const Columns& c,
+            size_t begin,
+            size_t end,
+            const DrawKey* keys,
+            const int64_t* units,
+            int64_t* deltas,
+            Status* results)
+        {
+            return convert_spice(c.energy, c, begin, end, keys[0], units, deltas, results);
+        }
+
+
+        size_t sell_spice_sse42(
+            const Columns& c,
+            size_t begin,
+            size_t end,
+            const DrawKey* keys,
+            const int64_t* units,
+            int64_t* deltas,
+            Status* results)
+        {
+            return convert_spice(c.solaris, c, begin, end, keys[0], units, deltas, results);
+        }
+
+
+        size_t mine_spice_sse42(
+            const Columns& c,
+            size_t begin,
+            size_t end,
+            const DrawKey* keys,
+            const int64_t* harvesters,
+            int64_t* deltas,
+            Status* results)
+        {
+            const __m128i one = _mm_set1_epi64x(1);
+            size_t succeeded = 0;
+            for (size_t i = begin; i < end; i += sse42_width)
+            {
+                const __m128i rows = row_index(i);
+                const __m128i h = load(harvesters + i);
+                const __m128i energy = load(c.energy + i);
+                const __m128i solaris = load(c.solaris + i);
+                const __m128i spice = load(c.spice + i);
+
+                const __m128i delta_energy = draw(keys[0], rows);
+                __m128i overflow_cost, overflow_yield, overflow_add;
+                const __m128i delta_solaris = safe_multiply(draw(keys[1], rows), h, overflow_cost);
+                const __m128i delta_spice = safe_multiply(draw(keys[2], rows), h, overflow_yield);
+                const __m128i new_spice = safe_add(spice, delta_spice, overflow_add);
+
+                __m128i status = _mm_setzero_si128();
+                status = fail(status, overflow_add, Status::overflow);
+                status = fail(status, _mm_cmpgt_epi64(delta_solaris, solaris), Status::no_solaris);
+                status = fail(status, _mm_or_si128(overflow_cost, overflow_yield), Status::overflow);
+                status = fail(status, _mm_cmpgt_epi64(delta_energy, energy), Status::no_energy);
+                status = fail(status, _mm_cmpgt_epi64(one, h), Status::no_harvester);
+
+                const __m128i ok = finish(status, results + i, succeeded);
+                store(c.energy + i, _mm_blendv_epi8(energy, _mm_sub_epi64(energy, delta_energy), ok));
+                store(c.solaris + i, _mm_blendv_epi8(solaris, _mm_sub_epi64(solaris, delta_solaris), ok));
+                store(c.spice + i, _mm_blendv_epi8(spice, new_spice, ok));
+                store(deltas + i, _mm_and_si128(delta_spice, ok));
+            }
+            return succeeded;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,161 @@
+// leaderboard.cpp: The Arrakeeners with the most of one counter
+
+#include "leaderboard.h"
+#include <iterator>
+
+namespace arrakis
+{
+    Leaderboard::Leaderboard(Field field) :
+        m_field(field),
+        m_complete(true)
+    {
+    }
+
+
+    int64_t Leaderboard::value(const Ledger& ledger) const noexcept
+    {
+        switch (m_field)
+        {
+        case Field::energy: return ledger.energy;
+        case Field::solaris: return ledger.solaris;
+        default: return ledger.spice;
+        }
+    }
+
+
+    // Pool allocations are adjacent, so mix the address before taking the
+    // top bits
+
+    Leaderboard::Shard& Leaderboard::shard(const Arrakeener& obj) const noexcept
+    {
+        const uint64_t mixed = (uint64_t)(uintptr_t)&obj * 0x9E3779B97F4A7C15ull;
+        return m_shards[mixed >> 60];
+    }
+
+
+    std::vector<Standing> Leaderboard::top(size_t k) const
+    {
+        static_assert(shard_count == 16, "shard() takes the top 4 bits");
+        if (k > max_top) k = max_top;
+        std::vector<const Entry*> places;
+        places.reserve(k);
+        std::vector<int64_t> values;
+        values.reserve(k);
+
+        {
+            std::unique_lock<std::mutex> locks[shard_count];
+            std::set<Entry>::const_iterator heads[shard_count];
+            for (unsigned s = 0; s < shard_count; ++s)
+            {
+                locks[s] = std::unique_lock<std::mutex>(m_shards[s].mutex);
+                heads[s] = m_shards[s].entries.begin();
+            }
+
+            // Each shard is sorted, so the next place is the best of the
+            // heads. Pinned, an object outlives the locks.
+            while (places.size() < k)
+            {
+                unsigned best = shard_count;
+                for (unsigned s = 0; s < shard_count; ++s)
+                {
+                    if (heads[s] == m_shards[s].entries.end()) continue;
+                    if (best == shard_count || *heads[s] < *heads[best]) best = s;
+                }
+                if (best == shard_count) break;
+                heads[best]->pins.fetch_add(1, std::memory_order_relaxed);
+                places.push_back(&*heads[best]);
+                values.push_back(heads[best]->value);
+                ++heads[best];
+            }
+        }
+
+        // Unpin each place once its names are copied, or on failure; the
+        // last to unpin wakes detached(), under the lock so as not to miss it
+        std::vector<Standing> result;
+        size_t copied = 0;
+        auto unpin = [&]
+        {
+            for (; copied < places.size(); ++copied)
+            {
+                Shard& s = shard(*places[copied]->obj);
+                if (places[copied]->pins.fetch_sub(1, std::memory_order_release) != 1) continue;
+                std::lock_guard<std::mutex> lock(s.mutex);
+                s.unpinned.notify_all();
+            }
+        };
+        try
+        {
+            result.reserve(places.size());
+            for (size_t i = 0; i < places.size(); ++i) result.push_back(Standing{ values[i], places[i]->obj->current_names() });
+        }
+        catch (...)
+        {
+            unpin();
+            throw;
+        }
+        unpin();
+        return result;
+    }
+
+
+    size_t Leaderboard::size() const noexcept
+    {
+        size_t n = 0;
+        for (Shard& s : m_shards)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            n += s.entries.size();
+        }
+        return n;
+    }
+
+
+    void Leaderboard::attached(const Arrakeener& obj, const State& state) noexcept
+    {
+        Shard& s = shard(obj);
+        try
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.entries.emplace(value(state.ledger), &obj);
+        }
+        catch (...)
+        {
+            m_complete.store(false, std::memory_order_relaxed);
+        }
+    }
+
+
+    void Leaderboard::renamed(const Arrakeener&, const Names&, const Names&) noexcept
+    {
+    }
+
+
+    // Reuse the node, so that an update never allocates
+
+    void Leaderboard::changed(const Arrakeener& obj, Change, int64_t, const Ledger& before, const Ledger& after) noexcept
+    {
+        const int64_t from = value(before), to = value(after);
+        if (from == to) return;
+        Shard& s = shard(obj);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto node = s.entries.extract(Entry(from, &obj));
+        if (!node) return;                  // Never ranked
+        node.value().value = to;
+        s.entries.insert(std::move(node));
+    }
+
+
+    // Nothing changes obj after this, so its published ledger is the one
+    // it was ranked by. A top() still copying its names holds it until done.
+
+    void Leaderboard::detached(const Arrakeener& obj) noexcept
+    {
+        const Entry entry(value(obj.current_ledger()), &obj);
+        Shard& s = shard(obj);
+        std::unique_lock<std::mutex> lock(s.mutex);
+        auto it = s.entries.find(entry);
+        if (it == s.entries.end()) return;
+        s.unpinned.wait(lock, [&] { return it->pins.load(std::memory_order_acquire) == 0; });
+        s.entries.erase(it);
+    }
+}
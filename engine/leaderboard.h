@@ -0,0 +1,101 @@
+// leaderboard.h: The Arrakeeners with the most of one counter
+#pragma once
+
+#include "core.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace arrakis
+{
+    // One place on a leaderboard
+
+    struct Standing
+    {
+        int64_t value;
+        Names names;
+    };
+
+
+    // Keeps the observed Arrakeeners ordered by one counter of their
+    // ledgers, updated from each change as it is made, so the top k can be
+    // read without sorting the population.
+    //
+    // Objects are spread over shards by address. Each shard is an ordered
+    // set under its own mutex, and a change moves the object's node within
+    // it without allocating, so an update costs O(log n) and changes to
+    // objects in different shards rarely wait for each other. top() locks
+    // every shard and merges their heads, so it sees a single instant, and
+    // pins the k objects it takes; it copies their names after unlocking,
+    // and detaching a pinned object waits for that. Ties are ordered
+    // arbitrarily.
+    //
+    // Objects whose entry could not be allocated are left off the board
+    // (see complete()).
+
+    class Leaderboard : public Observer
+    {
+        static const unsigned shard_count = 16;
+
+        struct Entry
+        {
+            int64_t value;
+            const Arrakeener* obj;
+            mutable std::atomic<uint32_t> pins{ 0 };  // Readers of obj outside the lock
+
+            Entry(int64_t v, const Arrakeener* o) noexcept : value(v), obj(o) {}
+
+            bool operator<(const Entry& other) const noexcept   // Largest first
+            {
+                return value != other.value ? value > other.value : obj < other.obj;
+            }
+        };
+
+        struct alignas(64) Shard
+        {
+            std::mutex mutex;
+            std::condition_variable unpinned;
+            std::set<Entry> entries;
+        };
+
+        const Field m_field;
+        mutable Shard m_shards[shard_count];
+        std::atomic<bool> m_complete;
+
+        int64_t value(const Ledger& ledger) const noexcept;
+        Shard& shard(const Arrakeener& obj) const noexcept;
+
+    public:
+        static const size_t max_top = 1000;
+
+        explicit Leaderboard(Field field);
+        Leaderboard(const Leaderboard&) = delete;
+        Leaderboard& operator=(const Leaderboard&) = delete;
+        // Objects must be detached before the board is destroyed
+
+        Field field() const noexcept { return m_field; }
+
+        // Start ranking obj and its future clones
+        void attach(Arrakeener& obj) { obj.observe(this); }
+
+        // The k largest, largest first; fewer if fewer are ranked, and at
+        // most max_top
+        std::vector<Standing> top(size_t k) const;
+
+        // Number of objects ranked
+        size_t size() const noexcept;
+
+        // False if some object could not be ranked
+        bool complete() const noexcept { return m_complete.load(std::memory_order_relaxed); }
+
+        // Observer
+        void attached(const Arrakeener& obj, const State& state) noexcept override;
+        void renamed(const Arrakeener& obj, const Names& before, const Names& after) noexcept override;
+        void changed(const Arrakeener& obj, Change change, int64_t arg, const Ledger& before, const Ledger& after) noexcept override;
+        void detached(const Arrakeener& obj) noexcept override;
+    };
+}
@@ -0,0 +1,91 @@
+// observer.h: Notifications of changes to Arrakeeners
+#pragma once
+
+#include "rules.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace arrakis
+{
+    class Arrakeener;
+    struct Names;
+    struct State;
+
+
+    // What changed the ledger
+    // Batches and transactions are reported once, with the number of
+    // elements or steps that applied.
+
+    enum class Change : uint8_t
+    {
+        eat,
+        sell,
+        mine,
+        eat_batch,
+        sell_batch,
+        mine_batch,
+        transaction
+    };
+
+
+    // Receives every change to the Arrakeeners it observes, for keeping
+    // something else in step with them (a journal, totals, an index).
+    // Calls for one object are made with its mutex held, in the order the
+    // changes were made; calls for different objects may be concurrent.
+    // Methods must not throw, and must not call back into the object except
+    // through the arguments and its lock-free getters.
+
+    class Observer
+    {
+    public:
+        virtual ~Observer() = default;
+
+        // Starts observing obj, a new clone of an observed object, or an
+        // object passed to Arrakeener::observe
+        virtual void attached(const Arrakeener& obj, const State& state) noexcept = 0;
+
+        // One name changed
+        virtual void renamed(const Arrakeener& obj, const Names& before, const Names& after) noexcept = 0;
+
+        // A successful operation; arg is its argument, or the number of
+        // elements or steps for batches and transactions
+        virtual void changed(const Arrakeener& obj, Change change, int64_t arg, const Ledger& before, const Ledger& after) noexcept = 0;
+
+        // Stops observing obj, because it is destroyed or observed by
+        // something else; the object is still valid
+        virtual void detached(const Arrakeener& obj) noexcept = 0;
+    };
+
+
+    // Forwards every call to each of a fixed list of observers in turn, so
+    // that one object can keep several things in step
+
+    class Observers : public Observer
+    {
+        const std::vector<Observer*> m_observers;
+
+    public:
+        explicit Observers(std::vector<Observer*> observers) : m_observers(std::move(observers)) {}
+
+        void attached(const Arrakeener& obj, const State& state) noexcept override
+        {
+            for (Observer* observer : m_observers) observer->attached(obj, state);
+        }
+
+        void renamed(const Arrakeener& obj, const Names& before, const Names& after) noexcept override
+        {
+            for (Observer* observer : m_observers) observer->renamed(obj, before, after);
+        }
+
+        void changed(const Arrakeener& obj, Change change, int64_t arg, const Ledger& before, const Ledger& after) noexcept override
+        {
+            for (Observer* observer : m_observers) observer->changed(obj, change, arg, before, after);
+        }
+
+        void detached(const Arrakeener& obj) noexcept override
+        {
+            for (Observer* observer : m_observers) observer->detached(obj);
+        }
+    };
+}
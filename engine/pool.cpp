@@ -0,0 +1,107 @@
+// pool.cpp: Fixed-size slab allocator for frequently created objects
+
+#include "pool.h"
+#include <cassert>
+#include <new>
+
+namespace arrakis
+{
+    using Guard = std::lock_guard<std::mutex>;
+
+    // Slots hold either an object or a free-list link, and every slot is
+    // aligned for any fundamental type
+
+    static size_t round_slot(size_t size) noexcept
+    {
+        const size_t align = alignof(std::max_align_t);
+        if (size < sizeof(void*)) size = sizeof(void*);
+        return (size + align - 1) / align * align;
+    }
+
+
+    Pool::Pool(size_t object_size, size_t slots_per_slab) :
+        m_slot_size(round_slot(object_size)),
+        m_slots_per_slab(slots_per_slab ? slots_per_slab : 1),
+        m_free(nullptr),
+        m_capacity(0),
+        m_in_use(0)
+    {
+    }
+
+
+    Pool::~Pool()
+    {
+        assert(m_in_use == 0);
+        for (void* slab : m_slabs) ::operator delete(slab);
+    }
+
+
+    // Add one allocation of the given number of slabs and thread its slots
+    // onto the free list in address order. Called with the mutex held.
+
+    void Pool::grow(size_t slabs)
+    {
+        m_slabs.reserve(m_slabs.size() + 1);
+        const size_t slots = slabs * m_slots_per_slab;
+        char* slab = static_cast<char*>(::operator new(m_slot_size * slots));
+        m_slabs.push_back(slab);
+        m_capacity += slots;
+
+        for (size_t i = slots; i-- > 0; )
+        {
+            Free* slot = reinterpret_cast<Free*>(slab + i * m_slot_size);
+            slot->next = m_free;
+            m_free = slot;
+        }
+    }
+
+
+    void* Pool::allocate()
+    {
+        Guard guard(m_mutex);
+        if (!m_free) grow();
+        Free* slot = m_free;
+        m_free = slot->next;
+        ++m_in_use;
+        return slot;
+    }
+
+
+    void Pool::allocate_many(void** out, size_t n)
+    {
+        Guard guard(m_mutex);
+        const size_t available = m_capacity - m_in_use;
+        if (available < n) grow((n - available + m_slots_per_slab - 1) / m_slots_per_slab);
+        for (size_t i = 0; i < n; ++i)
+        {
+            out[i] = m_free;
+            m_free = m_free->next;
+        }
+        m_in_use += n;
+    }
+
+
+    void Pool::deallocate(void* p) noexcept
+    {
+        if (!p) return;
+        Free* slot = static_cast<Free*>(p);
+        Guard guard(m_mutex);
+        slot->next = m_free;
+        m_free = slot;
+        --m_in_use;
+    }
+
+
+    size_t Pool::capacity() const
+    {
+        Guard guard(m_mutex);
+        return m_capacity;
+    }
+
+
+    size_t Pool::in_use() const
+    {
+        Guard guard(m_mutex);
+        return m_in_use;
+    }
+}
@@ -0,0 +1,53 @@
+// pool.h: Fixed-size slab allocator for frequently created objects
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace arrakis
+{
+    // Hands out slots of one size carved from slabs of many slots. Released
+    // slots go on a free list and are reused before any new slab is
+    // allocated; slabs are returned to the heap only when the pool is
+    // destroyed. Thread safe.
+
+    class Pool
+    {
+        struct Free
+        {
+            Free* next;
+        };
+
+        const size_t m_slot_size;
+        const size_t m_slots_per_slab;
+
+        mutable std::mutex m_mutex;
+        Free* m_free;                       // Released slots, most recent first
+        std::vector<void*> m_slabs;         // Each allocation holds one or more slabs
+        size_t m_capacity;
+        size_t m_in_use;
+
+        void grow(size_t slabs = 1);
+
+    public:
+        explicit Pool(size_t object_size, size_t slots_per_slab = 256);
+        ~Pool();
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+
+        // Uninitialized storage for one object; throws std::bad_alloc
+        void* allocate();
+
+        // Storage for n objects under one lock acquisition, growing the pool
+        // at most once; throws std::bad_alloc and then allocates nothing
+        void allocate_many(void** out, size_t n);
+
+        // Return storage from allocate; null is ignored
+        void deallocate(void* p) noexcept;
+
+        size_t slot_size() const noexcept { return m_slot_size; }
+        size_t capacity() const;            // Slots in all slabs
+        size_t in_use() const;              // Slots allocated and not yet released
+    };
+}
@@ -0,0 +1,349 @@
+// population.cpp: Structure-of-arrays storage for large numbers of Arrakeeners
+
+#include "population.h"
+#include "kernels.h"
+#include <utility>
+
+#if defined(ARRAKIS_X86_KERNELS) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace arrakis
+{
+    ///////////////////////////////////////////////////////////////////////////
+    //
+    // Scalar kernels
+    // These are the reference for the vector kernels and process their tails.
+    //
+
+    namespace kernels
+    {
+        size_t eat_spice_scalar(
+            const Columns& c,
+            size_t begin,
+            size_t end,
+            const DrawKey* keys,
+            const int64_t* units,
+            int64_t* deltas,
+            Status* results)
+        {
+            size_t succeeded = 0;
+            for (size_t i = begin; i < end; ++i)
+            {
+                const int64_t energy_per_unit = draw(keys[0], (uint32_t)i);
+                int64_t delta = 0, new_energy = 0;
+                Status status;
+                if (units[i] < 1) status = Status::nonpos_spice;
+                else if (c.spice[i] < units[i]) status = Status::no_spice;
+                else if (!safe_multiply(energy_per_unit, units[i], delta)) status = Status::overflow;
+                else if (!safe_add(c.energy[i], delta, new_energy)) status = Status::overflow;
+                else
+                {
+                    c.spice[i] -= units[i];
+                    c.energy[i] = new_energy;
+                    status = Status::ok;
+                    ++succeeded;
+                }
+                deltas[i] = status == Status::ok ? delta : 0;
+                results[i] = status;
+            }
+            return succeeded;
+        }
+
+
+        size_t sell_spice_scalar(
+            const Columns& c,
+            size_t begin,
+            size_t end,
+            const DrawKey* keys,
+            const int64_t* units,
+            int64_t* deltas,
+            Status* results)
+        {
+            size_t succeeded = 0;
+            for (size_t i = begin; i < end; ++i)
+            {
+                const int64_t price = draw(keys[0], (uint32_t)i);
+                int64_t delta = 0, new_solaris = 0;
+                Status status;
+                if (units[i] < 1) status = Status::nonpos_spice;
+                else if (c.spice[i] < units[i]) status = Status::no_spice;
+                else if (!safe_multiply(price, units[i], delta)) status = Status::overflow;
+                else if (!safe_add(c.solaris[i], delta, new_solaris)) status = Status::overflow;
+                else
+                {
+                    c.spice[i] -= units[i];
+                    c.solaris[i] = new_solaris;
+                    status = Status::ok;
+                    ++succeeded;
+                }
+                deltas[i] = status == Status::ok ? delta : 0;
+                results[i] = status;
+            }
+            return succeeded;
+        }
+
+
+        size_t mine_spice_scalar(
+            const Columns& c,
+            size_t begin,
+            size_t end,
+            const DrawKey* keys,
+            const int64_t* harvesters,
+            int64_t* deltas,
+            Status* results)
+        {
+            size_t succeeded = 0;
+            for (size_t i = begin; i < end; ++i)
+            {
+                const int64_t delta_energy = draw(keys[0], (uint32_t)i);
+                const int64_t cost = draw(keys[1], (uint32_t)i);
+                const int64_t yield = draw(keys[2], (uint32_t)i);
+                int64_t delta_solaris = 0, delta = 0, new_spice = 0;
+                Status status;
+                if (harvesters[i] < 1) status = Status::no_harvester;
+                else if (c.energy[i] < delta_energy) status = Status::no_energy;
+                else if (!safe_multiply(cost, harvesters[i], delta_solaris) ||
+                    !safe_multiply(yield, harvesters[i], delta)) status = Status::overflow;
+                else if (c.solaris[i] < delta_solaris) status = Status::no_solaris;
+                else if (!safe_add(c.spice[i], delta, new_spice)) status = Status::overflow;
+                else
+                {
+                    c.energy[i] -= delta_energy;
+                    c.solaris[i] -= delta_solaris;
+                    c.spice[i] = new_spice;
+                    status = Status::ok;
+                    ++succeeded;
+                }
+                deltas[i] = status == Status::ok ? delta : 0;
+                results[i] = status;
+            }
+            return succeeded;
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    //
+    // Kernel selection
+    //
+
+#ifdef ARRAKIS_X86_KERNELS
+#define ARRAKIS_KERNELS(op) { kernels::op##_scalar, kernels::op##_sse42, kernels::op##_avx2 }
+#else
+#define ARRAKIS_KERNELS(op) { kernels::op##_scalar, nullptr, nullptr }
+#endif
+
+    static const kernels::Operation eat_operation =
+    {
+        ARRAKIS_KERNELS(eat_spice),
+        { eat_energy },
+        1
+    };
+
+    static const kernels::Operation sell_operation =
+    {
+        ARRAKIS_KERNELS(sell_spice),
+        { sell_price },
+        1
+    };
+
+    static const kernels::Operation mine_operation =
+    {
+        ARRAKIS_KERNELS(mine_spice),
+        { mine_energy, mine_cost, mine_yield },
+        3
+    };
+
+#undef ARRAKIS_KERNELS
+
+    static size_t kernel_width(Kernel kernel) noexcept
+    {
+        switch (kernel)
+        {
+#ifdef ARRAKIS_X86_KERNELS
+        case Kernel::sse42: return kernels::sse42_width;
+        case Kernel::avx2: return kernels::avx2_width;
+#endif
+        default: return 1;
+        }
+    }
+
+
+    Kernel Population::best_kernel() noexcept
+    {
+#if defined(ARRAKIS_X86_KERNELS) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        const int max_leaf = info[0];
+        __cpuid(info, 1);
+        const bool sse42 = (info[2] & (1 << 20)) != 0;
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx2 = false;
+        if (max_leaf >= 7 && osxsave && (_xgetbv(0) & 6) == 6)
+        {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+        if (avx2) return Kernel::avx2;
+        if (sse42) return Kernel::sse42;
+#elif defined(ARRAKIS_X86_KERNELS)
+        if (__builtin_cpu_supports("avx2")) return Kernel::avx2;
+        if (__builtin_cpu_supports("sse4.2")) return Kernel::sse42;
+#endif
+        return Kernel::scalar;
+    }
+
+
+    void Population::set_kernel(Kernel kernel) noexcept
+    {
+        const Kernel best = best_kernel();
+        m_kernel = (int)kernel <= (int)best ? kernel : best;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    //
+    // Population
+    //
+
+    Population::Population(uint64_t seed) :
+        m_seed(seed),
+        m_step(0),
+        m_rng(seed),
+        m_kernel(best_kernel())
+    {
+    }
+
+
+    void Population::reserve(size_t n)
+    {
+        m_energy.reserve(n);
+        m_solaris.reserve(n);
+        m_spice.reserve(n);
+        m_names.reserve(n);
+    }
+
+
+    size_t Population::add()
+    {
+        return add(initial_ledger(m_rng));
+    }
+
+
+    size_t Population::add(const Ledger& ledger, Names names)
+    {
+        assert(size() < UINT32_MAX);   // Rows are 32-bit counters of the draws
+        assert(ledger.energy >= 0 && ledger.solaris >= 0 && ledger.spice >= 0);
+        m_names.push_back(std::move(names));
+        try
+        {
+            m_energy.push_back(ledger.energy);
+            m_solaris.push_back(ledger.solaris);
+            m_spice.push_back(ledger.spice);
+        }
+        catch (...)
+        {
+            // Keep the columns the same length
+            m_spice.resize(m_names.size() - 1);
+            m_solaris.resize(m_names.size() - 1);
+            m_energy.resize(m_names.size() - 1);
+            m_names.pop_back();
+            throw;
+        }
+        return size() - 1;
+    }
+
+
+    size_t Population::add(const Arrakeener& arrakeener)
+    {
+        State state = arrakeener.current_state();
+        return add(state.ledger, std::move(state.names));
+    }
+
+
+    std::vector<size_t> Population::census(Atom Names::* field) const
+    {
+        std::vector<size_t> counts(Atom::count());
+        for (const Names& names : m_names) ++counts[(names.*field).id()];
+        return counts;
+    }
+
+
+    Ledger Population::ledger(size_t row) const noexcept
+    {
+        Ledger ledger;
+        ledger.energy = m_energy[row];
+        ledger.solaris = m_solaris[row];
+        ledger.spice = m_spice[row];
+        return ledger;
+    }
+
+
+    // Run the selected kernel over whole vectors and the scalar kernel over
+    // the remaining rows
+
+    size_t Population::apply(const kernels::Operation& op, const int64_t* args, int64_t* deltas, Status* results)
+    {
+        kernels::DrawKey keys[3];
+        for (uint32_t d = 0; d < op.draws; ++d)
+        {
+            keys[d] = kernels::draw_key(m_seed, m_step, d, op.ranges[d]);
+        }
+        ++m_step;
+
+        const kernels::Columns columns = { m_energy.data(), m_solaris.data(), m_spice.data() };
+        const size_t n = size();
+        const size_t width = kernel_width(m_kernel);
+        const size_t vector_end = n - n % width;
+
+        size_t succeeded = 0;
+        if (vector_end > 0)
+        {
+            succeeded += op.kernels[(int)m_kernel](columns, 0, vector_end, keys, args, deltas, results);
+        }
+        succeeded += op.kernels[0](columns, vector_end, n, keys, args, deltas, results);
+        return succeeded;
+    }
+
+
+    const int64_t* Population::broadcast(int64_t value)
+    {
+        m_scratch.assign(size(), value);
+        return m_scratch.data();
+    }
+
+
+    size_t Population::eat_spice(const int64_t* units, int64_t* delta_energy, Status* results)
+    {
+        return apply(eat_operation, units, delta_energy, results);
+    }
+
+
+    size_t Population::sell_spice(const int64_t* units, int64_t* delta_solaris, Status* results)
+    {
+        return apply(sell_operation, units, delta_solaris, results);
+    }
+
+
+    size_t Population::mine_spice(const int64_t* harvesters, int64_t* delta_spice, Status* results)
+    {
+        return apply(mine_operation, harvesters, delta_spice, results);
+    }
+
+
+    size_t Population::eat_spice(int64_t units, int64_t* delta_energy, Status* results)
+    {
+        return eat_spice(broadcast(units), delta_energy, results);
+    }
+
+
+    size_t Population::sell_spice(int64_t units, int64_t* delta_solaris, Status* results)
+    {
+        return sell_spice(broadcast(units), delta_solaris, results);
+    }
+
+
+    size_t Population::mine_spice(int64_t harvesters, int64_t* delta_spice, Status* results)
+    {
+        return mine_spice(broadcast(harvesters), delta_spice, results);
+    }
+}
@@ -0,0 +1,125 @@
+// population.h: Structure-of-arrays storage for large numbers of Arrakeeners
+#pragma once
+
+#include "core.h"
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace arrakis
+{
+    namespace kernels
+    {
+        struct Operation;
+    }
+
+
+    // Allocator for cache-line aligned columns
+
+    template <typename T, size_t Alignment = 64>
+    struct AlignedAllocator
+    {
+        using value_type = T;
+
+        template <typename U>
+        struct rebind
+        {
+            using other = AlignedAllocator<U, Alignment>;
+        };
+
+        AlignedAllocator() noexcept = default;
+
+        template <typename U>
+        AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept { }
+
+        T* allocate(size_t n)
+        {
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+        }
+
+        void deallocate(T* p, size_t) noexcept
+        {
+            ::operator delete(p, std::align_val_t(Alignment));
+        }
+
+        friend bool operator==(const AlignedAllocator&, const AlignedAllocator&) noexcept { return true; }
+        friend bool operator!=(const AlignedAllocator&, const AlignedAllocator&) noexcept { return false; }
+    };
+
+    using Column = std::vector<int64_t, AlignedAllocator<int64_t>>;
+
+
+    // Implementation used for the column operations
+    // Requests for an instruction set the CPU lacks fall back to the best
+    // available one.
+
+    enum class Kernel
+    {
+        scalar,
+        sse42,
+        avx2
+    };
+
+
+    // A population of Arrakeeners stored as columns
+    // Operations apply to every row at once and follow the same rules as
+    // Arrakeener. Random draws come from a counter-based stream keyed by the
+    // seed, so results do not depend on the kernel. Not thread safe.
+
+    class Population
+    {
+        Column m_energy;
+        Column m_solaris;
+        Column m_spice;
+        std::vector<Names> m_names;         // Cold data
+
+        uint64_t m_seed;
+        uint64_t m_step;                    // Number of operations applied
+        Rng m_rng;                          // For initial ledgers
+        Kernel m_kernel;
+        Column m_scratch;                   // Broadcast arguments
+
+        size_t apply(const kernels::Operation& op, const int64_t* args, int64_t* deltas, Status* results);
+        const int64_t* broadcast(int64_t value);
+
+    public:
+        explicit Population(uint64_t seed);
+
+        size_t size() const noexcept { return m_energy.size(); }
+        void reserve(size_t n);
+
+        // Add a row and return its index
+        size_t add();                       // Random initial ledger
+        size_t add(const Ledger& ledger, Names names = Names());
+        size_t add(const Arrakeener& arrakeener);
+
+        Ledger ledger(size_t row) const noexcept;
+        const Names& names(size_t row) const noexcept { return m_names[row]; }
+        Names& names(size_t row) noexcept { return m_names[row]; }
+
+        // Rows per atom of an interned name, indexed by Atom::id
+        // e.g., census(&Names::affiliation) counts the members of each house
+        std::vector<size_t> census(Atom Names::* field) const;
+
+        const int64_t* energy() const noexcept { return m_energy.data(); }
+        const int64_t* solaris() const noexcept { return m_solaris.data(); }
+        const int64_t* spice() const noexcept { return m_spice.data(); }
+
+        Kernel kernel() const noexcept { return m_kernel; }
+        void set_kernel(Kernel kernel) noexcept;
+        static Kernel best_kernel() noexcept;
+
+        // Operations over all rows
+        // args, deltas and results have size() elements. Returns the number
+        // of rows that succeeded.
+
+        size_t eat_spice(const int64_t* units, int64_t* delta_energy, Status* results);
+        size_t sell_spice(const int64_t* units, int64_t* delta_solaris, Status* results);
+        size_t mine_spice(const int64_t* harvesters, int64_t* delta_spice, Status* results);
+
+        // Same argument for every row
+        size_t eat_spice(int64_t units, int64_t* delta_energy, Status* results);
+        size_t sell_spice(int64_t units, int64_t* delta_solaris, Status* results);
+        size_t mine_spice(int64_t harvesters, int64_t* delta_spice, Status* results);
+    };
+}
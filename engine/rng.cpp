@@ -0,0 +1,32 @@
+// rng.cpp: Per-instance random number streams
+
+#include "rng.h"
+#include "trace.h"
+#include <atomic>
+#include <chrono>
+#include <random>
+
+namespace arrakis
+{
+    // Mix a process-wide seed from the OS with a counter so that streams
+    // created in quick succession differ
+
+    static uint64_t entropy_seed()
+    {
+        trace::Span span("engine", "seed");    // The first call asks the OS
+        static const uint64_t base = []
+        {
+            std::random_device rd;
+            uint64_t seed = ((uint64_t)rd() << 32) ^ rd();
+            return seed ^ (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+        }();
+        static std::atomic<uint64_t> counter(0);
+        return base + counter.fetch_add(1, std::memory_order_relaxed) * 0xD1342543DE82EF95ull;
+    }
+
+
+    Rng::Rng() :
+        Rng(entropy_seed())
+    {
+    }
+}
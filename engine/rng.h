@@ -0,0 +1,77 @@
+// rng.h: Per-instance random number streams
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+
+namespace arrakis
+{
+    // xoshiro256** generator (Blackman and Vigna, 2018)
+    // Not thread safe; each Arrakeener or worker thread owns its own stream.
+
+    class Rng
+    {
+        uint64_t m_s[4];
+
+        static uint64_t rotl(uint64_t x, int k) noexcept
+        {
+            return (x << k) | (x >> (64 - k));
+        }
+
+    public:
+        // Expand a 64-bit seed with splitmix64 so that any seed is usable
+        explicit Rng(uint64_t seed) noexcept
+        {
+            for (uint64_t& s : m_s)
+            {
+                uint64_t z = (seed += 0x9E3779B97F4A7C15ull);
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                s = z ^ (z >> 31);
+            }
+        }
+
+        // Seed from the operating system, unique within the process
+        Rng();
+
+        uint64_t next() noexcept
+        {
+            const uint64_t result = rotl(m_s[1] * 5, 7) * 9;
+            const uint64_t t = m_s[1] << 17;
+            m_s[2] ^= m_s[0];
+            m_s[3] ^= m_s[1];
+            m_s[1] ^= m_s[2];
+            m_s[0] ^= m_s[3];
+            m_s[2] ^= t;
+            m_s[3] = rotl(m_s[3], 45);
+            return result;
+        }
+
+        // Uniform integer in [lower, upper] without modulo bias
+        // Uses Lemire's multiply-and-reject method on the upper 32 bits.
+
+        int64_t range(int lower, int upper) noexcept
+        {
+            assert(lower < upper);
+            const uint32_t span = (uint32_t)((int64_t)upper - lower + 1);
+            uint64_t m = (next() >> 32) * span;
+            uint32_t low = (uint32_t)m;
+            if (low < span)
+            {
+                const uint32_t threshold = (0u - span) % span;
+                while (low < threshold)
+                {
+                    m = (next() >> 32) * span;
+                    low = (uint32_t)m;
+                }
+            }
+            return (int64_t)lower + (int64_t)(m >> 32);
+        }
+
+        // Derive an independent stream, advancing this one
+        Rng split() noexcept
+        {
+            return Rng(next());
+        }
+    };
+}
@@ -0,0 +1,106 @@
+// rules.cpp: Portable game rules for Arrakis
+
+#include "rules.h"
+
+namespace arrakis
+{
+    static const StatusInfo status_table[status_count] =
+    {
+        { "ok", L"", false },
+        { "overflow", L"Integer overflow", false },
+        { "nonpos_spice", L"Spice units must be greater than zero", true },
+        { "no_spice", L"Insufficient spice", false },
+        { "no_energy", L"Insufficient energy", false },
+        { "no_solaris", L"Insufficient solaris", false },
+        { "no_harvester", L"Cannot mine spice without a harvester", true }
+    };
+
+
+    const StatusInfo& status_info(Status status) noexcept
+    {
+        assert((int)status < status_count);
+        return status_table[(int)status];
+    }
+
+
+    Ledger initial_ledger(Rng& rng) noexcept
+    {
+        Ledger ledger;
+        ledger.energy = randrange(rng, initial_energy);
+        ledger.solaris = randrange(rng, initial_solaris);
+        ledger.spice = 0;
+        return ledger;
+    }
+
+
+    Status eat_spice(Ledger& ledger, Rng& rng, int64_t units, int64_t& delta_energy) noexcept
+    {
+        delta_energy = 0;
+
+        if (units < 1) return Status::nonpos_spice;
+        if (ledger.spice < units) return Status::no_spice;
+
+        int64_t delta = 0;
+        if (!safe_multiply(randrange(rng, eat_energy), units, delta)) return Status::overflow;
+
+        int64_t new_energy = 0;
+        if (!safe_add(ledger.energy, delta, new_energy)) return Status::overflow;
+
+        ledger.spice -= units;              // This cannot overflow
+        ledger.energy = new_energy;         // This has been checked
+
+        delta_energy = delta;
+        return Status::ok;
+    }
+
+
+    Status sell_spice(Ledger& ledger, Rng& rng, int64_t units, int64_t& delta_solaris) noexcept
+    {
+        delta_solaris = 0;
+
+        if (units < 1) return Status::nonpos_spice;
+        if (ledger.spice < units) return Status::no_spice;
+
+        int64_t delta = 0;
+        if (!safe_multiply(randrange(rng, sell_price), units, delta)) return Status::overflow;
+
+        int64_t new_solaris = 0;
+        if (!safe_add(ledger.solaris, delta, new_solaris)) return Status::overflow;
+
+        ledger.spice -= units;              // This cannot overflow
+        ledger.solaris = new_solaris;       // This has been checked
+
+        delta_solaris = delta;
+        return Status::ok;
+    }
+
+
+    Status mine_spice(Ledger& ledger, Rng& rng, int64_t harvesters, int64_t& delta_spice) noexcept
+    {
+        delta_spice = 0;
+
+        if (harvesters < 1) return Status::no_harvester;
+
+        int64_t delta_energy = randrange(rng, mine_energy);
+        if (ledger.energy < delta_energy) return Status::no_energy;
+
+        int64_t delta_solaris = 0, delta = 0;
+        if (!safe_multiply(randrange(rng, mine_cost), harvesters, delta_solaris) ||
+            !safe_multiply(randrange(rng, mine_yield), harvesters, delta))
+        {
+            return Status::overflow;
+        }
+
+        if (ledger.solaris < delta_solaris) return Status::no_solaris;
+
+        int64_t new_spice = 0;
+        if (!safe_add(ledger.spice, delta, new_spice)) return Status::overflow;
+
+        ledger.energy -= delta_energy;      // This cannot overflow
+        ledger.solaris -= delta_solaris;    // This cannot overflow
+        ledger.spice = new_spice;           // This has been checked
+
+        delta_spice = delta;
+        return Status::ok;
+    }
+}
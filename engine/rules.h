@@ -0,0 +1,106 @@
+// rules.h: Portable game rules for Arrakis
+#pragma once
+
+#include "rng.h"
+#include <cassert>
+#include <cstdint>
+
+namespace arrakis
+{
+    // Outcome of an operation
+    // Each failure corresponds to one of the IDS_* strings of the COM server
+
+    enum class Status : uint8_t
+    {
+        ok,
+        overflow,           // IDS_OVERFLOW
+        nonpos_spice,       // IDS_NONPOSSPICE
+        no_spice,           // IDS_NOSPICE
+        no_energy,          // IDS_NOENERGY
+        no_solaris,         // IDS_NOSOLARIS
+        no_harvester        // IDS_NOHARVESTER
+    };
+
+    constexpr int status_count = (int)Status::no_harvester + 1;
+
+
+    // Fixed description of each status, for callers without the resources of
+    // the COM server. Entries are static, so looking one up never allocates.
+
+    struct StatusInfo
+    {
+        const char* name;               // e.g., "no_spice"
+        const wchar_t* message;         // Same text as the IDS_* string
+        bool invalid_argument;          // Caller error rather than insufficient state
+    };
+
+    const StatusInfo& status_info(Status status) noexcept;
+
+
+    // Numeric state of an Arrakeener
+
+    struct Ledger
+    {
+        int64_t energy;
+        int64_t solaris;
+        int64_t spice;
+    };
+
+
+    // Safe add (see C CERT rule 04  which addresses integer safety)
+
+    inline bool safe_add(int64_t const a, int64_t const b, int64_t& sum) noexcept
+    {
+        assert(b >= 0);
+        if ((b > 0) && (a > (INT64_MAX - b))) return false;
+        sum = a + b;
+        return true;
+    }
+
+
+    // Safe multiply (see C CERT rule 04  which addresses integer safety)
+
+    inline bool safe_multiply(int64_t const a, int64_t const b, int64_t& prod) noexcept
+    {
+        assert(a > 0);
+        assert(b > 0);
+        if (a > (INT64_MAX / b)) return false;
+        prod = a * b;
+        return true;
+    }
+
+
+    // Ranges of the random draws made by the operations
+
+    struct DrawRange
+    {
+        int lower;
+        int upper;
+    };
+
+    constexpr DrawRange initial_energy = { 1, 100 };
+    constexpr DrawRange initial_solaris = { 200000, 400000 };
+    constexpr DrawRange eat_energy = { 1, 100 };            // Energy per unit eaten
+    constexpr DrawRange sell_price = { 200000, 700000 };    // Solaris per unit sold
+    constexpr DrawRange mine_energy = { 1, 10 };            // Energy per mining run
+    constexpr DrawRange mine_cost = { 100000, 200000 };     // Solaris per harvester
+    constexpr DrawRange mine_yield = { 1, 50 };             // Spice per harvester
+
+
+    // Generate a random number within the provided range
+
+    inline int64_t randrange(Rng& rng, DrawRange range) noexcept
+    {
+        return rng.range(range.lower, range.upper);
+    }
+
+    // Starting energy and solaris for a new Arrakeener
+    Ledger initial_ledger(Rng& rng) noexcept;
+
+    // Operations
+    // On failure the ledger is unchanged and the delta is zero
+
+    Status eat_spice(Ledger& ledger, Rng& rng, int64_t units, int64_t& delta_energy) noexcept;
+    Status sell_spice(Ledger& ledger, Rng& rng, int64_t units, int64_t& delta_solaris) noexcept;
+    Status mine_spice(Ledger& ledger, Rng& rng, int64_t harvesters, int64_t& delta_spice) noexcept;
+}
@@ -0,0 +1,366 @@
+// scheduler.cpp: Work-stealing thread pool for batch work
+
+#include "scheduler.h"
+#include <cassert>
+
+namespace arrakis
+{
+    // Worker of the scheduler running on this thread, if any
+
+    static thread_local const Scheduler* t_scheduler = nullptr;
+    static thread_local void* t_worker = nullptr;
+    static thread_local uint32_t t_victim_seed = 0x9E3779B9;
+
+
+    static uint32_t next_victim(uint32_t& seed) noexcept
+    {
+        // xorshift32
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+
+
+    WorkDeque::WorkDeque(int64_t capacity) :
+        m_top(0),
+        m_bottom(0)
+    {
+        assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+        m_arrays.emplace_back(new Array(capacity));
+        m_array.store(m_arrays.back().get(), std::memory_order_relaxed);
+    }
+
+
+    void WorkDeque::push(Task* task)
+    {
+        const int64_t b = m_bottom.load(std::memory_order_relaxed);
+        const int64_t t = m_top.load(std::memory_order_acquire);
+        Array* a = m_array.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1)
+        {
+            m_arrays.reserve(m_arrays.size() + 1);
+            std::unique_ptr<Array> bigger(new Array(a->capacity * 2));
+            for (int64_t i = t; i < b; ++i) bigger->put(i, a->get(i));
+            a = bigger.get();
+            m_arrays.push_back(std::move(bigger));
+            m_array.store(a, std::memory_order_release);
+        }
+        a->put(b, task);
+        m_bottom.store(b + 1, std::memory_order_release);
+    }
+
+
+    Task* WorkDeque::pop() noexcept
+    {
+        const int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = m_array.load(std::memory_order_relaxed);
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            // Empty
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Task* task = a->get(b);
+        if (t == b)
+        {
+            // Last task; race the thieves for it
+            if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                task = nullptr;
+            }
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+
+    Task* WorkDeque::steal() noexcept
+    {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = m_bottom.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+
+        Array* a = m_array.load(std::memory_order_acquire);
+        Task* task = a->get(t);
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return task;
+    }
+
+
+    Scheduler::Scheduler(unsigned workers, unsigned spins) :
+        m_spins(spins),
+        m_queued(0),
+        m_epoch(0),
+        m_parked(0),
+        m_stop(false)
+    {
+        if (workers == 0) workers = std::thread::hardware_concurrency();
+        if (workers == 0) workers = 1;
+
+        for (unsigned i = 0; i < workers; ++i)
+        {
+            m_workers.emplace_back(new Worker{ WorkDeque(), 0 });
+            m_workers.back()->victim_seed = 0x9E3779B9u * (i + 1);
+        }
+
+        try
+        {
+            for (unsigned i = 0; i < workers; ++i)
+            {
+                Worker* worker = m_workers[i].get();
+                m_threads.emplace_back([this, worker]
+                {
+                    t_scheduler = this;
+                    t_worker = worker;
+                    work_until(nullptr);
+                });
+            }
+        }
+        catch (...)
+        {
+            m_stop.store(true);
+            wake_all();
+            for (auto& thread : m_threads) thread.join();
+            throw;
+        }
+    }
+
+
+    Scheduler::~Scheduler()
+    {
+        assert(!has_work());
+        m_stop.store(true);
+        wake_all();
+        for (auto& thread : m_threads) thread.join();
+    }
+
+
+    Scheduler& Scheduler::shared()
+    {
+        static Scheduler* scheduler = new Scheduler();
+        return *scheduler;
+    }
+
+
+    Scheduler::Worker* Scheduler::current() const noexcept
+    {
+        return t_scheduler == this ? static_cast<Worker*>(t_worker) : nullptr;
+    }
+
+
+    void Scheduler::push(Task* task)
+    {
+        if (Worker* self = current())
+        {
+            self->deque.push(task);
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            m_queue.push_back(task);
+            m_queued.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+
+    // Pairs with the fence in park: either the parking thread sees the task
+    // just pushed, or we see it parked
+
+    void Scheduler::signal()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_parked.load(std::memory_order_relaxed)) wake_one();
+    }
+
+
+    // Own deque newest first, then the shared queue, then the oldest task of
+    // each other worker starting from a random one
+
+    Task* Scheduler::find(Worker* self) noexcept
+    {
+        if (self)
+        {
+            if (Task* task = self->deque.pop()) return task;
+        }
+
+        if (m_queued.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            if (!m_queue.empty())
+            {
+                Task* task = m_queue.front();
+                m_queue.pop_front();
+                m_queued.fetch_sub(1, std::memory_order_relaxed);
+                return task;
+            }
+        }
+
+        const size_t n = m_workers.size();
+        const size_t start = next_victim(self ? self->victim_seed : t_victim_seed) % n;
+        for (size_t i = 0; i < n; ++i)
+        {
+            Worker* victim = m_workers[(start + i) % n].get();
+            if (victim == self) continue;
+            if (Task* task = victim->deque.steal()) return task;
+        }
+        return nullptr;
+    }
+
+
+    bool Scheduler::has_work() const noexcept
+    {
+        if (m_queued.load(std::memory_order_relaxed)) return true;
+        for (const auto& worker : m_workers)
+        {
+            if (!worker->deque.empty()) return true;
+        }
+        return false;
+    }
+
+
+    void Scheduler::run(Task* task) noexcept
+    {
+        TaskGroup* group = task->m_group;
+        try
+        {
+            task->execute();
+        }
+        catch (...)
+        {
+            group->fail(std::current_exception());
+        }
+        delete task;
+
+        // The group may be destroyed as soon as its count reaches zero
+        if (group->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) wake_all();
+    }
+
+
+    // Run tasks until the count reaches zero, or for a worker until the
+    // scheduler stops
+
+    void Scheduler::work_until(const std::atomic<size_t>* pending)
+    {
+        Worker* self = current();
+        unsigned idle = 0;
+        for (;;)
+        {
+            if (pending ? pending->load(std::memory_order_acquire) == 0 : m_stop.load(std::memory_order_acquire))
+            {
+                return;
+            }
+
+            if (Task* task = find(self))
+            {
+                run(task);
+                idle = 0;
+            }
+            else if (idle < m_spins)
+            {
+                ++idle;
+                std::this_thread::yield();
+            }
+            else
+            {
+                park(pending);
+                idle = 0;
+            }
+        }
+    }
+
+
+    void Scheduler::park(const std::atomic<size_t>* pending)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const uint64_t epoch = m_epoch;
+        m_parked.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        const bool done = pending ? pending->load(std::memory_order_acquire) == 0 : m_stop.load();
+        if (!done && !has_work())
+        {
+            m_wake.wait(lock, [&] { return m_epoch != epoch; });
+        }
+        m_parked.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+
+    void Scheduler::wake_one()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_epoch;
+        }
+        m_wake.notify_one();
+    }
+
+
+    // Needed when a group finishes, since only the threads waiting on that
+    // group care
+
+    void Scheduler::wake_all()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_epoch;
+        }
+        m_wake.notify_all();
+    }
+
+
+    TaskGroup::~TaskGroup()
+    {
+        if (m_pending.load(std::memory_order_acquire) != 0)
+        {
+            m_scheduler.work_until(&m_pending);
+        }
+    }
+
+
+    void TaskGroup::spawn(Task* task)
+    {
+        task->m_group = this;
+        m_pending.fetch_add(1, std::memory_order_relaxed);
+        try
+        {
+            m_scheduler.push(task);
+        }
+        catch (...)
+        {
+            m_pending.fetch_sub(1, std::memory_order_relaxed);
+            delete task;
+            throw;
+        }
+        m_scheduler.signal();
+    }
+
+
+    void TaskGroup::wait()
+    {
+        m_scheduler.work_until(&m_pending);
+
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(m_error_mutex);
+            std::swap(error, m_error);
+        }
+        if (error) std::rethrow_exception(error);
+    }
+
+
+    void TaskGroup::fail(std::exception_ptr error) noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_error_mutex);
+        if (!m_error) m_error = std::move(error);
+    }
+}
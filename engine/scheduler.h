@@ -0,0 +1,225 @@
+// scheduler.h: Work-stealing thread pool for batch work
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace arrakis
+{
+    class Scheduler;
+    class TaskGroup;
+
+
+    // Unit of work; deleted by the scheduler once it has run
+
+    class Task
+    {
+        friend class Scheduler;
+        friend class TaskGroup;
+        TaskGroup* m_group = nullptr;
+
+    public:
+        virtual ~Task() = default;
+        virtual void execute() = 0;
+
+        TaskGroup& group() const noexcept { return *m_group; }
+    };
+
+
+    // Double-ended queue of tasks (Chase and Lev, 2005, with the memory
+    // orderings of Le et al., 2013). The owning worker pushes and pops at
+    // the bottom; any thread may steal from the top. Grows without bound;
+    // outgrown arrays are kept until the deque is destroyed because a thief
+    // may still be reading them.
+
+    class WorkDeque
+    {
+        struct Array
+        {
+            const int64_t capacity;         // Power of two
+            std::unique_ptr<std::atomic<Task*>[]> slots;
+
+            explicit Array(int64_t capacity) : capacity(capacity), slots(new std::atomic<Task*>[capacity]) {}
+            Task* get(int64_t i) const noexcept { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+            void put(int64_t i, Task* task) noexcept { slots[i & (capacity - 1)].store(task, std::memory_order_relaxed); }
+        };
+
+        alignas(64) std::atomic<int64_t> m_top;
+        alignas(64) std::atomic<int64_t> m_bottom;
+        std::atomic<Array*> m_array;
+        std::vector<std::unique_ptr<Array>> m_arrays;   // Current one last
+
+    public:
+        explicit WorkDeque(int64_t capacity = 256);
+        WorkDeque(const WorkDeque&) = delete;
+        WorkDeque& operator=(const WorkDeque&) = delete;
+
+        // Owner only; throws std::bad_alloc when growing fails
+        void push(Task* task);
+        Task* pop() noexcept;
+
+        // Any thread; null when empty or when another thread won the race
+        Task* steal() noexcept;
+
+        bool empty() const noexcept
+        {
+            return m_bottom.load(std::memory_order_acquire) <= m_top.load(std::memory_order_acquire);
+        }
+    };
+
+
+    // Fixed set of worker threads, each with its own deque. Tasks spawned by
+    // a worker go on its own deque and run newest first; idle workers steal
+    // the oldest task of a random victim, which for splitting tasks is the
+    // largest piece of work left. Tasks submitted from other threads go on a
+    // shared queue. A worker that finds nothing spins for a while and then
+    // parks until new work arrives.
+    //
+    // Threads waiting on a task group run tasks while they wait, so groups
+    // may nest and be waited on from inside tasks.
+
+    class Scheduler
+    {
+        friend class TaskGroup;
+
+        struct Worker
+        {
+            WorkDeque deque;
+            uint32_t victim_seed;
+        };
+
+        const unsigned m_spins;
+        std::vector<std::unique_ptr<Worker>> m_workers;
+        std::vector<std::thread> m_threads;
+
+        std::mutex m_queue_mutex;
+        std::deque<Task*> m_queue;          // Submitted from outside
+        std::atomic<size_t> m_queued;
+
+        // Parking
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        uint64_t m_epoch;                   // Bumped to wake parked threads
+        std::atomic<unsigned> m_parked;
+        std::atomic<bool> m_stop;
+
+        Worker* current() const noexcept;
+        void push(Task* task);
+        void signal();
+        Task* find(Worker* self) noexcept;
+        bool has_work() const noexcept;
+        void run(Task* task) noexcept;
+        void work_until(const std::atomic<size_t>* pending);
+        void park(const std::atomic<size_t>* pending);
+        void wake_one();
+        void wake_all();
+
+    public:
+        // 0 workers for one per hardware thread. An idle thread polls for
+        // spins rounds before parking.
+        explicit Scheduler(unsigned workers = 0, unsigned spins = 256);
+        ~Scheduler();                       // Every group must have been waited on
+        Scheduler(const Scheduler&) = delete;
+        Scheduler& operator=(const Scheduler&) = delete;
+
+        unsigned workers() const noexcept { return (unsigned)m_workers.size(); }
+
+        // Process-wide scheduler with one worker per hardware thread, started
+        // on first use and never stopped
+        static Scheduler& shared();
+    };
+
+
+    // Set of tasks that can be waited on together
+    // The first exception thrown by a task is rethrown by wait(); the other
+    // tasks of the group still run.
+
+    class TaskGroup
+    {
+        friend class Scheduler;
+
+        Scheduler& m_scheduler;
+        std::atomic<size_t> m_pending;
+        std::mutex m_error_mutex;
+        std::exception_ptr m_error;
+
+        template <typename F>
+        class FunctionTask : public Task
+        {
+            F m_function;
+
+        public:
+            explicit FunctionTask(F&& function) : m_function(std::move(function)) {}
+            void execute() override { m_function(); }
+        };
+
+        void fail(std::exception_ptr error) noexcept;
+
+    public:
+        explicit TaskGroup(Scheduler& scheduler) : m_scheduler(scheduler), m_pending(0) {}
+        ~TaskGroup();                       // Waits; exceptions are dropped
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        Scheduler& scheduler() const noexcept { return m_scheduler; }
+
+        // Queue a task; the group takes ownership
+        void spawn(Task* task);
+
+        template <typename F>
+        void run(F function)
+        {
+            spawn(new FunctionTask<F>(std::move(function)));
+        }
+
+        // Run tasks until every task of the group has finished
+        void wait();
+    };
+
+
+    // Call body(first, last) on disjoint subranges covering [begin, end), in
+    // parallel. Ranges are split in half until they hold at most grain items,
+    // so that thieves take large pieces and owners work through small ones.
+
+    template <typename F>
+    class RangeTask : public Task
+    {
+        size_t m_begin;
+        size_t m_end;
+        const size_t m_grain;
+        const F& m_body;
+
+    public:
+        RangeTask(size_t begin, size_t end, size_t grain, const F& body) :
+            m_begin(begin), m_end(end), m_grain(grain < 1 ? 1 : grain), m_body(body) {}
+
+        void execute() override
+        {
+            while (m_end - m_begin > m_grain)
+            {
+                const size_t middle = m_begin + (m_end - m_begin) / 2;
+                group().spawn(new RangeTask(middle, m_end, m_grain, m_body));
+                m_end = middle;
+            }
+            m_body(m_begin, m_end);
+        }
+    };
+
+    template <typename F>
+    void parallel_for(Scheduler& scheduler, size_t begin, size_t end, size_t grain, const F& body)
+    {
+        if (begin >= end) return;
+        TaskGroup group(scheduler);
+        group.spawn(new RangeTask<F>(begin, end, grain, body));
+        group.wait();
+    }
+}
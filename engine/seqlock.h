@@ -0,0 +1,74 @@
+// seqlock.h: Sequence lock for small, trivially copyable values
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace arrakis
+{
+    // A value that readers copy without blocking. Readers retry if a write
+    // overlapped the copy, so they never see a partial (torn) value.
+    // Writers must be serialized by the caller, e.g. with a mutex.
+    //
+    // The value is held as relaxed atomic words, so the overlapping read is
+    // not a data race; the fences order the words against the sequence.
+
+    template <typename T>
+    class Seqlock
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Seqlock requires a trivially copyable type");
+        static_assert(sizeof(T) % sizeof(uint64_t) == 0, "Seqlock requires a whole number of words");
+
+        static constexpr size_t words = sizeof(T) / sizeof(uint64_t);
+
+        std::atomic<uint32_t> m_sequence;   // Odd while a write is in progress
+        std::atomic<uint64_t> m_words[words];
+
+    public:
+        explicit Seqlock(const T& value = T()) noexcept :
+            m_sequence(0)
+        {
+            uint64_t w[words];
+            std::memcpy(w, &value, sizeof(T));
+            for (size_t i = 0; i < words; ++i) m_words[i].store(w[i], std::memory_order_relaxed);
+        }
+
+        Seqlock(const Seqlock&) = delete;
+        Seqlock& operator=(const Seqlock&) = delete;
+
+        // Consistent copy of the value; spins while a write is in progress
+
+        T load() const noexcept
+        {
+            uint64_t w[words];
+            uint32_t before, after;
+            do
+            {
+                before = m_sequence.load(std::memory_order_acquire);
+                for (size_t i = 0; i < words; ++i) w[i] = m_words[i].load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                after = m_sequence.load(std::memory_order_relaxed);
+            } while ((before & 1) || before != after);
+
+            T value;
+            std::memcpy(&value, w, sizeof(T));
+            return value;
+        }
+
+        // Publish a new value; only one writer at a time
+
+        void store(const T& value) noexcept
+        {
+            uint64_t w[words];
+            std::memcpy(w, &value, sizeof(T));
+
+            const uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+            m_sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (size_t i = 0; i < words; ++i) m_words[i].store(w[i], std::memory_order_relaxed);
+            m_sequence.store(sequence + 2, std::memory_order_release);
+        }
+    };
+}
@@ -0,0 +1,120 @@
+// simulation.cpp: Parallel Monte Carlo trajectories of the Arrakeener economy
+
+#include "simulation.h"
+#include "scheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace arrakis
+{
+    // Trajectories per task; enough to amortize scheduling
+
+    static const size_t chunk = 256;
+
+
+    static Rng trajectory_rng(uint64_t seed, size_t i) noexcept
+    {
+        return Rng(seed ^ ((uint64_t)i * 0xD1342543DE82EF95ull));
+    }
+
+
+    // Run one trajectory; returns the number of cycles completed
+
+    static uint32_t run(const Simulation& simulation, size_t i, Ledger& ledger, std::vector<StepResult>& results) noexcept
+    {
+        Rng rng = trajectory_rng(simulation.seed, i);
+        ledger = simulation.start;
+        const size_t n = simulation.policy.size();
+        for (uint32_t cycle = 0; cycle < simulation.cycles; ++cycle)
+        {
+            size_t failed;
+            if (transact(ledger, rng, simulation.policy.data(), n, results.data(), failed) != Status::ok)
+            {
+                return cycle;
+            }
+        }
+        return simulation.cycles;
+    }
+
+
+    static Distribution distribution(std::vector<int64_t>& values, const std::vector<double>& quantiles)
+    {
+        Distribution result = {};
+        if (values.empty()) return result;
+
+        double sum = 0;
+        for (int64_t value : values) sum += (double)value;
+        result.mean = sum / (double)values.size();
+        result.min = *std::min_element(values.begin(), values.end());
+        result.max = *std::max_element(values.begin(), values.end());
+
+        // Nearest rank; each nth_element only reorders, so later quantiles
+        // still see every value
+        for (double q : quantiles)
+        {
+            double rank = std::ceil(std::min(std::max(q, 0.0), 1.0) * (double)values.size());
+            size_t k = rank < 1 ? 0 : (size_t)rank - 1;
+            std::nth_element(values.begin(), values.begin() + k, values.end());
+            result.quantiles.push_back(values[k]);
+        }
+        return result;
+    }
+
+
+    Outcome simulate(const Simulation& simulation)
+    {
+        assert(std::all_of(simulation.policy.begin(), simulation.policy.end(), [](const Step& step) { return valid(step); }));
+
+        const size_t n = simulation.trajectories;
+        std::vector<int64_t> energy(n), solaris(n), spice(n);
+        std::vector<uint32_t> cycles(n);
+
+        unsigned threads = simulation.threads ? simulation.threads : std::thread::hardware_concurrency();
+        threads = (unsigned)std::max<size_t>(1, std::min<size_t>(threads, (n + chunk - 1) / chunk));
+
+        auto body = [&](size_t begin, size_t end)
+        {
+            std::vector<StepResult> results(simulation.policy.size());
+            for (size_t i = begin; i < end; ++i)
+            {
+                Ledger ledger;
+                cycles[i] = run(simulation, i, ledger, results);
+                energy[i] = ledger.energy;
+                solaris[i] = ledger.solaris;
+                spice[i] = ledger.spice;
+            }
+        };
+
+        // The calling thread works too, so a private scheduler needs one
+        // worker fewer than the thread count
+        if (threads == 1)
+        {
+            body(0, n);
+        }
+        else if (simulation.threads == 0)
+        {
+            parallel_for(Scheduler::shared(), 0, n, chunk, body);
+        }
+        else
+        {
+            Scheduler scheduler(threads - 1);
+            parallel_for(scheduler, 0, n, chunk, body);
+        }
+
+        Outcome outcome = {};
+        size_t ruined = 0;
+        double completed = 0;
+        for (uint32_t c : cycles)
+        {
+            if (c < simulation.cycles) ++ruined;
+            completed += c;
+        }
+        outcome.ruin_probability = n ? (double)ruined / (double)n : 0;
+        outcome.mean_cycles = n ? completed / (double)n : 0;
+        outcome.energy = distribution(energy, simulation.quantiles);
+        outcome.solaris = distribution(solaris, simulation.quantiles);
+        outcome.spice = distribution(spice, simulation.quantiles);
+        return outcome;
+    }
+}
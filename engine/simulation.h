@@ -0,0 +1,52 @@
+// simulation.h: Parallel Monte Carlo trajectories of the Arrakeener economy
+#pragma once
+
+#include "transaction.h"
+#include <cstddef>
+#include <vector>
+
+namespace arrakis
+{
+    // A policy applied for a number of cycles to many independent copies of
+    // one starting ledger. Each cycle runs the policy steps as a transaction
+    // (see arrakis::transact). A trajectory is ruined by the first cycle
+    // that fails, and keeps the ledger it had before that cycle.
+    //
+    // Trajectory i draws from its own stream derived from (seed, i), so the
+    // outcome does not depend on the number of threads.
+
+    struct Simulation
+    {
+        Ledger start;
+        std::vector<Step> policy;           // Valid steps; empty does nothing
+        uint32_t cycles = 1;
+        size_t trajectories = 1;
+        uint64_t seed = 0;
+        unsigned threads = 0;               // 0 for the shared scheduler
+        std::vector<double> quantiles = { 0.05, 0.5, 0.95 };
+    };
+
+
+    // Distribution of one counter at the end of the trajectories
+
+    struct Distribution
+    {
+        double mean;
+        int64_t min;
+        int64_t max;
+        std::vector<int64_t> quantiles;     // At Simulation::quantiles (nearest rank)
+    };
+
+
+    struct Outcome
+    {
+        Distribution energy;
+        Distribution solaris;
+        Distribution spice;
+        double ruin_probability;            // Fraction of trajectories ruined
+        double mean_cycles;                 // Cycles completed, on average
+    };
+
+
+    Outcome simulate(const Simulation& simulation);
+}
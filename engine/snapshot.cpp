@@ -0,0 +1,399 @@
+// snapshot.cpp: Memory-mapped snapshot of a population of Arrakeeners
+
+#include "snapshot.h"
+#include "encoding.h"
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace arrakis
+{
+    using namespace encoding;
+
+    static const uint32_t snapshot_magic = 0x534B5241;  // "ARKS"
+    static const size_t header_size = 64;
+    static const size_t name_fields = 4;
+    static const size_t write_block = 1 << 16;          // Bytes encoded per write
+
+
+    static bool little_endian() noexcept
+    {
+        const uint16_t one = 1;
+        uint8_t first;
+        std::memcpy(&first, &one, 1);
+        return first == 1;
+    }
+
+
+    // Whether count elements of size bytes at offset lie within length
+    static bool within(uint64_t offset, uint64_t count, uint64_t size, uint64_t length) noexcept
+    {
+        return offset <= length && count <= (length - offset) / size;
+    }
+
+
+    // Map the whole file read only; the view outlives the handles
+
+    static void* map(const std::string& path, size_t& length)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                                  OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (file == INVALID_HANDLE_VALUE) throw std::system_error((int)GetLastError(), std::system_category(), path);
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size))
+        {
+            const DWORD error = GetLastError();
+            CloseHandle(file);
+            throw std::system_error((int)error, std::system_category(), path);
+        }
+        length = (size_t)size.QuadPart;
+        if (length < header_size)
+        {
+            CloseHandle(file);
+            throw std::runtime_error("not a snapshot: " + path);
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        const DWORD error = mapping ? 0 : GetLastError();
+        CloseHandle(file);
+        if (!mapping) throw std::system_error((int)error, std::system_category(), path);
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        const DWORD view_error = view ? 0 : GetLastError();
+        CloseHandle(mapping);
+        if (!view) throw std::system_error((int)view_error, std::system_category(), path);
+        return view;
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) throw std::system_error(errno, std::generic_category(), path);
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            const int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), path);
+        }
+        length = (size_t)info.st_size;
+        if (length < header_size)
+        {
+            ::close(fd);
+            throw std::runtime_error("not a snapshot: " + path);
+        }
+        void* view = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        const int error = errno;
+        ::close(fd);
+        if (view == MAP_FAILED) throw std::system_error(error, std::generic_category(), path);
+
+        // Reads are scattered; do not read ahead of them
+        madvise(view, length, MADV_RANDOM);
+        return view;
+#endif
+    }
+
+
+    static void unmap(void* view, size_t length) noexcept
+    {
+#ifdef _WIN32
+        (void)length;
+        UnmapViewOfFile(view);
+#else
+        munmap(view, length);
+#endif
+    }
+
+
+    Snapshot::Snapshot(const std::string& path, Observer* observer) :
+        m_view(map(path, m_length)),
+        m_count(0),
+        m_energy(nullptr),
+        m_solaris(nullptr),
+        m_spice(nullptr),
+        m_names(nullptr),
+        m_heap(nullptr),
+        m_heap_size(0),
+        m_observer(observer),
+        m_seed(Rng().next())
+    {
+        const uint8_t* data = static_cast<const uint8_t*>(m_view);
+        Reader header(data, header_size);
+        const uint32_t magic = header.get_u32();
+        const uint32_t file_version = header.get_u32();
+        const uint64_t count = (uint64_t)header.get_i64();
+        uint64_t columns[3];
+        for (uint64_t& offset : columns) offset = (uint64_t)header.get_i64();
+        const uint64_t names = (uint64_t)header.get_i64();
+        const uint64_t heap = (uint64_t)header.get_i64();
+        const uint64_t heap_size = (uint64_t)header.get_i64();
+
+        const char* error = nullptr;
+        if (magic != snapshot_magic) error = "not a snapshot: ";
+        else if (file_version != version) error = "unsupported snapshot version: ";
+        else if (!little_endian()) error = "snapshots need a little-endian host: ";
+        else
+        {
+            for (uint64_t offset : columns)
+            {
+                if (offset % 8 != 0 || !within(offset, count, 8, m_length)) error = "truncated snapshot: ";
+            }
+            if (!within(names, count, 4 * name_fields, m_length) || !within(heap, heap_size, 1, m_length)) error = "truncated snapshot: ";
+        }
+        if (error)
+        {
+            unmap(m_view, m_length);
+            throw std::runtime_error(error + path);
+        }
+
+        m_count = (size_t)count;
+        m_energy = reinterpret_cast<const int64_t*>(data + columns[0]);
+        m_solaris = reinterpret_cast<const int64_t*>(data + columns[1]);
+        m_spice = reinterpret_cast<const int64_t*>(data + columns[2]);
+        m_names = data + names;
+        m_heap = data + heap;
+        m_heap_size = (size_t)heap_size;
+
+        try
+        {
+            m_chunks.reset(new std::atomic<Chunk*>[(m_count + chunk_size - 1) / chunk_size]());
+        }
+        catch (...)
+        {
+            unmap(m_view, m_length);
+            throw;
+        }
+    }
+
+
+    Snapshot::~Snapshot()
+    {
+        const size_t chunks = (m_count + chunk_size - 1) / chunk_size;
+        for (size_t c = 0; c < chunks; ++c)
+        {
+            Chunk* chunk = m_chunks[c].load(std::memory_order_acquire);
+            if (!chunk) continue;
+            for (auto& obj : chunk->objects) delete obj.load(std::memory_order_relaxed);
+            delete chunk;
+        }
+        unmap(m_view, m_length);
+    }
+
+
+    Arrakeener* Snapshot::find(size_t i) const noexcept
+    {
+        assert(i < m_count);
+        Chunk* chunk = m_chunks[i / chunk_size].load(std::memory_order_acquire);
+        return chunk ? chunk->objects[i % chunk_size].load(std::memory_order_acquire) : nullptr;
+    }
+
+
+    std::wstring Snapshot::string(size_t i, int field) const
+    {
+        Reader entry(m_names + (name_fields * i + field) * 4, 4);
+        const uint32_t offset = entry.get_u32();
+        if (offset >= m_heap_size) throw std::runtime_error("corrupt snapshot name table");
+        Reader reader(m_heap + offset, m_heap_size - offset);
+        std::wstring value = reader.get_string();
+        if (!reader.ok()) throw std::runtime_error("corrupt snapshot string heap");
+        return value;
+    }
+
+
+    Ledger Snapshot::ledger(size_t i) const noexcept
+    {
+        if (const Arrakeener* obj = find(i)) return obj->current_ledger();
+        return Ledger{ m_energy[i], m_solaris[i], m_spice[i] };
+    }
+
+
+    Names Snapshot::saved_names(size_t i) const
+    {
+        Names names;
+        names.first_name = string(i, 0);
+        names.last_name = string(i, 1);
+        names.affiliation = string(i, 2);
+        names.occupation = string(i, 3);
+        return names;
+    }
+
+
+    Names Snapshot::names(size_t i) const
+    {
+        if (const Arrakeener* obj = find(i)) return obj->current_names();
+        return saved_names(i);
+    }
+
+
+    State Snapshot::state(size_t i) const
+    {
+        if (const Arrakeener* obj = find(i)) return obj->current_state();
+        State state;
+        state.names = names(i);
+        state.ledger = ledger(i);
+        return state;
+    }
+
+
+    // Chunks are published with a compare-and-swap; objects are created
+    // under the chunk's mutex so that each is created and attached once
+
+    Arrakeener& Snapshot::materialize(size_t i)
+    {
+        assert(i < m_count);
+        std::atomic<Chunk*>& slot = m_chunks[i / chunk_size];
+        Chunk* chunk = slot.load(std::memory_order_acquire);
+        if (!chunk)
+        {
+            std::unique_ptr<Chunk> fresh(new Chunk);
+            if (slot.compare_exchange_strong(chunk, fresh.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                chunk = fresh.release();
+            }
+        }
+
+        std::atomic<Arrakeener*>& entry = chunk->objects[i % chunk_size];
+        if (Arrakeener* obj = entry.load(std::memory_order_acquire)) return *obj;
+
+        std::lock_guard<std::mutex> lock(chunk->mutex);
+        if (Arrakeener* obj = entry.load(std::memory_order_relaxed)) return *obj;
+
+        std::unique_ptr<Arrakeener> obj = create(i);
+        if (m_observer) obj->observe(m_observer);
+        entry.store(obj.get(), std::memory_order_release);
+        return *obj.release();
+    }
+
+
+    std::unique_ptr<Arrakeener> Snapshot::create(size_t i) const
+    {
+        assert(i < m_count);
+        return std::make_unique<Arrakeener>(saved_names(i), Ledger{ m_energy[i], m_solaris[i], m_spice[i] }, m_seed + i);
+    }
+
+
+    // Flush the C library buffer and then the operating system's
+
+    static bool sync(std::FILE* file) noexcept
+    {
+        if (std::fflush(file) != 0) return false;
+#ifdef _WIN32
+        return _commit(_fileno(file)) == 0;
+#else
+        return fsync(fileno(file)) == 0;
+#endif
+    }
+
+
+    // The file is written beside the target and renamed over it, so that
+    // snapshots mapped from the old file keep reading the old contents
+
+    void Snapshot::write(const std::string& path, size_t n, const std::function<State(size_t)>& state)
+    {
+        std::vector<int64_t> energy(n), solaris(n), spice(n);
+        std::vector<uint32_t> names(name_fields * n);
+        std::vector<uint8_t> heap;
+        std::unordered_map<std::wstring, uint32_t> shared;     // Affiliations and occupations
+
+        auto add = [&](const std::wstring& value)
+        {
+            if (heap.size() > UINT32_MAX) throw std::length_error("snapshot string heap exceeds 4 GiB");
+            const uint32_t offset = (uint32_t)heap.size();
+            put_string(heap, value);
+            return offset;
+        };
+        auto add_shared = [&](const std::wstring& value)
+        {
+            auto it = shared.find(value);
+            if (it != shared.end()) return it->second;
+            const uint32_t offset = add(value);
+            shared.emplace(value, offset);
+            return offset;
+        };
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            const State s = state(i);
+            energy[i] = s.ledger.energy;
+            solaris[i] = s.ledger.solaris;
+            spice[i] = s.ledger.spice;
+            names[name_fields * i + 0] = add(s.names.first_name);
+            names[name_fields * i + 1] = add(s.names.last_name);
+            names[name_fields * i + 2] = add_shared(s.names.affiliation.str());
+            names[name_fields * i + 3] = add_shared(s.names.occupation.str());
+        }
+        while (heap.size() % 8 != 0) heap.push_back(0);
+
+        const uint64_t columns = header_size;
+        const uint64_t table = columns + 3 * 8 * (uint64_t)n;
+        const uint64_t strings = table + 4 * name_fields * (uint64_t)n;
+
+        const std::string temporary = path + ".tmp";
+        std::FILE* file = std::fopen(temporary.c_str(), "wb");
+        if (!file) throw std::system_error(errno, std::generic_category(), temporary);
+
+        std::vector<uint8_t> block;
+        bool ok = true;
+        auto flush = [&](bool force)
+        {
+            if (block.size() < write_block && !force) return;
+            ok = ok && std::fwrite(block.data(), 1, block.size(), file) == block.size();
+            block.clear();
+        };
+
+        put_u32(block, snapshot_magic);
+        put_u32(block, version);
+        put_i64(block, (int64_t)n);
+        put_i64(block, (int64_t)columns);
+        put_i64(block, (int64_t)(columns + 8 * (uint64_t)n));
+        put_i64(block, (int64_t)(columns + 16 * (uint64_t)n));
+        put_i64(block, (int64_t)table);
+        put_i64(block, (int64_t)strings);
+        put_i64(block, (int64_t)heap.size());
+        assert(block.size() == header_size);
+
+        for (const auto* column : { &energy, &solaris, &spice })
+        {
+            for (int64_t value : *column)
+            {
+                put_i64(block, value);
+                flush(false);
+            }
+        }
+        for (uint32_t offset : names)
+        {
+            put_u32(block, offset);
+            flush(false);
+        }
+        flush(true);
+        ok = ok && std::fwrite(heap.data(), 1, heap.size(), file) == heap.size();
+        ok = sync(file) && ok;
+        ok = std::fclose(file) == 0 && ok;
+
+        std::error_code error;
+        if (ok) std::filesystem::rename(temporary, path, error);
+        if (!ok || error)
+        {
+            std::remove(temporary.c_str());
+            throw std::system_error(ok ? error.value() : EIO, ok ? error.category() : std::generic_category(), path);
+        }
+    }
+}
@@ -0,0 +1,101 @@
+// snapshot.h: Memory-mapped snapshot of a population of Arrakeeners
+#pragma once
+
+#include "core.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace arrakis
+{
+    // A population saved in a fixed layout that is read in place. Opening
+    // maps the file and checks its header; nothing else is read until it is
+    // asked for, so opening costs the same for any population and reads
+    // touch only the pages that hold them.
+    //
+    // Reads of an object come from the mapping until the object is first
+    // changed. materialize() then creates it, once, as an Arrakeener with
+    // its saved state and a new random stream; from then on reads come from
+    // the object. The file is not changed; save a new snapshot to keep the
+    // changes.
+    //
+    // The file is little endian, 8-byte aligned:
+    //   u32 magic "ARKS", u32 version, u64 count, and u64 file offsets of
+    //     the energy, solaris and spice columns, the name table and the
+    //     string heap, and u64 heap size in bytes (64 bytes in all)
+    //   three columns of count i64
+    //   name table: for each object, u32 heap offsets of its first name,
+    //     last name, affiliation and occupation
+    //   string heap: strings as in encoding.h; each distinct affiliation and
+    //     occupation is stored once
+    // The columns are read directly, so reading needs a little-endian host.
+
+    class Snapshot
+    {
+        static const size_t chunk_size = 4096;
+
+        // Objects materialized so far, allocated a chunk at a time
+        struct Chunk
+        {
+            std::mutex mutex;               // Serializes materializing
+            std::atomic<Arrakeener*> objects[chunk_size] = {};
+        };
+
+        void* m_view;
+        size_t m_length;
+        size_t m_count;
+        const int64_t* m_energy;
+        const int64_t* m_solaris;
+        const int64_t* m_spice;
+        const uint8_t* m_names;
+        const uint8_t* m_heap;
+        size_t m_heap_size;
+        Observer* m_observer;
+        uint64_t m_seed;
+        std::unique_ptr<std::atomic<Chunk*>[]> m_chunks;
+
+        Arrakeener* find(size_t i) const noexcept;
+        std::wstring string(size_t i, int field) const;
+        Names saved_names(size_t i) const;
+
+    public:
+        static const uint32_t version = 1;
+
+        // Map the file at path; objects materialized later are observed by
+        // observer, if any, which must outlive the snapshot. Throws
+        // std::system_error if the file cannot be mapped and
+        // std::runtime_error if it is not a snapshot.
+        explicit Snapshot(const std::string& path, Observer* observer = nullptr);
+        ~Snapshot();                        // Destroys the materialized objects
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        size_t size() const noexcept { return m_count; }
+
+        // Current state of object i < size(), from the mapping or the
+        // materialized object. Names throw std::runtime_error if the name
+        // table or heap is corrupt.
+        Ledger ledger(size_t i) const noexcept;
+        Names names(size_t i) const;
+        State state(size_t i) const;
+
+        // The object i, created on first use; thread safe
+        Arrakeener& materialize(size_t i);
+        bool materialized(size_t i) const noexcept { return find(i) != nullptr; }
+
+        // A new object with the saved state of i, owned by the caller and
+        // not observed; for owners that keep their objects elsewhere, such
+        // as a server that can also destroy them. Every call for i starts
+        // the same random stream.
+        std::unique_ptr<Arrakeener> create(size_t i) const;
+
+        // Save n objects, the state of object i given by state(i); throws
+        // std::system_error if the file cannot be written and
+        // std::length_error if the string heap would exceed 4 GiB
+        static void write(const std::string& path, size_t n, const std::function<State(size_t)>& state);
+    };
+}
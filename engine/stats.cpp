@@ -0,0 +1,360 @@
+// stats.cpp: Per-method call counts, errors, latency and lock waits
+
+#include "stats.h"
+#include <cassert>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+
+namespace arrakis
+{
+    namespace stats
+    {
+        std::atomic<bool> recording(false);
+
+
+        void enable(bool on) noexcept
+        {
+            recording.store(on, std::memory_order_relaxed);
+        }
+
+
+        const char* name(Method method) noexcept
+        {
+            static const char* const names[method_count] =
+            {
+                "create",
+                "clone",
+                "clones",
+                "first_name",
+                "set_first_name",
+                "last_name",
+                "set_last_name",
+                "affiliation",
+                "set_affiliation",
+                "occupation",
+                "set_occupation",
+                "energy",
+                "solaris",
+                "spice",
+                "ledger",
+                "names",
+                "state",
+                "eat_spice",
+                "sell_spice",
+                "mine_spice",
+                "eat_spice_batch",
+                "sell_spice_batch",
+                "mine_spice_batch",
+                "transact"
+            };
+            assert((int)method < method_count);
+            return names[(int)method];
+        }
+
+
+        // The bucket layout shared by every thread's counters
+        static const Histogram& layout()
+        {
+            static const Histogram instance(highest_latency, latency_precision);
+            return instance;
+        }
+
+
+        // A counter only its thread adds to, so a load and a store will do;
+        // atomic so that collect() may read it at any time
+
+        struct Counter
+        {
+            std::atomic<uint64_t> value{ 0 };
+
+            void add(uint64_t n) noexcept
+            {
+                value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+            }
+
+            uint64_t get() const noexcept { return value.load(std::memory_order_relaxed); }
+        };
+
+
+        struct Tally
+        {
+            Counter calls;
+            Counter statuses[status_count];
+            Counter latency_sum;
+            Counter lock_wait_sum;
+            Counter* latency = nullptr;     // layout().buckets() each, in Record::buckets
+            Counter* lock_wait = nullptr;
+        };
+
+
+        // The counters of one thread. Records live on a global, grow-only
+        // list; a thread claims one on its first recorded call and gives it
+        // back when it exits, and the next thread to claim it adds on.
+
+        struct Record
+        {
+            Tally tallies[method_count];
+            std::unique_ptr<Counter[]> buckets;
+            std::atomic<bool> active{ true };
+            Record* next = nullptr;
+
+            Record() :
+                buckets(new Counter[2 * method_count * layout().buckets()])
+            {
+                const size_t n = layout().buckets();
+                for (int i = 0; i < method_count; ++i)
+                {
+                    tallies[i].latency = &buckets[2 * i * n];
+                    tallies[i].lock_wait = &buckets[(2 * i + 1) * n];
+                }
+            }
+        };
+
+        static std::atomic<Record*> records(nullptr);
+
+
+        std::vector<MethodStats> collect()
+        {
+            std::vector<MethodStats> stats(method_count);
+            const size_t n = layout().buckets();
+            for (int i = 0; i < method_count; ++i) stats[i].method = (Method)i;
+
+            for (Record* record = records.load(std::memory_order_acquire); record; record = record->next)
+            {
+                for (int i = 0; i < method_count; ++i)
+                {
+                    const Tally& tally = record->tallies[i];
+                    MethodStats& s = stats[i];
+                    s.calls += tally.calls.get();
+                    for (int j = 0; j < status_count; ++j) s.statuses[j] += tally.statuses[j].get();
+                    s.latency_sum += tally.latency_sum.get();
+                    s.lock_wait_sum += tally.lock_wait_sum.get();
+                    for (size_t b = 0; b < n; ++b)
+                    {
+                        const uint64_t latency = tally.latency[b].get();
+                        const uint64_t lock_wait = tally.lock_wait[b].get();
+                        if (latency) s.latency.record(layout().bucket_highest(b), latency);
+                        if (lock_wait) s.lock_wait.record(layout().bucket_highest(b), lock_wait);
+                    }
+                }
+            }
+            return stats;
+        }
+
+
+        std::string summary(const std::vector<MethodStats>& stats)
+        {
+            std::string text;
+            char line[160];
+            for (const MethodStats& s : stats)
+            {
+                if (!s.calls) continue;
+                text += name(s.method);
+                std::snprintf(line, sizeof(line), " calls=%" PRIu64, s.calls);
+                text += line;
+                if (s.latency.count())
+                {
+                    std::snprintf(line, sizeof(line), " mean_ns=%" PRIu64 " p50_ns=%" PRId64 " p99_ns=%" PRId64 " max_ns=%" PRId64,
+                        s.latency_sum / s.latency.count(), s.latency.percentile(50), s.latency.percentile(99), s.latency.max());
+                    text += line;
+                }
+                if (s.lock_wait.count())
+                {
+                    std::snprintf(line, sizeof(line), " wait_p99_ns=%" PRId64 " wait_max_ns=%" PRId64,
+                        s.lock_wait.percentile(99), s.lock_wait.max());
+                    text += line;
+                }
+                for (int j = 1; j < status_count; ++j)
+                {
+                    if (!s.statuses[j]) continue;
+                    std::snprintf(line, sizeof(line), " %s=%" PRIu64, status_info((Status)j).name, s.statuses[j]);
+                    text += line;
+                }
+                text += '\n';
+            }
+            return text;
+        }
+
+
+        // Upper bounds of the exported buckets, in nanoseconds. A value is
+        // placed by its histogram bucket, so to within the histogram's
+        // precision of a bound.
+        static const int64_t bounds[] =
+        {
+            100, 250, 500,
+            1000, 2500, 5000,
+            10000, 25000, 50000,
+            100000, 250000, 500000,
+            1000000, 10000000, 100000000, 1000000000
+        };
+
+
+        static void append_histogram(std::string& text, const char* metric, const char* method, const Histogram& histogram, uint64_t sum)
+        {
+            char line[200];
+            uint64_t below[sizeof(bounds) / sizeof(bounds[0])] = {};
+            histogram.for_each([&](int64_t, int64_t highest, uint64_t count)
+            {
+                for (size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]); ++i)
+                {
+                    if (highest <= bounds[i]) below[i] += count;
+                }
+            });
+            for (size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]); ++i)
+            {
+                std::snprintf(line, sizeof(line), "%s_bucket{method=\"%s\",le=\"%g\"} %" PRIu64 "\n", metric, method, (double)bounds[i] / 1e9, below[i]);
+                text += line;
+            }
+            std::snprintf(line, sizeof(line), "%s_bucket{method=\"%s\",le=\"+Inf\"} %" PRIu64 "\n", metric, method, histogram.count());
+            text += line;
+            std::snprintf(line, sizeof(line), "%s_sum{method=\"%s\"} %.9f\n", metric, method, (double)sum / 1e9);
+            text += line;
+            std::snprintf(line, sizeof(line), "%s_count{method=\"%s\"} %" PRIu64 "\n", metric, method, histogram.count());
+            text += line;
+        }
+
+
+        std::string prometheus(const std::vector<MethodStats>& stats)
+        {
+            std::string text;
+            char line[200];
+
+            text += "# HELP arrakis_calls_total Calls of each method while recording.\n";
+            text += "# TYPE arrakis_calls_total counter\n";
+            for (const MethodStats& s : stats)
+            {
+                if (!s.calls) continue;
+                std::snprintf(line, sizeof(line), "arrakis_calls_total{method=\"%s\"} %" PRIu64 "\n", name(s.method), s.calls);
+                text += line;
+            }
+
+            text += "# HELP arrakis_errors_total Failed calls of each method, by status.\n";
+            text += "# TYPE arrakis_errors_total counter\n";
+            for (const MethodStats& s : stats)
+            {
+                for (int j = 1; j < status_count; ++j)
+                {
+                    if (!s.statuses[j]) continue;
+                    std::snprintf(line, sizeof(line), "arrakis_errors_total{method=\"%s\",status=\"%s\"} %" PRIu64 "\n",
+                        name(s.method), status_info((Status)j).name, s.statuses[j]);
+                    text += line;
+                }
+            }
+
+            text += "# HELP arrakis_latency_seconds Time in each method.\n";
+            text += "# TYPE arrakis_latency_seconds histogram\n";
+            for (const MethodStats& s : stats)
+            {
+                if (s.latency.count()) append_histogram(text, "arrakis_latency_seconds", name(s.method), s.latency, s.latency_sum);
+            }
+
+            text += "# HELP arrakis_lock_wait_seconds Time each method waited for the object's mutex.\n";
+            text += "# TYPE arrakis_lock_wait_seconds histogram\n";
+            for (const MethodStats& s : stats)
+            {
+                if (s.lock_wait.count()) append_histogram(text, "arrakis_lock_wait_seconds", name(s.method), s.lock_wait, s.lock_wait_sum);
+            }
+            return text;
+        }
+
+
+#if !defined(ARRAKIS_NO_STATS)
+        static Record* acquire_record()
+        {
+            for (Record* record = records.load(std::memory_order_acquire); record; record = record->next)
+            {
+                bool active = false;
+                if (!record->active.load(std::memory_order_relaxed) &&
+                    record->active.compare_exchange_strong(active, true, std::memory_order_acquire))
+                {
+                    return record;
+                }
+            }
+
+            Record* record = new Record;
+            Record* head = records.load(std::memory_order_relaxed);
+            do
+            {
+                record->next = head;
+            } while (!records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+            return record;
+        }
+
+
+        struct Thread
+        {
+            Record* record = nullptr;
+
+            ~Thread()
+            {
+                if (record) record->active.store(false, std::memory_order_release);
+            }
+        };
+
+        static thread_local Thread thread;
+
+
+        // Null if the record could not be allocated; the call goes uncounted
+        static Tally* tally(Method method) noexcept
+        {
+            if (!thread.record)
+            {
+                try
+                {
+                    thread.record = acquire_record();
+                }
+                catch (...)
+                {
+                    return nullptr;
+                }
+            }
+            return &thread.record->tallies[(int)method];
+        }
+
+
+        int64_t Call::now() noexcept
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+
+        // Most locks are free; only a wait is worth two more clock reads
+
+        void Call::lock_timed(std::mutex& mutex)
+        {
+            int64_t waited = 0;
+            if (!mutex.try_lock())
+            {
+                const int64_t start = now();
+                mutex.lock();
+                waited = now() - start;
+            }
+            if (Tally* t = tally(m_method))
+            {
+                t->lock_wait[layout().bucket(waited)].add(1);
+                t->lock_wait_sum.add((uint64_t)waited);
+            }
+        }
+
+
+        void Call::finish() noexcept
+        {
+            const int64_t elapsed = now() - m_start;
+            Tally* t = tally(m_method);
+            if (!t) return;
+            t->calls.add(1);
+            if (m_status >= 0) t->statuses[m_status].add(1);
+            t->latency[layout().bucket(elapsed)].add(1);
+            t->latency_sum.add((uint64_t)elapsed);
+        }
+
+
+        void record(Method method) noexcept
+        {
+            if (Tally* t = tally(method)) t->calls.add(1);
+        }
+#endif
+    }
+}
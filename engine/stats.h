@@ -0,0 +1,168 @@
+// stats.h: Per-method call counts, errors, latency and lock waits
+#pragma once
+
+#include "histogram.h"
+#include "rules.h"
+#include "trace.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace arrakis
+{
+    // Instrumentation of the members of Arrakeener. While recording is on,
+    // each call counts its method, the status it returns, how long it took
+    // and how long it waited for the object's mutex. Off, which is the
+    // default, a call costs one relaxed load and a branch; building with
+    // ARRAKIS_NO_STATS removes even that.
+    //
+    // Each thread adds to counters of its own, so recording takes no lock
+    // and shares no cache lines; collect() adds up the threads. The counts
+    // of threads that have exited are kept.
+
+    namespace stats
+    {
+        enum class Method : uint8_t
+        {
+            create,                         // Counted, not timed
+            clone,
+            clones,
+            first_name,
+            set_first_name,
+            last_name,
+            set_last_name,
+            affiliation,
+            set_affiliation,
+            occupation,
+            set_occupation,
+            energy,
+            solaris,
+            spice,
+            ledger,
+            names,
+            state,
+            eat_spice,
+            sell_spice,
+            mine_spice,
+            eat_spice_batch,
+            sell_spice_batch,
+            mine_spice_batch,
+            transact
+        };
+
+        constexpr int method_count = (int)Method::transact + 1;
+
+        const char* name(Method method) noexcept;
+
+        // Range and precision of the histograms, in nanoseconds (about 69
+        // seconds, to within 12.5%)
+        const int64_t highest_latency = (int64_t)1 << 36;
+        const unsigned latency_precision = 3;
+
+        extern std::atomic<bool> recording;
+
+        inline bool enabled() noexcept { return recording.load(std::memory_order_relaxed); }
+        void enable(bool on) noexcept;
+
+
+        // Totals of one method over all threads. Values in the histograms are
+        // the tops of their buckets, so percentiles and maxima err high.
+
+        struct MethodStats
+        {
+            Method method;
+            uint64_t calls = 0;
+            uint64_t statuses[status_count] = {};   // For methods that return a Status
+            uint64_t latency_sum = 0;               // Nanoseconds
+            uint64_t lock_wait_sum = 0;
+            Histogram latency{ highest_latency, latency_precision };
+            Histogram lock_wait{ highest_latency, latency_precision };  // 0 when the mutex was free
+        };
+
+        // Every method, in the order of Method. Calls in progress on other
+        // threads may be partly counted.
+        std::vector<MethodStats> collect();
+
+        // One line per method called, for people
+        std::string summary(const std::vector<MethodStats>& stats);
+
+        // Prometheus text exposition format, in seconds
+        std::string prometheus(const std::vector<MethodStats>& stats);
+
+
+        // Records one call from construction to destruction, if recording
+        // was on at the start
+
+#if defined(ARRAKIS_NO_STATS)
+        class Call
+        {
+        public:
+            explicit Call(Method) noexcept {}
+            std::mutex& lock(std::mutex& mutex)
+            {
+                trace::Span span("engine", "lock");
+                mutex.lock();
+                return mutex;
+            }
+            Status result(Status status) noexcept { return status; }
+        };
+
+        inline void count(Method) noexcept {}
+#else
+        class Call
+        {
+            Method m_method;
+            bool m_timed;
+            int8_t m_status;                // -1 until result()
+            int64_t m_start;
+
+            static int64_t now() noexcept;
+            void lock_timed(std::mutex& mutex);
+            void finish() noexcept;
+
+        public:
+            explicit Call(Method method) noexcept :
+                m_method(method),
+                m_timed(enabled()),
+                m_status(-1),
+                m_start(m_timed ? now() : 0)
+            {
+            }
+
+            ~Call()
+            {
+                if (m_timed) finish();
+            }
+
+            Call(const Call&) = delete;
+            Call& operator=(const Call&) = delete;
+
+            // Lock mutex, timing and tracing the wait; for a guard that adopts it
+            std::mutex& lock(std::mutex& mutex)
+            {
+                trace::Span span("engine", "lock");
+                if (m_timed) lock_timed(mutex);
+                else mutex.lock();
+                return mutex;
+            }
+
+            // Note the outcome of the call and pass it on
+            Status result(Status status) noexcept
+            {
+                m_status = (int8_t)status;
+                return status;
+            }
+        };
+
+        void record(Method method) noexcept;
+
+        // Count a call without timing it
+        inline void count(Method method) noexcept
+        {
+            if (enabled()) record(method);
+        }
+#endif
+    }
+}
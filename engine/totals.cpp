@@ -0,0 +1,182 @@
+// totals.cpp: Running totals of the Arrakeeners in each affiliation
+
+#include "totals.h"
+
+namespace arrakis
+{
+    static const Ledger zero = { 0, 0, 0 };
+
+
+    // a - b, wrapping around
+    static Ledger difference(const Ledger& a, const Ledger& b) noexcept
+    {
+        return Ledger
+        {
+            (int64_t)((uint64_t)a.energy - (uint64_t)b.energy),
+            (int64_t)((uint64_t)a.solaris - (uint64_t)b.solaris),
+            (int64_t)((uint64_t)a.spice - (uint64_t)b.spice)
+        };
+    }
+
+
+    // Threads take stripes in turn
+    static std::atomic<unsigned> next_stripe(0);
+    static thread_local unsigned t_stripe = next_stripe.fetch_add(1, std::memory_order_relaxed);
+
+
+    Totals::Totals() :
+        m_chunks(new std::atomic<Chunk*>[max_atoms / chunk_size]()),
+        m_complete(true)
+    {
+    }
+
+
+    Totals::~Totals()
+    {
+        for (uint32_t c = 0; c < max_atoms / chunk_size; ++c) delete m_chunks[c].load(std::memory_order_relaxed);
+    }
+
+
+    // The chunk for an atom id, allocated on first use; null if it is out
+    // of range or cannot be allocated
+
+    Totals::Chunk* Totals::chunk(uint32_t id) noexcept
+    {
+        if (id >= max_atoms)
+        {
+            m_complete.store(false, std::memory_order_relaxed);
+            return nullptr;
+        }
+        std::atomic<Chunk*>& slot = m_chunks[id / chunk_size];
+        Chunk* chunk = slot.load(std::memory_order_acquire);
+        if (chunk) return chunk;
+
+        Chunk* fresh = new (std::nothrow) Chunk;
+        if (!fresh)
+        {
+            m_complete.store(false, std::memory_order_relaxed);
+            return nullptr;
+        }
+        if (slot.compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel, std::memory_order_acquire)) return fresh;
+        delete fresh;
+        return chunk;
+    }
+
+
+    void Totals::add(Atom affiliation, int64_t count, const Ledger& delta) noexcept
+    {
+        const uint32_t id = affiliation.id();
+        Chunk* c = chunk(id);
+        if (!c) return;
+
+        // Remember the atom the first time, so queries can name it
+        std::atomic<bool>& used = c->used[id % chunk_size];
+        if (!used.load(std::memory_order_acquire))
+        {
+            try
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!used.load(std::memory_order_relaxed))
+                {
+                    m_used.push_back(affiliation);
+                    used.store(true, std::memory_order_release);
+                }
+            }
+            catch (...)
+            {
+                m_complete.store(false, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        Sums& sums = c->sums[t_stripe % stripes][id % chunk_size];
+        if (count) sums.count.fetch_add((uint64_t)count, std::memory_order_relaxed);
+        if (delta.energy) sums.energy.fetch_add((uint64_t)delta.energy, std::memory_order_relaxed);
+        if (delta.solaris) sums.solaris.fetch_add((uint64_t)delta.solaris, std::memory_order_relaxed);
+        if (delta.spice) sums.spice.fetch_add((uint64_t)delta.spice, std::memory_order_relaxed);
+    }
+
+
+    Aggregate Totals::affiliation(Atom affiliation) const noexcept
+    {
+        Aggregate aggregate = { affiliation, 0, zero };
+        const uint32_t id = affiliation.id();
+        const Chunk* c = id < max_atoms ? m_chunks[id / chunk_size].load(std::memory_order_acquire) : nullptr;
+        if (!c) return aggregate;
+
+        uint64_t count = 0, energy = 0, solaris = 0, spice = 0;
+        for (unsigned s = 0; s < stripes; ++s)
+        {
+            const Sums& sums = c->sums[s][id % chunk_size];
+            count += sums.count.load(std::memory_order_relaxed);
+            energy += sums.energy.load(std::memory_order_relaxed);
+            solaris += sums.solaris.load(std::memory_order_relaxed);
+            spice += sums.spice.load(std::memory_order_relaxed);
+        }
+        aggregate.count = (int64_t)count;
+        aggregate.totals = Ledger{ (int64_t)energy, (int64_t)solaris, (int64_t)spice };
+        return aggregate;
+    }
+
+
+    std::vector<Aggregate> Totals::by_affiliation() const
+    {
+        std::vector<Atom> used;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            used = m_used;
+        }
+        std::vector<Aggregate> result;
+        result.reserve(used.size());
+        for (Atom atom : used)
+        {
+            Aggregate aggregate = affiliation(atom);
+            if (aggregate.count != 0) result.push_back(aggregate);
+        }
+        return result;
+    }
+
+
+    void Totals::attached(const Arrakeener&, const State& state) noexcept
+    {
+        add(state.names.affiliation, 1, state.ledger);
+    }
+
+
+    // Moving to another affiliation takes the whole ledger along. The
+    // object's mutex is held, so its published ledger is current.
+
+    void Totals::renamed(const Arrakeener& obj, const Names& before, const Names& after) noexcept
+    {
+        if (before.affiliation == after.affiliation) return;
+        const Ledger ledger = obj.current_ledger();
+        add(before.affiliation, -1, difference(zero, ledger));
+        add(after.affiliation, 1, ledger);
+    }
+
+
+    void Totals::changed(const Arrakeener& obj, Change, int64_t, const Ledger& before, const Ledger& after) noexcept
+    {
+        try
+        {
+            add(obj.affiliation_atom(), 0, difference(after, before));
+        }
+        catch (...)
+        {
+            m_complete.store(false, std::memory_order_relaxed);
+        }
+    }
+
+
+    void Totals::detached(const Arrakeener& obj) noexcept
+    {
+        try
+        {
+            add(obj.affiliation_atom(), -1, difference(zero, obj.current_ledger()));
+        }
+        catch (...)
+        {
+            m_complete.store(false, std::memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,94 @@
+// totals.h: Running totals of the Arrakeeners in each affiliation
+#pragma once
+
+#include "core.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace arrakis
+{
+    // Sums over the members of one affiliation
+
+    struct Aggregate
+    {
+        Atom affiliation;
+        int64_t count;
+        Ledger totals;
+    };
+
+
+    // Keeps the number of observed Arrakeeners in each affiliation and the
+    // sums of their ledgers, updated from each change as it is made, so a
+    // query costs a few reads per affiliation whatever the population.
+    //
+    // Counters are split into stripes, and each thread adds to the stripe
+    // it was given, so changes on different threads rarely share a cache
+    // line and never take a lock. A query adds up the stripes; while
+    // changes are in flight it may see some of them and not others, and is
+    // exact once they finish. Sums wrap around rather than overflow.
+    //
+    // Affiliations are indexed by atom id; atoms beyond max_atoms are not
+    // counted, and neither are changes whose memory could not be allocated
+    // (see complete()).
+
+    class Totals : public Observer
+    {
+    public:
+        static const uint32_t max_atoms = 1 << 18;
+
+    private:
+        static const uint32_t chunk_size = 64;
+        static const unsigned stripes = 16;
+
+        struct Sums
+        {
+            std::atomic<uint64_t> count{ 0 };
+            std::atomic<uint64_t> energy{ 0 };
+            std::atomic<uint64_t> solaris{ 0 };
+            std::atomic<uint64_t> spice{ 0 };
+        };
+
+        // Counters for chunk_size atoms, a stripe at a time
+        struct Chunk
+        {
+            Sums sums[stripes][chunk_size];
+            std::atomic<bool> used[chunk_size] = {};
+        };
+
+        std::unique_ptr<std::atomic<Chunk*>[]> m_chunks;
+        mutable std::mutex m_mutex;
+        std::vector<Atom> m_used;           // Affiliations seen so far, by first use
+        std::atomic<bool> m_complete;
+
+        Chunk* chunk(uint32_t id) noexcept;
+        void add(Atom affiliation, int64_t count, const Ledger& delta) noexcept;
+
+    public:
+        Totals();
+        ~Totals();                          // Objects must be detached first
+        Totals(const Totals&) = delete;
+        Totals& operator=(const Totals&) = delete;
+
+        // Start counting obj and its future clones
+        void attach(Arrakeener& obj) { obj.observe(this); }
+
+        // Every affiliation with members, in order of first use
+        std::vector<Aggregate> by_affiliation() const;
+
+        // One affiliation, which may have no members
+        Aggregate affiliation(Atom affiliation) const noexcept;
+
+        // False if some change could not be counted
+        bool complete() const noexcept { return m_complete.load(std::memory_order_relaxed); }
+
+        // Observer
+        void attached(const Arrakeener& obj, const State& state) noexcept override;
+        void renamed(const Arrakeener& obj, const Names& before, const Names& after) noexcept override;
+        void changed(const Arrakeener& obj, Change change, int64_t arg, const Ledger& before, const Ledger& after) noexcept override;
+        void detached(const Arrakeener& obj) noexcept override;
+    };
+}
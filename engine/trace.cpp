@@ -0,0 +1,261 @@
+// trace.cpp: Spans of time for the Chrome and Perfetto trace viewers
+
+#include "trace.h"
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <mutex>
+#include <system_error>
+#include <vector>
+
+namespace arrakis
+{
+    namespace trace
+    {
+        std::atomic<bool> tracing(false);
+
+
+        void enable(bool on) noexcept
+        {
+            tracing.store(on, std::memory_order_relaxed);
+        }
+
+
+        // Atomic so that a flush may copy a span as it is overwritten; the
+        // copy is then thrown away
+        struct Event
+        {
+            std::atomic<const char*> category{ nullptr };
+            std::atomic<const char*> name{ nullptr };
+            std::atomic<int64_t> start{ 0 };
+            std::atomic<int64_t> duration{ 0 };
+        };
+
+
+        // The spans of one thread. Rings live on a global, grow-only list; a
+        // thread claims one on its first span and gives it back when it
+        // exits, and the next thread to claim it carries on where it left
+        // off, under the same thread id.
+        //
+        // Span i goes in events[i % ring_size]. The thread bumps begun before
+        // writing a span and written after, like the sequence of a seqlock;
+        // a flush keeps only spans that no write can have overlapped.
+
+        struct Ring
+        {
+            Event events[ring_size];
+            std::atomic<uint64_t> begun{ 0 };
+            std::atomic<uint64_t> written{ 0 };
+            uint64_t flushed = 0;           // Under flush_mutex
+            uint32_t tid;
+            std::atomic<bool> active{ true };
+            Ring* next = nullptr;
+
+            explicit Ring(uint32_t id) noexcept : tid(id) {}
+        };
+
+        static_assert((ring_size & (ring_size - 1)) == 0, "ring_size must be a power of two");
+
+        static std::atomic<Ring*> rings(nullptr);
+        static std::atomic<uint32_t> ring_count(0);
+        static std::mutex flush_mutex;
+        static std::atomic<uint64_t> lost(0);
+
+
+        struct Copy
+        {
+            const char* category;
+            const char* name;
+            int64_t start;
+            int64_t duration;
+            uint32_t tid;
+        };
+
+
+        // Copy the spans written since the last flush, oldest first
+        static void drain(Ring& ring, std::vector<Copy>& out)
+        {
+            const uint64_t written = ring.written.load(std::memory_order_acquire);
+            uint64_t from = written > ring_size ? written - ring_size : 0;
+            if (from < ring.flushed) from = ring.flushed;
+            const size_t first = out.size();
+            for (uint64_t i = from; i < written; ++i)
+            {
+                const Event& e = ring.events[i & (ring_size - 1)];
+                out.push_back(Copy
+                {
+                    e.category.load(std::memory_order_relaxed),
+                    e.name.load(std::memory_order_relaxed),
+                    e.start.load(std::memory_order_relaxed),
+                    e.duration.load(std::memory_order_relaxed),
+                    ring.tid
+                });
+            }
+
+            // Spans the thread has since begun to overwrite are not to be trusted
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t begun = ring.begun.load(std::memory_order_relaxed);
+            const uint64_t valid = begun > ring_size ? begun - ring_size : 0;
+            size_t torn = 0;
+            if (valid > from) torn = (size_t)(valid - from < written - from ? valid - from : written - from);
+            out.erase(out.begin() + first, out.begin() + first + torn);
+
+            lost.fetch_add((from - ring.flushed) + torn, std::memory_order_relaxed);
+            ring.flushed = written;
+        }
+
+
+        static void append_string(std::string& text, const char* s)
+        {
+            text += '"';
+            for (; s && *s; ++s)
+            {
+                if (*s == '"' || *s == '\\') text += '\\';
+                text += *s;
+            }
+            text += '"';
+        }
+
+
+        // Microseconds, to the nanosecond
+        static void append_time(std::string& text, int64_t ns)
+        {
+            char number[32];
+            std::snprintf(number, sizeof(number), "%" PRId64 ".%03d", ns / 1000, (int)(ns % 1000));
+            text += number;
+        }
+
+
+        // Room for the end of the document, the dropped count included
+        static const size_t tail_size = 96;
+
+
+        std::string flush(size_t max_size)
+        {
+            std::vector<Copy> spans;
+            {
+                std::lock_guard<std::mutex> lock(flush_mutex);
+                for (Ring* ring = rings.load(std::memory_order_acquire); ring; ring = ring->next) drain(*ring, spans);
+            }
+
+            std::string text = "{\"traceEvents\":[";
+            char ids[64];
+            size_t i = 0;
+            for (; i < spans.size(); ++i)
+            {
+                const Copy& span = spans[i];
+                const size_t before = text.size();
+                text += i ? ",\n{\"name\":" : "\n{\"name\":";
+                append_string(text, span.name);
+                text += ",\"cat\":";
+                append_string(text, span.category);
+                std::snprintf(ids, sizeof(ids), ",\"ph\":\"X\",\"pid\":1,\"tid\":%" PRIu32 ",\"ts\":", span.tid);
+                text += ids;
+                append_time(text, span.start);
+                text += ",\"dur\":";
+                append_time(text, span.duration);
+                text += '}';
+                if (text.size() + tail_size > max_size)
+                {
+                    text.resize(before);
+                    break;
+                }
+            }
+            const uint64_t dropped_now = lost.fetch_add(spans.size() - i, std::memory_order_relaxed) + (spans.size() - i);
+            std::snprintf(ids, sizeof(ids), "%" PRIu64, dropped_now);
+            text += "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":";
+            text += ids;
+            text += "}}\n";
+            return text;
+        }
+
+
+        void flush(const std::string& path)
+        {
+            const std::string text = flush();
+            std::FILE* file = std::fopen(path.c_str(), "wb");
+            if (!file) throw std::system_error(errno, std::generic_category(), path);
+            const bool ok = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+            if (std::fclose(file) != 0 || !ok) throw std::system_error(EIO, std::generic_category(), path);
+        }
+
+
+        uint64_t dropped() noexcept
+        {
+            return lost.load(std::memory_order_relaxed);
+        }
+
+
+#if !defined(ARRAKIS_NO_TRACE)
+        static Ring* acquire_ring()
+        {
+            for (Ring* ring = rings.load(std::memory_order_acquire); ring; ring = ring->next)
+            {
+                bool active = false;
+                if (!ring->active.load(std::memory_order_relaxed) &&
+                    ring->active.compare_exchange_strong(active, true, std::memory_order_acquire))
+                {
+                    return ring;
+                }
+            }
+
+            Ring* ring = new Ring(ring_count.fetch_add(1, std::memory_order_relaxed) + 1);
+            Ring* head = rings.load(std::memory_order_relaxed);
+            do
+            {
+                ring->next = head;
+            } while (!rings.compare_exchange_weak(head, ring, std::memory_order_release, std::memory_order_relaxed));
+            return ring;
+        }
+
+
+        struct Thread
+        {
+            Ring* ring = nullptr;
+
+            ~Thread()
+            {
+                if (ring) ring->active.store(false, std::memory_order_release);
+            }
+        };
+
+        static thread_local Thread thread;
+
+
+        int64_t Span::now() noexcept
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+
+        // The span is lost if the ring cannot be allocated
+        void Span::finish() noexcept
+        {
+            const int64_t end = now();
+            if (!thread.ring)
+            {
+                try
+                {
+                    thread.ring = acquire_ring();
+                }
+                catch (...)
+                {
+                    return;
+                }
+            }
+
+            Ring& ring = *thread.ring;
+            const uint64_t i = ring.written.load(std::memory_order_relaxed);
+            ring.begun.store(i + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            Event& e = ring.events[i & (ring_size - 1)];
+            e.category.store(m_category, std::memory_order_relaxed);
+            e.name.store(m_name, std::memory_order_relaxed);
+            e.start.store(m_start, std::memory_order_relaxed);
+            e.duration.store(end - m_start, std::memory_order_relaxed);
+            ring.written.store(i + 1, std::memory_order_release);
+        }
+#endif
+    }
+}
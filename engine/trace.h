@@ -0,0 +1,89 @@
+// trace.h: Spans of time for the Chrome and Perfetto trace viewers
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace arrakis
+{
+    // Scoped spans, such as a wait for a lock or the creation of an object,
+    // kept while tracing is on and written as Chrome trace-event JSON. Off,
+    // which is the default, a span costs one relaxed load and a branch;
+    // building with ARRAKIS_NO_TRACE removes even that.
+    //
+    // Each thread writes its spans to a ring of its own without a lock.
+    // A thread that outruns the ring overwrites its oldest spans unwritten;
+    // they are counted as dropped.
+
+    namespace trace
+    {
+        const size_t ring_size = 65536;     // Spans kept per thread, 2 MB; a power of two
+
+        extern std::atomic<bool> tracing;
+
+        inline bool enabled() noexcept { return tracing.load(std::memory_order_relaxed); }
+        void enable(bool on) noexcept;
+
+        // Take every span kept since the last flush, as a trace-event JSON
+        // document with a "dropped" count in its metadata. Spans that would
+        // make it longer than max_size bytes are left out and counted as
+        // dropped.
+        std::string flush(size_t max_size = SIZE_MAX);
+
+        // Flush to a file, replacing it; throws std::system_error
+        void flush(const std::string& path);
+
+        // Spans lost to full rings, as found by the flushes so far
+        uint64_t dropped() noexcept;
+
+
+        // Records the time from construction to destruction, if tracing was
+        // on at the start. The names must be string literals, or otherwise
+        // outlive the next flush.
+
+#if defined(ARRAKIS_NO_TRACE)
+        class Span
+        {
+        public:
+            Span(const char*, const char*) noexcept {}
+            void end() noexcept {}
+        };
+#else
+        class Span
+        {
+            const char* m_category;
+            const char* m_name;
+            int64_t m_start;                // -1 when not tracing
+
+            static int64_t now() noexcept;
+            void finish() noexcept;
+
+        public:
+            Span(const char* category, const char* name) noexcept :
+                m_category(category),
+                m_name(name),
+                m_start(enabled() ? now() : -1)
+            {
+            }
+
+            ~Span()
+            {
+                end();
+            }
+
+            Span(const Span&) = delete;
+            Span& operator=(const Span&) = delete;
+
+            // End the span before the end of its scope
+            void end() noexcept
+            {
+                if (m_start < 0) return;
+                finish();
+                m_start = -1;
+            }
+        };
+#endif
+    }
+}
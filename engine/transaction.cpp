@@ -0,0 +1,78 @@
+// transaction.cpp: Compound operations applied all or nothing
+
+#include "transaction.h"
+
+namespace arrakis
+{
+    bool valid(const Step& step) noexcept
+    {
+        if (step.op > Op::mine) return false;
+        if (step.condition.field > Field::spice) return false;
+        if (step.condition.compare > Compare::greater_equal) return false;
+        if (step.max_runs < 1 || step.max_runs > max_step_runs) return false;
+        if (step.arg == all_spice && step.op == Op::mine) return false;
+        return true;
+    }
+
+
+    static bool holds(const Ledger& ledger, const Condition& condition) noexcept
+    {
+        int64_t value = 0;
+        switch (condition.field)
+        {
+        case Field::energy: value = ledger.energy; break;
+        case Field::solaris: value = ledger.solaris; break;
+        case Field::spice: value = ledger.spice; break;
+        }
+
+        switch (condition.compare)
+        {
+        case Compare::always: return true;
+        case Compare::less: return value < condition.value;
+        case Compare::less_equal: return value <= condition.value;
+        case Compare::greater: return value > condition.value;
+        case Compare::greater_equal: return value >= condition.value;
+        }
+        return false;
+    }
+
+
+    static Status run(Ledger& ledger, Rng& rng, const Step& step, int64_t& delta) noexcept
+    {
+        const int64_t arg = step.arg == all_spice ? ledger.spice : step.arg;
+        switch (step.op)
+        {
+        case Op::eat: return eat_spice(ledger, rng, arg, delta);
+        case Op::sell: return sell_spice(ledger, rng, arg, delta);
+        case Op::mine: return mine_spice(ledger, rng, arg, delta);
+        }
+        return Status::overflow;
+    }
+
+
+    Status transact(Ledger& ledger, Rng& rng, const Step* steps, size_t n, StepResult* results, size_t& failed) noexcept
+    {
+        const Ledger saved = ledger;
+        for (size_t i = 0; i < n; ++i)
+        {
+            assert(valid(steps[i]));
+            results[i] = StepResult{ 0, 0 };
+            while (results[i].runs < steps[i].max_runs && holds(ledger, steps[i].condition))
+            {
+                int64_t delta = 0;
+                const Status status = run(ledger, rng, steps[i], delta);
+                if (status != Status::ok)
+                {
+                    // Roll back
+                    ledger = saved;
+                    for (size_t j = 0; j < n; ++j) results[j] = StepResult{ 0, 0 };
+                    failed = i;
+                    return status;
+                }
+                results[i].delta += delta;  // Bounded by the counter it was added to
+                ++results[i].runs;
+            }
+        }
+        return Status::ok;
+    }
+}
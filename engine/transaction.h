@@ -0,0 +1,78 @@
+// transaction.h: Compound operations applied all or nothing
+#pragma once
+
+#include "rules.h"
+#include <cstddef>
+
+namespace arrakis
+{
+    enum class Op : uint8_t
+    {
+        eat,
+        sell,
+        mine
+    };
+
+    enum class Field : uint8_t
+    {
+        energy,
+        solaris,
+        spice
+    };
+
+    enum class Compare : uint8_t
+    {
+        always,
+        less,
+        less_equal,
+        greater,
+        greater_equal
+    };
+
+
+    // Test of one counter of the ledger, e.g., spice < 100
+
+    struct Condition
+    {
+        Field field;
+        Compare compare;
+        int64_t value;
+    };
+
+
+    // Apply an operation while the condition holds, at most max_runs times.
+    // The condition is tested before each run, so a step whose condition is
+    // false from the start does nothing. With Compare::always the step runs
+    // exactly max_runs times.
+
+    struct Step
+    {
+        Op op;
+        int64_t arg;                        // Units or harvesters, or all_spice
+        Condition condition;
+        uint32_t max_runs;
+    };
+
+    constexpr int64_t all_spice = INT64_MIN;    // Eat or sell every unit held
+    constexpr uint32_t max_step_runs = 1024;    // Bounds the time under the lock
+
+    // What one step did: the sum of the deltas of its runs
+    // The delta is energy for eat, solaris for sell and spice for mine.
+
+    struct StepResult
+    {
+        int64_t delta;
+        uint32_t runs;
+    };
+
+    // Op, field and compare are in range, max_runs is 1..max_step_runs, and
+    // all_spice is only used with eat and sell
+    bool valid(const Step& step) noexcept;
+
+    // Apply the steps in order with the same rules as the single operations.
+    // If any run fails, the ledger is restored, every result is zero, failed
+    // is the index of the step, and the status of the failing run is
+    // returned. Random draws are consumed either way. Steps must be valid.
+
+    Status transact(Ledger& ledger, Rng& rng, const Step* steps, size_t n, StepResult* results, size_t& failed) noexcept;
+}
@@ -0,0 +1,137 @@
+// client.cpp: Client of the socket server
+
+#include "client.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace arrakis
+{
+    using namespace protocol;
+
+
+    Client::Client(const std::string& path) :
+        m_fd(-1),
+        m_start(0),
+        m_next_tag(0)
+    {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) throw std::system_error(ENAMETOOLONG, std::generic_category(), path);
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (m_fd < 0) throw std::system_error(errno, std::generic_category(), path);
+        if (connect(m_fd, (const sockaddr*)&address, sizeof(address)) < 0)
+        {
+            const int error = errno;
+            ::close(m_fd);
+            throw std::system_error(error, std::generic_category(), path);
+        }
+    }
+
+
+    Client::~Client()
+    {
+        ::close(m_fd);
+    }
+
+
+    uint32_t Client::send(Request request)
+    {
+        request.tag = m_next_tag++;
+        encode(request, m_out);
+        return request.tag;
+    }
+
+
+    // Read what has arrived, waiting for something if asked; false if
+    // nothing was read
+
+    bool Client::fill(bool wait)
+    {
+        if (m_start > 0 && m_start == m_in.size())
+        {
+            m_in.clear();
+            m_start = 0;
+        }
+        uint8_t buffer[64 * 1024];
+        for (;;)
+        {
+            const ssize_t got = recv(m_fd, buffer, sizeof(buffer), wait ? 0 : MSG_DONTWAIT);
+            if (got > 0)
+            {
+                m_in.insert(m_in.end(), buffer, buffer + got);
+                return true;
+            }
+            if (got == 0) throw std::runtime_error("connection closed by the server");
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return false;
+            throw std::system_error(errno, std::generic_category(), "recv");
+        }
+    }
+
+
+    // Write while reading whatever comes back, so that neither side can
+    // wait on the other
+
+    void Client::flush()
+    {
+        size_t sent = 0;
+        while (sent < m_out.size())
+        {
+            pollfd events = { m_fd, POLLIN | POLLOUT, 0 };
+            if (poll(&events, 1, -1) < 0)
+            {
+                if (errno == EINTR) continue;
+                throw std::system_error(errno, std::generic_category(), "poll");
+            }
+            if (events.revents & POLLIN) fill(false);
+            if (events.revents & (POLLOUT | POLLERR | POLLHUP))
+            {
+                const ssize_t put = ::send(m_fd, m_out.data() + sent, m_out.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (put < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) throw std::system_error(errno, std::generic_category(), "send");
+                if (put > 0) sent += (size_t)put;
+            }
+        }
+        m_out.clear();
+    }
+
+
+    bool Client::try_receive(Response& response)
+    {
+        for (;;)
+        {
+            const size_t size = frame_size(m_in.data() + m_start, m_in.size() - m_start);
+            if (size != 0 && size <= m_in.size() - m_start)
+            {
+                if (!decode(m_in.data() + m_start, size, response)) throw std::runtime_error("malformed response");
+                m_start += size;
+                return true;
+            }
+            if (size > max_response) throw std::runtime_error("malformed response");
+            if (!fill(false)) return false;
+        }
+    }
+
+
+    Response Client::receive()
+    {
+        flush();
+        Response response;
+        while (!try_receive(response)) fill(true);
+        return response;
+    }
+
+
+    Response Client::call(const Request& request)
+    {
+        send(request);
+        return receive();
+    }
+}
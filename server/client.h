@@ -0,0 +1,53 @@
+// client.h: Client of the socket server
+#pragma once
+
+#include "protocol.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace arrakis
+{
+    // A connection to a Server, for tests, benchmarks and tools. Requests
+    // are buffered until flush() or receive(), so many can be sent before
+    // any response is read; responses that arrive while flushing are kept
+    // for receive(), so a long pipeline cannot deadlock against the
+    // server's limit on unsent responses. Not thread safe. Throws
+    // std::system_error if the connection fails, and std::runtime_error if
+    // the server closes it or sends a malformed response.
+
+    class Client
+    {
+        int m_fd;
+        std::vector<uint8_t> m_out;         // Not yet sent
+        std::vector<uint8_t> m_in;          // m_in[m_start, size) received, not yet returned
+        size_t m_start;
+        uint32_t m_next_tag;
+
+        bool fill(bool wait);
+
+    public:
+        explicit Client(const std::string& path);
+        ~Client();
+        Client(const Client&) = delete;
+        Client& operator=(const Client&) = delete;
+
+        // Buffer a request, tagged with the next tag; returns the tag
+        uint32_t send(protocol::Request request);
+
+        // Send everything buffered
+        void flush();
+
+        // Flush, then wait for the next response
+        protocol::Response receive();
+
+        // Take a response that has already arrived, without waiting
+        bool try_receive(protocol::Response& response);
+
+        // One round trip; earlier requests must have been received
+        protocol::Response call(const protocol::Request& request);
+
+        int fd() const noexcept { return m_fd; }  // For waiting on several clients at once
+    };
+}
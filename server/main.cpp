@@ -0,0 +1,103 @@
+// main.cpp: arrakisd, the socket server as a process
+// Usage: arrakisd [--journal file] <socket path> [reactors [snapshot]]
+// With a snapshot, serves the objects saved there, if it exists, and saves
+// every object back to it on SIGINT or SIGTERM. With a journal instead,
+// recreates the objects recorded there and records every change from then
+// on, so that they survive a crash.
+
+#include "journal.h"
+#include "rng.h"
+#include "server.h"
+#include "stats.h"
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <pthread.h>
+
+int main(int argc, char* argv[])
+{
+    const char* program = argv[0];
+    std::string journal_path;
+    if (argc > 2 && std::strcmp(argv[1], "--journal") == 0)
+    {
+        journal_path = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 2 || argc > 4 || (!journal_path.empty() && argc > 3))
+    {
+        std::fprintf(stderr, "usage: %s [--journal file] <socket path> [reactors [snapshot]]\n"
+                             "a journal and a snapshot cannot be combined\n", program);
+        return 2;
+    }
+    std::unique_ptr<arrakis::Journal> journal;  // Outlives every object
+    arrakis::Server::Options options;
+    options.reactors = argc > 2 ? (unsigned)std::strtoul(argv[2], nullptr, 10) : 0;
+    const std::string snapshot = argc > 3 ? argv[3] : "";
+    struct stat status;
+    if (!snapshot.empty() && stat(snapshot.c_str(), &status) == 0) options.snapshot = snapshot;
+
+    // Block the stop signals before any thread starts, then wait for one
+    sigset_t stop;
+    sigemptyset(&stop);
+    sigaddset(&stop, SIGINT);
+    sigaddset(&stop, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop, nullptr);
+
+    // Two clock reads a call are little beside a round trip on the socket
+    arrakis::stats::enable(true);
+
+    try
+    {
+        // The objects recorded take the first handles, in the order created,
+        // and start the new journal. The old one is kept until the server
+        // starts, so that failing to start loses nothing.
+        if (!journal_path.empty())
+        {
+            arrakis::Replay replay = arrakis::Journal::recover(journal_path);
+            if (!replay.complete)
+            {
+                std::fprintf(stderr, "%s: %s: replayed %zu records; the rest is torn\n",
+                             program, journal_path.c_str(), replay.records);
+            }
+            std::vector<arrakis::State> states = replay.take();
+            journal.reset(new arrakis::Journal(journal_path));
+            journal->restore([&]
+            {
+                const uint64_t seed = arrakis::Rng().next();
+                for (size_t i = 0; i < states.size(); ++i)
+                {
+                    auto obj = std::make_shared<arrakis::Arrakeener>(std::move(states[i].names), states[i].ledger, seed + i);
+                    journal->attach(*obj);
+                    options.objects.push_back(std::move(obj));
+                }
+            });
+            options.observer = journal.get();
+        }
+        arrakis::Server server(argv[1], options);
+        options.objects.clear();            // Released objects are destroyed
+        if (journal) arrakis::Journal::recovered(journal_path);
+
+        // Stop before saving, so that no request changes what is saved, and
+        // close the journal before the objects go, so that they are not
+        // recorded as destroyed
+        int signal = 0;
+        sigwait(&stop, &signal);
+        server.stop();
+        if (journal) journal->close();
+        if (!snapshot.empty()) server.save(snapshot);
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s: %s\n", program, e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+// protocol.cpp: Binary protocol of the socket server
+
+#include "protocol.h"
+
+namespace arrakis
+{
+    namespace protocol
+    {
+        using namespace encoding;
+
+
+        // Fill in the size once the frame is complete
+
+        static size_t begin_frame(std::vector<uint8_t>& out, uint32_t tag)
+        {
+            const size_t start = out.size();
+            put_u32(out, 0);
+            put_u32(out, tag);
+            return start;
+        }
+
+
+        static void end_frame(std::vector<uint8_t>& out, size_t start) noexcept
+        {
+            const uint32_t size = (uint32_t)(out.size() - start - 4);
+            for (int i = 0; i < 4; ++i) out[start + i] = (uint8_t)(size >> (8 * i));
+        }
+
+
+        static bool has_handle(Method method) noexcept
+        {
+            return method != Method::create && method != Method::stats && method != Method::trace;
+        }
+
+
+        size_t frame_size(const uint8_t* data, size_t size) noexcept
+        {
+            if (size < 4) return 0;
+            return 4 + ((size_t)data[0] | ((size_t)data[1] << 8) | ((size_t)data[2] << 16) | ((size_t)data[3] << 24));
+        }
+
+
+        void encode(const Request& request, std::vector<uint8_t>& out)
+        {
+            const size_t start = begin_frame(out, request.tag);
+            put_u8(out, (uint8_t)request.method);
+            if (has_handle(request.method)) put_i64(out, (int64_t)request.handle);
+            switch (request.method)
+            {
+            case Method::get:
+                put_u8(out, (uint8_t)request.property);
+                break;
+            case Method::put:
+                put_u8(out, (uint8_t)request.property);
+                put_string(out, request.text);
+                break;
+            case Method::eat:
+            case Method::sell:
+            case Method::mine:
+                put_i64(out, request.arg);
+                break;
+            case Method::stats:
+                put_u8(out, (uint8_t)request.format);
+                break;
+            case Method::trace:
+                put_u8(out, request.on ? 1 : 0);
+                break;
+            default:
+                break;
+            }
+            end_frame(out, start);
+        }
+
+
+        void encode(const Response& response, std::vector<uint8_t>& out)
+        {
+            const size_t start = begin_frame(out, response.tag);
+            put_u8(out, response.status);
+            if (response.status == 0)
+            {
+                put_u8(out, (uint8_t)response.payload);
+                if (response.payload == Payload::integer) put_i64(out, response.value);
+                if (response.payload == Payload::text) put_string(out, response.text);
+            }
+            end_frame(out, start);
+        }
+
+
+        bool decode(const uint8_t* frame, size_t size, Request& request)
+        {
+            if (size < 4 || frame_size(frame, size) != size) return false;
+            Reader reader(frame + 4, size - 4);
+            request.tag = reader.get_u32();
+            const uint8_t method = reader.get_u8();
+            if (method > (uint8_t)Method::trace) return false;
+            request.method = (Method)method;
+            if (has_handle(request.method)) request.handle = (uint64_t)reader.get_i64();
+            switch (request.method)
+            {
+            case Method::get:
+            case Method::put:
+                {
+                    const uint8_t property = reader.get_u8();
+                    if (property > (uint8_t)Property::spice) return false;
+                    request.property = (Property)property;
+                    if (request.method == Method::put)
+                    {
+                        if (request.property > Property::occupation) return false;
+                        request.text = reader.get_string();
+                    }
+                }
+                break;
+            case Method::eat:
+            case Method::sell:
+            case Method::mine:
+                request.arg = reader.get_i64();
+                break;
+            case Method::stats:
+                {
+                    const uint8_t format = reader.get_u8();
+                    if (format > (uint8_t)Format::prometheus) return false;
+                    request.format = (Format)format;
+                }
+                break;
+            case Method::trace:
+                {
+                    const uint8_t on = reader.get_u8();
+                    if (on > 1) return false;
+                    request.on = on != 0;
+                }
+                break;
+            default:
+                break;
+            }
+            return reader.ok() && reader.remaining() == 0;
+        }
+
+
+        bool decode(const uint8_t* frame, size_t size, Response& response)
+        {
+            if (size < 4 || frame_size(frame, size) != size) return false;
+            Reader reader(frame + 4, size - 4);
+            response.tag = reader.get_u32();
+            response.status = reader.get_u8();
+            response.payload = Payload::none;
+            if (response.status == 0)
+            {
+                const uint8_t payload = reader.get_u8();
+                if (payload > (uint8_t)Payload::text) return false;
+                response.payload = (Payload)payload;
+                if (response.payload == Payload::integer) response.value = reader.get_i64();
+                if (response.payload == Payload::text) response.text = reader.get_string();
+            }
+            return reader.ok() && reader.remaining() == 0;
+        }
+    }
+}
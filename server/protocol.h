@@ -0,0 +1,122 @@
+// protocol.h: Binary protocol of the socket server
+#pragma once
+
+#include "encoding.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace arrakis
+{
+    // Requests and responses are frames of
+    //   u32 size of the rest, u32 tag, body
+    // in the types of encoding.h. The server answers the requests of a
+    // connection in order, so a client may send many before reading any
+    // (pipelining); the tag is echoed back to match them up.
+    //
+    // Request bodies are a u8 method followed by
+    //   create                                   (returns a handle)
+    //   release  i64 handle
+    //   get      i64 handle, u8 property         (returns the value)
+    //   put      i64 handle, u8 property, string (a name property)
+    //   eat      i64 handle, i64 units           (returns the energy delta)
+    //   sell     i64 handle, i64 units           (returns the solaris delta)
+    //   mine     i64 handle, i64 harvesters      (returns the spice delta)
+    //   clone    i64 handle                      (returns the new handle)
+    //   stats    u8 format                       (returns the engine's statistics
+    //                                             as text; see stats.h)
+    //   trace    u8 on                           (starts tracing, or stops it and
+    //                                             returns what was traced as
+    //                                             text; see trace.h)
+    //
+    // Response bodies are a u8 status: a Status of the engine, or one of
+    // the protocol errors below. A response with status ok carries a value:
+    //   u8 0, nothing; u8 1, i64; or u8 2, string.
+    // Objects belong to the server, not the connection, so any connection
+    // may use a handle until some connection releases it. Responses may be
+    // longer than requests, for the statistics and traces.
+
+    namespace protocol
+    {
+        enum class Method : uint8_t
+        {
+            create,
+            release,
+            get,
+            put,
+            eat,
+            sell,
+            mine,
+            clone,
+            stats,
+            trace
+        };
+
+        enum class Property : uint8_t
+        {
+            first_name,
+            last_name,
+            affiliation,
+            occupation,
+            energy,
+            solaris,
+            spice
+        };
+
+        enum class Format : uint8_t
+        {
+            summary,                        // stats::summary
+            prometheus                      // stats::prometheus
+        };
+
+        // Statuses beyond the engine's
+        const uint8_t bad_request = 128;    // Malformed, or an unknown method or property
+        const uint8_t no_object = 129;      // The handle is not live
+        const uint8_t server_error = 130;   // Out of memory, for example
+
+        const uint32_t max_frame = 64 * 1024;   // Including the size; larger frames end the connection
+        const uint32_t max_response = 64 * 1024 * 1024;    // A trace is cut to fit
+
+        struct Request
+        {
+            uint32_t tag = 0;
+            Method method = Method::create;
+            uint64_t handle = 0;
+            Property property = Property::first_name;
+            Format format = Format::summary;
+            bool on = false;                // For trace
+            int64_t arg = 0;
+            std::wstring text;              // For put
+        };
+
+        enum class Payload : uint8_t
+        {
+            none,
+            integer,
+            text
+        };
+
+        struct Response
+        {
+            uint32_t tag = 0;
+            uint8_t status = 0;
+            Payload payload = Payload::none;
+            int64_t value = 0;
+            std::wstring text;
+        };
+
+        // Size of the frame at the start of data, or 0 if not even its size
+        // has arrived yet
+        size_t frame_size(const uint8_t* data, size_t size) noexcept;
+
+        // Append a frame to out
+        void encode(const Request& request, std::vector<uint8_t>& out);
+        void encode(const Response& response, std::vector<uint8_t>& out);
+
+        // Decode one whole frame; false if it is malformed. A malformed
+        // request still yields its tag when the frame is long enough.
+        bool decode(const uint8_t* frame, size_t size, Request& request);
+        bool decode(const uint8_t* frame, size_t size, Response& response);
+    }
+}
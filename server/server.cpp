@@ -0,0 +1,614 @@
+// server.cpp: Arrakeeners served over a Unix domain socket
+
+#include "server.h"
+#include "stats.h"
+#include "trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace arrakis
+{
+    using namespace protocol;
+
+    static const size_t read_size = 64 * 1024;      // Asked of each read
+    static const int max_events = 64;
+
+
+    struct Server::Connection
+    {
+        int fd;
+        std::vector<uint8_t> in;            // in[0, used) received, not yet run
+        size_t used = 0;
+        std::vector<uint8_t> out;           // out[sent, size) not yet sent
+        size_t sent = 0;
+        uint32_t interest = EPOLLIN;        // Events registered with epoll
+    };
+
+
+    // Events carry a Connection*, null for the listener, or &wake
+
+    struct Server::Reactor
+    {
+        int epoll = -1;
+        int wake = -1;                      // eventfd, readable when stopping
+        std::unordered_map<Connection*, std::unique_ptr<Connection>> connections;
+        std::thread thread;
+    };
+
+
+    static Server::Options options(unsigned reactors, Observer* observer)
+    {
+        Server::Options result;
+        result.reactors = reactors;
+        result.observer = observer;
+        return result;
+    }
+
+
+    Server::Server(const std::string& path, unsigned reactors, Observer* observer) :
+        Server(path, options(reactors, observer))
+    {
+    }
+
+
+    Server::Server(const std::string& path, const Options& options) :
+        m_path(path),
+        m_observer(options.observer),
+        m_max_unsent(options.max_unsent),
+        m_saved(0),
+        m_listener(-1),
+        m_next_handle(1),
+        m_connections(0)
+    {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) throw std::system_error(ENAMETOOLONG, std::generic_category(), path);
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        unsigned reactors = options.reactors;
+        if (reactors == 0) reactors = std::thread::hardware_concurrency();
+        if (reactors == 0) reactors = 1;
+
+        // Saved objects take the first handles
+        if (!options.snapshot.empty())
+        {
+            m_snapshot.reset(new Snapshot(options.snapshot));
+            m_taken.reset(new uint8_t[m_snapshot->size()]());
+            m_saved.store(m_snapshot->size(), std::memory_order_relaxed);
+            m_next_handle.store(m_snapshot->size() + 1, std::memory_order_relaxed);
+        }
+        for (const auto& obj : options.objects) insert(obj);
+
+        try
+        {
+            // Replace a socket left by a server that did not shut down, but
+            // nothing else
+            struct stat status;
+            if (lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) unlink(path.c_str());
+
+            m_listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (m_listener < 0) throw std::system_error(errno, std::generic_category(), path);
+            if (bind(m_listener, (const sockaddr*)&address, sizeof(address)) < 0 || listen(m_listener, SOMAXCONN) < 0)
+            {
+                const int error = errno;
+                ::close(m_listener);
+                m_listener = -1;
+                throw std::system_error(error, std::generic_category(), path);
+            }
+
+            for (unsigned i = 0; i < reactors; ++i)
+            {
+                m_reactors.emplace_back(new Reactor);
+                Reactor& reactor = *m_reactors.back();
+                reactor.epoll = epoll_create1(EPOLL_CLOEXEC);
+                reactor.wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (reactor.epoll < 0 || reactor.wake < 0) throw std::system_error(errno, std::generic_category(), "epoll");
+
+                // Exclusive, so a new connection wakes one reactor rather than all
+                epoll_event event = {};
+                event.events = EPOLLIN | EPOLLEXCLUSIVE;
+                event.data.ptr = nullptr;
+                if (epoll_ctl(reactor.epoll, EPOLL_CTL_ADD, m_listener, &event) < 0) throw std::system_error(errno, std::generic_category(), "epoll");
+                event.events = EPOLLIN;
+                event.data.ptr = &reactor.wake;
+                if (epoll_ctl(reactor.epoll, EPOLL_CTL_ADD, reactor.wake, &event) < 0) throw std::system_error(errno, std::generic_category(), "epoll");
+            }
+
+            for (auto& reactor : m_reactors)
+            {
+                Reactor* r = reactor.get();
+                reactor->thread = std::thread([this, r] { run(*r); });
+            }
+        }
+        catch (...)
+        {
+            stop();
+            throw;
+        }
+    }
+
+
+    Server::~Server()
+    {
+        stop();
+        for (Shard& shard : m_shards) shard.objects.clear();
+    }
+
+
+    // Stop the reactors, then close everything they owned
+
+    void Server::stop() noexcept
+    {
+        for (auto& reactor : m_reactors)
+        {
+            const uint64_t one = 1;
+            if (reactor->wake >= 0 && write(reactor->wake, &one, sizeof(one)) < 0) {}
+        }
+        for (auto& reactor : m_reactors)
+        {
+            if (reactor->thread.joinable()) reactor->thread.join();
+            for (auto& entry : reactor->connections) ::close(entry.first->fd);
+            reactor->connections.clear();
+            if (reactor->wake >= 0) ::close(reactor->wake);
+            if (reactor->epoll >= 0) ::close(reactor->epoll);
+        }
+        m_reactors.clear();
+        m_connections.store(0, std::memory_order_relaxed);
+        if (m_listener >= 0)
+        {
+            ::close(m_listener);
+            unlink(m_path.c_str());
+            m_listener = -1;
+        }
+    }
+
+
+    void Server::run(Reactor& reactor) noexcept
+    {
+        epoll_event events[max_events];
+        for (;;)
+        {
+            const int n = epoll_wait(reactor.epoll, events, max_events, -1);
+            if (n < 0 && errno != EINTR) return;
+            for (int i = 0; i < n; ++i)
+            {
+                void* p = events[i].data.ptr;
+                if (p == &reactor.wake) return;
+                if (!p)
+                {
+                    accept(reactor);
+                    continue;
+                }
+                Connection& connection = *static_cast<Connection*>(p);
+                if (!serve(reactor, connection)) close(reactor, connection);
+            }
+        }
+    }
+
+
+    // Take every pending connection. Failures drop the connection; the
+    // client sees it closed.
+
+    void Server::accept(Reactor& reactor) noexcept
+    {
+        for (;;)
+        {
+            const int fd = accept4(m_listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;             // None left, or out of descriptors until one closes
+            try
+            {
+                std::unique_ptr<Connection> owned(new Connection);
+                Connection* connection = owned.get();
+                connection->fd = fd;
+                reactor.connections.emplace(connection, std::move(owned));
+                epoll_event event = {};
+                event.events = connection->interest;
+                event.data.ptr = connection;
+                if (epoll_ctl(reactor.epoll, EPOLL_CTL_ADD, fd, &event) < 0)
+                {
+                    reactor.connections.erase(connection);
+                    ::close(fd);
+                    continue;
+                }
+                m_connections.fetch_add(1, std::memory_order_relaxed);
+            }
+            catch (...)
+            {
+                ::close(fd);
+            }
+        }
+    }
+
+
+    // Read what has arrived, run the whole requests, and send the responses.
+    // Returns false if the connection should be closed.
+
+    bool Server::serve(Reactor& reactor, Connection& c) noexcept
+    {
+        try
+        {
+            // Read until the socket is empty or a frame's worth is buffered
+            // beyond what can be run now
+            while (c.out.size() - c.sent < m_max_unsent && c.used < max_frame + read_size)
+            {
+                if (c.in.size() < c.used + read_size) c.in.resize(c.used + read_size);
+                const ssize_t got = recv(c.fd, c.in.data() + c.used, read_size, 0);
+                if (got == 0) return false;
+                if (got < 0)
+                {
+                    if (errno == EINTR) continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                    return false;
+                }
+                c.used += (size_t)got;
+                if ((size_t)got < read_size) break;
+            }
+
+            for (;;)
+            {
+                // Run requests while their responses fit
+                size_t offset = 0;
+                while (c.out.size() - c.sent < m_max_unsent)
+                {
+                    const size_t size = frame_size(c.in.data() + offset, c.used - offset);
+                    if (size == 0) break;
+                    if (size < 8 || size > max_frame) return false;
+                    if (size > c.used - offset) break;
+                    Request request;
+                    if (decode(c.in.data() + offset, size, request))
+                    {
+                        encode(execute(request), c.out);
+                    }
+                    else
+                    {
+                        Response response;
+                        response.tag = request.tag;
+                        response.status = bad_request;
+                        encode(response, c.out);
+                    }
+                    offset += size;
+                }
+                if (offset)
+                {
+                    std::memmove(c.in.data(), c.in.data() + offset, c.used - offset);
+                    c.used -= offset;
+                }
+
+                while (c.sent < c.out.size())
+                {
+                    const ssize_t put = send(c.fd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL);
+                    if (put < 0)
+                    {
+                        if (errno == EINTR) continue;
+                        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                        return false;
+                    }
+                    c.sent += (size_t)put;
+                }
+                if (c.sent == c.out.size())
+                {
+                    c.out.clear();
+                    c.sent = 0;
+                }
+
+                // Responses drained while whole requests wait: run them too,
+                // even if none ran this time, as nothing may wake us for them
+                const size_t next = frame_size(c.in.data(), c.used);
+                if (c.out.empty() && next && next <= c.used) continue;
+                break;
+            }
+
+            // Read only while responses can be queued; write only while some wait
+            const uint32_t interest = (c.out.size() - c.sent < m_max_unsent ? (uint32_t)EPOLLIN : 0) | (c.out.empty() ? 0 : (uint32_t)EPOLLOUT);
+            if (interest != c.interest)
+            {
+                epoll_event event = {};
+                event.events = interest;
+                event.data.ptr = &c;
+                if (epoll_ctl(reactor.epoll, EPOLL_CTL_MOD, c.fd, &event) < 0) return false;
+                c.interest = interest;
+            }
+            return true;
+        }
+        catch (...)
+        {
+            return false;                   // Out of memory for the buffers
+        }
+    }
+
+
+    void Server::close(Reactor& reactor, Connection& connection) noexcept
+    {
+        ::close(connection.fd);             // Also removes it from the epoll set
+        reactor.connections.erase(&connection);
+        m_connections.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+
+    static void get(const Arrakeener& obj, Property property, Response& response)
+    {
+        response.payload = Payload::text;
+        switch (property)
+        {
+        case Property::first_name: response.text = obj.first_name(); break;
+        case Property::last_name: response.text = obj.last_name(); break;
+        case Property::affiliation: response.text = obj.affiliation(); break;
+        case Property::occupation: response.text = obj.occupation(); break;
+        case Property::energy: response.payload = Payload::integer; response.value = obj.energy(); break;
+        case Property::solaris: response.payload = Payload::integer; response.value = obj.solaris(); break;
+        default: response.payload = Payload::integer; response.value = obj.spice(); break;
+        }
+    }
+
+
+    static void get(const Snapshot& snapshot, size_t i, Property property, Response& response)
+    {
+        response.payload = Payload::text;
+        switch (property)
+        {
+        case Property::first_name: response.text = snapshot.names(i).first_name; break;
+        case Property::last_name: response.text = snapshot.names(i).last_name; break;
+        case Property::affiliation: response.text = snapshot.names(i).affiliation; break;
+        case Property::occupation: response.text = snapshot.names(i).occupation; break;
+        default:
+            response.payload = Payload::integer;
+            const Ledger ledger = snapshot.ledger(i);
+            response.value = property == Property::energy ? ledger.energy : property == Property::solaris ? ledger.solaris : ledger.spice;
+            break;
+        }
+    }
+
+
+    static void put(Arrakeener& obj, Property property, const std::wstring& value)
+    {
+        switch (property)
+        {
+        case Property::first_name: obj.set_first_name(value.c_str()); break;
+        case Property::last_name: obj.set_last_name(value.c_str()); break;
+        case Property::affiliation: obj.set_affiliation(value.c_str()); break;
+        default: obj.set_occupation(value.c_str()); break;
+        }
+    }
+
+
+    // A span for each method, named as in protocol.h
+    static const char* const span_names[] =
+    {
+        "create", "release", "get", "put", "eat", "sell", "mine", "clone", "stats", "trace"
+    };
+
+
+    // Starting discards what was traced before; stopping returns it, cut
+    // to what fits in a response of UTF-16 text
+    static void set_tracing(const Request& request, Response& response)
+    {
+        if (request.on)
+        {
+            trace::flush();
+            trace::enable(true);
+            return;
+        }
+        trace::enable(false);
+        const std::string text = trace::flush(max_response / 2 - 64);
+        response.payload = Payload::text;
+        response.text.assign(text.begin(), text.end());
+    }
+
+
+    Response Server::execute(const Request& request) noexcept
+    {
+        static_assert(sizeof(span_names) / sizeof(span_names[0]) == (size_t)Method::trace + 1, "A span name for each method");
+        trace::Span span("server", span_names[(int)request.method]);
+        Response response;
+        response.tag = request.tag;
+        try
+        {
+            if (request.method == Method::create)
+            {
+                auto obj = std::make_shared<Arrakeener>();
+                if (m_observer) obj->observe(m_observer);
+                response.payload = Payload::integer;
+                response.value = (int64_t)insert(std::move(obj));
+                return response;
+            }
+            if (request.method == Method::release)
+            {
+                if (!release(request.handle)) response.status = no_object;
+                return response;
+            }
+            if (request.method == Method::stats)
+            {
+                const auto collected = stats::collect();
+                const std::string text = request.format == Format::prometheus ? stats::prometheus(collected) : stats::summary(collected);
+                response.payload = Payload::text;
+                response.text.assign(text.begin(), text.end());
+                return response;
+            }
+            if (request.method == Method::trace)
+            {
+                set_tracing(request, response);
+                return response;
+            }
+
+            // Reads of saved objects come from the snapshot; anything else
+            // creates them
+            std::shared_ptr<Arrakeener> obj;
+            if (request.method == Method::get)
+            {
+                bool answered = false;
+                obj = find(request, response, answered);
+                if (answered) return response;
+            }
+            else
+            {
+                obj = materialize(request.handle);
+            }
+            if (!obj)
+            {
+                response.status = no_object;
+                return response;
+            }
+            switch (request.method)
+            {
+            case Method::get:
+                get(*obj, request.property, response);
+                break;
+            case Method::put:
+                put(*obj, request.property, request.text);
+                break;
+            case Method::eat:
+                response.status = (uint8_t)obj->eat_spice(request.arg, response.value);
+                response.payload = Payload::integer;
+                break;
+            case Method::sell:
+                response.status = (uint8_t)obj->sell_spice(request.arg, response.value);
+                response.payload = Payload::integer;
+                break;
+            case Method::mine:
+                response.status = (uint8_t)obj->mine_spice(request.arg, response.value);
+                response.payload = Payload::integer;
+                break;
+            case Method::clone:
+                response.value = (int64_t)insert(std::make_shared<Arrakeener>(*obj));
+                response.payload = Payload::integer;
+                break;
+            default:
+                response.status = bad_request;
+                break;
+            }
+        }
+        catch (...)
+        {
+            response = Response();
+            response.tag = request.tag;
+            response.status = server_error;
+        }
+        return response;
+    }
+
+
+    // Whether handle is a saved object, taken or not
+    bool Server::saved(uint64_t handle) const noexcept
+    {
+        return m_snapshot && handle >= 1 && handle <= m_snapshot->size();
+    }
+
+
+    // The object a get is for, or null. A saved object still read from the
+    // snapshot is read under the shard's lock, which materialize() holds to
+    // create it, so no write can slip in between; answered tells.
+
+    std::shared_ptr<Arrakeener> Server::find(const Request& request, Response& response, bool& answered) const
+    {
+        const uint64_t handle = request.handle;
+        Shard& shard = m_shards[handle % shard_count];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.objects.find(handle);
+        if (it != shard.objects.end()) return it->second;
+        if (saved(handle) && !m_taken[handle - 1])
+        {
+            get(*m_snapshot, handle - 1, request.property, response);
+            answered = true;
+        }
+        return nullptr;
+    }
+
+
+    // An object in the table, creating a saved object there on first use
+
+    std::shared_ptr<Arrakeener> Server::materialize(uint64_t handle)
+    {
+        Shard& shard = m_shards[handle % shard_count];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.objects.find(handle);
+        if (it != shard.objects.end()) return it->second;
+        if (!saved(handle) || m_taken[handle - 1]) return nullptr;
+
+        std::shared_ptr<Arrakeener> obj = m_snapshot->create(handle - 1);
+        if (m_observer) obj->observe(m_observer);
+        shard.objects.emplace(handle, obj);
+        m_taken[handle - 1] = 1;
+        m_saved.fetch_sub(1, std::memory_order_relaxed);
+        return obj;
+    }
+
+
+    uint64_t Server::insert(std::shared_ptr<Arrakeener> obj)
+    {
+        const uint64_t handle = m_next_handle.fetch_add(1, std::memory_order_relaxed);
+        Shard& shard = m_shards[handle % shard_count];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.objects.emplace(handle, std::move(obj));
+        return handle;
+    }
+
+
+    // The object is destroyed outside the lock, by whichever request
+    // lets go of it last
+
+    bool Server::release(uint64_t handle)
+    {
+        std::shared_ptr<Arrakeener> obj;
+        Shard& shard = m_shards[handle % shard_count];
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.objects.find(handle);
+            if (it == shard.objects.end())
+            {
+                if (!saved(handle) || m_taken[handle - 1]) return false;
+                m_taken[handle - 1] = 1;
+                m_saved.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+            obj = std::move(it->second);
+            shard.objects.erase(it);
+        }
+        return true;
+    }
+
+
+    size_t Server::objects() const noexcept
+    {
+        size_t n = m_saved.load(std::memory_order_relaxed);
+        for (Shard& shard : m_shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            n += shard.objects.size();
+        }
+        return n;
+    }
+
+
+    // Each object is saved as it is when reached; saved objects not yet
+    // taken are read from the snapshot, without creating them
+
+    void Server::save(const std::string& path) const
+    {
+        std::vector<std::pair<uint64_t, std::shared_ptr<Arrakeener>>> live;
+        const uint64_t count = m_snapshot ? m_snapshot->size() : 0;
+        for (size_t s = 0; s < shard_count; ++s)
+        {
+            Shard& shard = m_shards[s];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (const auto& entry : shard.objects) live.emplace_back(entry.first, entry.second);
+            for (uint64_t handle = s ? s : shard_count; handle <= count; handle += shard_count)
+            {
+                if (!m_taken[handle - 1]) live.emplace_back(handle, nullptr);
+            }
+        }
+        std::sort(live.begin(), live.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        Snapshot::write(path, live.size(), [&](size_t i)
+        {
+            return live[i].second ? live[i].second->current_state() : m_snapshot->state(live[i].first - 1);
+        });
+    }
+}
@@ -0,0 +1,111 @@
+// server.h: Arrakeeners served over a Unix domain socket
+#pragma once
+
+#include "core.h"
+#include "protocol.h"
+#include "snapshot.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace arrakis
+{
+    // Serves Arrakeeners to local clients, the counterpart of the COM server
+    // for Linux (see protocol.h for the wire format).
+    //
+    // Each reactor thread waits on its own epoll set. All of them watch the
+    // listening socket, and the one woken takes the new connection for good,
+    // so a connection is only ever touched by one thread. A reactor reads
+    // whatever has arrived, runs every whole request in it, and writes the
+    // responses together; a connection stops being read while its unsent
+    // responses exceed a limit, so a client that never reads cannot exhaust
+    // memory.
+    //
+    // Objects live in a table sharded by handle and are shared with the
+    // requests using them, so a release by one connection cannot destroy an
+    // object another is in the middle of changing. Objects are reported to
+    // the observer, if any, from creation; it must outlive the server.
+    //
+    // A server may start from a snapshot (see snapshot.h). Its objects take
+    // handles 1 to n in the order saved, and are read from the mapped file
+    // until first changed or cloned; only then is each created in the
+    // table, and reported to the observer. Starting costs the same for any
+    // population. Objects restored from elsewhere, such as a journal, take
+    // the handles after.
+
+    class Server
+    {
+        struct Connection;
+        struct Reactor;
+
+        struct alignas(64) Shard
+        {
+            std::mutex mutex;
+            std::unordered_map<uint64_t, std::shared_ptr<Arrakeener>> objects;
+        };
+
+        static const unsigned shard_count = 64;
+
+        const std::string m_path;
+        Observer* const m_observer;
+        const size_t m_max_unsent;
+        std::unique_ptr<Snapshot> m_snapshot;
+        std::unique_ptr<uint8_t[]> m_taken; // Per saved object, set once created or released; under its shard's mutex
+        std::atomic<size_t> m_saved;        // Saved objects not yet taken
+        int m_listener;
+        std::vector<std::unique_ptr<Reactor>> m_reactors;
+        mutable Shard m_shards[shard_count];
+        std::atomic<uint64_t> m_next_handle;
+        std::atomic<size_t> m_connections;
+
+        void run(Reactor& reactor) noexcept;
+        void accept(Reactor& reactor) noexcept;
+        bool serve(Reactor& reactor, Connection& connection) noexcept;
+        void close(Reactor& reactor, Connection& connection) noexcept;
+
+        protocol::Response execute(const protocol::Request& request) noexcept;
+        std::shared_ptr<Arrakeener> find(const protocol::Request& request, protocol::Response& response, bool& answered) const;
+        std::shared_ptr<Arrakeener> materialize(uint64_t handle);
+        uint64_t insert(std::shared_ptr<Arrakeener> obj);
+        bool release(uint64_t handle);
+        bool saved(uint64_t handle) const noexcept;
+
+    public:
+        struct Options
+        {
+            unsigned reactors = 1;          // 0 for one per core
+            Observer* observer = nullptr;
+            size_t max_unsent = 1024 * 1024;    // Unsent response bytes beyond which a connection is not read
+            std::string snapshot;           // Snapshot to serve, if not empty
+            std::vector<std::shared_ptr<Arrakeener>> objects;   // To serve as well, already observed
+        };
+
+        // Listen on path, replacing any socket left there; throws
+        // std::system_error, or std::runtime_error for a bad snapshot
+        Server(const std::string& path, const Options& options);
+        Server(const std::string& path, unsigned reactors = 1, Observer* observer = nullptr);
+        ~Server();                          // Stops, and destroys every object
+        Server(const Server&) = delete;
+        Server& operator=(const Server&) = delete;
+
+        const std::string& path() const noexcept { return m_path; }
+
+        // Stop serving and close every connection; the objects remain until
+        // destruction, so they can still be saved
+        void stop() noexcept;
+
+        size_t objects() const noexcept;  // Including saved objects not yet created
+
+        // Save every object to a snapshot at path, handles renumbered from 1
+        // in order; throws as Snapshot::write. The file may be the one
+        // being served.
+        void save(const std::string& path) const;
+        size_t connections() const noexcept { return m_connections.load(std::memory_order_relaxed); }
+    };
+}